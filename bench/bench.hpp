@@ -0,0 +1,44 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+
+namespace bench {
+
+// Runs `body` `repeats` times and returns the fastest run in nanoseconds.
+template <typename F> double measure_ns(int repeats, F&& body) {
+    double best = std::numeric_limits<double>::max();
+    for (int i = 0; i < repeats; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        body();
+        const auto end = std::chrono::steady_clock::now();
+        best = std::min(
+            best,
+            std::chrono::duration<double, std::nano>(end - start).count());
+    }
+    return best;
+}
+
+// Keeps the optimizer from discarding a computed value.
+template <typename T> void do_not_optimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const T* sink;
+    sink = &value;
+#endif
+}
+
+inline void report(const char* name, double ns, double items) {
+    std::printf("%-36s %10.2f ns/op %12.2f Mop/s\n",
+                name,
+                ns / items,
+                items / ns * 1e3);
+}
+
+} // namespace bench
+
+#endif
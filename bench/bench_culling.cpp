@@ -0,0 +1,94 @@
+#include "bench.hpp"
+#include "culling.hpp"
+#include "mathlib.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+int main() {
+    constexpr size_t count = 1024 * 1024 + 5;
+    constexpr int repeats = 20;
+
+    // Objects scattered around the camera, so roughly a tenth of them end up
+    // inside the 60 degree frustum.
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> size(0.1f, 2.0f);
+    std::vector<math::aabb> boxes(count);
+    std::vector<math::sphere> spheres(count);
+    culling::aabb_soa box_set;
+    box_set.resize(count);
+    culling::sphere_soa sphere_set;
+    sphere_set.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        const math::vec3 center(position(rng), position(rng), position(rng));
+        const math::vec3 extent(size(rng), size(rng), size(rng));
+        boxes[i] = math::aabb{center - extent, center + extent};
+        spheres[i] = {center, size(rng)};
+        box_set.set(i, boxes[i]);
+        sphere_set.set(i, spheres[i]);
+    }
+
+    auto proj = math::perspesctive(math::radians(60.0f), 1.5f, 0.1f, 150.0f);
+    proj[1][1] *= -1;
+    const auto view = math::look_at(math::vec3(0.0f, 0.0f, 0.0f),
+                                    math::vec3(1.0f, 0.5f, 0.2f),
+                                    math::vec3(0.0f, 0.0f, 1.0f));
+    const auto frustum = culling::extract_frustum(proj * view);
+
+    std::vector<uint32_t> visible(count);
+    std::vector<uint32_t> reference;
+    reference.reserve(count);
+    size_t visible_count = 0;
+
+    auto ns = bench::measure_ns(repeats, [&] {
+        reference.clear();
+        for (size_t i = 0; i < count; ++i) {
+            if (culling::is_visible(frustum, boxes[i])) {
+                reference.push_back(static_cast<uint32_t>(i));
+            }
+        }
+        bench::do_not_optimize(reference);
+    });
+    bench::report("aabb (per box)", ns, count);
+
+    ns = bench::measure_ns(repeats, [&] {
+        visible_count = culling::cull(frustum, box_set, visible.data());
+        bench::do_not_optimize(visible);
+    });
+    bench::report("cull aabb_soa", ns, count);
+
+    if (visible_count != reference.size() ||
+        !std::equal(reference.begin(), reference.end(), visible.begin())) {
+        std::printf("cull aabb_soa differs from is_visible\n");
+        return 1;
+    }
+    std::printf("%zu of %zu boxes visible\n", visible_count, count);
+
+    ns = bench::measure_ns(repeats, [&] {
+        reference.clear();
+        for (size_t i = 0; i < count; ++i) {
+            if (culling::is_visible(frustum, spheres[i])) {
+                reference.push_back(static_cast<uint32_t>(i));
+            }
+        }
+        bench::do_not_optimize(reference);
+    });
+    bench::report("sphere (per sphere)", ns, count);
+
+    ns = bench::measure_ns(repeats, [&] {
+        visible_count = culling::cull(frustum, sphere_set, visible.data());
+        bench::do_not_optimize(visible);
+    });
+    bench::report("cull sphere_soa", ns, count);
+
+    if (visible_count != reference.size() ||
+        !std::equal(reference.begin(), reference.end(), visible.begin())) {
+        std::printf("cull sphere_soa differs from is_visible\n");
+        return 1;
+    }
+    std::printf("%zu of %zu spheres visible\n", visible_count, count);
+    return 0;
+}
@@ -0,0 +1,220 @@
+#include "bench.hpp"
+#include "gpu_allocator.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+// Device memory that only hands out handles, so the allocator runs without
+// a GPU. Tracks what is live to catch leaks and double frees.
+struct fake_device {
+    std::map<uint64_t, uint64_t> live;
+    uint64_t next = 1;
+    uint32_t allocation_count = 0;
+    bool double_free = false;
+
+    gpu_memory_device device() {
+        gpu_memory_device result;
+        result.allocate =
+            [this](uint32_t, uint64_t size, gpu_resource_kind, uint64_t) {
+                live[next] = size;
+                ++allocation_count;
+                return gpu_memory_block{next++, nullptr};
+            };
+        result.free = [this](const gpu_memory_block& block) {
+            double_free |= live.erase(block.memory) == 0;
+        };
+        return result;
+    }
+};
+
+struct resource {
+    gpu_memory_request request;
+    gpu_allocation allocation;
+};
+
+// Mixed buffers and images of one to a few hundred KB, like the uploads and
+// textures of a scene, in three memory types.
+gpu_memory_request random_request(uint32_t& seed) {
+    const auto next = [&] {
+        seed = seed * 1664525 + 1013904223;
+        return seed >> 8;
+    };
+    gpu_memory_request request;
+    const auto large = next() % 8 == 0;
+    request.size = 1 + next() % (large ? 300000 : 4000);
+    request.alignment = uint64_t{1} << (next() % 12);
+    request.memory_type = next() % 3;
+    request.kind = next() % 2 ? gpu_resource_kind::optimal
+                              : gpu_resource_kind::linear;
+    return request;
+}
+
+// Every allocation lies in its device memory, is aligned, and does not
+// overlap others or share a block with another memory type or kind.
+bool is_valid(const std::vector<resource>& resources, const fake_device& fake) {
+    std::map<uint64_t,
+             std::vector<std::tuple<uint64_t, uint64_t, const resource*>>>
+        ranges;
+    for (const auto& r : resources) {
+        const auto& a = r.allocation;
+        const auto memory = fake.live.find(a.memory);
+        if (memory == fake.live.end() || a.offset + a.size > memory->second ||
+            a.size < r.request.size || a.offset % r.request.alignment != 0) {
+            return false;
+        }
+        ranges[a.memory].emplace_back(a.offset, a.offset + a.size, &r);
+    }
+    for (auto& [memory, list] : ranges) {
+        std::sort(list.begin(), list.end());
+        for (size_t i = 1; i < list.size(); ++i) {
+            const auto* first = std::get<2>(list.front());
+            const auto* r = std::get<2>(list[i]);
+            if (std::get<0>(list[i]) < std::get<1>(list[i - 1]) ||
+                r->request.memory_type != first->request.memory_type ||
+                r->request.kind != first->request.kind) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main() {
+    constexpr int operations = 200000;
+    fake_device fake;
+    uint32_t resource_count = 0;
+    {
+        gpu_allocator allocator(fake.device(), 1 << 20);
+        std::vector<resource> resources;
+        uint32_t seed = 12345;
+        for (int i = 0; i < operations; ++i) {
+            if (resources.empty() || seed % 100 < 52) {
+                resource r{random_request(seed), {}};
+                r.allocation = allocator.allocate(r.request);
+                resources.push_back(r);
+                ++resource_count;
+            } else {
+                std::swap(resources[seed % resources.size()], resources.back());
+                allocator.free(resources.back().allocation);
+                resources.pop_back();
+                seed = seed * 1664525 + 1013904223;
+            }
+            if (i % 10000 == 0 && !is_valid(resources, fake)) {
+                std::printf("allocations overlap or are misplaced\n");
+                return 1;
+            }
+        }
+        auto stats = allocator.stats();
+        std::printf("%u resources in %u device allocations, %u live in %u "
+                    "blocks, %.1f%% of reserved memory used\n",
+                    resource_count,
+                    fake.allocation_count,
+                    stats.allocation_count,
+                    stats.block_count + stats.dedicated_count,
+                    100.0 * stats.used_bytes / stats.reserved_bytes);
+
+        // Compaction in passes of 1MB, with resources made and freed while
+        // the moves of a pass are in flight.
+        const auto before = stats;
+        gpu_defragment_stats total;
+        std::vector<resource> during;
+        for (int pass = 0;; ++pass) {
+            std::vector<gpu_allocation*> movable;
+            for (auto& r : resources) {
+                movable.push_back(&r.allocation);
+            }
+            auto moves = allocator.plan_defragmentation(movable, 1 << 20);
+            if (moves.empty()) {
+                break;
+            }
+            for (int i = 0; i < 16; ++i) {
+                resource r{random_request(seed), {}};
+                r.allocation = allocator.allocate(r.request);
+                during.push_back(r);
+            }
+            if (pass % 4 == 0) {
+                allocator.free(*moves.front().allocation);
+            }
+            auto checked = resources;
+            std::erase_if(checked,
+                          [](const resource& r) { return !r.allocation; });
+            checked.insert(checked.end(), during.begin(), during.end());
+            for (const auto& move : moves) {
+                const auto owner = std::find_if(
+                    resources.begin(), resources.end(), [&](const auto& r) {
+                        return &r.allocation == move.allocation;
+                    });
+                checked.push_back({owner->request, move.destination});
+            }
+            if (!is_valid(checked, fake)) {
+                std::printf("planned moves overlap or are misplaced\n");
+                return 1;
+            }
+            const auto pass_stats = allocator.commit_defragmentation(moves);
+            total.move_count += pass_stats.move_count;
+            total.bytes_moved += pass_stats.bytes_moved;
+            total.blocks_freed += pass_stats.blocks_freed;
+            total.bytes_freed += pass_stats.bytes_freed;
+            std::erase_if(resources,
+                          [](const resource& r) { return !r.allocation; });
+            checked = resources;
+            checked.insert(checked.end(), during.begin(), during.end());
+            if (!is_valid(checked, fake)) {
+                std::printf("moved allocations overlap or are misplaced\n");
+                return 1;
+            }
+        }
+        stats = allocator.stats();
+        std::printf("compaction moved %u allocations, %.1f MB, and freed %u "
+                    "blocks, %.1f MB: %u blocks %.1f%% used before, %u "
+                    "blocks %.1f%% used after\n",
+                    total.move_count,
+                    total.bytes_moved / 1e6,
+                    total.blocks_freed,
+                    total.bytes_freed / 1e6,
+                    before.block_count,
+                    100.0 * before.used_bytes / before.reserved_bytes,
+                    stats.block_count,
+                    100.0 * stats.used_bytes / stats.reserved_bytes);
+        for (auto& r : resources) {
+            allocator.free(r.allocation);
+        }
+        for (auto& r : during) {
+            allocator.free(r.allocation);
+        }
+    }
+    if (!fake.live.empty() || fake.double_free) {
+        std::printf("device memory leaked or freed twice\n");
+        return 1;
+    }
+
+    // Steady state churn: allocations and frees that find their blocks
+    // already there.
+    gpu_allocator allocator(fake.device(), 64 << 20);
+    std::vector<gpu_memory_request> requests;
+    uint32_t seed = 54321;
+    for (int i = 0; i < 4096; ++i) {
+        requests.push_back(random_request(seed));
+    }
+    std::vector<gpu_allocation> allocations(requests.size());
+    const auto ns = bench::measure_ns(20, [&] {
+        for (size_t i = 0; i < requests.size(); ++i) {
+            allocations[i] = allocator.allocate(requests[i]);
+        }
+        for (size_t i = 0; i < requests.size(); i += 2) {
+            allocator.free(allocations[i]);
+        }
+        for (size_t i = 1; i < requests.size(); i += 2) {
+            allocator.free(allocations[i]);
+        }
+    });
+    bench::report("allocate + free", ns, static_cast<double>(requests.size()));
+}
@@ -0,0 +1,161 @@
+#include "asset_loader.hpp"
+#include "bench.hpp"
+#include "flat_hash_map.hpp"
+#include "hash.hpp"
+#include "obj_generator.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <tiny_obj_loader.h>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// The hash load_model used before, per-float std::hash combined with shifts.
+struct legacy_vertex_hash {
+    static size_t h(float f) { return std::hash<float>()(f); }
+    static size_t h(const math::vec2& v) {
+        return (h(v.x) ^ (h(v.y) << 1)) >> 1;
+    }
+    static size_t h(const math::vec3& v) {
+        return ((h(v.x) ^ (h(v.y) << 1)) >> 1) ^ (h(v.z) << 1);
+    }
+    size_t operator()(const Vertex& vertex) const {
+        return ((h(vertex.pos) ^ (h(vertex.color) << 1)) >> 1) ^
+               (h(vertex.tex_coord) << 1);
+    }
+};
+
+Vertex make_vertex(const tinyobj::attrib_t& attrib,
+                   const tinyobj::index_t& index) {
+    Vertex vertex{};
+    vertex.pos = {attrib.vertices[3 * index.vertex_index + 0],
+                  attrib.vertices[3 * index.vertex_index + 1],
+                  attrib.vertices[3 * index.vertex_index + 2]};
+    vertex.tex_coord = {attrib.texcoords[2 * index.texcoord_index + 0],
+                        1.0f - attrib.texcoords[2 * index.texcoord_index + 1]};
+    vertex.color = {1.0f, 1.0f, 1.0f};
+    return vertex;
+}
+
+} // namespace
+
+// Usage: bench_load_obj [model.obj]. Without an argument a torus of 2 million
+// triangles is generated in the working directory and removed afterwards.
+int main(int argc, char** argv) {
+    constexpr int repeats = 3;
+
+    std::string path;
+    if (argc > 1) {
+        path = argv[1];
+    } else {
+        path = "bench_load_obj.obj";
+        bench::write_torus_obj(path, 1000);
+    }
+    const auto file_size = std::filesystem::file_size(path);
+
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    auto ns = bench::measure_ns(repeats, [&] {
+        std::vector<tinyobj::material_t> materials;
+        std::string err;
+        attrib = {};
+        shapes.clear();
+        if (!tinyobj::LoadObj(&attrib,
+                              &shapes,
+                              &materials,
+                              &err,
+                              path.c_str())) {
+            std::printf("failed to load %s: %s\n", path.c_str(), err.c_str());
+        }
+    });
+    size_t index_count = 0;
+    for (const auto& shape : shapes) {
+        index_count += shape.mesh.indices.size();
+    }
+    std::printf("%s: %.1f MB, %zu triangles\n",
+                path.c_str(),
+                file_size / 1e6,
+                index_count / 3);
+    std::printf("%-36s %10.2f ms\n", "tinyobj::LoadObj", ns / 1e6);
+
+    // Deduplication exactly as load_model did it, including the extra
+    // push_back of every vertex.
+    size_t legacy_vertex_count = 0;
+    ns = bench::measure_ns(repeats, [&] {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        std::unordered_map<Vertex, uint32_t, legacy_vertex_hash>
+            unique_vertices{};
+        for (const auto& shape : shapes) {
+            for (const auto& index : shape.mesh.indices) {
+                const auto vertex = make_vertex(attrib, index);
+                vertices.push_back(vertex);
+                if (unique_vertices.count(vertex) == 0) {
+                    unique_vertices[vertex] =
+                        static_cast<uint32_t>(vertices.size());
+                    vertices.push_back(vertex);
+                }
+                indices.push_back(unique_vertices[vertex]);
+            }
+        }
+        legacy_vertex_count = vertices.size();
+        bench::do_not_optimize(indices);
+    });
+    std::printf("%-36s %10.2f ms %10zu vertices\n",
+                "dedup (unordered_map, legacy hash)",
+                ns / 1e6,
+                legacy_vertex_count);
+
+    size_t vertex_count = 0;
+    ns = bench::measure_ns(repeats, [&] {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        vertices.reserve(index_count / 4);
+        indices.reserve(index_count);
+        flat_hash_map<Vertex,
+                      uint32_t,
+                      hash::byte_hash<Vertex>,
+                      hash::byte_equal<Vertex>>
+            unique_vertices;
+        unique_vertices.reserve(index_count / 4);
+        for (const auto& shape : shapes) {
+            for (const auto& index : shape.mesh.indices) {
+                const auto vertex = make_vertex(attrib, index);
+                const auto [slot, inserted] = unique_vertices.try_emplace(
+                    vertex,
+                    static_cast<uint32_t>(vertices.size()));
+                if (inserted) {
+                    vertices.push_back(vertex);
+                }
+                indices.push_back(*slot);
+            }
+        }
+        vertex_count = vertices.size();
+        bench::do_not_optimize(indices);
+    });
+    std::printf("%-36s %10.2f ms %10zu vertices\n",
+                "dedup (flat_hash_map)",
+                ns / 1e6,
+                vertex_count);
+
+    mesh_data mesh;
+    ns = bench::measure_ns(repeats, [&] { mesh = load_obj(path); });
+    std::printf("%-36s %10.2f ms %10zu vertices\n",
+                "load_obj",
+                ns / 1e6,
+                mesh.vertices.size());
+
+    if (argc <= 1) {
+        std::filesystem::remove(path);
+    }
+    if (mesh.vertices.size() != vertex_count ||
+        legacy_vertex_count != vertex_count + index_count) {
+        std::printf("vertex counts do not match\n");
+        return 1;
+    }
+    return 0;
+}
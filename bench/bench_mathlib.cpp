@@ -0,0 +1,267 @@
+#include "bench.hpp"
+#include "mathlib.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+// The column-by-column composition mathlib used before the mat4 kernels
+// existed, kept here as the scalar baseline.
+math::vec4 scalar_mul(const math::mat4& m, const math::vec4& v) {
+    return m[0] * v.x + m[1] * v.y + m[2] * v.z + m[3] * v.w;
+}
+
+math::mat4 scalar_mul(const math::mat4& a, const math::mat4& b) {
+    return math::mat4(scalar_mul(a, b[0]),
+                      scalar_mul(a, b[1]),
+                      scalar_mul(a, b[2]),
+                      scalar_mul(a, b[3]));
+}
+
+math::mat4 random_matrix(std::mt19937& rng) {
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    math::mat4 m;
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            m[i][j] = dist(rng);
+        }
+    }
+    // Diagonal dominance keeps every matrix comfortably invertible.
+    for (int i = 0; i < 4; ++i) {
+        m[i][i] += 4.0f;
+    }
+    return m;
+}
+
+// Hides a value from the optimizer so the call using it runs at runtime.
+template <typename T> T opaque(T value) {
+    volatile unsigned char bytes[sizeof(T)];
+    auto* raw = reinterpret_cast<unsigned char*>(&value);
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        bytes[i] = raw[i];
+    }
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        raw[i] = bytes[i];
+    }
+    return value;
+}
+
+template <typename T> bool same_bits(const T& a, const T& b) {
+    return std::memcmp(&a, &b, sizeof(T)) == 0;
+}
+
+// Results folded at compile time must match the runtime (SIMD) path exactly.
+bool check_constant_evaluation() {
+    constexpr math::vec3 eye(2.0f, 2.0f, 2.0f);
+    constexpr math::vec3 center(0.0f, 0.0f, 0.0f);
+    constexpr math::vec3 up(0.0f, 0.0f, 1.0f);
+    constexpr auto view = math::look_at(eye, center, up);
+    constexpr auto proj =
+        math::perspesctive(math::radians(45.0f), 16.0f / 9.0f, 0.1f, 10.0f);
+    constexpr auto model =
+        math::rotate(math::mat4::identity(), math::radians(33.0f), up);
+    constexpr auto mvp = proj * view * model;
+    constexpr auto inv = math::inverse(mvp);
+    constexpr auto inv_view = math::inverse_affine(view);
+    constexpr auto point = mvp * math::vec4(0.5f, -0.25f, 1.0f, 1.0f);
+
+    const auto rt_view = math::look_at(opaque(eye), opaque(center), up);
+    const auto rt_proj = math::perspesctive(opaque(math::radians(45.0f)),
+                                            16.0f / 9.0f,
+                                            0.1f,
+                                            10.0f);
+    const auto rt_model = math::rotate(math::mat4::identity(),
+                                       opaque(math::radians(33.0f)),
+                                       up);
+    const auto rt_mvp = opaque(rt_proj) * opaque(rt_view) * opaque(rt_model);
+
+    constexpr auto spin = math::angle_axis(math::radians(33.0f), up);
+    constexpr auto halfway =
+        math::slerp(math::quat::identity(), spin, 0.5f);
+    constexpr auto spin_matrix = math::to_mat4(spin);
+    const auto rt_spin = math::angle_axis(opaque(math::radians(33.0f)), up);
+
+    return same_bits(view, rt_view) && same_bits(proj, rt_proj) &&
+           same_bits(model, rt_model) && same_bits(mvp, rt_mvp) &&
+           same_bits(inv, math::inverse(rt_mvp)) &&
+           same_bits(inv_view, math::inverse_affine(rt_view)) &&
+           same_bits(point, rt_mvp * math::vec4(0.5f, -0.25f, 1.0f, 1.0f)) &&
+           same_bits(spin, rt_spin) &&
+           same_bits(halfway,
+                     math::slerp(math::quat::identity(), rt_spin, 0.5f)) &&
+           same_bits(spin_matrix, math::to_mat4(rt_spin));
+}
+
+float max_error(const math::mat4& a, const math::mat4& b) {
+    float error = 0.0f;
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            error = std::max(error, std::abs(a[i][j] - b[i][j]));
+        }
+    }
+    return error;
+}
+
+} // namespace
+
+int main() {
+    constexpr int count = 1 << 16;
+    constexpr int repeats = 20;
+
+    std::mt19937 rng(42);
+    std::vector<math::mat4> a(count);
+    std::vector<math::mat4> b(count);
+    std::vector<math::vec4> v(count);
+    std::vector<math::mat4> out(count);
+    std::vector<math::vec4> out_v(count);
+    for (int i = 0; i < count; ++i) {
+        a[i] = random_matrix(rng);
+        b[i] = random_matrix(rng);
+        v[i] = b[i][0];
+    }
+
+#if MATHLIB_AVX
+    std::printf("mathlib kernels: AVX\n");
+#elif MATHLIB_SSE
+    std::printf("mathlib kernels: SSE\n");
+#else
+    std::printf("mathlib kernels: scalar\n");
+#endif
+
+    // Sanity checks before timing anything.
+    if (!check_constant_evaluation()) {
+        std::printf("constant evaluation differs from runtime path\n");
+        return 1;
+    }
+    for (int i = 0; i < count; ++i) {
+        const auto simd = a[i] * b[i];
+        const auto scalar = scalar_mul(a[i], b[i]);
+        if (std::memcmp(&simd, &scalar, sizeof(math::mat4)) != 0) {
+            std::printf("mat4 * mat4 differs from scalar path at %d\n", i);
+            return 1;
+        }
+        const auto identity = a[i] * math::inverse(a[i]);
+        if (max_error(identity, math::mat4::identity()) > 1e-5f) {
+            std::printf("inverse error too large at %d\n", i);
+            return 1;
+        }
+    }
+
+    auto ns = bench::measure_ns(repeats, [&] {
+        for (int i = 0; i < count; ++i) {
+            out[i] = scalar_mul(a[i], b[i]);
+        }
+        bench::do_not_optimize(out);
+    });
+    bench::report("mat4 * mat4 (scalar baseline)", ns, count);
+
+    ns = bench::measure_ns(repeats, [&] {
+        for (int i = 0; i < count; ++i) {
+            out[i] = a[i] * b[i];
+        }
+        bench::do_not_optimize(out);
+    });
+    bench::report("mat4 * mat4", ns, count);
+
+    ns = bench::measure_ns(repeats, [&] {
+        for (int i = 0; i < count; ++i) {
+            out_v[i] = scalar_mul(a[i], v[i]);
+        }
+        bench::do_not_optimize(out_v);
+    });
+    bench::report("mat4 * vec4 (scalar baseline)", ns, count);
+
+    ns = bench::measure_ns(repeats, [&] {
+        for (int i = 0; i < count; ++i) {
+            out_v[i] = a[i] * v[i];
+        }
+        bench::do_not_optimize(out_v);
+    });
+    bench::report("mat4 * vec4", ns, count);
+
+    ns = bench::measure_ns(repeats, [&] {
+        for (int i = 0; i < count; ++i) {
+            out[i] = math::transpose(a[i]);
+        }
+        bench::do_not_optimize(out);
+    });
+    bench::report("transpose", ns, count);
+
+    ns = bench::measure_ns(repeats, [&] {
+        for (int i = 0; i < count; ++i) {
+            out[i] = math::inverse_affine(a[i]);
+        }
+        bench::do_not_optimize(out);
+    });
+    bench::report("inverse_affine", ns, count);
+
+    ns = bench::measure_ns(repeats, [&] {
+        for (int i = 0; i < count; ++i) {
+            out[i] = math::inverse(a[i]);
+        }
+        bench::do_not_optimize(out);
+    });
+    bench::report("inverse", ns, count);
+
+    ns = bench::measure_ns(repeats, [&] {
+        for (int i = 0; i < count; ++i) {
+            out[i] = math::rotate(a[i], v[i].x, math::vec3(0.0f, 0.0f, 1.0f));
+        }
+        bench::do_not_optimize(out);
+    });
+    bench::report("rotate", ns, count);
+
+    std::vector<math::transform> ta(count);
+    std::vector<math::transform> tb(count);
+    std::vector<math::transform> out_t(count);
+    for (int i = 0; i < count; ++i) {
+        ta[i].translation = {v[i].x, v[i].y, v[i].z};
+        ta[i].rotation = math::angle_axis(v[i].w, math::vec3(1.0f, 2.0f, 3.0f));
+        tb[i].rotation = math::angle_axis(v[i].x, math::vec3(0.0f, 0.0f, 1.0f));
+        const auto product = math::to_mat4(ta[i]) * math::to_mat4(tb[i]);
+        const auto error = max_error(math::to_mat4(ta[i] * tb[i]), product);
+        if (error > 1e-4f * (1.0f + std::abs(v[i].x) + std::abs(v[i].y) +
+                             std::abs(v[i].z))) {
+            std::printf("transform * transform differs from mat4 at %d\n", i);
+            return 1;
+        }
+    }
+
+    ns = bench::measure_ns(repeats, [&] {
+        for (int i = 0; i < count; ++i) {
+            out_t[i] = ta[i] * tb[i];
+        }
+        bench::do_not_optimize(out_t);
+    });
+    bench::report("transform * transform", ns, count);
+
+    ns = bench::measure_ns(repeats, [&] {
+        for (int i = 0; i < count; ++i) {
+            out_t[i] = math::inverse(ta[i]);
+        }
+        bench::do_not_optimize(out_t);
+    });
+    bench::report("inverse (transform)", ns, count);
+
+    ns = bench::measure_ns(repeats, [&] {
+        for (int i = 0; i < count; ++i) {
+            out_t[i] = math::interpolate(ta[i], tb[i], 0.25f);
+        }
+        bench::do_not_optimize(out_t);
+    });
+    bench::report("interpolate (transform)", ns, count);
+
+    ns = bench::measure_ns(repeats, [&] {
+        for (int i = 0; i < count; ++i) {
+            out[i] = math::to_mat4(ta[i]);
+        }
+        bench::do_not_optimize(out);
+    });
+    bench::report("to_mat4 (transform)", ns, count);
+
+    return 0;
+}
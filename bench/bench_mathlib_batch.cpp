@@ -0,0 +1,136 @@
+#include "bench.hpp"
+#include "mathlib.hpp"
+#include "mathlib_batch.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+struct aos_vertex {
+    math::vec3 pos;
+    math::vec3 color;
+    math::vec2 tex_coord;
+};
+
+} // namespace
+
+int main() {
+    constexpr size_t count = 4 * 1024 * 1024 + 3;
+    constexpr int repeats = 10;
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> dist(-100.0f, 100.0f);
+    std::vector<aos_vertex> vertices(count);
+    for (auto& vertex : vertices) {
+        vertex.pos = {dist(rng), dist(rng), dist(rng)};
+    }
+
+    math::vec3_soa positions;
+    positions.resize(count);
+    math::vec3_soa transformed;
+    transformed.resize(count);
+    std::vector<math::vec4> transformed_aos(count);
+
+    const auto matrix = math::perspesctive(math::radians(60.0f),
+                                           1.5f,
+                                           0.1f,
+                                           100.0f) *
+                        math::look_at(math::vec3(10.0f, 5.0f, 3.0f),
+                                      math::vec3(0.0f, 0.0f, 0.0f),
+                                      math::vec3(0.0f, 0.0f, 1.0f));
+
+    const double bytes_in = count * 3.0 * sizeof(float);
+    auto report_bandwidth = [](const char* name, double ns, double bytes) {
+        std::printf("%-36s %10.2f ms %10.2f GB/s\n",
+                    name,
+                    ns / 1e6,
+                    bytes / ns);
+    };
+
+    auto ns = bench::measure_ns(repeats, [&] {
+        math::deinterleave(reinterpret_cast<const std::byte*>(&vertices[0].pos),
+                           sizeof(aos_vertex),
+                           positions.span());
+    });
+    report_bandwidth("deinterleave", ns, count * sizeof(aos_vertex));
+
+    ns = bench::measure_ns(repeats, [&] {
+        for (size_t i = 0; i < count; ++i) {
+            const auto& p = vertices[i].pos;
+            transformed_aos[i] = matrix * math::vec4(p.x, p.y, p.z, 1.0f);
+        }
+        bench::do_not_optimize(transformed_aos);
+    });
+    report_bandwidth("transform (per vertex mat4 * vec4)", ns, bytes_in);
+
+    ns = bench::measure_ns(repeats, [&] {
+        math::transform_points(matrix, positions.span(), transformed.span());
+        bench::do_not_optimize(transformed);
+    });
+    report_bandwidth("transform_points", ns, bytes_in * 2);
+
+    for (size_t i = 0; i < count; ++i) {
+        if (std::memcmp(&transformed.x[i], &transformed_aos[i].x, 4) != 0 ||
+            std::memcmp(&transformed.z[i], &transformed_aos[i].z, 4) != 0) {
+            std::printf("transform_points differs from mat4 * vec4 at %zu\n",
+                        i);
+            return 1;
+        }
+    }
+
+    math::aabb bounds{};
+    ns = bench::measure_ns(repeats, [&] {
+        bounds = math::compute_aabb(positions.span());
+        bench::do_not_optimize(bounds);
+    });
+    report_bandwidth("compute_aabb", ns, bytes_in);
+
+    ns = bench::measure_ns(repeats, [&] {
+        math::aabb scalar_bounds{vertices[0].pos, vertices[0].pos};
+        for (const auto& vertex : vertices) {
+            for (int axis = 0; axis < 3; ++axis) {
+                scalar_bounds.min[axis] =
+                    std::min(scalar_bounds.min[axis], vertex.pos[axis]);
+                scalar_bounds.max[axis] =
+                    std::max(scalar_bounds.max[axis], vertex.pos[axis]);
+            }
+        }
+        bench::do_not_optimize(scalar_bounds);
+    });
+    report_bandwidth("aabb (per vertex AoS)", ns, bytes_in);
+
+    math::sphere sphere{};
+    ns = bench::measure_ns(repeats, [&] {
+        sphere = math::compute_bounding_sphere(positions.span());
+        bench::do_not_optimize(sphere);
+    });
+    report_bandwidth("compute_bounding_sphere", ns, bytes_in * 2);
+
+    ns = bench::measure_ns(repeats, [&] {
+        math::normalize(positions.span(), transformed.span());
+        bench::do_not_optimize(transformed);
+    });
+    report_bandwidth("normalize", ns, bytes_in * 2);
+
+    ns = bench::measure_ns(repeats, [&] {
+        for (size_t i = 0; i < count; ++i) {
+            const auto n = math::normalize(vertices[i].pos);
+            transformed_aos[i] = {n.x, n.y, n.z, 0.0f};
+        }
+        bench::do_not_optimize(transformed_aos);
+    });
+    report_bandwidth("normalize (per vertex)", ns, bytes_in * 2);
+
+    std::printf("bounds (%.2f %.2f %.2f) - (%.2f %.2f %.2f), radius %.2f\n",
+                bounds.min.x,
+                bounds.min.y,
+                bounds.min.z,
+                bounds.max.x,
+                bounds.max.y,
+                bounds.max.z,
+                sphere.radius);
+    return 0;
+}
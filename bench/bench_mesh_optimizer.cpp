@@ -0,0 +1,252 @@
+#include "bench.hpp"
+#include "mesh_optimizer.hpp"
+#include "obj_parser.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace {
+
+// A size x size grid wrapped around a torus, built in memory.
+mesh_data make_torus(int size) {
+    constexpr float two_pi = 6.2831853f;
+    mesh_data mesh;
+    for (int j = 0; j <= size; ++j) {
+        for (int i = 0; i <= size; ++i) {
+            const float u = two_pi * i / size;
+            const float v = two_pi * j / size;
+            const float r = 2.0f + std::cos(v);
+            Vertex vertex{};
+            vertex.pos = {r * std::cos(u), r * std::sin(u), std::sin(v)};
+            vertex.color = {1.0f, 1.0f, 1.0f};
+            vertex.tex_coord = {static_cast<float>(i) / size,
+                                static_cast<float>(j) / size};
+            mesh.vertices.push_back(vertex);
+        }
+    }
+    const auto row = static_cast<uint32_t>(size + 1);
+    for (uint32_t j = 0; j < static_cast<uint32_t>(size); ++j) {
+        for (uint32_t i = 0; i < static_cast<uint32_t>(size); ++i) {
+            const auto a = j * row + i;
+            const auto b = a + 1;
+            const auto c = a + row;
+            const auto d = c + 1;
+            mesh.indices.insert(mesh.indices.end(), {a, b, d, a, d, c});
+        }
+    }
+    return mesh;
+}
+
+// Random triangle order, the worst case for the cache.
+void shuffle_triangles(std::vector<uint32_t>& indices) {
+    std::vector<uint32_t> order(indices.size() / 3);
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = static_cast<uint32_t>(i);
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937(42));
+    const auto source = indices;
+    for (size_t i = 0; i < order.size(); ++i) {
+        std::copy_n(&source[3 * order[i]], 3, &indices[3 * i]);
+    }
+}
+
+// Fraction of vertex fetches that move backwards in memory or skip ahead.
+float fetch_jump_ratio(const std::vector<uint32_t>& indices) {
+    size_t jumps = 0;
+    uint32_t furthest = 0;
+    for (const auto index : indices) {
+        if (index > furthest + 1 || index + 64 < furthest) {
+            ++jumps;
+        }
+        furthest = std::max(furthest, index);
+    }
+    return static_cast<float>(jumps) / indices.size();
+}
+
+// Depth complexity the triangle order leads to: pixels that pass the depth
+// test, over pixels covered, averaged over orthographic views from the axes
+// and the corners of the bounding cube. Back faces are culled, counter
+// clockwise triangles facing the view like the renderer's.
+float overdraw_ratio(const mesh_data& mesh) {
+    constexpr int resolution = 256;
+    const math::vec3 directions[] = {
+        {1, 0, 0},   {-1, 0, 0},  {0, 1, 0},    {0, -1, 0},  {0, 0, 1},
+        {0, 0, -1},  {1, 1, 1},   {1, 1, -1},   {1, -1, 1},  {1, -1, -1},
+        {-1, 1, 1},  {-1, 1, -1}, {-1, -1, 1},  {-1, -1, -1}};
+    size_t shaded = 0;
+    size_t covered = 0;
+    std::vector<float> depth(resolution * resolution);
+    std::vector<math::vec3> projected(mesh.vertices.size());
+    for (const auto& direction : directions) {
+        // The view looks along `forward`, `right` and `up` span the image.
+        const auto forward = math::normalize(direction);
+        const auto helper = std::abs(forward.z) < 0.9f
+                                ? math::vec3(0.0f, 0.0f, 1.0f)
+                                : math::vec3(1.0f, 0.0f, 0.0f);
+        const auto right = math::normalize(math::cross(helper, forward));
+        const auto up = math::cross(forward, right);
+        auto min_x = std::numeric_limits<float>::max();
+        auto min_y = min_x;
+        auto max_x = std::numeric_limits<float>::lowest();
+        auto max_y = max_x;
+        for (size_t v = 0; v < mesh.vertices.size(); ++v) {
+            const auto& pos = mesh.vertices[v].pos;
+            projected[v] = {math::dot(pos, right),
+                            math::dot(pos, up),
+                            math::dot(pos, forward)};
+            min_x = std::min(min_x, projected[v].x);
+            min_y = std::min(min_y, projected[v].y);
+            max_x = std::max(max_x, projected[v].x);
+            max_y = std::max(max_y, projected[v].y);
+        }
+        const auto scale =
+            (resolution - 1) / std::max(max_x - min_x, max_y - min_y);
+        for (auto& point : projected) {
+            point.x = (point.x - min_x) * scale;
+            point.y = (point.y - min_y) * scale;
+        }
+
+        std::fill(depth.begin(), depth.end(),
+                  std::numeric_limits<float>::max());
+        for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+            const auto& a = projected[mesh.indices[i + 0]];
+            const auto& b = projected[mesh.indices[i + 1]];
+            const auto& c = projected[mesh.indices[i + 2]];
+            // Front faces have a negative area in this image basis.
+            const auto area =
+                (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+            if (area >= 0) {
+                continue;
+            }
+            const auto x0 = std::max(0, static_cast<int>(
+                                            std::min({a.x, b.x, c.x})));
+            const auto x1 = std::min(resolution - 1,
+                                     static_cast<int>(
+                                         std::max({a.x, b.x, c.x})) +
+                                         1);
+            const auto y0 = std::max(0, static_cast<int>(
+                                            std::min({a.y, b.y, c.y})));
+            const auto y1 = std::min(resolution - 1,
+                                     static_cast<int>(
+                                         std::max({a.y, b.y, c.y})) +
+                                         1);
+            for (int y = y0; y <= y1; ++y) {
+                for (int x = x0; x <= x1; ++x) {
+                    const auto px = x + 0.5f;
+                    const auto py = y + 0.5f;
+                    const auto wa =
+                        (c.x - b.x) * (py - b.y) - (c.y - b.y) * (px - b.x);
+                    const auto wb =
+                        (a.x - c.x) * (py - c.y) - (a.y - c.y) * (px - c.x);
+                    const auto wc =
+                        (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+                    if (wa > 0 || wb > 0 || wc > 0) {
+                        continue;
+                    }
+                    const auto z = (wa * a.z + wb * b.z + wc * c.z) / area;
+                    auto& stored = depth[y * resolution + x];
+                    if (z < stored) {
+                        shaded += 1;
+                        stored = z;
+                    }
+                }
+            }
+        }
+        for (const auto stored : depth) {
+            covered += stored != std::numeric_limits<float>::max();
+        }
+    }
+    return covered > 0 ? static_cast<float>(shaded) / covered : 0.0f;
+}
+
+void print_stats(const char* name, const mesh_data& mesh) {
+    const auto stats = analyze_vertex_cache(mesh.indices, mesh.vertices.size());
+    std::printf("%-24s ACMR %5.3f  ATVR %5.3f  fetch jumps %5.1f%%  "
+                "overdraw %5.3f\n",
+                name,
+                stats.acmr,
+                stats.atvr,
+                100 * fetch_jump_ratio(mesh.indices),
+                overdraw_ratio(mesh));
+}
+
+} // namespace
+
+// Usage: bench_mesh_optimizer [model.obj]. Without an argument a torus of
+// 500000 triangles is used. The triangles are shuffled before optimizing, so
+// the result does not depend on the order the source happened to have.
+int main(int argc, char** argv) {
+    constexpr int repeats = 3;
+
+    const auto source = argc > 1 ? parse_obj(argv[1]) : make_torus(500);
+    if (source.indices.empty()) {
+        return 1;
+    }
+    std::printf("%zu vertices, %zu triangles, FIFO cache of %u\n",
+                source.vertices.size(),
+                source.indices.size() / 3,
+                vertex_cache_size);
+    print_stats("source order", source);
+
+    auto shuffled = source;
+    shuffle_triangles(shuffled.indices);
+    print_stats("shuffled", shuffled);
+
+    auto mesh = shuffled;
+    std::vector<uint32_t> clusters;
+    auto ns = bench::measure_ns(repeats, [&] {
+        mesh.indices = shuffled.indices;
+        clusters = optimize_vertex_cache(mesh.indices, mesh.vertices.size());
+    });
+    print_stats("optimize_vertex_cache", mesh);
+    const auto triangle_count = static_cast<double>(mesh.indices.size() / 3);
+    bench::report("optimize_vertex_cache / triangle", ns, triangle_count);
+
+    const auto cache_optimized = mesh.indices;
+    ns = bench::measure_ns(repeats, [&] {
+        mesh.indices = cache_optimized;
+        optimize_overdraw(mesh.indices, mesh.vertices, clusters);
+    });
+    print_stats("optimize_overdraw", mesh);
+    bench::report("optimize_overdraw / triangle", ns, triangle_count);
+    std::printf("%zu clusters\n", clusters.size());
+
+    const auto overdraw_optimized = mesh.indices;
+    ns = bench::measure_ns(repeats, [&] {
+        mesh.indices = overdraw_optimized;
+        mesh.vertices = optimize_vertex_fetch(shuffled.vertices, mesh.indices);
+    });
+    print_stats("optimize_vertex_fetch", mesh);
+    bench::report("optimize_vertex_fetch / triangle", ns, triangle_count);
+
+    auto split = mesh;
+    std::vector<mesh_range> ranges;
+    ns = bench::measure_ns(repeats, [&] {
+        split = mesh;
+        ranges = split_mesh(split);
+    });
+    bench::report("split_mesh / triangle", ns, triangle_count);
+    for (const auto& range : ranges) {
+        const auto end = range.first_index + range.index_count;
+        for (auto i = range.first_index; i < end; ++i) {
+            const auto index = split.indices[i];
+            if (index >= range.vertex_count ||
+                !(split.vertices[range.vertex_offset + index] ==
+                  mesh.vertices[mesh.indices[i]])) {
+                std::printf("split_mesh changed triangle %u\n", i / 3);
+                return 1;
+            }
+        }
+    }
+    std::printf("%zu ranges, %zu duplicated vertices, indices %zu KB -> "
+                "%zu KB\n",
+                ranges.size(),
+                split.vertices.size() - mesh.vertices.size(),
+                mesh.indices.size() * sizeof(uint32_t) / 1024,
+                split.indices.size() * sizeof(uint16_t) / 1024);
+    return 0;
+}
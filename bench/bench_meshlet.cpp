@@ -0,0 +1,169 @@
+#include "bench.hpp"
+#include "culling.hpp"
+#include "mesh_optimizer.hpp"
+#include "meshlet.hpp"
+#include "obj_generator.hpp"
+#include "obj_parser.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace {
+
+bool all_backfacing(const mesh_data& mesh,
+                    const mesh_range& range,
+                    const meshlet& m,
+                    const math::vec3& camera) {
+    for (auto i = m.first_index; i < m.first_index + m.index_count; i += 3) {
+        const auto* v = &mesh.vertices[range.vertex_offset];
+        const auto& a = v[mesh.indices[i]].pos;
+        const auto& b = v[mesh.indices[i + 1]].pos;
+        const auto& c = v[mesh.indices[i + 2]].pos;
+        const auto normal = math::cross(b - a, c - a);
+        if (math::dot(a - camera, normal) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+// Usage: bench_meshlet [model.obj]. Without an argument a torus of 2 million
+// triangles is generated in the working directory and removed afterwards.
+// Meshlets are built in the order the mesh cooker leaves the triangles, then
+// cone culled from cameras on a ring around the mesh.
+int main(int argc, char** argv) {
+    constexpr int repeats = 3;
+
+    std::string path;
+    if (argc > 1) {
+        path = argv[1];
+    } else {
+        path = "bench_meshlet.obj";
+        bench::write_torus_obj(path, 1000);
+    }
+    auto mesh = parse_obj(path);
+    if (argc <= 1) {
+        std::filesystem::remove(path);
+    }
+    if (mesh.indices.empty()) {
+        return 1;
+    }
+    const auto clusters =
+        optimize_vertex_cache(mesh.indices, mesh.vertices.size());
+    optimize_overdraw(mesh.indices, mesh.vertices, clusters);
+    mesh.vertices = optimize_vertex_fetch(mesh.vertices, mesh.indices);
+    const auto ranges = split_mesh(mesh);
+
+    const auto cooked = mesh;
+    std::vector<meshlet> meshlets;
+    const auto ns = bench::measure_ns(repeats, [&] {
+        mesh = cooked;
+        meshlets = build_meshlets(mesh, ranges);
+    });
+    const auto triangle_count = mesh.indices.size() / 3;
+    bench::report("build_meshlets / triangle",
+                  ns,
+                  static_cast<double>(triangle_count));
+    std::printf("%zu meshlets, %.1f triangles each\n",
+                meshlets.size(),
+                static_cast<double>(triangle_count) / meshlets.size());
+
+    math::aabb bounds = ranges[0].bounds;
+    for (const auto& range : ranges) {
+        bounds.min = {std::min(bounds.min.x, range.bounds.min.x),
+                      std::min(bounds.min.y, range.bounds.min.y),
+                      std::min(bounds.min.z, range.bounds.min.z)};
+        bounds.max = {std::max(bounds.max.x, range.bounds.max.x),
+                      std::max(bounds.max.y, range.bounds.max.y),
+                      std::max(bounds.max.z, range.bounds.max.z)};
+    }
+    const auto center = (bounds.min + bounds.max) * 0.5f;
+    const auto size = bounds.max - bounds.min;
+    const auto distance = 2 * std::max({size.x, size.y, size.z});
+
+    constexpr int camera_count = 16;
+    size_t culled_triangles = 0;
+    culling::sphere_soa spheres;
+    spheres.resize(meshlets.size());
+    for (size_t i = 0; i < meshlets.size(); ++i) {
+        spheres.set(i, meshlets[i].sphere);
+    }
+    for (int k = 0; k < camera_count; ++k) {
+        const float angle = 6.2831853f * k / camera_count;
+        const auto camera =
+            center + math::vec3{distance * std::cos(angle),
+                                distance * std::sin(angle),
+                                distance * 0.5f};
+        for (const auto& m : meshlets) {
+            if (!is_backfacing(m, camera)) {
+                continue;
+            }
+            if (!all_backfacing(mesh, ranges[m.range], m, camera)) {
+                std::printf("meshlet at index %u culled with front faces\n",
+                            m.first_index);
+                return 1;
+            }
+            culled_triangles += m.index_count / 3;
+        }
+    }
+    std::printf("cone culling rejects %.1f%% of the triangles\n",
+                100.0 * culled_triangles / (triangle_count * camera_count));
+
+    // Draws the renderer issues from the same cameras: visible meshlets
+    // that follow each other in the index buffer are drawn together.
+    const auto proj =
+        math::perspesctive(math::radians(45.0f), 1.0f, 0.1f, 4 * distance);
+    std::vector<uint32_t> visible(meshlets.size());
+    size_t visible_meshlets = 0;
+    size_t draws = 0;
+    for (int k = 0; k < camera_count; ++k) {
+        const float angle = 6.2831853f * k / camera_count;
+        const auto camera =
+            center + math::vec3{distance * std::cos(angle),
+                                distance * std::sin(angle),
+                                distance * 0.5f};
+        const auto view = math::look_at(camera, center, math::vec3{0, 0, 1});
+        const auto frustum = culling::extract_frustum(proj * view);
+        const auto count = culling::cull(frustum, spheres, visible.data());
+        const meshlet* last = nullptr;
+        for (size_t i = 0; i < count; ++i) {
+            const auto& m = meshlets[visible[i]];
+            if (is_backfacing(m, camera)) {
+                continue;
+            }
+            ++visible_meshlets;
+            if (last == nullptr || last->range != m.range ||
+                last->first_index + last->index_count != m.first_index) {
+                ++draws;
+            }
+            last = &m;
+        }
+    }
+    std::printf("%.1f meshlets drawn with %.1f draws per frame\n",
+                static_cast<double>(visible_meshlets) / camera_count,
+                static_cast<double>(draws) / camera_count);
+
+    const auto camera = center + math::vec3{distance, 0.0f, distance * 0.5f};
+    const auto view = math::look_at(camera, center, math::vec3{0, 0, 1});
+    const auto frustum = culling::extract_frustum(proj * view);
+    const auto cull_ns = bench::measure_ns(repeats, [&] {
+        auto count = culling::cull(frustum, spheres, visible.data());
+        size_t kept = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (!is_backfacing(meshlets[visible[i]], camera)) {
+                visible[kept++] = visible[i];
+            }
+        }
+        bench::do_not_optimize(kept);
+    });
+    bench::report("frustum + cone cull / meshlet",
+                  cull_ns,
+                  static_cast<double>(meshlets.size()));
+    return 0;
+}
@@ -0,0 +1,133 @@
+#include "asset_loader.hpp"
+#include "bench.hpp"
+#include "obj_generator.hpp"
+#include "obj_parser.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <tiny_obj_loader.h>
+#include <vector>
+
+namespace {
+
+// Syntax the torus does not use: quads and pentagons, relative and missing
+// indices, exponents, long fractions, comments, groups and CRLF endings.
+// Repeated until it spans many parser chunks, so relative indices also
+// point across chunk boundaries.
+void write_mixed_obj(const std::string& path, int repeats) {
+    std::ofstream file(path, std::ios::binary);
+    file << "# mixed syntax\r\nmtllib missing.mtl\r\n";
+    for (int i = 0; i < repeats; ++i) {
+        file << "o part" << i << "\r\n"
+             << "v 1.5e-1 -2.25E+2 " << i << ".0625\r\n"
+             << "v\t-0.333333333333 +4 0.1\n"
+             << "  v 7 8 9 1.0\n"
+             << "v -1.0000001 2.5e3 -3.75\r"
+             << "v 0 0 " << -i << "\n"
+             << "vt 0.25 0.75\n"
+             << "vt 1e-2 0.123456789012\n"
+             << "vt .5 1\n"
+             << "vn 0 0 1\n"
+             << "g group " << i % 3 << "\n"
+             << "usemtl m" << i % 2 << "\n"
+             << "f -5/-3/1 -4/-2/1 -3/-1/1 -2/-3/1\n"
+             << "f -1//1 -2//1 -3//1\n"
+             << "s off\n"
+             << "f " << 5 * i + 1 << "/" << 3 * i + 1 << " " << 5 * i + 2
+             << "/" << 3 * i + 2 << " " << 5 * i + 5 << "/" << 3 * i + 3
+             << "  " << 5 * i + 4 << "/" << 3 * i + 1 << " -1/-2 \r\n";
+    }
+}
+
+bool same_mesh(const mesh_data& a, const mesh_data& b) {
+    return a.vertices.size() == b.vertices.size() &&
+           a.indices.size() == b.indices.size() &&
+           std::memcmp(a.vertices.data(),
+                       b.vertices.data(),
+                       a.vertices.size() * sizeof(Vertex)) == 0 &&
+           std::memcmp(a.indices.data(),
+                       b.indices.data(),
+                       a.indices.size() * sizeof(uint32_t)) == 0;
+}
+
+} // namespace
+
+// Usage: bench_obj_parser [model.obj]. Without an argument a torus of 2
+// million triangles is generated in the working directory and removed
+// afterwards.
+int main(int argc, char** argv) {
+    constexpr int repeats = 3;
+    const auto threads = std::max(1u, std::thread::hardware_concurrency());
+
+    const std::string mixed_path = "bench_obj_parser_mixed.obj";
+    write_mixed_obj(mixed_path, 100000);
+    const auto mixed_reference = load_obj(mixed_path);
+    for (const unsigned thread_count : {1u, 3u, threads}) {
+        if (!same_mesh(parse_obj(mixed_path, thread_count), mixed_reference)) {
+            std::printf("parse_obj with %u threads differs from load_obj on "
+                        "mixed syntax\n",
+                        thread_count);
+            return 1;
+        }
+    }
+    std::filesystem::remove(mixed_path);
+
+    std::string path;
+    if (argc > 1) {
+        path = argv[1];
+    } else {
+        path = "bench_obj_parser.obj";
+        bench::write_torus_obj(path, 1000);
+    }
+    const auto megabytes = std::filesystem::file_size(path) / 1e6;
+    auto report_throughput = [&](const char* name, double ns) {
+        std::printf("%-36s %10.2f ms %10.2f MB/s\n",
+                    name,
+                    ns / 1e6,
+                    megabytes / (ns / 1e9));
+    };
+    std::printf("%s: %.1f MB\n", path.c_str(), megabytes);
+
+    auto ns = bench::measure_ns(repeats, [&] {
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> materials;
+        std::string err;
+        tinyobj::LoadObj(&attrib, &shapes, &materials, &err, path.c_str());
+        bench::do_not_optimize(shapes);
+    });
+    report_throughput("tinyobj::LoadObj", ns);
+
+    mesh_data reference;
+    ns = bench::measure_ns(repeats, [&] { reference = load_obj(path); });
+    report_throughput("load_obj (tinyobj + dedup)", ns);
+
+    mesh_data mesh;
+    ns = bench::measure_ns(repeats, [&] { mesh = parse_obj(path, 1); });
+    report_throughput("parse_obj (1 thread)", ns);
+    if (!same_mesh(mesh, reference)) {
+        std::printf("parse_obj differs from load_obj\n");
+        return 1;
+    }
+
+    ns = bench::measure_ns(repeats, [&] { mesh = parse_obj(path, threads); });
+    char name[64];
+    std::snprintf(name, sizeof(name), "parse_obj (%u threads)", threads);
+    report_throughput(name, ns);
+    if (!same_mesh(mesh, reference)) {
+        std::printf("parse_obj differs from load_obj\n");
+        return 1;
+    }
+
+    std::printf("%zu vertices, %zu triangles\n",
+                mesh.vertices.size(),
+                mesh.indices.size() / 3);
+    if (argc <= 1) {
+        std::filesystem::remove(path);
+    }
+    return 0;
+}
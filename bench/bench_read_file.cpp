@@ -0,0 +1,114 @@
+#include "asset_loader.hpp"
+#include "bench.hpp"
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// read_file as it was before it mapped files.
+std::vector<std::byte> read_file_buffered(const std::string& filename) {
+    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        return {};
+    }
+    auto size = file.tellg();
+    std::vector<std::byte> buffer(size);
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(buffer.data()), size);
+    return buffer;
+}
+
+// Reads one word per page, enough to fault every page in.
+uint64_t touch_pages(std::span<const std::byte> bytes) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < bytes.size(); i += 4096) {
+        sum += static_cast<uint64_t>(bytes[i]);
+    }
+    return sum;
+}
+
+// Reads every byte, as a parser or hash would.
+uint64_t read_all(std::span<const std::byte> bytes) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i + 8 <= bytes.size(); i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes.data() + i, sizeof(word));
+        sum += word;
+    }
+    return sum;
+}
+
+void write_file(const std::string& path, size_t size) {
+    std::ofstream file(path, std::ios::binary);
+    std::vector<uint64_t> block(1 << 16);
+    for (size_t written = 0; written < size;) {
+        for (size_t i = 0; i < block.size(); ++i) {
+            block[i] = (written / sizeof(uint64_t) + i) * 0x9E3779B97F4A7C15;
+        }
+        const auto count =
+            std::min(size - written, block.size() * sizeof(uint64_t));
+        file.write(reinterpret_cast<const char*>(block.data()), count);
+        written += count;
+    }
+}
+
+} // namespace
+
+// Usage: bench_read_file [file]. Without an argument a 512 MB file is written
+// to the working directory and removed afterwards. The file is read once
+// before measuring, so every variant finds it in the page cache and the
+// numbers compare copying against mapping rather than disk speed.
+int main(int argc, char** argv) {
+    constexpr int repeats = 5;
+
+    std::string path;
+    if (argc > 1) {
+        path = argv[1];
+    } else {
+        path = "bench_read_file.bin";
+        write_file(path, size_t{512} << 20);
+    }
+    const auto size = static_cast<double>(std::filesystem::file_size(path));
+    const auto expected = read_all(read_file_buffered(path));
+
+    bool same = true;
+    auto check = [&](uint64_t sum) { same = same && sum == expected; };
+    const auto buffered_ns = bench::measure_ns(repeats, [&] {
+        const auto bytes = read_file_buffered(path);
+        check(read_all(bytes));
+    });
+    const auto mapped_ns = bench::measure_ns(repeats, [&] {
+        const auto file = read_file(path, file_access::normal);
+        check(read_all(file.span()));
+    });
+    const auto sequential_ns = bench::measure_ns(repeats, [&] {
+        const auto file = read_file(path, file_access::sequential);
+        check(read_all(file.span()));
+    });
+    const auto open_ns = bench::measure_ns(repeats, [&] {
+        const auto file = read_file(path, file_access::normal);
+        bench::do_not_optimize(touch_pages(file.span()));
+    });
+    if (argc <= 1) {
+        std::filesystem::remove(path);
+    }
+    if (!same) {
+        std::printf("mapped contents differ from the buffered read\n");
+        return 1;
+    }
+
+    const auto megabytes = size / (1 << 20);
+    bench::report("buffered read + scan / MB", buffered_ns, megabytes);
+    bench::report("mapped + scan / MB", mapped_ns, megabytes);
+    bench::report("mapped sequential + scan / MB", sequential_ns, megabytes);
+    bench::report("mapped + fault every page / MB", open_ns, megabytes);
+    return 0;
+}
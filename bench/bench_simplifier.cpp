@@ -0,0 +1,74 @@
+#include "bench.hpp"
+#include "mesh_optimizer.hpp"
+#include "obj_generator.hpp"
+#include "obj_parser.hpp"
+#include "simplifier.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Usage: bench_simplifier [model.obj]. Without an argument a torus of 320
+// thousand triangles is generated in the working directory and removed
+// afterwards. Builds the level of detail chain the mesh cooker stores and
+// prints the triangles, error and vertex cache efficiency of every level.
+int main(int argc, char** argv) {
+    constexpr int repeats = 3;
+
+    std::string path;
+    if (argc > 1) {
+        path = argv[1];
+    } else {
+        path = "bench_simplifier.obj";
+        bench::write_torus_obj(path, 400);
+    }
+    auto mesh = parse_obj(path);
+    if (argc <= 1) {
+        std::filesystem::remove(path);
+    }
+    if (mesh.indices.empty()) {
+        return 1;
+    }
+    const auto clusters =
+        optimize_vertex_cache(mesh.indices, mesh.vertices.size());
+    optimize_overdraw(mesh.indices, mesh.vertices, clusters);
+    mesh.vertices = optimize_vertex_fetch(mesh.vertices, mesh.indices);
+    const auto full_ranges = split_mesh(mesh);
+    const auto full_index_count = mesh.indices.size();
+
+    auto lod_mesh = mesh;
+    auto ranges = full_ranges;
+    std::vector<mesh_lod> lods;
+    const auto ns = bench::measure_ns(repeats, [&] {
+        lod_mesh.indices.resize(full_index_count);
+        ranges = full_ranges;
+        lods = build_lod_chain(lod_mesh, ranges);
+    });
+    bench::report("build_lod_chain / triangle",
+                  ns,
+                  static_cast<double>(full_index_count / 3));
+
+    for (size_t level = 0; level < lods.size(); ++level) {
+        const auto& lod = lods[level];
+        size_t triangles = 0;
+        size_t transformed = 0;
+        for (auto r = lod.first_range; r < lod.first_range + lod.range_count;
+             ++r) {
+            const auto& range = ranges[r];
+            const std::span<const uint32_t> indices(
+                lod_mesh.indices.data() + range.first_index,
+                range.index_count);
+            triangles += range.index_count / 3;
+            transformed +=
+                analyze_vertex_cache(indices, range.vertex_count)
+                    .vertices_transformed;
+        }
+        std::printf("level %zu: %zu triangles, error %g, acmr %.2f\n",
+                    level,
+                    triangles,
+                    lod.error,
+                    static_cast<double>(transformed) / triangles);
+    }
+    return 0;
+}
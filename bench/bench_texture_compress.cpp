@@ -0,0 +1,68 @@
+#include "bench.hpp"
+#include "texture_compress.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+// Smooth gradients with a little noise and hard edges, closer to a painted
+// texture than random texels, which no block format can represent.
+std::vector<std::byte> make_image(uint32_t width, uint32_t height) {
+    std::vector<std::byte> pixels(size_t{width} * height * 4);
+    uint32_t seed = 12345;
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            seed = seed * 1664525 + 1013904223;
+            const auto noise = static_cast<int>(seed >> 29);
+            const auto edge = ((x / 37) + (y / 53)) % 2 ? 40 : 0;
+            auto* texel = &pixels[4 * (size_t{y} * width + x)];
+            texel[0] = std::byte(static_cast<uint8_t>(x * 200 / width + edge));
+            texel[1] = std::byte(static_cast<uint8_t>(
+                128 + 100 * std::sin(y * 0.02f) + noise));
+            texel[2] = std::byte(static_cast<uint8_t>((x + y) % 256));
+            texel[3] = std::byte{255};
+        }
+    }
+    return pixels;
+}
+
+double psnr(uint64_t error, uint32_t width, uint32_t height) {
+    const auto mse = static_cast<double>(error) / (3.0 * width * height);
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+} // namespace
+
+int main() {
+    constexpr uint32_t width = 1024;
+    constexpr uint32_t height = 1024;
+    const auto pixels = make_image(width, height);
+    const double texels = double{width} * height;
+
+    std::vector<std::byte> bc1(
+        block_compressed_size(width, height, bc1_block_size));
+    uint64_t bc1_error = 0;
+    const auto bc1_ns = bench::measure_ns(3, [&] {
+        bc1_error = encode_bc1(pixels, width, height, bc1);
+        bench::do_not_optimize(bc1);
+    });
+    bench::report("encode_bc1 (per texel)", bc1_ns, texels);
+    std::printf("  %zu bytes, PSNR %.2f dB\n",
+                bc1.size(),
+                psnr(bc1_error, width, height));
+
+    std::vector<std::byte> bc7(
+        block_compressed_size(width, height, bc7_block_size));
+    uint64_t bc7_error = 0;
+    const auto bc7_ns = bench::measure_ns(3, [&] {
+        bc7_error = encode_bc7(pixels, width, height, bc7);
+        bench::do_not_optimize(bc7);
+    });
+    bench::report("encode_bc7 (per texel)", bc7_ns, texels);
+    std::printf("  %zu bytes, PSNR %.2f dB\n",
+                bc7.size(),
+                psnr(bc7_error, width, height));
+}
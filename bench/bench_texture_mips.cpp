@@ -0,0 +1,90 @@
+#include "bench.hpp"
+#include "texture_mips.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+float srgb_to_linear(float c) {
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+const std::array<float, 256> srgb_decode = [] {
+    std::array<float, 256> values;
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = srgb_to_linear(static_cast<float>(i) / 255.0f);
+    }
+    return values;
+}();
+
+float linear_to_srgb(float c) {
+    return c <= 0.0031308f ? c * 12.92f
+                           : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+// downsample_srgb_rgba8 as it was before its encode table and threads.
+void downsample_pow(const uint8_t* in,
+                    uint32_t width,
+                    uint32_t height,
+                    uint8_t* out) {
+    const auto dst_width = std::max(width / 2, 1u);
+    const auto dst_height = std::max(height / 2, 1u);
+    for (uint32_t y = 0; y < dst_height; ++y) {
+        const uint32_t rows[2] = {std::min(2 * y, height - 1),
+                                  std::min(2 * y + 1, height - 1)};
+        for (uint32_t x = 0; x < dst_width; ++x) {
+            const uint32_t columns[2] = {std::min(2 * x, width - 1),
+                                         std::min(2 * x + 1, width - 1)};
+            float color[4] = {};
+            for (const auto row : rows) {
+                for (const auto column : columns) {
+                    const auto* texel = in + 4 * (size_t{row} * width + column);
+                    for (int c = 0; c < 3; ++c) {
+                        color[c] += srgb_decode[texel[c]];
+                    }
+                    color[3] += texel[3] / 255.0f;
+                }
+            }
+            auto* texel = out + 4 * (size_t{y} * dst_width + x);
+            for (int c = 0; c < 4; ++c) {
+                const auto value =
+                    c < 3 ? linear_to_srgb(color[c] * 0.25f) : color[c] * 0.25f;
+                texel[c] = static_cast<uint8_t>(
+                    std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+            }
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    constexpr uint32_t size = 2048;
+    std::vector<std::byte> image(size_t{size} * size * 4);
+    uint32_t seed = 12345;
+    for (auto& value : image) {
+        seed = seed * 1664525 + 1013904223;
+        value = std::byte(static_cast<uint8_t>(seed >> 24));
+    }
+    std::vector<std::byte> level(image.size() / 4);
+    const double texels = double{size} * size;
+
+    const auto pow_ns = bench::measure_ns(5, [&] {
+        downsample_pow(reinterpret_cast<const uint8_t*>(image.data()),
+                       size,
+                       size,
+                       reinterpret_cast<uint8_t*>(level.data()));
+        bench::do_not_optimize(level);
+    });
+    bench::report("downsample with pow (per texel)", pow_ns, texels);
+
+    const auto table_ns = bench::measure_ns(5, [&] {
+        downsample_srgb_rgba8(image, size, size, level);
+        bench::do_not_optimize(level);
+    });
+    bench::report("downsample_srgb_rgba8 (per texel)", table_ns, texels);
+}
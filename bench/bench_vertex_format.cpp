@@ -0,0 +1,101 @@
+#include "bench.hpp"
+#include "mathlib_batch.hpp"
+#include "obj_generator.hpp"
+#include "obj_parser.hpp"
+#include "vertex_format.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+namespace {
+
+// Largest difference between the source and the round trip through the
+// packed format, per attribute and relative to the attribute's range.
+void report_error(const char* name,
+                  const mesh_data& mesh,
+                  const math::aabb& bounds,
+                  tex_coord_encoding encoding) {
+    const auto quantized = quantize_vertices(mesh.vertices, bounds, encoding);
+    const auto size = bounds.max - bounds.min;
+    const auto extent = std::max({size.x, size.y, size.z});
+    float position_error = 0;
+    float tex_coord_error = 0;
+    for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+        const auto& source = mesh.vertices[i];
+        const auto result = dequantize_vertex(quantized.vertices[i],
+                                              quantized.dequantization,
+                                              encoding);
+        const auto d = result.pos - source.pos;
+        position_error = std::max(
+            {position_error, std::abs(d.x), std::abs(d.y), std::abs(d.z)});
+        tex_coord_error =
+            std::max({tex_coord_error,
+                      std::abs(result.tex_coord.x - source.tex_coord.x),
+                      std::abs(result.tex_coord.y - source.tex_coord.y)});
+    }
+    std::printf("%-24s position error %.2e of extent, tex_coord error %.2e\n",
+                name,
+                position_error / extent,
+                tex_coord_error);
+}
+
+} // namespace
+
+// Usage: bench_vertex_format [model.obj]. Without an argument a torus of 2
+// million triangles is generated in the working directory and removed
+// afterwards.
+int main(int argc, char** argv) {
+    constexpr int repeats = 5;
+
+    std::string path;
+    if (argc > 1) {
+        path = argv[1];
+    } else {
+        path = "bench_vertex_format.obj";
+        bench::write_torus_obj(path, 1000);
+    }
+    const auto mesh = parse_obj(path);
+    if (argc <= 1) {
+        std::filesystem::remove(path);
+    }
+    if (mesh.vertices.empty()) {
+        return 1;
+    }
+
+    math::vec3_soa positions;
+    positions.resize(mesh.vertices.size());
+    const auto* first_position =
+        reinterpret_cast<const std::byte*>(&mesh.vertices[0].pos);
+    math::deinterleave(first_position, sizeof(Vertex), positions.span());
+    const auto bounds = math::compute_aabb(positions.span());
+
+    const auto count = mesh.vertices.size();
+    std::printf("%zu vertices: %.1f MB as Vertex, %.1f MB packed\n",
+                count,
+                count * sizeof(Vertex) / 1e6,
+                count * sizeof(packed_vertex) / 1e6);
+    report_error("unorm16 tex_coord",
+                 mesh,
+                 bounds,
+                 tex_coord_encoding::unorm16);
+    report_error("half tex_coord", mesh, bounds, tex_coord_encoding::half);
+
+    for (const auto encoding :
+         {tex_coord_encoding::unorm16, tex_coord_encoding::half}) {
+        const auto ns = bench::measure_ns(repeats, [&] {
+            const auto quantized =
+                quantize_vertices(mesh.vertices, bounds, encoding);
+            bench::do_not_optimize(quantized.vertices.data());
+        });
+        bench::report(encoding == tex_coord_encoding::unorm16
+                          ? "quantize_vertices unorm16"
+                          : "quantize_vertices half",
+                      ns,
+                      static_cast<double>(count));
+    }
+    return 0;
+}
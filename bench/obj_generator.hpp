@@ -0,0 +1,44 @@
+#ifndef OBJ_GENERATOR_HPP
+#define OBJ_GENERATOR_HPP
+
+#include <cmath>
+#include <fstream>
+#include <string>
+
+namespace bench {
+
+// A size x size grid wrapped around a torus, 2 * size * size triangles. Every
+// interior vertex is shared by six triangles and the coordinates are
+// symmetric around 0.
+inline void write_torus_obj(const std::string& path, int size) {
+    constexpr float two_pi = 6.2831853f;
+    std::ofstream file(path);
+    for (int j = 0; j <= size; ++j) {
+        for (int i = 0; i <= size; ++i) {
+            const float u = two_pi * i / size;
+            const float v = two_pi * j / size;
+            const float r = 2.0f + std::cos(v);
+            file << "v " << r * std::cos(u) << ' ' << r * std::sin(u) << ' '
+                 << std::sin(v) << '\n';
+            file << "vt " << static_cast<float>(i) / size << ' '
+                 << static_cast<float>(j) / size << '\n';
+        }
+    }
+    const int row = size + 1;
+    for (int j = 0; j < size; ++j) {
+        for (int i = 0; i < size; ++i) {
+            const int a = j * row + i + 1;
+            const int b = a + 1;
+            const int c = a + row;
+            const int d = c + 1;
+            file << "f " << a << '/' << a << ' ' << b << '/' << b << ' ' << d
+                 << '/' << d << '\n';
+            file << "f " << a << '/' << a << ' ' << d << '/' << d << ' ' << c
+                 << '/' << c << '\n';
+        }
+    }
+}
+
+} // namespace bench
+
+#endif
@@ -4,17 +4,19 @@ layout(binding = 0) uniform UniformBufferObject {
     mat4 model;
     mat4 view;
     mat4 proj;
+    mat4 mvp;
+    vec4 positionScale;
+    vec4 positionOffset;
+    vec4 texCoordTransform;
 } ubo;
 
-layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inColor;
-layout(location = 2) in vec2 inTexCoord;
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inTexCoord;
 
-layout(location = 0) out vec3 fragColor;
-layout(location = 1) out vec2 fragTexCoord;
+layout(location = 0) out vec2 fragTexCoord;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
-    fragColor = inColor;
-    fragTexCoord = inTexCoord;
+    vec3 position = ubo.positionOffset.xyz + inPosition.xyz * ubo.positionScale.xyz;
+    gl_Position = ubo.mvp * vec4(position, 1.0);
+    fragTexCoord = ubo.texCoordTransform.zw + inTexCoord * ubo.texCoordTransform.xy;
 }
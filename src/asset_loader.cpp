@@ -1,33 +1,227 @@
 #include "asset_loader.hpp"
 
+#include "asset_package.hpp"
+#include "flat_hash_map.hpp"
+#include "hash.hpp"
+
+#include <algorithm>
 #include <cstddef>
-#include <fstream>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <utility>
+
+namespace {
+
+// Memory the image decoding on this thread should end up in. stb_image gets
+// it for an allocation of exactly its size, which for 8 bit PNG images is the
+// buffer the pixels are returned in, so they need no copy. Other formats
+// allocate their result differently and get copied into it once.
+struct decode_target {
+    void* data = nullptr;
+    size_t size = 0;
+    bool in_use = false;
+};
+thread_local decode_target target;
+
+void* image_malloc(size_t size) {
+    if (target.data && !target.in_use && size == target.size) {
+        target.in_use = true;
+        return target.data;
+    }
+    return std::malloc(size);
+}
+
+void* image_realloc(void* p, size_t old_size, size_t new_size) {
+    if (p && p == target.data) {
+        auto* moved = std::malloc(new_size);
+        if (moved) {
+            std::memcpy(moved, p, std::min(old_size, new_size));
+            target.in_use = false;
+        }
+        return moved;
+    }
+    return std::realloc(p, new_size);
+}
+
+void image_free(void* p) {
+    if (p && p == target.data) {
+        target.in_use = false;
+        return;
+    }
+    std::free(p);
+}
+
+} // namespace
+
+#define STBI_MALLOC(size) image_malloc(size)
+#define STBI_REALLOC_SIZED(p, old_size, new_size)                             \
+    image_realloc(p, old_size, new_size)
+#define STBI_FREE(p) image_free(p)
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
-#include <string>
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
 #include <vector>
 
-std::vector<std::byte> read_file(const std::string& filename) {
-    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+// The vertex is hashed and compared as raw bytes.
+static_assert(sizeof(Vertex) == 8 * sizeof(float));
+
+mapped_file read_file(const std::string& filename, file_access access) {
+    auto file = open_asset(filename, access);
     if (!file.is_open()) {
         std::cerr << "failed to open file! " << filename << std::endl;
-        return {};
     }
-    auto fileSize = file.tellg();
-    std::vector<std::byte> buffer(fileSize);
-    file.seekg(0);
-    file.read(reinterpret_cast<char*>(buffer.data()), fileSize);
-    file.close();
-    return buffer;
+    return file;
 }
 
+img_data::img_data(img_data&& other) noexcept
+    : width(other.width), height(other.height), channels(other.channels),
+      pixels(std::exchange(other.pixels, nullptr)) {}
+
+img_data& img_data::operator=(img_data&& other) noexcept {
+    if (this != &other) {
+        stbi_image_free(pixels);
+        width = other.width;
+        height = other.height;
+        channels = other.channels;
+        pixels = std::exchange(other.pixels, nullptr);
+    }
+    return *this;
+}
+
+img_data::~img_data() { stbi_image_free(pixels); }
+
 img_data load_image(const std::string& filename) {
     img_data result;
-    result.pixels = reinterpret_cast<std::byte*>(stbi_load(filename.c_str(),
-                                                           &result.width,
-                                                           &result.height,
-                                                           &result.channels,
-                                                           STBI_rgb_alpha));
+    const auto file = read_file(filename);
+    if (!file.is_open()) {
+        return result;
+    }
+    result.pixels = reinterpret_cast<std::byte*>(stbi_load_from_memory(
+        reinterpret_cast<const stbi_uc*>(file.data()),
+        static_cast<int>(file.size()),
+        &result.width,
+        &result.height,
+        &result.channels,
+        STBI_rgb_alpha));
     return result;
 }
+
+image_info load_image_info(const std::string& filename) {
+    image_info info;
+    const auto file = read_file(filename);
+    if (!file.is_open()) {
+        return {};
+    }
+    if (!stbi_info_from_memory(reinterpret_cast<const stbi_uc*>(file.data()),
+                               static_cast<int>(file.size()),
+                               &info.width,
+                               &info.height,
+                               &info.channels)) {
+        std::cerr << "failed to load texture image! " << filename
+                  << std::endl;
+        return {};
+    }
+    return info;
+}
+
+bool load_image_into(const std::string& filename,
+                     std::span<std::byte> pixels) {
+    const auto file = read_file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+    const auto* bytes = reinterpret_cast<const stbi_uc*>(file.data());
+    const auto size = static_cast<int>(file.size());
+    int width;
+    int height;
+    int channels;
+    if (!stbi_info_from_memory(bytes, size, &width, &height, &channels) ||
+        size_t(width) * height * 4 != pixels.size()) {
+        std::cerr << "failed to load texture image! " << filename
+                  << std::endl;
+        return false;
+    }
+
+    target = {pixels.data(), pixels.size(), false};
+    auto* decoded = stbi_load_from_memory(bytes,
+                                          size,
+                                          &width,
+                                          &height,
+                                          &channels,
+                                          STBI_rgb_alpha);
+    target = {};
+    if (!decoded) {
+        std::cerr << "failed to load texture image! " << filename
+                  << std::endl;
+        return false;
+    }
+    if (decoded != reinterpret_cast<stbi_uc*>(pixels.data())) {
+        std::memcpy(pixels.data(), decoded, pixels.size());
+        stbi_image_free(decoded);
+    }
+    return true;
+}
+
+mesh_data load_obj(const std::string& filename) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+
+    if (!tinyobj::LoadObj(&attrib,
+                          &shapes,
+                          &materials,
+                          &err,
+                          filename.c_str())) {
+        std::cerr << "failed to load model! " << filename << " " << err
+                  << std::endl;
+        return {};
+    }
+
+    size_t index_count = 0;
+    for (const auto& shape : shapes) {
+        index_count += shape.mesh.indices.size();
+    }
+
+    // Closed meshes share each vertex between about six triangles, so a
+    // quarter of the index count rarely needs to grow and does not
+    // overallocate much for meshes without sharing.
+    mesh_data mesh;
+    mesh.indices.reserve(index_count);
+    mesh.vertices.reserve(index_count / 4);
+    flat_hash_map<Vertex,
+                  uint32_t,
+                  hash::byte_hash<Vertex>,
+                  hash::byte_equal<Vertex>>
+        unique_vertices;
+    unique_vertices.reserve(index_count / 4);
+
+    for (const auto& shape : shapes) {
+        for (const auto& index : shape.mesh.indices) {
+            Vertex vertex{};
+
+            vertex.pos = {attrib.vertices[3 * index.vertex_index + 0],
+                          attrib.vertices[3 * index.vertex_index + 1],
+                          attrib.vertices[3 * index.vertex_index + 2]};
+            vertex.tex_coord = {0.0f, 1.0f};
+            if (index.texcoord_index >= 0) {
+                vertex.tex_coord = {
+                    attrib.texcoords[2 * index.texcoord_index + 0],
+                    1.0f - attrib.texcoords[2 * index.texcoord_index + 1]};
+            }
+            vertex.color = {1.0f, 1.0f, 1.0f};
+
+            const auto next_index = static_cast<uint32_t>(mesh.vertices.size());
+            const auto [slot, inserted] =
+                unique_vertices.try_emplace(vertex, next_index);
+            if (inserted) {
+                mesh.vertices.push_back(vertex);
+            }
+            mesh.indices.push_back(*slot);
+        }
+    }
+    return mesh;
+}
@@ -1,18 +1,67 @@
 #ifndef ASSET_LOADER_HPP
 #define ASSET_LOADER_HPP
 
+#include "mapped_file.hpp"
+#include "mathlib.hpp"
+
 #include <cstddef>
+#include <cstdint>
+#include <span>
 #include <string>
 #include <vector>
 
+struct image_info {
+    int width = 0;
+    int height = 0;
+    // In the file, the pixels are always decoded to RGBA.
+    int channels = 0;
+};
+
+// Decoded RGBA pixels, freed with the image.
 struct img_data {
-    int width;
-    int height;
-    int channels;
-    std::byte* pixels;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    std::byte* pixels = nullptr;
+
+    img_data() = default;
+    img_data(img_data&& other) noexcept;
+    img_data& operator=(img_data&& other) noexcept;
+    ~img_data();
+};
+
+struct Vertex {
+    math::vec3 pos;
+    math::vec3 color;
+    math::vec2 tex_coord;
+
+    bool operator==(const Vertex& other) const {
+        return pos == other.pos && color == other.color &&
+               tex_coord == other.tex_coord;
+    }
+};
+
+struct mesh_data {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
 };
 
-std::vector<std::byte> read_file(const std::string& filename);
+// Maps the whole file, or reads it into memory when it cannot be mapped. Files
+// in the mounted asset package are read from there instead. The contents
+// stay valid while the returned file lives. Returns a closed file on failure.
+mapped_file read_file(const std::string& filename,
+                      file_access access = file_access::sequential);
 img_data load_image(const std::string& filename);
+// Reads the size of an image without decoding it. Returns a zero size on
+// failure.
+image_info load_image_info(const std::string& filename);
+// Decodes an image as RGBA straight into `pixels`, which must hold exactly
+// width * height * 4 bytes. Decoding reads back what it wrote, so mapped
+// staging memory only suits when it is cached on the host. Returns false
+// when the file cannot be decoded or its size does not match.
+bool load_image_into(const std::string& filename, std::span<std::byte> pixels);
+// Loads every shape of an OBJ file into one indexed mesh with identical
+// vertices merged. Returns an empty mesh on failure.
+mesh_data load_obj(const std::string& filename);
 
 #endif
@@ -0,0 +1,273 @@
+#include "asset_package.hpp"
+
+#include "hash.hpp"
+#include "lz4_block.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <tuple>
+#include <utility>
+
+namespace {
+
+constexpr char package_magic[4] = {'P', 'A', 'C', 'K'};
+constexpr uint32_t package_version = 1;
+// Contents start on a page, so each can be advised and faulted in on its
+// own.
+constexpr uint64_t blob_alignment = 4096;
+
+// Followed by the (1 << bucket_bits) + 1 bucket starts, the index and the
+// names at the given offsets, in native byte order.
+struct package_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t bucket_bits;
+    uint64_t bucket_offset;
+    uint64_t entry_offset;
+    uint64_t name_offset;
+    uint64_t name_size;
+};
+
+constexpr uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+uint64_t hash_name(std::string_view name) {
+    return hash::hash_bytes(name.data(), name.size());
+}
+
+uint32_t bucket_of(uint64_t name_hash, uint32_t bucket_bits) {
+    return bucket_bits == 0
+               ? 0
+               : static_cast<uint32_t>(name_hash >> (64 - bucket_bits));
+}
+
+// Names are looked up with '/' on every platform.
+std::string normalize(std::string path) {
+    std::replace(path.begin(), path.end(), '\\', '/');
+    return path;
+}
+
+asset_package mounted_package;
+
+} // namespace
+
+asset_package::asset_package(const std::string& path) {
+    // Lookups touch the index at scattered places.
+    mapped_file package(path, file_access::random);
+    if (package.size() < sizeof(package_header)) {
+        return;
+    }
+    package_header header;
+    std::memcpy(&header, package.data(), sizeof(header));
+    const auto bucket_count = (uint64_t{1} << header.bucket_bits) + 1;
+    if (std::memcmp(header.magic, package_magic, 4) != 0 ||
+        header.version != package_version || header.bucket_bits > 31 ||
+        header.bucket_offset % alignof(uint32_t) != 0 ||
+        header.entry_offset % alignof(package_entry) != 0 ||
+        header.bucket_offset + bucket_count * sizeof(uint32_t) >
+            package.size() ||
+        header.entry_offset +
+                uint64_t{header.entry_count} * sizeof(package_entry) >
+            package.size() ||
+        header.name_offset + header.name_size > package.size()) {
+        return;
+    }
+
+    const std::span<const uint32_t> bucket_starts = {
+        reinterpret_cast<const uint32_t*>(package.data() +
+                                          header.bucket_offset),
+        bucket_count};
+    const std::span<const package_entry> index = {
+        reinterpret_cast<const package_entry*>(package.data() +
+                                               header.entry_offset),
+        header.entry_count};
+    // Checked once here so lookups can trust the tables.
+    if (bucket_starts.front() != 0 ||
+        bucket_starts.back() != header.entry_count ||
+        !std::is_sorted(bucket_starts.begin(), bucket_starts.end())) {
+        return;
+    }
+    for (uint32_t bucket = 0; bucket + 1 < bucket_count; ++bucket) {
+        for (auto i = bucket_starts[bucket]; i < bucket_starts[bucket + 1];
+             ++i) {
+            const auto& entry = index[i];
+            if (bucket_of(entry.name_hash, header.bucket_bits) != bucket ||
+                entry.offset + entry.stored_size > package.size() ||
+                uint64_t{entry.name_offset} + entry.name_size >
+                    header.name_size ||
+                (entry.compression != package_compression::none &&
+                 entry.compression != package_compression::lz4_block) ||
+                (entry.compression == package_compression::none &&
+                 entry.stored_size != entry.size)) {
+                return;
+            }
+        }
+    }
+
+    buckets = bucket_starts;
+    entries = index;
+    names = {reinterpret_cast<const char*>(package.data() + header.name_offset),
+             header.name_size};
+    bucket_bits = header.bucket_bits;
+    file = std::move(package);
+}
+
+const package_entry* asset_package::find(std::string_view name) const {
+    if (!is_open()) {
+        return nullptr;
+    }
+    const auto name_hash = hash_name(name);
+    const auto bucket = bucket_of(name_hash, bucket_bits);
+    for (auto i = buckets[bucket]; i < buckets[bucket + 1]; ++i) {
+        const auto& entry = entries[i];
+        if (entry.name_hash == name_hash && this->name(entry) == name) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+std::string_view asset_package::name(const package_entry& entry) const {
+    return names.substr(entry.name_offset, entry.name_size);
+}
+
+mapped_file asset_package::open(const package_entry& entry,
+                                file_access access) const {
+    const std::span<const std::byte> stored = {file.data() + entry.offset,
+                                               entry.stored_size};
+    if (entry.compression == package_compression::none) {
+        return mapped_file::view(stored, access);
+    }
+    std::vector<std::byte> contents(entry.size);
+    if (!lz4_decompress(stored, contents)) {
+        std::cerr << "failed to decompress asset! " << name(entry)
+                  << std::endl;
+        return {};
+    }
+    return mapped_file::from_buffer(std::move(contents));
+}
+
+bool write_asset_package(const std::string& path,
+                         std::span<const package_input> inputs,
+                         bool compress) {
+    struct packed_file {
+        std::string name;
+        mapped_file source;
+        std::vector<std::byte> compressed;
+        package_entry entry{};
+    };
+    std::vector<packed_file> files;
+    files.reserve(inputs.size());
+    for (const auto& input : inputs) {
+        auto& file = files.emplace_back();
+        file.name = normalize(input.name);
+        file.source = mapped_file(input.path, file_access::sequential);
+        if (!file.source.is_open()) {
+            std::cerr << "failed to open file! " << input.path << std::endl;
+            return false;
+        }
+        file.entry.name_hash = hash_name(file.name);
+        file.entry.size = file.source.size();
+        file.entry.stored_size = file.source.size();
+        file.entry.compression = package_compression::none;
+        if (compress && !file.source.span().empty()) {
+            file.compressed = lz4_compress(file.source.span());
+            if (file.compressed.size() <=
+                file.entry.size - file.entry.size / 8) {
+                file.entry.stored_size = file.compressed.size();
+                file.entry.compression = package_compression::lz4_block;
+            } else {
+                file.compressed = {};
+            }
+        }
+    }
+    std::sort(files.begin(), files.end(), [](const auto& a, const auto& b) {
+        return std::tie(a.entry.name_hash, a.name) <
+               std::tie(b.entry.name_hash, b.name);
+    });
+    for (size_t i = 1; i < files.size(); ++i) {
+        if (files[i].name == files[i - 1].name) {
+            std::cerr << "file packed twice! " << files[i].name << std::endl;
+            return false;
+        }
+    }
+
+    // About one entry per bucket.
+    uint32_t bucket_bits = 0;
+    while ((size_t{1} << bucket_bits) < files.size()) {
+        ++bucket_bits;
+    }
+    std::vector<uint32_t> buckets((size_t{1} << bucket_bits) + 1, 0);
+    for (const auto& file : files) {
+        ++buckets[bucket_of(file.entry.name_hash, bucket_bits) + 1];
+    }
+    for (size_t i = 1; i < buckets.size(); ++i) {
+        buckets[i] += buckets[i - 1];
+    }
+
+    package_header header{};
+    std::memcpy(header.magic, package_magic, 4);
+    header.version = package_version;
+    header.entry_count = static_cast<uint32_t>(files.size());
+    header.bucket_bits = bucket_bits;
+    header.bucket_offset = sizeof(header);
+    header.entry_offset =
+        align_up(header.bucket_offset + buckets.size() * sizeof(uint32_t),
+                 alignof(package_entry));
+    header.name_offset =
+        header.entry_offset + files.size() * sizeof(package_entry);
+    std::string names;
+    for (auto& file : files) {
+        file.entry.name_offset = static_cast<uint32_t>(names.size());
+        file.entry.name_size = static_cast<uint32_t>(file.name.size());
+        names += file.name;
+    }
+    header.name_size = names.size();
+    auto offset = align_up(header.name_offset + names.size(), blob_alignment);
+    for (auto& file : files) {
+        file.entry.offset = offset;
+        offset = align_up(offset + file.entry.stored_size, blob_alignment);
+    }
+
+    return write_file_atomically(path, [&](std::ostream& out) {
+        const char padding[blob_alignment]{};
+        const auto pad_to = [&](uint64_t position) {
+            out.write(padding,
+                      static_cast<std::streamsize>(
+                          position - static_cast<uint64_t>(out.tellp())));
+        };
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(buckets.data()),
+                  buckets.size() * sizeof(uint32_t));
+        pad_to(header.entry_offset);
+        for (const auto& file : files) {
+            out.write(reinterpret_cast<const char*>(&file.entry),
+                      sizeof(file.entry));
+        }
+        out.write(names.data(), names.size());
+        for (const auto& file : files) {
+            pad_to(file.entry.offset);
+            const auto contents = file.compressed.empty()
+                                      ? file.source.span()
+                                      : std::span<const std::byte>(
+                                            file.compressed);
+            out.write(reinterpret_cast<const char*>(contents.data()),
+                      contents.size());
+        }
+    });
+}
+
+bool mount_asset_package(const std::string& path) {
+    mounted_package = asset_package(path);
+    return mounted_package.is_open();
+}
+
+mapped_file open_asset(const std::string& path, file_access access) {
+    if (const auto* entry = mounted_package.find(normalize(path))) {
+        return mounted_package.open(*entry, access);
+    }
+    return mapped_file(path, access);
+}
@@ -0,0 +1,84 @@
+#ifndef ASSET_PACKAGE_HPP
+#define ASSET_PACKAGE_HPP
+
+#include "mapped_file.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Single file holding many assets, mapped once and looked up by name. The
+// file is a header, a bucket table, the index sorted by the hash of the
+// names, the names, then every file's contents at a multiple of 4KB, stored
+// as is or LZ4 block compressed. The top bits of a name's hash pick its
+// bucket, which points at the run of index entries sharing them, so a lookup
+// compares about one entry whatever the number of files.
+
+enum class package_compression : uint32_t {
+    none = 0,
+    lz4_block = 1,
+};
+
+struct package_entry {
+    uint64_t name_hash;
+    // Of the stored contents in the package.
+    uint64_t offset;
+    uint64_t stored_size;
+    // Once decompressed.
+    uint64_t size;
+    uint32_t name_offset;
+    uint32_t name_size;
+    package_compression compression;
+    uint32_t reserved;
+};
+
+class asset_package {
+  public:
+    asset_package() = default;
+    explicit asset_package(const std::string& path);
+
+    bool is_open() const { return file.is_open(); }
+    size_t size() const { return entries.size(); }
+
+    const package_entry* find(std::string_view name) const;
+    std::string_view name(const package_entry& entry) const;
+    // The contents of `entry`: a view into the package when stored as is,
+    // otherwise decompressed into a buffer. Returns a closed file when the
+    // contents are damaged.
+    mapped_file open(const package_entry& entry,
+                     file_access access = file_access::normal) const;
+
+  private:
+    mapped_file file;
+    std::span<const uint32_t> buckets;
+    std::span<const package_entry> entries;
+    std::string_view names;
+    uint32_t bucket_bits = 0;
+};
+
+struct package_input {
+    // Looked up with '/' between directories, whatever the platform.
+    std::string name;
+    std::string path;
+};
+
+// Packs the files at the inputs' paths under their names, LZ4 compressing
+// those that shrink by an eighth or more when `compress` is set.
+bool write_asset_package(const std::string& path,
+                         std::span<const package_input> inputs,
+                         bool compress);
+
+// Maps the package that open_asset looks in first. Call it before any asset
+// is loaded: lookups are not synchronized with it. Returns false, leaving
+// only the file system, when there is no valid package at `path`.
+bool mount_asset_package(const std::string& path);
+
+// Opens the asset `path` from the mounted package, or from the file system
+// when it is not in there. Returns a closed file when it is in neither.
+mapped_file open_asset(const std::string& path,
+                       file_access access = file_access::normal);
+
+#endif
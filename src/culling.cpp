@@ -0,0 +1,217 @@
+#include "culling.hpp"
+
+#include "mathlib_wide.hpp"
+
+#include <bit>
+#include <cmath>
+
+namespace culling {
+namespace {
+
+using math::detail::scalar_ops;
+using math::detail::wide_ops;
+
+// Plane coefficients splatted once per call. abs_* are used to project the
+// box extent onto the plane normal.
+template <typename Ops> struct plane_set {
+    typename Ops::type x[6];
+    typename Ops::type y[6];
+    typename Ops::type z[6];
+    typename Ops::type w[6];
+    typename Ops::type abs_x[6];
+    typename Ops::type abs_y[6];
+    typename Ops::type abs_z[6];
+
+    explicit plane_set(const frustum& f) {
+        for (int i = 0; i < 6; ++i) {
+            x[i] = Ops::splat(f.planes[i].x);
+            y[i] = Ops::splat(f.planes[i].y);
+            z[i] = Ops::splat(f.planes[i].z);
+            w[i] = Ops::splat(f.planes[i].w);
+            abs_x[i] = Ops::splat(std::abs(f.planes[i].x));
+            abs_y[i] = Ops::splat(std::abs(f.planes[i].y));
+            abs_z[i] = Ops::splat(std::abs(f.planes[i].z));
+        }
+    }
+};
+
+// Appends base + bit for every lane of `visible_bits`.
+size_t emit(unsigned visible_bits, uint32_t base, uint32_t* visible) {
+    size_t count = 0;
+    while (visible_bits != 0) {
+        visible[count++] = base + std::countr_zero(visible_bits);
+        visible_bits &= visible_bits - 1;
+    }
+    return count;
+}
+
+// Every kernel processes [begin, size()) in steps of Ops::width, advancing
+// `begin` and returning the number of indices written.
+
+template <typename Ops>
+size_t cull_aabbs_impl(const frustum& f,
+                       const aabb_soa& boxes,
+                       size_t& begin,
+                       uint32_t* visible) {
+    using O = Ops;
+    const plane_set<O> p(f);
+    constexpr unsigned all_lanes = (1u << O::width) - 1;
+    size_t count = 0;
+    size_t i = begin;
+    for (; i + O::width <= boxes.size(); i += O::width) {
+        const auto cx = O::load(boxes.center_x.data() + i);
+        const auto cy = O::load(boxes.center_y.data() + i);
+        const auto cz = O::load(boxes.center_z.data() + i);
+        const auto ex = O::load(boxes.extent_x.data() + i);
+        const auto ey = O::load(boxes.extent_y.data() + i);
+        const auto ez = O::load(boxes.extent_z.data() + i);
+        // A box is outside when even its corner furthest along the normal,
+        // at distance d + r, is behind the plane.
+        unsigned outside = 0;
+        for (int j = 0; j < 6; ++j) {
+            auto d = O::mul(p.x[j], cx);
+            d = O::add(d, O::mul(p.y[j], cy));
+            d = O::add(d, O::mul(p.z[j], cz));
+            d = O::add(d, p.w[j]);
+            auto r = O::mul(p.abs_x[j], ex);
+            r = O::add(r, O::mul(p.abs_y[j], ey));
+            r = O::add(r, O::mul(p.abs_z[j], ez));
+            outside |= O::negative_mask(O::add(d, r));
+        }
+        count += emit(~outside & all_lanes,
+                      static_cast<uint32_t>(i),
+                      visible + count);
+    }
+    begin = i;
+    return count;
+}
+
+template <typename Ops>
+size_t cull_spheres_impl(const frustum& f,
+                         const sphere_soa& spheres,
+                         size_t& begin,
+                         uint32_t* visible) {
+    using O = Ops;
+    const plane_set<O> p(f);
+    constexpr unsigned all_lanes = (1u << O::width) - 1;
+    size_t count = 0;
+    size_t i = begin;
+    for (; i + O::width <= spheres.size(); i += O::width) {
+        const auto cx = O::load(spheres.center_x.data() + i);
+        const auto cy = O::load(spheres.center_y.data() + i);
+        const auto cz = O::load(spheres.center_z.data() + i);
+        const auto radius = O::load(spheres.radius.data() + i);
+        unsigned outside = 0;
+        for (int j = 0; j < 6; ++j) {
+            auto d = O::mul(p.x[j], cx);
+            d = O::add(d, O::mul(p.y[j], cy));
+            d = O::add(d, O::mul(p.z[j], cz));
+            d = O::add(d, p.w[j]);
+            outside |= O::negative_mask(O::add(d, radius));
+        }
+        count += emit(~outside & all_lanes,
+                      static_cast<uint32_t>(i),
+                      visible + count);
+    }
+    begin = i;
+    return count;
+}
+
+} // namespace
+
+frustum extract_frustum(const math::mat4& clip) {
+    const auto rows = math::transpose(clip);
+    frustum f{};
+    f.planes[0] = rows[3] + rows[0];         // left
+    f.planes[1] = rows[3] + rows[0] * -1.0f; // right
+    f.planes[2] = rows[3] + rows[1];         // bottom
+    f.planes[3] = rows[3] + rows[1] * -1.0f; // top
+    f.planes[4] = rows[3] + rows[2];         // near
+    f.planes[5] = rows[3] + rows[2] * -1.0f; // far
+    for (auto& plane : f.planes) {
+        const auto length = std::sqrt(plane.x * plane.x + plane.y * plane.y +
+                                      plane.z * plane.z);
+        plane = plane * (1.0f / length);
+    }
+    return f;
+}
+
+// Same operation order as the batch kernels, so both agree on every volume.
+bool is_visible(const frustum& f, const math::aabb& box) {
+    const math::vec3 center((box.min.x + box.max.x) * 0.5f,
+                            (box.min.y + box.max.y) * 0.5f,
+                            (box.min.z + box.max.z) * 0.5f);
+    const math::vec3 extent((box.max.x - box.min.x) * 0.5f,
+                            (box.max.y - box.min.y) * 0.5f,
+                            (box.max.z - box.min.z) * 0.5f);
+    for (const auto& plane : f.planes) {
+        const auto d = plane.x * center.x + plane.y * center.y +
+                       plane.z * center.z + plane.w;
+        const auto r = std::abs(plane.x) * extent.x +
+                       std::abs(plane.y) * extent.y +
+                       std::abs(plane.z) * extent.z;
+        if (d + r < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool is_visible(const frustum& f, const math::sphere& s) {
+    for (const auto& plane : f.planes) {
+        const auto d = plane.x * s.center.x + plane.y * s.center.y +
+                       plane.z * s.center.z + plane.w;
+        if (d + s.radius < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void aabb_soa::resize(size_t count) {
+    center_x.resize(count);
+    center_y.resize(count);
+    center_z.resize(count);
+    extent_x.resize(count);
+    extent_y.resize(count);
+    extent_z.resize(count);
+}
+
+void aabb_soa::set(size_t i, const math::aabb& box) {
+    center_x[i] = (box.min.x + box.max.x) * 0.5f;
+    center_y[i] = (box.min.y + box.max.y) * 0.5f;
+    center_z[i] = (box.min.z + box.max.z) * 0.5f;
+    extent_x[i] = (box.max.x - box.min.x) * 0.5f;
+    extent_y[i] = (box.max.y - box.min.y) * 0.5f;
+    extent_z[i] = (box.max.z - box.min.z) * 0.5f;
+}
+
+void sphere_soa::resize(size_t count) {
+    center_x.resize(count);
+    center_y.resize(count);
+    center_z.resize(count);
+    radius.resize(count);
+}
+
+void sphere_soa::set(size_t i, const math::sphere& s) {
+    center_x[i] = s.center.x;
+    center_y[i] = s.center.y;
+    center_z[i] = s.center.z;
+    radius[i] = s.radius;
+}
+
+size_t cull(const frustum& f, const aabb_soa& boxes, uint32_t* visible) {
+    size_t i = 0;
+    auto count = cull_aabbs_impl<wide_ops>(f, boxes, i, visible);
+    count += cull_aabbs_impl<scalar_ops>(f, boxes, i, visible + count);
+    return count;
+}
+
+size_t cull(const frustum& f, const sphere_soa& spheres, uint32_t* visible) {
+    size_t i = 0;
+    auto count = cull_spheres_impl<wide_ops>(f, spheres, i, visible);
+    count += cull_spheres_impl<scalar_ops>(f, spheres, i, visible + count);
+    return count;
+}
+
+} // namespace culling
@@ -0,0 +1,62 @@
+#ifndef CULLING_HPP
+#define CULLING_HPP
+
+#include "mathlib.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// View frustum culling of object bounds. The batch functions test 8 (AVX2) or
+// 4 (SSE, NEON) volumes per iteration against all six planes.
+namespace culling {
+
+// Planes as (normal, distance) with unit normals pointing inside, so a point p
+// is inside a plane when dot(normal, p) + distance >= 0.
+struct frustum {
+    math::vec4 planes[6];
+};
+
+// Gribb-Hartmann extraction from a clip matrix with GL depth (-1..1). Passing
+// proj * view gives world space planes, proj * view * model object space ones.
+frustum extract_frustum(const math::mat4& clip);
+
+// A volume is culled only when it lies fully behind one of the planes, so
+// boxes near the frustum corners can be reported visible.
+bool is_visible(const frustum& f, const math::aabb& box);
+bool is_visible(const frustum& f, const math::sphere& s);
+
+// Boxes stored as center and half extent, one array per component.
+struct aabb_soa {
+    std::vector<float> center_x;
+    std::vector<float> center_y;
+    std::vector<float> center_z;
+    std::vector<float> extent_x;
+    std::vector<float> extent_y;
+    std::vector<float> extent_z;
+
+    void resize(size_t count);
+    size_t size() const { return center_x.size(); }
+    void set(size_t i, const math::aabb& box);
+};
+
+struct sphere_soa {
+    std::vector<float> center_x;
+    std::vector<float> center_y;
+    std::vector<float> center_z;
+    std::vector<float> radius;
+
+    void resize(size_t count);
+    size_t size() const { return center_x.size(); }
+    void set(size_t i, const math::sphere& s);
+};
+
+// Writes the indices of the visible volumes, in increasing order, to
+// `visible` and returns how many there are. `visible` must have room for
+// size() entries. The result matches calling is_visible on every volume.
+size_t cull(const frustum& f, const aabb_soa& boxes, uint32_t* visible);
+size_t cull(const frustum& f, const sphere_soa& spheres, uint32_t* visible);
+
+} // namespace culling
+
+#endif
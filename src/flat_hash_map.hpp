@@ -0,0 +1,122 @@
+#ifndef FLAT_HASH_MAP_HPP
+#define FLAT_HASH_MAP_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Open-addressing hash map with linear probing. Keys and values live inline
+// in one slot array next to a byte per slot holding 7 bits of the hash, so a
+// probe scans a dense byte array and only compares keys on a tag match.
+// Inserting never allocates unless the table grows. There is no erase, the
+// map is meant for tables that are built once, like vertex deduplication.
+template <typename Key,
+          typename Value,
+          typename Hash,
+          typename Equal = std::equal_to<Key>>
+class flat_hash_map {
+  public:
+    flat_hash_map() = default;
+
+    // Makes room for `count` entries without rehashing.
+    void reserve(size_t count) {
+        size_t capacity = 16;
+        while (capacity * max_load_num < count * max_load_den) {
+            capacity *= 2;
+        }
+        if (capacity > tags.size()) {
+            rehash(capacity);
+        }
+    }
+
+    // Inserts `value` unless `key` is already present. Returns the stored
+    // value and whether it was inserted, with a single probe sequence.
+    std::pair<Value*, bool> try_emplace(const Key& key, const Value& value) {
+        if ((count + 1) * max_load_den > tags.size() * max_load_num) {
+            rehash(tags.empty() ? 16 : tags.size() * 2);
+        }
+        const auto h = static_cast<uint64_t>(Hash{}(key));
+        const auto tag = tag_of(h);
+        const auto mask = tags.size() - 1;
+        for (auto i = static_cast<size_t>(h) & mask;; i = (i + 1) & mask) {
+            if (tags[i] == empty) {
+                tags[i] = tag;
+                slots[i] = {key, value};
+                ++count;
+                return {&slots[i].value, true};
+            }
+            if (tags[i] == tag && Equal{}(slots[i].key, key)) {
+                return {&slots[i].value, false};
+            }
+        }
+    }
+
+    Value* find(const Key& key) {
+        if (count == 0) {
+            return nullptr;
+        }
+        const auto h = static_cast<uint64_t>(Hash{}(key));
+        const auto tag = tag_of(h);
+        const auto mask = tags.size() - 1;
+        for (auto i = static_cast<size_t>(h) & mask;; i = (i + 1) & mask) {
+            if (tags[i] == empty) {
+                return nullptr;
+            }
+            if (tags[i] == tag && Equal{}(slots[i].key, key)) {
+                return &slots[i].value;
+            }
+        }
+    }
+
+    size_t size() const { return count; }
+    size_t capacity() const { return tags.size(); }
+
+    void clear() {
+        std::fill(tags.begin(), tags.end(), empty);
+        count = 0;
+    }
+
+  private:
+    struct slot {
+        Key key;
+        Value value;
+    };
+
+    static constexpr uint8_t empty = 0;
+    static constexpr size_t max_load_num = 3;
+    static constexpr size_t max_load_den = 4;
+
+    // Top bits, since the low ones already pick the slot. Never `empty`.
+    static uint8_t tag_of(uint64_t h) {
+        return static_cast<uint8_t>(h >> 57) | 0x80;
+    }
+
+    void rehash(size_t new_capacity) {
+        auto old_tags = std::move(tags);
+        auto old_slots = std::move(slots);
+        tags.assign(new_capacity, empty);
+        slots.resize(new_capacity);
+        const auto mask = new_capacity - 1;
+        for (size_t j = 0; j < old_tags.size(); ++j) {
+            if (old_tags[j] == empty) {
+                continue;
+            }
+            const auto h = static_cast<uint64_t>(Hash{}(old_slots[j].key));
+            auto i = static_cast<size_t>(h) & mask;
+            while (tags[i] != empty) {
+                i = (i + 1) & mask;
+            }
+            tags[i] = old_tags[j];
+            slots[i] = std::move(old_slots[j]);
+        }
+    }
+
+    std::vector<uint8_t> tags;
+    std::vector<slot> slots;
+    size_t count = 0;
+};
+
+#endif
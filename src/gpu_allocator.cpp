@@ -0,0 +1,553 @@
+#include "gpu_allocator.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+
+constexpr uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Size class of `size`: the first level is the position of its top bit, the
+// second the sl_bits bits below it. Sizes under sl_count map one to one.
+template <uint32_t sl_bits>
+void size_class(uint64_t size, uint32_t& fl, uint32_t& sl) {
+    constexpr auto sl_count = 1u << sl_bits;
+    if (size < sl_count) {
+        fl = 0;
+        sl = static_cast<uint32_t>(size);
+        return;
+    }
+    const auto top = static_cast<uint32_t>(std::bit_width(size)) - 1;
+    fl = top - sl_bits + 1;
+    sl = static_cast<uint32_t>(size >> (top - sl_bits)) - sl_count;
+}
+
+} // namespace
+
+gpu_allocator::pool::pool(uint32_t memory_type, gpu_resource_kind kind)
+    : memory_type(memory_type), kind(kind) {
+    for (auto& level : heads) {
+        level.fill(no_node);
+    }
+}
+
+gpu_allocator::gpu_allocator(gpu_memory_device device, uint64_t block_size)
+    : device(std::move(device)) {
+    block_sizes.fill(block_size);
+}
+
+gpu_allocator::gpu_allocator(gpu_memory_device device,
+                             std::span<const uint64_t> block_sizes)
+    : gpu_allocator(std::move(device)) {
+    std::copy_n(block_sizes.begin(),
+                std::min<size_t>(block_sizes.size(), max_memory_types),
+                this->block_sizes.begin());
+}
+
+gpu_allocator::~gpu_allocator() {
+    for (const auto& p : pools) {
+        if (!p) {
+            continue;
+        }
+        for (const auto& b : p->blocks) {
+            if (b.live) {
+                device.free(b.memory);
+            }
+        }
+    }
+}
+
+gpu_allocation gpu_allocator::allocate(const gpu_memory_request& request) {
+    const auto size = std::max<uint64_t>(request.size, 1);
+    const auto alignment = std::max<uint64_t>(request.alignment, 1);
+    std::lock_guard lock(mutex);
+
+    gpu_allocation allocation;
+    if (request.dedicated || size > block_sizes[request.memory_type] / 2) {
+        const auto memory = device.allocate(request.memory_type,
+                                            size,
+                                            request.kind,
+                                            request.resource);
+        if (memory.memory == 0) {
+            return {};
+        }
+        allocation.memory = memory.memory;
+        allocation.size = size;
+        allocation.mapped = memory.mapped;
+        ++dedicated_count;
+        dedicated_bytes += size;
+        return allocation;
+    }
+
+    auto& p = pool_for(request.memory_type, request.kind);
+    auto index = find_fit(p, size, alignment);
+    if (index == no_node) {
+        // A new block starts at offset 0, aligned for anything.
+        index = add_block(p, size);
+        if (index == no_node) {
+            return {};
+        }
+    }
+    return allocation_of(p, take(p, index, size, alignment));
+}
+
+void gpu_allocator::free(gpu_allocation& allocation) {
+    if (!allocation) {
+        return;
+    }
+    std::lock_guard lock(mutex);
+    if (allocation.pool == gpu_allocation::dedicated_pool) {
+        device.free({allocation.memory, allocation.mapped});
+        --dedicated_count;
+        dedicated_bytes -= allocation.size;
+        allocation = {};
+        return;
+    }
+    release(*pools[allocation.pool], allocation.node);
+    allocation = {};
+}
+
+gpu_allocator_stats gpu_allocator::stats() const {
+    std::lock_guard lock(mutex);
+    gpu_allocator_stats result;
+    result.dedicated_count = dedicated_count;
+    result.allocation_count = dedicated_count;
+    result.reserved_bytes = dedicated_bytes;
+    result.used_bytes = dedicated_bytes;
+    for (const auto& p : pools) {
+        if (!p) {
+            continue;
+        }
+        for (const auto& b : p->blocks) {
+            if (b.live) {
+                ++result.block_count;
+                result.reserved_bytes += b.size;
+            }
+        }
+        result.allocation_count += p->allocation_count;
+        result.used_bytes += p->used_bytes;
+    }
+    return result;
+}
+
+std::vector<gpu_defragment_move>
+gpu_allocator::plan_defragmentation(std::span<gpu_allocation* const> movable,
+                                    uint64_t max_bytes) {
+    std::lock_guard lock(mutex);
+    std::unordered_map<uint64_t, gpu_allocation*> owners;
+    for (auto* allocation : movable) {
+        if (*allocation && allocation->pool != gpu_allocation::dedicated_pool) {
+            owners.emplace(uint64_t{allocation->pool} << 32 | allocation->node,
+                           allocation);
+        }
+    }
+
+    std::vector<gpu_defragment_move> moves;
+    uint64_t planned_bytes = 0;
+    for (uint32_t pool_index = 0; pool_index < pools.size(); ++pool_index) {
+        if (!pools[pool_index] || pools[pool_index]->live_blocks < 2) {
+            continue;
+        }
+        auto& p = *pools[pool_index];
+        // Blocks given moves are kept, the others are emptied sparsest
+        // first, as those take the least copying per block returned.
+        std::vector<bool> targets(p.blocks.size(), false);
+        std::vector<uint32_t> candidates;
+        for (uint32_t i = 0; i < p.blocks.size(); ++i) {
+            const auto& b = p.blocks[i];
+            if (b.live && !b.evacuating && b.used_bytes > 0) {
+                candidates.push_back(i);
+            }
+        }
+        std::sort(candidates.begin(),
+                  candidates.end(),
+                  [&](uint32_t a, uint32_t b) {
+                      return p.blocks[a].used_bytes < p.blocks[b].used_bytes;
+                  });
+
+        for (const auto source : candidates) {
+            const auto& b = p.blocks[source];
+            if (targets[source] || (!moves.empty() &&
+                                    planned_bytes + b.used_bytes > max_bytes)) {
+                continue;
+            }
+            uint64_t free_elsewhere = 0;
+            for (uint32_t i = 0; i < p.blocks.size(); ++i) {
+                const auto& other = p.blocks[i];
+                if (i != source && other.live && !other.evacuating) {
+                    free_elsewhere += other.size - other.used_bytes;
+                }
+            }
+            if (b.used_bytes > free_elsewhere) {
+                continue;
+            }
+            std::vector<std::pair<uint32_t, gpu_allocation*>> used;
+            bool all_movable = true;
+            for (auto i = b.first_node; i != no_node;
+                 i = p.nodes[i].next_physical) {
+                if (p.nodes[i].free) {
+                    continue;
+                }
+                const auto owner = owners.find(uint64_t{pool_index} << 32 | i);
+                if (owner == owners.end()) {
+                    all_movable = false;
+                    break;
+                }
+                used.emplace_back(i, owner->second);
+            }
+            if (!all_movable) {
+                continue;
+            }
+
+            // Locked first, so none of the allocations lands back in it.
+            lock_block(p, source);
+            const auto first_move = moves.size();
+            for (const auto& [index, owner] : used) {
+                const auto size = p.nodes[index].size;
+                const auto alignment = p.nodes[index].alignment;
+                const auto destination = find_fit(p, size, alignment);
+                if (destination == no_node) {
+                    break;
+                }
+                moves.push_back(
+                    {owner,
+                     allocation_of(p, take(p, destination, size, alignment))});
+            }
+            if (moves.size() - first_move < used.size()) {
+                for (auto i = first_move; i < moves.size(); ++i) {
+                    release(p, moves[i].destination.node);
+                }
+                moves.resize(first_move);
+                unlock_block(p, source);
+                continue;
+            }
+            for (auto i = first_move; i < moves.size(); ++i) {
+                targets[p.nodes[moves[i].destination.node].block] = true;
+            }
+            planned_bytes += b.used_bytes;
+        }
+    }
+    return moves;
+}
+
+gpu_defragment_stats
+gpu_allocator::commit_defragmentation(std::span<gpu_defragment_move> moves) {
+    std::lock_guard lock(mutex);
+    gpu_defragment_stats result;
+    uint32_t blocks_before = 0;
+    uint64_t bytes_before = 0;
+    for (const auto& p : pools) {
+        if (p) {
+            for (const auto& b : p->blocks) {
+                blocks_before += b.live;
+                bytes_before += b.live ? b.size : 0;
+            }
+        }
+    }
+
+    // Sources are freed into unlocked blocks, which go back to the device
+    // once the last of them is gone.
+    for (const auto& p : pools) {
+        if (!p) {
+            continue;
+        }
+        for (uint32_t i = 0; i < p->blocks.size(); ++i) {
+            if (p->blocks[i].live && p->blocks[i].evacuating) {
+                unlock_block(*p, i);
+            }
+        }
+    }
+    for (auto& move : moves) {
+        auto& p = *pools[move.destination.pool];
+        auto& source = *move.allocation;
+        if (!source) {
+            release(p, move.destination.node);
+            continue;
+        }
+        release(p, source.node);
+        source = move.destination;
+        ++result.move_count;
+        result.bytes_moved += source.size;
+    }
+
+    for (const auto& p : pools) {
+        if (p) {
+            for (const auto& b : p->blocks) {
+                blocks_before -= b.live;
+                bytes_before -= b.live ? b.size : 0;
+            }
+        }
+    }
+    result.blocks_freed = blocks_before;
+    result.bytes_freed = bytes_before;
+    return result;
+}
+
+gpu_allocator::pool& gpu_allocator::pool_for(uint32_t memory_type,
+                                             gpu_resource_kind kind) {
+    auto& p = pools[2 * memory_type + static_cast<uint32_t>(kind)];
+    if (!p) {
+        p = std::make_unique<pool>(memory_type, kind);
+    }
+    return *p;
+}
+
+uint32_t gpu_allocator::add_block(pool& p, uint64_t min_size) {
+    // The first blocks of a memory type are smaller, so types that only hold
+    // a few small resources do not reserve a whole block.
+    const auto block_size = block_sizes[p.memory_type];
+    const auto preferred =
+        std::max(block_size >> (3 - std::min(p.live_blocks, 3u)), min_size);
+    auto memory = device.allocate(p.memory_type, preferred, p.kind, 0);
+    auto size = preferred;
+    if (memory.memory == 0 && preferred > min_size) {
+        memory = device.allocate(p.memory_type, min_size, p.kind, 0);
+        size = min_size;
+    }
+    if (memory.memory == 0) {
+        return no_node;
+    }
+
+    auto slot = static_cast<uint32_t>(
+        std::find_if(p.blocks.begin(),
+                     p.blocks.end(),
+                     [](const block& b) { return !b.live; }) -
+        p.blocks.begin());
+    if (slot == p.blocks.size()) {
+        p.blocks.emplace_back();
+    }
+    const auto index = new_node(p);
+    p.blocks[slot] = {memory, size, index, 0, true, false};
+    ++p.live_blocks;
+
+    p.nodes[index] = {
+        0, size, slot, no_node, no_node, no_node, no_node, 1, true};
+    insert_free(p, index);
+    return index;
+}
+
+uint32_t gpu_allocator::find_free(const pool& p, uint64_t size) const {
+    // Rounded up to the next class, every range in the class found fits.
+    if (size >= sl_count) {
+        const auto top = static_cast<uint32_t>(std::bit_width(size)) - 1;
+        size += (uint64_t{1} << (top - sl_bits)) - 1;
+    }
+    uint32_t fl;
+    uint32_t sl;
+    size_class<sl_bits>(size, fl, sl);
+    if (fl >= fl_count) {
+        return no_node;
+    }
+    auto sl_map = p.sl_bitmaps[fl] & (~0u << sl);
+    if (sl_map == 0) {
+        const auto fl_map =
+            fl + 1 < 64 ? p.fl_bitmap & (~uint64_t{0} << (fl + 1)) : 0;
+        if (fl_map == 0) {
+            return no_node;
+        }
+        fl = static_cast<uint32_t>(std::countr_zero(fl_map));
+        sl_map = p.sl_bitmaps[fl];
+    }
+    sl = static_cast<uint32_t>(std::countr_zero(sl_map));
+    return p.heads[fl][sl];
+}
+
+uint32_t gpu_allocator::find_fit(const pool& p,
+                                 uint64_t size,
+                                 uint64_t alignment) const {
+    // The first range of the size's class is taken when it has room for the
+    // alignment, otherwise one a whole alignment larger, which always has.
+    const auto fits = [&](uint32_t index) {
+        if (index == no_node) {
+            return false;
+        }
+        const auto& n = p.nodes[index];
+        return align_up(n.offset, alignment) + size <= n.offset + n.size;
+    };
+    auto index = find_free(p, size);
+    if (!fits(index)) {
+        index = find_free(p, size + alignment - 1);
+    }
+    return index;
+}
+
+// Cuts `size` bytes at `alignment` out of the free range at `index`.
+uint32_t gpu_allocator::take(pool& p,
+                             uint32_t index,
+                             uint64_t size,
+                             uint64_t alignment) {
+    remove_free(p, index);
+    const auto padding =
+        align_up(p.nodes[index].offset, alignment) - p.nodes[index].offset;
+    if (padding > 0) {
+        const auto rest = split(p, index, padding);
+        insert_free(p, index);
+        index = rest;
+    }
+    if (p.nodes[index].size > size) {
+        insert_free(p, split(p, index, size));
+    }
+    auto& n = p.nodes[index];
+    n.free = false;
+    n.alignment = alignment;
+    ++p.allocation_count;
+    p.used_bytes += n.size;
+    p.blocks[n.block].used_bytes += n.size;
+    return index;
+}
+
+gpu_allocation gpu_allocator::allocation_of(const pool& p,
+                                            uint32_t index) const {
+    const auto& n = p.nodes[index];
+    const auto& b = p.blocks[n.block];
+    gpu_allocation allocation;
+    allocation.memory = b.memory.memory;
+    allocation.offset = n.offset;
+    allocation.size = n.size;
+    allocation.mapped = b.memory.mapped ? b.memory.mapped + n.offset : nullptr;
+    allocation.pool = 2 * p.memory_type + static_cast<uint32_t>(p.kind);
+    allocation.node = index;
+    return allocation;
+}
+
+void gpu_allocator::release(pool& p, uint32_t index) {
+    auto& b = p.blocks[p.nodes[index].block];
+    p.nodes[index].free = true;
+    --p.allocation_count;
+    p.used_bytes -= p.nodes[index].size;
+    b.used_bytes -= p.nodes[index].size;
+
+    // Free ranges of a locked block are not in the lists.
+    const auto prev = p.nodes[index].prev_physical;
+    if (prev != no_node && p.nodes[prev].free) {
+        if (!b.evacuating) {
+            remove_free(p, prev);
+        }
+        merge(p, prev, index);
+        index = prev;
+    }
+    const auto next = p.nodes[index].next_physical;
+    if (next != no_node && p.nodes[next].free) {
+        if (!b.evacuating) {
+            remove_free(p, next);
+        }
+        merge(p, index, next);
+    }
+
+    // Empty blocks go back to the device, but the last one is kept so a
+    // pool that is filled and emptied in turns does not churn.
+    if (b.used_bytes == 0 && p.live_blocks > 1) {
+        device.free(b.memory);
+        b.live = false;
+        b.evacuating = false;
+        --p.live_blocks;
+        p.unused_nodes.push_back(index);
+        return;
+    }
+    if (!b.evacuating) {
+        insert_free(p, index);
+    }
+}
+
+void gpu_allocator::lock_block(pool& p, uint32_t block_index) {
+    auto& b = p.blocks[block_index];
+    for (auto i = b.first_node; i != no_node; i = p.nodes[i].next_physical) {
+        if (p.nodes[i].free) {
+            remove_free(p, i);
+        }
+    }
+    b.evacuating = true;
+}
+
+void gpu_allocator::unlock_block(pool& p, uint32_t block_index) {
+    auto& b = p.blocks[block_index];
+    for (auto i = b.first_node; i != no_node; i = p.nodes[i].next_physical) {
+        if (p.nodes[i].free) {
+            insert_free(p, i);
+        }
+    }
+    b.evacuating = false;
+}
+
+uint32_t gpu_allocator::new_node(pool& p) {
+    if (!p.unused_nodes.empty()) {
+        const auto index = p.unused_nodes.back();
+        p.unused_nodes.pop_back();
+        return index;
+    }
+    p.nodes.emplace_back();
+    return static_cast<uint32_t>(p.nodes.size() - 1);
+}
+
+void gpu_allocator::insert_free(pool& p, uint32_t index) {
+    auto& n = p.nodes[index];
+    uint32_t fl;
+    uint32_t sl;
+    size_class<sl_bits>(n.size, fl, sl);
+    n.free = true;
+    n.prev_free = no_node;
+    n.next_free = p.heads[fl][sl];
+    if (n.next_free != no_node) {
+        p.nodes[n.next_free].prev_free = index;
+    }
+    p.heads[fl][sl] = index;
+    p.sl_bitmaps[fl] |= 1u << sl;
+    p.fl_bitmap |= uint64_t{1} << fl;
+}
+
+void gpu_allocator::remove_free(pool& p, uint32_t index) {
+    const auto& n = p.nodes[index];
+    if (n.prev_free != no_node) {
+        p.nodes[n.prev_free].next_free = n.next_free;
+    }
+    if (n.next_free != no_node) {
+        p.nodes[n.next_free].prev_free = n.prev_free;
+    }
+    uint32_t fl;
+    uint32_t sl;
+    size_class<sl_bits>(n.size, fl, sl);
+    if (p.heads[fl][sl] == index) {
+        p.heads[fl][sl] = n.next_free;
+        if (n.next_free == no_node) {
+            p.sl_bitmaps[fl] &= ~(1u << sl);
+            if (p.sl_bitmaps[fl] == 0) {
+                p.fl_bitmap &= ~(uint64_t{1} << fl);
+            }
+        }
+    }
+}
+
+// Cuts the range at `index` after `size` bytes, returning the second part.
+uint32_t gpu_allocator::split(pool& p, uint32_t index, uint64_t size) {
+    const auto rest = new_node(p);
+    auto& n = p.nodes[index];
+    auto& r = p.nodes[rest];
+    r.offset = n.offset + size;
+    r.size = n.size - size;
+    r.block = n.block;
+    r.prev_physical = index;
+    r.next_physical = n.next_physical;
+    r.free = n.free;
+    if (r.next_physical != no_node) {
+        p.nodes[r.next_physical].prev_physical = rest;
+    }
+    n.size = size;
+    n.next_physical = rest;
+    return rest;
+}
+
+// Joins `next` into the range at `index` before it.
+void gpu_allocator::merge(pool& p, uint32_t index, uint32_t next) {
+    auto& n = p.nodes[index];
+    const auto& m = p.nodes[next];
+    n.size += m.size;
+    n.next_physical = m.next_physical;
+    if (n.next_physical != no_node) {
+        p.nodes[n.next_physical].prev_physical = index;
+    }
+    p.unused_nodes.push_back(next);
+}
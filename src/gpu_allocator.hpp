@@ -0,0 +1,228 @@
+#ifndef GPU_ALLOCATOR_HPP
+#define GPU_ALLOCATOR_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+// Sub-allocates buffers and images from large device memory blocks, so a
+// scene takes a handful of device allocations instead of one per resource.
+// Every memory type gets its own blocks, grown from an eighth of the block
+// size up to it, and each pool of blocks is managed as a two level
+// segregated fit: free ranges are binned by size on a two level bitmap, so
+// finding and freeing one takes constant time, and freed ranges merge with
+// free neighbors. Large requests get memory of their own.
+//
+// Freeing resources leaves blocks partly used, so the allocator can also
+// plan compacting its pools: allocations are moved out of the sparsest
+// blocks into the free ranges of the others, the caller copies them and
+// rebinds its resources, and the emptied blocks go back to the device.
+//
+// The allocator only sees opaque memory handles through gpu_memory_device,
+// which the renderer implements over Vulkan, so it runs without a GPU.
+
+// Linear resources are buffers and linearly tiled images, optimal ones are
+// optimally tiled images. The two are kept in different blocks, so
+// neighbors never share a bufferImageGranularity page.
+enum class gpu_resource_kind : uint8_t {
+    linear,
+    optimal,
+};
+
+struct gpu_memory_block {
+    // Null when the device is out of memory.
+    uint64_t memory = 0;
+    // Persistently mapped start of the block for host visible memory types.
+    std::byte* mapped = nullptr;
+};
+
+struct gpu_memory_device {
+    // Allocates `size` bytes of `memory_type`. `dedicated_resource` is the
+    // buffer or image the memory is dedicated to, or 0 for a shared block.
+    std::function<gpu_memory_block(uint32_t memory_type,
+                                   uint64_t size,
+                                   gpu_resource_kind kind,
+                                   uint64_t dedicated_resource)>
+        allocate;
+    std::function<void(const gpu_memory_block& block)> free;
+};
+
+struct gpu_memory_request {
+    uint64_t size = 0;
+    uint64_t alignment = 1;
+    uint32_t memory_type = 0;
+    gpu_resource_kind kind = gpu_resource_kind::linear;
+    // Asks for memory of its own, as drivers prefer for some resources.
+    // Requests above half the block size of their memory type always get it.
+    bool dedicated = false;
+    // Buffer or image handle passed on for dedicated memory.
+    uint64_t resource = 0;
+};
+
+struct gpu_allocation {
+    uint64_t memory = 0;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    // Start of the allocation for host visible memory types.
+    std::byte* mapped = nullptr;
+
+    explicit operator bool() const { return memory != 0; }
+
+  private:
+    friend class gpu_allocator;
+    static constexpr uint32_t dedicated_pool = UINT32_MAX;
+    uint32_t pool = dedicated_pool;
+    uint32_t node = 0;
+};
+
+// Planned by gpu_allocator::plan_defragmentation. `allocation` is the
+// owner's, still holding the source, and the caller copies its contents to
+// `destination` before committing the move.
+struct gpu_defragment_move {
+    gpu_allocation* allocation = nullptr;
+    gpu_allocation destination;
+};
+
+struct gpu_defragment_stats {
+    uint32_t move_count = 0;
+    uint64_t bytes_moved = 0;
+    uint32_t blocks_freed = 0;
+    // Device memory returned with the emptied blocks.
+    uint64_t bytes_freed = 0;
+};
+
+struct gpu_allocator_stats {
+    uint32_t block_count = 0;
+    uint32_t dedicated_count = 0;
+    uint32_t allocation_count = 0;
+    // Device memory held, in blocks and dedicated allocations.
+    uint64_t reserved_bytes = 0;
+    // Of that, given out to resources.
+    uint64_t used_bytes = 0;
+};
+
+class gpu_allocator {
+  public:
+    static constexpr uint64_t default_block_size = 64ull << 20;
+    static constexpr uint32_t max_memory_types = 32;
+
+    gpu_allocator(gpu_memory_device device,
+                  uint64_t block_size = default_block_size);
+    // Blocks of every memory type sized by `block_sizes`, indexed by memory
+    // type. Types past its end use default_block_size.
+    gpu_allocator(gpu_memory_device device,
+                  std::span<const uint64_t> block_sizes);
+    // Returns every block to the device. Allocations still live are lost.
+    ~gpu_allocator();
+
+    gpu_allocator(const gpu_allocator&) = delete;
+    gpu_allocator& operator=(const gpu_allocator&) = delete;
+
+    // Returns an empty allocation when the device is out of memory.
+    gpu_allocation allocate(const gpu_memory_request& request);
+    // Frees and clears `allocation`. Empty allocations are ignored.
+    void free(gpu_allocation& allocation);
+
+    gpu_allocator_stats stats() const;
+
+    // Plans moving allocations out of the sparsest blocks of each pool into
+    // free ranges of its other blocks, for about `max_bytes`, but at least
+    // one block. A block is only emptied when every allocation in it is in
+    // `movable` and fits elsewhere; nothing new is placed in it until the
+    // moves are committed, so one pass is planned at a time. Returns no
+    // moves when no block can be emptied.
+    std::vector<gpu_defragment_move>
+    plan_defragmentation(std::span<gpu_allocation* const> movable,
+                         uint64_t max_bytes);
+    // Once the contents are copied and the sources no longer used, frees the
+    // sources, hands the destinations to their owners and returns the
+    // emptied blocks. Moves whose owner freed the source meanwhile drop
+    // their destination instead.
+    gpu_defragment_stats
+    commit_defragmentation(std::span<gpu_defragment_move> moves);
+
+  private:
+    static constexpr uint32_t sl_bits = 5;
+    static constexpr uint32_t sl_count = 1u << sl_bits;
+    static constexpr uint32_t fl_count = 64 - sl_bits + 1;
+    static constexpr uint32_t no_node = UINT32_MAX;
+
+    // A range of a block, free or used. Ranges of a block are linked in
+    // address order, free ones also in the list of their size class.
+    struct node {
+        uint64_t offset;
+        uint64_t size;
+        uint32_t block;
+        uint32_t prev_physical;
+        uint32_t next_physical;
+        uint32_t prev_free;
+        uint32_t next_free;
+        // Of the request, for moving the allocation.
+        uint64_t alignment;
+        bool free;
+    };
+
+    struct block {
+        gpu_memory_block memory;
+        uint64_t size;
+        // The range at offset 0, which splits and merges keep in place.
+        uint32_t first_node;
+        uint64_t used_bytes;
+        // False once the block is returned to the device, until its slot is
+        // reused.
+        bool live;
+        // Being emptied by defragmentation: its free ranges are out of the
+        // size class lists until the moves are committed.
+        bool evacuating;
+    };
+
+    struct pool {
+        uint32_t memory_type;
+        gpu_resource_kind kind;
+        std::vector<node> nodes;
+        std::vector<uint32_t> unused_nodes;
+        std::vector<block> blocks;
+        uint32_t live_blocks = 0;
+        uint64_t fl_bitmap = 0;
+        std::array<uint32_t, fl_count> sl_bitmaps{};
+        std::array<std::array<uint32_t, sl_count>, fl_count> heads;
+        uint64_t used_bytes = 0;
+        uint32_t allocation_count = 0;
+
+        pool(uint32_t memory_type, gpu_resource_kind kind);
+    };
+
+    pool& pool_for(uint32_t memory_type, gpu_resource_kind kind);
+    // Returns the free range spanning the new block.
+    uint32_t add_block(pool& p, uint64_t min_size);
+    uint32_t find_free(const pool& p, uint64_t size) const;
+    // A free range `size` bytes at `alignment` fit in, or no_node.
+    uint32_t find_fit(const pool& p, uint64_t size, uint64_t alignment) const;
+    uint32_t take(pool& p, uint32_t index, uint64_t size, uint64_t alignment);
+    gpu_allocation allocation_of(const pool& p, uint32_t index) const;
+    void release(pool& p, uint32_t index);
+    // Takes the free ranges of a block out of the free lists, or puts them
+    // back.
+    void lock_block(pool& p, uint32_t block_index);
+    void unlock_block(pool& p, uint32_t block_index);
+    uint32_t new_node(pool& p);
+    void insert_free(pool& p, uint32_t index);
+    void remove_free(pool& p, uint32_t index);
+    uint32_t split(pool& p, uint32_t index, uint64_t size);
+    void merge(pool& p, uint32_t index, uint32_t next);
+
+    gpu_memory_device device;
+    std::array<uint64_t, max_memory_types> block_sizes;
+    mutable std::mutex mutex;
+    // One per memory type and resource kind, made on first use.
+    std::array<std::unique_ptr<pool>, 2 * max_memory_types> pools;
+    uint32_t dedicated_count = 0;
+    uint64_t dedicated_bytes = 0;
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+// 64-bit hashing of raw bytes, following wyhash (public domain). Every input
+// bit affects every output bit, unlike combining per-float std::hash values
+// with shifts and xors.
+namespace hash {
+namespace detail {
+
+constexpr uint64_t secret[4] = {0xa0761d6478bd642full,
+                                0xe7037ed1a0b428dbull,
+                                0x8ebc6af09c88c6e3ull,
+                                0x589965cc75374cc3ull};
+
+// Full 64x64 -> 128 bit product, returned as its two halves.
+inline void multiply(uint64_t& a, uint64_t& b) {
+#if defined(__SIZEOF_INT128__)
+    const auto r = static_cast<unsigned __int128>(a) * b;
+    a = static_cast<uint64_t>(r);
+    b = static_cast<uint64_t>(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    a = _umul128(a, b, &b);
+#else
+    const uint64_t ha = a >> 32, hb = b >> 32;
+    const uint64_t la = static_cast<uint32_t>(a), lb = static_cast<uint32_t>(b);
+    const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    const uint64_t t = rl + (rm0 << 32);
+    uint64_t c = t < rl;
+    const uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    a = lo;
+    b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+inline uint64_t mix(uint64_t a, uint64_t b) {
+    multiply(a, b);
+    return a ^ b;
+}
+
+inline uint64_t read64(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t read32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// 1 to 3 bytes.
+inline uint64_t read_small(const uint8_t* p, size_t size) {
+    return (static_cast<uint64_t>(p[0]) << 16) |
+           (static_cast<uint64_t>(p[size >> 1]) << 8) | p[size - 1];
+}
+
+} // namespace detail
+
+inline uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0) {
+    using detail::read32;
+    using detail::read64;
+    using detail::secret;
+
+    const auto* p = static_cast<const uint8_t*>(data);
+    seed ^= detail::mix(seed ^ secret[0], secret[1]);
+    uint64_t a = 0;
+    uint64_t b = 0;
+    if (size <= 16) {
+        if (size >= 4) {
+            const auto offset = (size >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + offset);
+            b = (read32(p + size - 4) << 32) | read32(p + size - 4 - offset);
+        } else if (size > 0) {
+            a = detail::read_small(p, size);
+        }
+    } else {
+        auto remaining = size;
+        if (remaining > 48) {
+            auto seed1 = seed;
+            auto seed2 = seed;
+            do {
+                seed = detail::mix(read64(p) ^ secret[1], read64(p + 8) ^ seed);
+                seed1 = detail::mix(read64(p + 16) ^ secret[2],
+                                    read64(p + 24) ^ seed1);
+                seed2 = detail::mix(read64(p + 32) ^ secret[3],
+                                    read64(p + 40) ^ seed2);
+                p += 48;
+                remaining -= 48;
+            } while (remaining > 48);
+            seed ^= seed1 ^ seed2;
+        }
+        while (remaining > 16) {
+            seed = detail::mix(read64(p) ^ secret[1], read64(p + 8) ^ seed);
+            p += 16;
+            remaining -= 16;
+        }
+        a = read64(p + remaining - 16);
+        b = read64(p + remaining - 8);
+    }
+    a ^= secret[1];
+    b ^= seed;
+    detail::multiply(a, b);
+    return detail::mix(a ^ secret[0] ^ size, b ^ secret[1]);
+}
+
+// Hash and equality over the object representation of T, for plain structs
+// without padding. Floats compare bitwise here, so 0.0f and -0.0f are
+// distinct keys and a NaN equals itself.
+template <typename T> struct byte_hash {
+    static_assert(std::is_trivially_copyable_v<T>);
+    uint64_t operator()(const T& value) const {
+        return hash_bytes(&value, sizeof(T));
+    }
+};
+
+template <typename T> struct byte_equal {
+    static_assert(std::is_trivially_copyable_v<T>);
+    bool operator()(const T& a, const T& b) const {
+        return std::memcmp(&a, &b, sizeof(T)) == 0;
+    }
+};
+
+} // namespace hash
+
+#endif
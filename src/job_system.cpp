@@ -0,0 +1,272 @@
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <utility>
+
+namespace jobs {
+
+namespace {
+
+// The pool the current thread works for, and the index of its deque there.
+thread_local const thread_pool* current_pool = nullptr;
+thread_local size_t current_queue = 0;
+
+} // namespace
+
+thread_pool::thread_pool(unsigned thread_count) {
+    if (thread_count == 0) {
+        thread_count = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    }
+    for (unsigned i = 0; i <= thread_count; ++i) {
+        queues.push_back(std::make_unique<job_queue>());
+    }
+    threads.reserve(thread_count);
+    for (unsigned i = 0; i < thread_count; ++i) {
+        threads.emplace_back([this, i] { work(i); });
+    }
+}
+
+thread_pool::~thread_pool() {
+    {
+        std::lock_guard lock(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+size_t thread_pool::home_queue() const {
+    return current_pool == this ? current_queue : queues.size() - 1;
+}
+
+void thread_pool::submit(std::function<void()> job) {
+    auto& queue = *queues[home_queue()];
+    {
+        std::lock_guard lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+    queued.fetch_add(1);
+    // Taking the lock orders the count before any sleeper's check of it.
+    { std::lock_guard lock(sleep_mutex); }
+    wake.notify_all();
+}
+
+std::function<void()> thread_pool::take(size_t home) {
+    std::function<void()> job;
+    {
+        auto& queue = *queues[home];
+        std::lock_guard lock(queue.mutex);
+        if (!queue.jobs.empty()) {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+        }
+    }
+    for (size_t i = 1; !job && i < queues.size(); ++i) {
+        auto& victim = *queues[(home + i) % queues.size()];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+        }
+    }
+    if (job) {
+        queued.fetch_sub(1);
+    }
+    return job;
+}
+
+void thread_pool::run(const std::function<void()>& job) {
+    job();
+    // Whoever waits on the job's results rechecks them.
+    { std::lock_guard lock(sleep_mutex); }
+    wake.notify_all();
+}
+
+void thread_pool::work(size_t index) {
+    current_pool = this;
+    current_queue = index;
+    for (;;) {
+        if (auto job = take(index)) {
+            run(job);
+            continue;
+        }
+        std::unique_lock lock(sleep_mutex);
+        wake.wait(lock, [&] { return stopping || queued.load() > 0; });
+        if (stopping && queued.load() == 0) {
+            return;
+        }
+    }
+}
+
+void thread_pool::wait_until(const std::function<bool()>& done, bool help) {
+    const auto home = home_queue();
+    while (!done()) {
+        if (help) {
+            if (auto job = take(home)) {
+                run(job);
+                continue;
+            }
+        }
+        std::unique_lock lock(sleep_mutex);
+        wake.wait(lock, [&] { return (help && queued.load() > 0) || done(); });
+    }
+}
+
+thread_pool& pool() {
+    static thread_pool instance;
+    return instance;
+}
+
+task_graph::task_id task_graph::add(std::string name,
+                                    std::function<void()> body,
+                                    std::initializer_list<task_id> dependencies,
+                                    thread_affinity affinity) {
+    const auto id = static_cast<task_id>(tasks.size());
+    for (const auto dependency : dependencies) {
+        assert(dependency < id);
+        tasks[dependency].successors.push_back(id);
+    }
+    tasks.push_back({std::move(name),
+                     std::move(body),
+                     dependencies,
+                     {},
+                     affinity});
+    return id;
+}
+
+void task_graph::run(thread_pool& pool) {
+    workers = &pool;
+    waiting = std::make_unique<std::atomic<uint32_t>[]>(tasks.size());
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        waiting[i] = static_cast<uint32_t>(tasks[i].dependencies.size());
+    }
+    finished = 0;
+    start_time = std::chrono::steady_clock::now();
+    for (task_id id = 0; id < tasks.size(); ++id) {
+        if (tasks[id].dependencies.empty()) {
+            make_ready(id);
+        }
+    }
+
+    // The calling thread stays free for the main thread tasks rather than
+    // picking up pool jobs that would hold them back.
+    for (;;) {
+        pool.wait_until(
+            [&] {
+                return finished.load() == tasks.size() || main_pending.load();
+            },
+            false);
+        if (finished.load() == tasks.size()) {
+            break;
+        }
+        std::vector<task_id> ready;
+        {
+            std::lock_guard lock(main_mutex);
+            ready.swap(main_ready);
+            main_pending = false;
+        }
+        for (const auto id : ready) {
+            execute(id);
+        }
+    }
+    wall_ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start_time)
+                  .count();
+}
+
+void task_graph::make_ready(task_id id) {
+    if (tasks[id].affinity == thread_affinity::main) {
+        std::lock_guard lock(main_mutex);
+        main_ready.push_back(id);
+        main_pending = true;
+    } else {
+        workers->submit([this, id] { execute(id); });
+    }
+}
+
+void task_graph::execute(task_id id) {
+    auto& t = tasks[id];
+    const auto now = [&] {
+        return std::chrono::duration<double, std::milli>(
+                   std::chrono::steady_clock::now() - start_time)
+            .count();
+    };
+    t.thread = current_pool == workers
+                   ? static_cast<unsigned>(current_queue + 1)
+                   : 0;
+    t.start_ms = now();
+    t.body();
+    t.end_ms = now();
+    for (const auto successor : t.successors) {
+        if (waiting[successor].fetch_sub(1) == 1) {
+            make_ready(successor);
+        }
+    }
+    finished.fetch_add(1);
+}
+
+void task_graph::print_timings(std::ostream& out) const {
+    // Longest chain ending at every task. Dependencies come before the tasks
+    // that need them, so one pass in order suffices.
+    std::vector<double> chain(tasks.size());
+    std::vector<task_id> longest_dependency(tasks.size());
+    for (task_id id = 0; id < tasks.size(); ++id) {
+        double longest = 0;
+        longest_dependency[id] = id;
+        for (const auto dependency : tasks[id].dependencies) {
+            if (chain[dependency] > longest) {
+                longest = chain[dependency];
+                longest_dependency[id] = dependency;
+            }
+        }
+        chain[id] = longest + tasks[id].end_ms - tasks[id].start_ms;
+    }
+    std::vector<bool> critical(tasks.size());
+    if (!tasks.empty()) {
+        auto id = static_cast<task_id>(
+            std::max_element(chain.begin(), chain.end()) - chain.begin());
+        critical[id] = true;
+        while (longest_dependency[id] != id) {
+            id = longest_dependency[id];
+            critical[id] = true;
+        }
+    }
+
+    std::vector<task_id> order(tasks.size());
+    for (task_id id = 0; id < tasks.size(); ++id) {
+        order[id] = id;
+    }
+    std::sort(order.begin(), order.end(), [&](task_id a, task_id b) {
+        return tasks[a].start_ms < tasks[b].start_ms;
+    });
+    double total_ms = 0;
+    char line[128];
+    out << "  start   time  thread  task (* on the critical path)\n";
+    for (const auto id : order) {
+        const auto& t = tasks[id];
+        std::snprintf(line,
+                      sizeof(line),
+                      "%7.1f %6.1f %7u %c %s\n",
+                      t.start_ms,
+                      t.end_ms - t.start_ms,
+                      t.thread,
+                      critical[id] ? '*' : ' ',
+                      t.name.c_str());
+        out << line;
+        total_ms += t.end_ms - t.start_ms;
+    }
+    std::snprintf(line,
+                  sizeof(line),
+                  "%.1f ms wall, %.1f ms critical path, %.1f ms of work\n",
+                  wall_ms,
+                  tasks.empty() ? 0.0
+                                : *std::max_element(chain.begin(), chain.end()),
+                  total_ms);
+    out << line;
+}
+
+} // namespace jobs
@@ -0,0 +1,142 @@
+#ifndef JOB_SYSTEM_HPP
+#define JOB_SYSTEM_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace jobs {
+
+// Fixed set of worker threads, each with its own deque of jobs. A thread
+// pushes and pops jobs at the back of its deque, so recently queued and still
+// cached work runs first, and idle workers steal the oldest jobs from the
+// front of the others'.
+class thread_pool {
+  public:
+    // `thread_count` 0 starts one worker per hardware thread but the caller's,
+    // which helps while it waits.
+    explicit thread_pool(unsigned thread_count = 0);
+    ~thread_pool();
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    void submit(std::function<void()> job);
+    // Runs queued jobs on the calling thread until `done` returns true,
+    // sleeping while there are none, or only sleeps when not `help`ing.
+    // `done` is checked after every job and should be cheap.
+    void wait_until(const std::function<bool()>& done, bool help = true);
+    unsigned thread_count() const {
+        return static_cast<unsigned>(threads.size());
+    }
+
+  private:
+    struct job_queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> jobs;
+    };
+
+    size_t home_queue() const;
+    std::function<void()> take(size_t home);
+    void run(const std::function<void()>& job);
+    void work(size_t index);
+
+    // One per worker, and a last one shared by threads outside the pool.
+    std::vector<std::unique_ptr<job_queue>> queues;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> queued{0};
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
+
+// The pool shared by the engine, started on first use.
+thread_pool& pool();
+
+// Runs task(0) .. task(count - 1) on the shared pool, task(0) on the calling
+// thread, and returns once all of them finished. Safe to call from a job.
+template <typename F> void parallel_for(size_t count, const F& task) {
+    if (count == 0) {
+        return;
+    }
+    auto& workers = pool();
+    std::atomic<size_t> remaining(count - 1);
+    for (size_t i = 1; i < count; ++i) {
+        workers.submit([&task, &remaining, i] {
+            task(i);
+            remaining.fetch_sub(1, std::memory_order_release);
+        });
+    }
+    task(0);
+    workers.wait_until(
+        [&] { return remaining.load(std::memory_order_acquire) == 0; });
+}
+
+enum class thread_affinity {
+    any,
+    // Only on the thread calling task_graph::run, for APIs like window
+    // creation that must stay on the main thread.
+    main,
+};
+
+// Tasks that start as soon as the tasks they depend on finished, timed so
+// the chain that bounded the run can be shown.
+class task_graph {
+  public:
+    using task_id = uint32_t;
+
+    // `dependencies` are tasks added before, so the graph has no cycles.
+    task_id add(std::string name,
+                std::function<void()> body,
+                std::initializer_list<task_id> dependencies = {},
+                thread_affinity affinity = thread_affinity::any);
+
+    // Runs every task once and returns when all finished.
+    void run(thread_pool& workers);
+
+    // Prints when every task started, how long it took and on which thread,
+    // marking the critical path: the chain of dependent tasks with the
+    // longest total duration, which no number of threads can shorten.
+    void print_timings(std::ostream& out) const;
+
+  private:
+    struct task {
+        std::string name;
+        std::function<void()> body;
+        std::vector<task_id> dependencies;
+        std::vector<task_id> successors;
+        thread_affinity affinity;
+        double start_ms = 0;
+        double end_ms = 0;
+        unsigned thread = 0;
+    };
+
+    void make_ready(task_id id);
+    void execute(task_id id);
+
+    std::vector<task> tasks;
+    thread_pool* workers = nullptr;
+    // Dependencies left per task while running.
+    std::unique_ptr<std::atomic<uint32_t>[]> waiting;
+    std::atomic<size_t> finished{0};
+    std::mutex main_mutex;
+    std::vector<task_id> main_ready;
+    std::atomic<bool> main_pending{false};
+    std::chrono::steady_clock::time_point start_time;
+    double wall_ms = 0;
+};
+
+} // namespace jobs
+
+#endif
@@ -0,0 +1,174 @@
+#include "lz4_block.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+constexpr size_t min_match = 4;
+// The format ends every block with at least 5 literals, and the last match
+// starts at least 12 bytes before the end.
+constexpr size_t last_literals = 5;
+constexpr size_t match_start_limit = 12;
+constexpr size_t max_offset = 65535;
+constexpr unsigned hash_bits = 14;
+
+uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t hash_sequence(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - hash_bits);
+}
+
+// A length field above 15 continues in bytes of 255 and a last one below it.
+void write_length(std::vector<std::byte>& out, size_t length) {
+    for (; length >= 255; length -= 255) {
+        out.push_back(std::byte{255});
+    }
+    out.push_back(static_cast<std::byte>(length));
+}
+
+void write_sequence(std::vector<std::byte>& out,
+                    const uint8_t* literals,
+                    size_t literal_count,
+                    size_t offset,
+                    size_t match_length) {
+    const auto match_field = match_length - min_match;
+    const auto token = (std::min<size_t>(literal_count, 15) << 4) |
+                       std::min<size_t>(match_field, 15);
+    out.push_back(static_cast<std::byte>(token));
+    if (literal_count >= 15) {
+        write_length(out, literal_count - 15);
+    }
+    const auto* first = reinterpret_cast<const std::byte*>(literals);
+    out.insert(out.end(), first, first + literal_count);
+    out.push_back(static_cast<std::byte>(offset & 0xff));
+    out.push_back(static_cast<std::byte>(offset >> 8));
+    if (match_field >= 15) {
+        write_length(out, match_field - 15);
+    }
+}
+
+bool read_length(std::span<const std::byte> input,
+                 size_t& pos,
+                 size_t& length) {
+    uint8_t byte;
+    do {
+        if (pos >= input.size()) {
+            return false;
+        }
+        byte = static_cast<uint8_t>(input[pos++]);
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+} // namespace
+
+std::vector<std::byte> lz4_compress(std::span<const std::byte> input) {
+    const auto* src = reinterpret_cast<const uint8_t*>(input.data());
+    const auto size = input.size();
+    std::vector<std::byte> out;
+    out.reserve(size + size / 255 + 16);
+
+    size_t anchor = 0;
+    if (size > match_start_limit) {
+        // Positions 0 in the table compare equal only when the bytes there
+        // match, so it needs no separate empty marker.
+        std::vector<uint32_t> table(size_t{1} << hash_bits, 0);
+        const auto match_end = size - last_literals;
+        size_t pos = 0;
+        while (pos + match_start_limit <= size) {
+            const auto sequence = read32(src + pos);
+            auto& slot = table[hash_sequence(sequence)];
+            const size_t candidate = slot;
+            slot = static_cast<uint32_t>(pos);
+            if (candidate >= pos || pos - candidate > max_offset ||
+                read32(src + candidate) != sequence) {
+                // Incompressible stretches are skipped ever faster.
+                pos += 1 + ((pos - anchor) >> 6);
+                continue;
+            }
+            auto length = min_match;
+            while (pos + length < match_end &&
+                   src[candidate + length] == src[pos + length]) {
+                ++length;
+            }
+            write_sequence(out,
+                           src + anchor,
+                           pos - anchor,
+                           pos - candidate,
+                           length);
+            pos += length;
+            anchor = pos;
+        }
+    }
+
+    const auto literal_count = size - anchor;
+    out.push_back(
+        static_cast<std::byte>(std::min<size_t>(literal_count, 15) << 4));
+    if (literal_count >= 15) {
+        write_length(out, literal_count - 15);
+    }
+    out.insert(out.end(), input.begin() + anchor, input.end());
+    return out;
+}
+
+bool lz4_decompress(std::span<const std::byte> input,
+                    std::span<std::byte> output) {
+    auto* dst = reinterpret_cast<uint8_t*>(output.data());
+    size_t in = 0;
+    size_t out = 0;
+    for (;;) {
+        if (in >= input.size()) {
+            return false;
+        }
+        const auto token = static_cast<uint8_t>(input[in++]);
+        size_t literal_count = token >> 4;
+        if (literal_count == 15 && !read_length(input, in, literal_count)) {
+            return false;
+        }
+        if (literal_count > input.size() - in ||
+            literal_count > output.size() - out) {
+            return false;
+        }
+        if (literal_count > 0) {
+            std::memcpy(dst + out, input.data() + in, literal_count);
+        }
+        in += literal_count;
+        out += literal_count;
+        // The last sequence is literals only.
+        if (in == input.size()) {
+            return out == output.size();
+        }
+
+        if (input.size() - in < 2) {
+            return false;
+        }
+        const size_t offset = static_cast<uint8_t>(input[in]) |
+                              (static_cast<size_t>(input[in + 1]) << 8);
+        in += 2;
+        size_t length = token & 15;
+        if (length == 15 && !read_length(input, in, length)) {
+            return false;
+        }
+        length += min_match;
+        if (offset == 0 || offset > out || length > output.size() - out) {
+            return false;
+        }
+        // Matches may overlap the bytes they produce, repeating a pattern.
+        const auto* match = dst + out - offset;
+        if (offset >= length) {
+            std::memcpy(dst + out, match, length);
+        } else {
+            for (size_t i = 0; i < length; ++i) {
+                dst[out + i] = match[i];
+            }
+        }
+        out += length;
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef LZ4_BLOCK_HPP
+#define LZ4_BLOCK_HPP
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+// Compression in the LZ4 block format, without the frame around it: the
+// stream is a run of literals and back references of at least 4 bytes, up
+// to 64KB back. Compression greedily takes the last earlier position with
+// the same 4 bytes, which favors speed over ratio. Decompression is bounds
+// checked, so damaged input fails instead of reading or writing outside the
+// spans.
+
+std::vector<std::byte> lz4_compress(std::span<const std::byte> input);
+
+// Decompresses `input` into `output`, which must be exactly the size of the
+// original data. Returns false when the input is not a valid block of that
+// size.
+bool lz4_decompress(std::span<const std::byte> input,
+                    std::span<std::byte> output);
+
+#endif
@@ -0,0 +1,259 @@
+#include "mapped_file.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr size_t read_chunk_size = 64 * 1024;
+
+#ifdef _WIN32
+bool read_all(HANDLE file, std::vector<std::byte>& buffer) {
+    for (;;) {
+        const auto offset = buffer.size();
+        buffer.resize(offset + read_chunk_size);
+        DWORD count = 0;
+        if (!ReadFile(file,
+                      buffer.data() + offset,
+                      static_cast<DWORD>(read_chunk_size),
+                      &count,
+                      nullptr)) {
+            // A pipe whose writer closed reports the end as an error.
+            buffer.resize(offset);
+            return GetLastError() == ERROR_BROKEN_PIPE;
+        }
+        buffer.resize(offset + count);
+        if (count == 0) {
+            return true;
+        }
+    }
+}
+#else
+bool read_all(int fd, std::vector<std::byte>& buffer) {
+    for (;;) {
+        const auto offset = buffer.size();
+        buffer.resize(offset + read_chunk_size);
+        const auto count = ::read(fd, buffer.data() + offset, read_chunk_size);
+        buffer.resize(offset + (count > 0 ? count : 0));
+        if (count == 0) {
+            return true;
+        }
+        if (count < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+}
+#endif
+
+} // namespace
+
+mapped_file::mapped_file(const std::string& filename, file_access access) {
+#ifdef _WIN32
+    // Windows has no advice for mapped views, but faults on them go through
+    // the cache manager, which follows the open flags.
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if (access == file_access::sequential) {
+        flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+    } else if (access == file_access::random) {
+        flags |= FILE_FLAG_RANDOM_ACCESS;
+    }
+    const auto file = CreateFileA(filename.c_str(),
+                                  GENERIC_READ,
+                                  FILE_SHARE_READ,
+                                  nullptr,
+                                  OPEN_EXISTING,
+                                  flags,
+                                  nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    if (GetFileType(file) != FILE_TYPE_DISK) {
+        const bool read = read_all(file, buffer);
+        CloseHandle(file);
+        if (!read) {
+            std::cerr << "failed to read file! " << filename << std::endl;
+            buffer = {};
+            return;
+        }
+        bytes = buffer.data();
+        length = buffer.size();
+        open = true;
+        return;
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size)) {
+        CloseHandle(file);
+        return;
+    }
+    length = static_cast<size_t>(file_size.QuadPart);
+    if (length > 0) {
+        // The view keeps the mapping and the file alive once both handles
+        // are closed.
+        const auto mapping =
+            CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping != nullptr) {
+            bytes = static_cast<const std::byte*>(
+                MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+#else
+    const auto fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        ::close(fd);
+        return;
+    }
+    // Pipes and devices cannot be mapped, and files like those in /proc
+    // report a size of zero whatever they hold.
+    if (!S_ISREG(file_stat.st_mode) || file_stat.st_size == 0) {
+        const bool read = read_all(fd, buffer);
+        ::close(fd);
+        if (!read) {
+            std::cerr << "failed to read file! " << filename << std::endl;
+            buffer = {};
+            return;
+        }
+        bytes = buffer.data();
+        length = buffer.size();
+        open = true;
+        return;
+    }
+    length = static_cast<size_t>(file_stat.st_size);
+    if (length > 0) {
+        const auto address =
+            mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED) {
+            bytes = static_cast<const std::byte*>(address);
+            if (access == file_access::sequential) {
+                madvise(address, length, MADV_SEQUENTIAL);
+                madvise(address, length, MADV_WILLNEED);
+            } else if (access == file_access::random) {
+                madvise(address, length, MADV_RANDOM);
+            }
+        }
+    }
+    ::close(fd);
+#endif
+    if (length > 0 && bytes == nullptr) {
+        std::cerr << "failed to map file! " << filename << std::endl;
+        length = 0;
+        return;
+    }
+    open = true;
+}
+
+mapped_file::~mapped_file() { close(); }
+
+mapped_file::mapped_file(mapped_file&& other) noexcept
+    : bytes(std::exchange(other.bytes, nullptr)),
+      length(std::exchange(other.length, 0)),
+      open(std::exchange(other.open, false)),
+      borrowed(std::exchange(other.borrowed, false)),
+      buffer(std::move(other.buffer)) {}
+
+mapped_file& mapped_file::operator=(mapped_file&& other) noexcept {
+    if (this != &other) {
+        close();
+        bytes = std::exchange(other.bytes, nullptr);
+        length = std::exchange(other.length, 0);
+        open = std::exchange(other.open, false);
+        borrowed = std::exchange(other.borrowed, false);
+        buffer = std::move(other.buffer);
+    }
+    return *this;
+}
+
+mapped_file mapped_file::from_buffer(std::vector<std::byte> contents) {
+    mapped_file file;
+    file.buffer = std::move(contents);
+    file.bytes = file.buffer.empty() ? nullptr : file.buffer.data();
+    file.length = file.buffer.size();
+    file.open = true;
+    return file;
+}
+
+mapped_file mapped_file::view(std::span<const std::byte> contents,
+                              file_access access) {
+    mapped_file file;
+    file.bytes = contents.empty() ? nullptr : contents.data();
+    file.length = contents.size();
+    file.open = true;
+    file.borrowed = true;
+#ifndef _WIN32
+    // The advice applies to whole pages, so the range is widened to them.
+    if (!contents.empty() && access != file_access::normal) {
+        const auto page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        const auto begin = reinterpret_cast<uintptr_t>(contents.data());
+        const auto first = begin / page_size * page_size;
+        const auto length = begin + contents.size() - first;
+        const auto address = reinterpret_cast<void*>(first);
+        if (access == file_access::sequential) {
+            madvise(address, length, MADV_SEQUENTIAL);
+            madvise(address, length, MADV_WILLNEED);
+        } else {
+            madvise(address, length, MADV_RANDOM);
+        }
+    }
+#else
+    (void)access;
+#endif
+    return file;
+}
+
+void mapped_file::close() {
+    if (is_mapped() && !borrowed) {
+#ifdef _WIN32
+        UnmapViewOfFile(bytes);
+#else
+        munmap(const_cast<std::byte*>(bytes), length);
+#endif
+    }
+    bytes = nullptr;
+    length = 0;
+    open = false;
+    borrowed = false;
+    buffer = {};
+}
+
+bool write_file_atomically(const std::string& path,
+                           const std::function<void(std::ostream&)>& write) {
+    const auto temp_path = path + ".tmp";
+    std::error_code error;
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (out.is_open()) {
+            write(out);
+            out.close();
+        }
+        if (!out) {
+            std::filesystem::remove(temp_path, error);
+            return false;
+        }
+    }
+    std::filesystem::rename(temp_path, path, error);
+    if (error) {
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,69 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+// How the contents will be read, passed to the kernel as a paging hint.
+enum class file_access {
+    normal,
+    // Read front to back soon after opening: the whole file is prefetched
+    // and pages behind the reader may be dropped early.
+    sequential,
+    // Read in scattered places: no readahead around faults.
+    random,
+};
+
+// Read-only memory mapping of a whole file, unmapped on destruction. Files
+// that cannot be mapped, like pipes and character devices, are read into a
+// buffer instead, behind the same interface.
+class mapped_file {
+  public:
+    mapped_file() = default;
+    explicit mapped_file(const std::string& filename,
+                         file_access access = file_access::normal);
+    ~mapped_file();
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+    mapped_file(mapped_file&& other) noexcept;
+    mapped_file& operator=(mapped_file&& other) noexcept;
+
+    // Contents read or decompressed by the caller, behind the same interface.
+    static mapped_file from_buffer(std::vector<std::byte> contents);
+    // Borrows part of a mapping that outlives the returned file, such as a
+    // file in a package, and gives the kernel the paging hint for its pages.
+    static mapped_file view(std::span<const std::byte> contents,
+                            file_access access = file_access::normal);
+
+    // False when the file could not be opened or read. An empty file is
+    // open with size() == 0.
+    bool is_open() const { return open; }
+    // False when the contents were read into a buffer, or there are none.
+    bool is_mapped() const { return bytes != nullptr && buffer.empty(); }
+    const std::byte* data() const { return bytes; }
+    size_t size() const { return length; }
+    std::span<const std::byte> span() const { return {bytes, length}; }
+
+    void close();
+
+  private:
+    const std::byte* bytes = nullptr;
+    size_t length = 0;
+    bool open = false;
+    // Set for views, which are unmapped with the mapping they are part of.
+    bool borrowed = false;
+    std::vector<std::byte> buffer;
+};
+
+// Writes `path` through `write` into a temporary file, which replaces `path`
+// once complete, so an interrupted write never leaves a file that looks
+// valid. The temporary file is removed when writing or replacing fails.
+bool write_file_atomically(const std::string& path,
+                           const std::function<void(std::ostream&)>& write);
+
+#endif
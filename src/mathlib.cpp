@@ -1,164 +1,150 @@
 #include "mathlib.hpp"
 
-#include <cassert>
-#include <cmath>
-#include <numbers>
-
+// The whole library is header-only and constexpr. This translation unit holds
+// compile-time checks of it, so any build of the engine verifies them.
 namespace math {
-// vec2
-bool operator==(const vec2& a, const vec2& b) {
-    return a.x == b.x && a.y == b.y;
-}
-// vec3
-float& vec3::operator[](int idx) {
-    assert(idx >= 0 && idx <= 2);
-    return (&x)[idx];
-}
-const float& vec3::operator[](int idx) const {
-    assert(idx >= 0 && idx <= 2);
-    return (&x)[idx];
-}
-vec3 operator-(const vec3& a, const vec3& b) {
-    return vec3(a.x - b.x, a.y - b.y, a.z - b.z);
-}
-vec3 operator*(const vec3& a, float b) {
-    return vec3(a.x * b, a.y * b, a.z * b);
-}
-vec3 operator*(float a, const vec3& b) { return b * a; }
-bool operator==(const vec3& a, const vec3& b) {
-    return a.x == b.x && a.y == b.y && a.z == b.z;
-}
-
-// vec4
-float& vec4::operator[](int idx) {
-    assert(idx >= 0 && idx <= 3);
-    return (&x)[idx];
-}
-const float& vec4::operator[](int idx) const {
-    assert(idx >= 0 && idx <= 3);
-    return (&x)[idx];
-}
-vec4 operator+(const vec4& a, const vec4& b) {
-    return vec4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w);
-}
-vec4 operator*(const vec4& a, float b) {
-    return vec4(a.x * b, a.y * b, a.z * b, a.w * b);
-}
-vec4 operator*(float a, const vec4& b) { return b * a; }
-
-// mat4
-mat4::mat4() {}
-
-mat4::mat4(vec4 v0, vec4 v1, vec4 v2, vec4 v3) : data{v0, v1, v2, v3} {
-}
-
-mat4::mat4(float i)
-    : data{{i, 0.0f, 0.0f, 0.0f},
-           {0.0f, i, 0.0f, 0.0f},
-           {0.0f, 0.0f, i, 0.0f},
-           {0.0f, 0.0f, 0.0f, i}} {}
-
-vec4& mat4::operator[](int idx) {
-    assert(idx >= 0 && idx <= 3);
-    return data[idx];
-}
-
-const vec4& mat4::operator[](int idx) const {
-    assert(idx >= 0 && idx <= 3);
-    return data[idx];
-}
-
-mat4 mat4::identity() { return mat4(1.0f); }
+namespace {
+
+constexpr bool approx_equal(float a, float b, float epsilon = 1e-6f) {
+    return a - b <= epsilon && b - a <= epsilon;
+}
+
+constexpr bool approx_equal(const mat4& a, const mat4& b) {
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            if (!approx_equal(a[i][j], b[i][j])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// vec
+static_assert(vec3(1.0f, 2.0f, 3.0f) - vec3(1.0f, 1.0f, 1.0f) ==
+              vec3(0.0f, 1.0f, 2.0f));
+static_assert(2.0f * vec3(1.0f, 2.0f, 3.0f) == vec3(2.0f, 4.0f, 6.0f));
+static_assert(vec4(1.0f, 2.0f, 3.0f, 4.0f) * 0.5f +
+                  vec4(1.0f, 1.0f, 1.0f, 1.0f) ==
+              vec4(1.5f, 2.0f, 2.5f, 3.0f));
+static_assert(vec3(1.0f, 2.0f, 3.0f)[2] == 3.0f);
+static_assert(dot(vec3(1.0f, 2.0f, 3.0f), vec3(4.0f, 5.0f, 6.0f)) == 32.0f);
+static_assert(cross(vec3(1.0f, 0.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f)) ==
+              vec3(0.0f, 0.0f, 1.0f));
+static_assert(normalize(vec3(3.0f, 0.0f, 4.0f)) == vec3(0.6f, 0.0f, 0.8f));
+
+// Integer valued matrices keep every product exact.
+constexpr mat4 a{
+    {1.0f,  2.0f,  3.0f,  4.0f},
+    {5.0f,  6.0f,  7.0f,  8.0f},
+    {9.0f, 10.0f, 11.0f, 12.0f},
+    {13.0f, 14.0f, 15.0f, 16.0f}
+};
+constexpr mat4 b{
+    {2.0f, 0.0f, 1.0f, 0.0f},
+    {0.0f, 1.0f, 0.0f, 3.0f},
+    {1.0f, 0.0f, 0.0f, 1.0f},
+    {0.0f, 2.0f, 1.0f, 0.0f}
+};
+static_assert(a * mat4::identity() == a);
+static_assert(mat4::identity() * a == a);
+static_assert(a * b == mat4({11.0f, 14.0f, 17.0f, 20.0f},
+                            {44.0f, 48.0f, 52.0f, 56.0f},
+                            {14.0f, 16.0f, 18.0f, 20.0f},
+                            {19.0f, 22.0f, 25.0f, 28.0f}));
+static_assert(a * vec4(1.0f, 0.0f, 0.0f, 1.0f) ==
+              vec4(14.0f, 16.0f, 18.0f, 20.0f));
+static_assert(transpose(transpose(a)) == a);
+static_assert(transpose(a)[0] == vec4(1.0f, 5.0f, 9.0f, 13.0f));
+
+constexpr mat4 scale_translate{
+    {2.0f, 0.0f, 0.0f, 0.0f},
+    {0.0f, 4.0f, 0.0f, 0.0f},
+    {0.0f, 0.0f, 8.0f, 0.0f},
+    {1.0f, 2.0f, 3.0f, 1.0f}
+};
+static_assert(inverse(scale_translate) ==
+              mat4({0.5f, 0.0f, 0.0f, 0.0f},
+                   {0.0f, 0.25f, 0.0f, 0.0f},
+                   {0.0f, 0.0f, 0.125f, 0.0f},
+                   {-0.5f, -0.5f, -0.375f, 1.0f}));
+static_assert(inverse_affine(scale_translate) == inverse(scale_translate));
+static_assert(approx_equal(b * inverse(b), mat4::identity()));
 
 // Functions
-
-float radians(float degrees) { return degrees * std::numbers::pi / 180; }
-
-vec3 normalize(const vec3& vector) {
-    const auto isqrt = 1 / std::hypot(vector.x, vector.y, vector.z);
-    return vec3(vector.x * isqrt, vector.y * isqrt, vector.z * isqrt);
-}
-
-vec3 cross(const vec3& a, const vec3& b) {
-    return vec3{a.y * b.z - a.z * b.y,
-                a.z * b.x - a.x * b.z,
-                a.x * b.y - a.y * b.x};
-}
-
-float dot(const vec3& a, const vec3& b) {
-    return a.x * b.x + a.y * b.y + a.z * b.z;
-}
-
-mat4 look_at(const vec3& position, const vec3& target, const vec3& up) {
-    const auto f = normalize(target - position);
-    const auto s = normalize(cross(f, up));
-    const auto u = cross(s, f);
-
-    mat4 result(1.0f);
-    result[0][0] = s.x;
-    result[1][0] = s.y;
-    result[2][0] = s.z;
-    result[0][1] = u.x;
-    result[1][1] = u.y;
-    result[2][1] = u.z;
-    result[0][2] = -f.x;
-    result[1][2] = -f.y;
-    result[2][2] = -f.z;
-    result[3][0] = -dot(s, position);
-    result[3][1] = -dot(u, position);
-    result[3][2] = dot(f, position);
-    return result;
+static_assert(radians(180.0f) == std::numbers::pi_v<float>);
+static_assert(detail::sqrt(2.0f) == 1.41421356f);
+static_assert(detail::sin(0.0f) == 0.0f && detail::cos(0.0f) == 1.0f);
+static_assert(detail::sin(radians(90.0f)) == 1.0f);
+static_assert(detail::cos(radians(180.0f)) == -1.0f);
+static_assert(approx_equal(detail::sin(radians(30.0f)), 0.5f));
+static_assert(approx_equal(detail::tan(radians(45.0f)), 1.0f));
+
+static_assert(rotate(a, 0.0f, vec3(0.0f, 0.0f, 1.0f)) == a);
+static_assert(approx_equal(rotate(mat4::identity(),
+                                  radians(90.0f),
+                                  vec3(0.0f, 0.0f, 2.0f)),
+                           mat4({0.0f, 1.0f, 0.0f, 0.0f},
+                                {-1.0f, 0.0f, 0.0f, 0.0f},
+                                {0.0f, 0.0f, 1.0f, 0.0f},
+                                {0.0f, 0.0f, 0.0f, 1.0f})));
+
+constexpr auto view = look_at(vec3(0.0f, 0.0f, 5.0f),
+                              vec3(0.0f, 0.0f, 0.0f),
+                              vec3(0.0f, 1.0f, 0.0f));
+static_assert(view == mat4({1.0f, 0.0f, 0.0f, 0.0f},
+                           {0.0f, 1.0f, 0.0f, 0.0f},
+                           {0.0f, 0.0f, 1.0f, 0.0f},
+                           {0.0f, 0.0f, -5.0f, 1.0f}));
+static_assert(inverse_affine(view) * view == mat4::identity());
+
+constexpr auto proj = perspesctive(radians(90.0f), 1.0f, 1.0f, 3.0f);
+static_assert(approx_equal(proj[0][0], 1.0f) && approx_equal(proj[1][1], 1.0f));
+static_assert(proj[2][2] == -2.0f && proj[3][2] == -3.0f && proj[2][3] == -1);
+
+// Bounding volumes
+constexpr aabb unit_box{
+    {-1.0f, -1.0f, -1.0f},
+    {1.0f, 1.0f, 1.0f}
 };
-
-mat4 perspesctive(float fov,
-                  float aspect,
-                  float near_clipping,
-                  float far_clipping) {
-    assert(aspect != 0.0f);
-    assert(near_clipping != far_clipping);
-    const float half_fov_tan = std::tan(fov / 2);
-
-    mat4 result{};
-    result[0][0] = 1 / (aspect * half_fov_tan);
-    result[1][1] = 1 / half_fov_tan;
-    result[2][2] =
-        -(far_clipping + near_clipping) / (far_clipping - near_clipping);
-    result[2][3] = -1;
-    result[3][2] =
-        -(2 * near_clipping * far_clipping) / (far_clipping - near_clipping);
-
-    return result;
-}
-
-mat4 rotate(const mat4& matrix, float angle, const vec3& vector) {
-    const auto cos = std::cos(angle);
-    const auto sin = std::sin(angle);
-
-    const auto axis = normalize(vector);
-    const auto temp = (1.0f - cos) * axis;
-
-    mat4 rotate{};
-    rotate[0][0] = cos + temp[0] * axis[0];
-    rotate[0][1] = 0 + temp[0] * axis[1] + sin * axis[2];
-    rotate[0][2] = 0 + temp[0] * axis[2] - sin * axis[1];
-
-    rotate[1][0] = 0 + temp[1] * axis[0] - sin * axis[2];
-    rotate[1][1] = cos + temp[1] * axis[1];
-    rotate[1][2] = 0 + temp[1] * axis[2] + sin * axis[0];
-
-    rotate[2][0] = 0 + temp[2] * axis[0] + sin * axis[1];
-    rotate[2][1] = 0 + temp[2] * axis[1] - sin * axis[0];
-    rotate[2][2] = cos + temp[2] * axis[2];
-
-    mat4 result{};
-    result[0] = matrix[0] * rotate[0][0] + matrix[1] * rotate[0][1] +
-                matrix[2] * rotate[0][2];
-    result[1] = matrix[0] * rotate[1][0] + matrix[1] * rotate[1][1] +
-                matrix[2] * rotate[1][2];
-    result[2] = matrix[0] * rotate[2][0] + matrix[1] * rotate[2][1] +
-                matrix[2] * rotate[2][2];
-    result[3] = matrix[3];
-    return result;
-}
-
+constexpr auto moved_box = transform_aabb(scale_translate, unit_box);
+static_assert(moved_box.min == vec3(-1.0f, -2.0f, -5.0f) &&
+              moved_box.max == vec3(3.0f, 6.0f, 11.0f));
+constexpr auto turned_box = transform_aabb(
+    rotate(mat4::identity(), radians(90.0f), vec3(0.0f, 0.0f, 1.0f)),
+    aabb{{0.0f, 0.0f, 0.0f}, {2.0f, 1.0f, 1.0f}});
+static_assert(approx_equal(turned_box.min.x, -1.0f) &&
+              approx_equal(turned_box.max.y, 2.0f));
+
+// Rotations and transforms
+constexpr auto quarter_turn =
+    angle_axis(radians(90.0f), vec3(0.0f, 0.0f, 2.0f));
+static_assert(approx_equal(rotate(quarter_turn, vec3(1.0f, 0.0f, 0.0f)).y,
+                           1.0f));
+static_assert(approx_equal(to_mat4(quarter_turn),
+                           rotate(mat4::identity(),
+                                  radians(90.0f),
+                                  vec3(0.0f, 0.0f, 1.0f))));
+static_assert(approx_equal(
+    dot(conjugate(quarter_turn) * quarter_turn, quat::identity()), 1.0f));
+static_assert(approx_equal(
+    dot(slerp(quat::identity(), quarter_turn, 0.0f), quat::identity()),
+    1.0f));
+static_assert(approx_equal(
+    dot(slerp(quat::identity(), quarter_turn, 0.5f),
+        angle_axis(radians(45.0f), vec3(0.0f, 0.0f, 1.0f))),
+    1.0f));
+static_assert(approx_equal(detail::acos(0.5f), radians(60.0f)) &&
+              approx_equal(detail::acos(-1.0f), radians(180.0f)));
+
+constexpr transform parent{
+    vec3(1.0f, 2.0f, 3.0f), quarter_turn, vec3(2.0f, 2.0f, 2.0f)};
+constexpr transform child{
+    vec3(1.0f, 0.0f, 0.0f), quat::identity(), vec3(1.0f, 1.0f, 1.0f)};
+static_assert(approx_equal(to_mat4(parent * child),
+                           to_mat4(parent) * to_mat4(child)));
+static_assert(approx_equal(to_mat4(inverse(parent)),
+                           inverse(to_mat4(parent))));
+
+} // namespace
 } // namespace math
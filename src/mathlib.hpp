@@ -1,80 +1,845 @@
 #ifndef MATHLIB_HPP
 #define MATHLIB_HPP
+
+#include "hash.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
 #include <functional>
+#include <limits>
+#include <numbers>
+#include <type_traits>
+
+// Define MATHLIB_FORCE_SCALAR to compile the mat4/vec4 kernels without
+// intrinsics. Every SIMD path performs the same operations in the same order
+// as the scalar one, so both produce bit-identical results.
+#if !defined(MATHLIB_FORCE_SCALAR) &&                                          \
+    (defined(__SSE2__) || defined(_M_X64) ||                                   \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define MATHLIB_SSE 1
+#if defined(__AVX__)
+#define MATHLIB_AVX 1
+#endif
+#include <immintrin.h>
+#endif
+
+// Everything in this header is constexpr. Constant evaluation always takes the
+// scalar path, runtime evaluation the SIMD one when available.
 namespace math {
 
 struct vec2 {
     float x;
     float y;
 };
-bool operator==(const vec2& a, const vec2& b);
+constexpr bool operator==(const vec2& a, const vec2& b) {
+    return a.x == b.x && a.y == b.y;
+}
 
 struct vec3 {
     float x;
     float y;
     float z;
 
-    float& operator[](int idx);
-    const float& operator[](int idx) const;
+    constexpr float& operator[](int idx) {
+        assert(idx >= 0 && idx <= 2);
+        switch (idx) {
+        case 0:
+            return x;
+        case 1:
+            return y;
+        default:
+            return z;
+        }
+    }
+    constexpr const float& operator[](int idx) const {
+        assert(idx >= 0 && idx <= 2);
+        switch (idx) {
+        case 0:
+            return x;
+        case 1:
+            return y;
+        default:
+            return z;
+        }
+    }
 };
-vec3 operator-(const vec3& a, const vec3& b);
-vec3 operator*(const vec3& a, float b);
-vec3 operator*(float a, const vec3& b);
-bool operator==(const vec3& a, const vec3& b);
+constexpr vec3 operator+(const vec3& a, const vec3& b) {
+    return vec3(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+constexpr vec3 operator-(const vec3& a, const vec3& b) {
+    return vec3(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+constexpr vec3 operator*(const vec3& a, float b) {
+    return vec3(a.x * b, a.y * b, a.z * b);
+}
+constexpr vec3 operator*(float a, const vec3& b) { return b * a; }
+// Component-wise, as used for scales.
+constexpr vec3 operator*(const vec3& a, const vec3& b) {
+    return vec3(a.x * b.x, a.y * b.y, a.z * b.z);
+}
+constexpr bool operator==(const vec3& a, const vec3& b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+}
 
-struct vec4 {
+struct alignas(16) vec4 {
     float x;
     float y;
     float z;
     float w;
 
-    float& operator[](int idx);
-    const float& operator[](int idx) const;
+    constexpr float& operator[](int idx) {
+        assert(idx >= 0 && idx <= 3);
+        switch (idx) {
+        case 0:
+            return x;
+        case 1:
+            return y;
+        case 2:
+            return z;
+        default:
+            return w;
+        }
+    }
+    constexpr const float& operator[](int idx) const {
+        assert(idx >= 0 && idx <= 3);
+        switch (idx) {
+        case 0:
+            return x;
+        case 1:
+            return y;
+        case 2:
+            return z;
+        default:
+            return w;
+        }
+    }
 };
-vec4 operator+(const vec4& a, const vec4& b);
-vec4 operator*(const vec4& a, float b);
-vec4 operator*(float a, const vec4& b);
+constexpr vec4 operator+(const vec4& a, const vec4& b) {
+    return vec4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w);
+}
+constexpr vec4 operator*(const vec4& a, float b) {
+    return vec4(a.x * b, a.y * b, a.z * b, a.w * b);
+}
+constexpr vec4 operator*(float a, const vec4& b) { return b * a; }
+constexpr bool operator==(const vec4& a, const vec4& b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+}
 
 struct mat4 {
     vec4 data[4]{};
-    mat4();
-    mat4(vec4 v0, vec4 v1, vec4 v2, vec4 v3);
-    mat4(float i);
+    constexpr mat4() = default;
+    constexpr mat4(vec4 v0, vec4 v1, vec4 v2, vec4 v3)
+        : data{v0, v1, v2, v3} {}
+    constexpr mat4(float i)
+        : data{{i, 0.0f, 0.0f, 0.0f},
+               {0.0f, i, 0.0f, 0.0f},
+               {0.0f, 0.0f, i, 0.0f},
+               {0.0f, 0.0f, 0.0f, i}} {}
+
+    constexpr vec4& operator[](int idx) {
+        assert(idx >= 0 && idx <= 3);
+        return data[idx];
+    }
+    constexpr const vec4& operator[](int idx) const {
+        assert(idx >= 0 && idx <= 3);
+        return data[idx];
+    }
+
+    static constexpr mat4 identity() { return mat4(1.0f); }
+};
+constexpr bool operator==(const mat4& a, const mat4& b) {
+    return a[0] == b[0] && a[1] == b[1] && a[2] == b[2] && a[3] == b[3];
+}
+
+// Bounding volumes
+
+struct aabb {
+    vec3 min;
+    vec3 max;
+};
+
+struct sphere {
+    vec3 center;
+    float radius;
+};
+
+// Rotations and transforms
+
+// Unit quaternion, w is the real part.
+struct quat {
+    float x;
+    float y;
+    float z;
+    float w;
+
+    static constexpr quat identity() { return {0.0f, 0.0f, 0.0f, 1.0f}; }
+};
+constexpr bool operator==(const quat& a, const quat& b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+}
+
+// Translation, rotation and scale applied as T * R * S, 40 bytes instead of
+// the 64 of a mat4. Composition is exact for uniform scales, a non-uniform
+// scale under a rotated parent would need shear which TRS cannot express.
+struct transform {
+    vec3 translation{};
+    quat rotation = quat::identity();
+    vec3 scale{1.0f, 1.0f, 1.0f};
+
+    static constexpr transform identity() { return {}; }
+};
+
+namespace detail {
+// Minimal 4-wide float abstraction the mat4 kernels are written against.
+// scalar4 is always available and is what constant evaluation uses.
+struct scalar4 {
+    float v[4];
+};
+
+template <typename V> constexpr V load(const vec4& v);
+template <typename V> constexpr V set(float x, float y, float z, float w);
+template <typename V> constexpr V splat(float f) { return set<V>(f, f, f, f); }
+
+template <> constexpr scalar4 load<scalar4>(const vec4& v) {
+    return {v.x, v.y, v.z, v.w};
+}
+template <>
+constexpr scalar4 set<scalar4>(float x, float y, float z, float w) {
+    return {x, y, z, w};
+}
+constexpr void store(vec4& v, scalar4 a) {
+    v = {a.v[0], a.v[1], a.v[2], a.v[3]};
+}
+constexpr scalar4 add(scalar4 a, scalar4 b) {
+    return {a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]};
+}
+constexpr scalar4 sub(scalar4 a, scalar4 b) {
+    return {a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]};
+}
+constexpr scalar4 mul(scalar4 a, scalar4 b) {
+    return {a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]};
+}
+template <int i> constexpr float lane(scalar4 a) { return a.v[i]; }
+
+// {a[i0], a[i1], b[i2], b[i3]}, same semantics as _mm_shuffle_ps
+template <int i0, int i1, int i2, int i3>
+constexpr scalar4 shuffle(scalar4 a, scalar4 b) {
+    return {a.v[i0], a.v[i1], b.v[i2], b.v[i3]};
+}
+
+#if MATHLIB_SSE
+using native4 = __m128;
+
+template <> inline __m128 load<__m128>(const vec4& v) {
+    return _mm_load_ps(&v.x);
+}
+template <> inline __m128 set<__m128>(float x, float y, float z, float w) {
+    return _mm_setr_ps(x, y, z, w);
+}
+inline void store(vec4& v, __m128 a) { _mm_store_ps(&v.x, a); }
+inline __m128 add(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+inline __m128 sub(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+inline __m128 mul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+
+template <int i0, int i1, int i2, int i3>
+inline __m128 shuffle(__m128 a, __m128 b) {
+    return _mm_shuffle_ps(a, b, _MM_SHUFFLE(i3, i2, i1, i0));
+}
+template <int i> inline float lane(__m128 a) {
+    return _mm_cvtss_f32(shuffle<i, i, i, i>(a, a));
+}
+#else
+using native4 = scalar4;
+#endif
+
+template <int i, typename V> constexpr V broadcast(V a) {
+    return shuffle<i, i, i, i>(a, a);
+}
+
+// a * v.x + b * v.y + c * v.z + d * v.w, evaluated left to right
+template <typename V> constexpr V combine(V a, V b, V c, V d, V v) {
+    auto r = mul(a, broadcast<0>(v));
+    r = add(r, mul(b, broadcast<1>(v)));
+    r = add(r, mul(c, broadcast<2>(v)));
+    return add(r, mul(d, broadcast<3>(v)));
+}
+
+// Lanes of a.yzx * b.zxy - a.zxy * b.yzx, w ends up as 0
+template <typename V> constexpr V cross(V a, V b) {
+    const auto a_yzx = shuffle<1, 2, 0, 3>(a, a);
+    const auto b_zxy = shuffle<2, 0, 1, 3>(b, b);
+    const auto a_zxy = shuffle<2, 0, 1, 3>(a, a);
+    const auto b_yzx = shuffle<1, 2, 0, 3>(b, b);
+    return sub(mul(a_yzx, b_zxy), mul(a_zxy, b_yzx));
+}
+
+// Six 2x2 sub-determinant pairs of columns 1..3 used by the cofactor inverse,
+// for rows p and q.
+template <int p, int q, typename V>
+constexpr V cofactors(V c1, V c2, V c3) {
+    const auto a = shuffle<p, p, p, p>(c2, c1);
+    const auto b_tmp = shuffle<q, q, q, q>(c3, c2);
+    const auto b = shuffle<0, 0, 0, 2>(b_tmp, b_tmp);
+    const auto c_tmp = shuffle<p, p, p, p>(c3, c2);
+    const auto c = shuffle<0, 0, 0, 2>(c_tmp, c_tmp);
+    const auto d = shuffle<q, q, q, q>(c2, c1);
+    return sub(mul(a, b), mul(c, d));
+}
+
+// {c1[r], c0[r], c0[r], c0[r]}
+template <int r, typename V> constexpr V cofactor_column(V c0, V c1) {
+    const auto tmp = shuffle<r, r, r, r>(c1, c0);
+    return shuffle<0, 2, 2, 2>(tmp, tmp);
+}
+
+template <typename V> constexpr vec4 mul(const mat4& m, const vec4& v) {
+    vec4 result{};
+    store(result,
+          combine(load<V>(m.data[0]),
+                  load<V>(m.data[1]),
+                  load<V>(m.data[2]),
+                  load<V>(m.data[3]),
+                  load<V>(v)));
+    return result;
+}
+
+template <typename V> constexpr mat4 mul(const mat4& a, const mat4& b) {
+    const auto a0 = load<V>(a.data[0]);
+    const auto a1 = load<V>(a.data[1]);
+    const auto a2 = load<V>(a.data[2]);
+    const auto a3 = load<V>(a.data[3]);
+    mat4 result;
+    for (int i = 0; i < 4; ++i) {
+        store(result.data[i], combine(a0, a1, a2, a3, load<V>(b.data[i])));
+    }
+    return result;
+}
+
+#if MATHLIB_AVX
+// Two result columns per iteration, a's columns duplicated in both lanes.
+inline mat4 mul_avx(const mat4& a, const mat4& b) {
+    const auto a0 =
+        _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a.data[0]));
+    const auto a1 =
+        _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a.data[1]));
+    const auto a2 =
+        _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a.data[2]));
+    const auto a3 =
+        _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a.data[3]));
+    mat4 result;
+    for (int i = 0; i < 4; i += 2) {
+        const auto bj = _mm256_loadu_ps(&b.data[i].x);
+        auto r = _mm256_mul_ps(a0, _mm256_permute_ps(bj, 0x00));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_permute_ps(bj, 0x55)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_permute_ps(bj, 0xAA)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_permute_ps(bj, 0xFF)));
+        _mm256_storeu_ps(&result.data[i].x, r);
+    }
+    return result;
+}
+#endif
+
+constexpr mat4 transpose_scalar(const mat4& m) {
+    const auto& c = m.data;
+    return mat4({c[0].x, c[1].x, c[2].x, c[3].x},
+                {c[0].y, c[1].y, c[2].y, c[3].y},
+                {c[0].z, c[1].z, c[2].z, c[3].z},
+                {c[0].w, c[1].w, c[2].w, c[3].w});
+}
+
+template <typename V> constexpr mat4 transpose(const mat4& m) {
+#if MATHLIB_SSE
+    if constexpr (!std::is_same_v<V, scalar4>) {
+        auto c0 = load<V>(m.data[0]);
+        auto c1 = load<V>(m.data[1]);
+        auto c2 = load<V>(m.data[2]);
+        auto c3 = load<V>(m.data[3]);
+        _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+        mat4 result;
+        store(result.data[0], c0);
+        store(result.data[1], c1);
+        store(result.data[2], c2);
+        store(result.data[3], c3);
+        return result;
+    }
+#endif
+    return transpose_scalar(m);
+}
+
+template <typename V> constexpr mat4 inverse_affine(const mat4& m) {
+    const auto c0 = load<V>(m.data[0]);
+    const auto c1 = load<V>(m.data[1]);
+    const auto c2 = load<V>(m.data[2]);
+
+    // Rows of the inverse 3x3 are the cross products of the columns divided by
+    // the determinant.
+    const auto r0 = cross(c1, c2);
+    const auto r1 = cross(c2, c0);
+    const auto r2 = cross(c0, c1);
+    const auto det = mul(c0, r0);
+    const auto inv_det =
+        splat<V>(1.0f / (lane<0>(det) + lane<1>(det) + lane<2>(det)));
+
+    mat4 result;
+    store(result.data[0], mul(r0, inv_det));
+    store(result.data[1], mul(r1, inv_det));
+    store(result.data[2], mul(r2, inv_det));
+    store(result.data[3], splat<V>(0.0f));
+    result = transpose<V>(result);
+
+    const auto zero = splat<V>(0.0f);
+    const auto translation = combine(load<V>(result.data[0]),
+                                     load<V>(result.data[1]),
+                                     load<V>(result.data[2]),
+                                     zero,
+                                     load<V>(m.data[3]));
+    store(result.data[3], sub(zero, translation));
+    result.data[3].w = 1.0f;
+    return result;
+}
+
+template <typename V> constexpr mat4 inverse(const mat4& m) {
+    const auto c0 = load<V>(m.data[0]);
+    const auto c1 = load<V>(m.data[1]);
+    const auto c2 = load<V>(m.data[2]);
+    const auto c3 = load<V>(m.data[3]);
+
+    const auto fac0 = cofactors<2, 3>(c1, c2, c3);
+    const auto fac1 = cofactors<1, 3>(c1, c2, c3);
+    const auto fac2 = cofactors<1, 2>(c1, c2, c3);
+    const auto fac3 = cofactors<0, 3>(c1, c2, c3);
+    const auto fac4 = cofactors<0, 2>(c1, c2, c3);
+    const auto fac5 = cofactors<0, 1>(c1, c2, c3);
 
-    vec4& operator[](int idx);
-    const vec4& operator[](int idx) const;
+    const auto v0 = cofactor_column<0>(c0, c1);
+    const auto v1 = cofactor_column<1>(c0, c1);
+    const auto v2 = cofactor_column<2>(c0, c1);
+    const auto v3 = cofactor_column<3>(c0, c1);
 
-    static mat4 identity();
+    const auto sign_a = set<V>(1.0f, -1.0f, 1.0f, -1.0f);
+    const auto sign_b = set<V>(-1.0f, 1.0f, -1.0f, 1.0f);
+    const auto inv0 =
+        mul(add(sub(mul(v1, fac0), mul(v2, fac1)), mul(v3, fac2)), sign_a);
+    const auto inv1 =
+        mul(add(sub(mul(v0, fac0), mul(v2, fac3)), mul(v3, fac4)), sign_b);
+    const auto inv2 =
+        mul(add(sub(mul(v0, fac1), mul(v1, fac3)), mul(v3, fac5)), sign_a);
+    const auto inv3 =
+        mul(add(sub(mul(v0, fac2), mul(v1, fac4)), mul(v2, fac5)), sign_b);
+
+    // First row of the adjugate dotted with the first column gives det(m).
+    const auto row0 = shuffle<0, 2, 0, 2>(shuffle<0, 0, 0, 0>(inv0, inv1),
+                                          shuffle<0, 0, 0, 0>(inv2, inv3));
+    const auto dot = mul(c0, row0);
+    const auto det =
+        (lane<0>(dot) + lane<1>(dot)) + (lane<2>(dot) + lane<3>(dot));
+    const auto inv_det = splat<V>(1.0f / det);
+
+    mat4 result;
+    store(result.data[0], mul(inv0, inv_det));
+    store(result.data[1], mul(inv1, inv_det));
+    store(result.data[2], mul(inv2, inv_det));
+    store(result.data[3], mul(inv3, inv_det));
+    return result;
+}
+
+// Correctly rounded square root. Newton's iteration in double precision
+// converges from above to within an ulp, which is well below the precision
+// needed to round to the same float std::sqrt returns.
+constexpr float sqrt(float x) {
+    if (!std::is_constant_evaluated()) {
+        return std::sqrt(x);
+    }
+    if (x < 0.0f || x != x) {
+        return std::numeric_limits<float>::quiet_NaN();
+    }
+    if (x == 0.0f || x == std::numeric_limits<float>::infinity()) {
+        return x;
+    }
+    double result = x > 1.0f ? x : 1.0;
+    while (true) {
+        const double next = 0.5 * (result + x / result);
+        if (next >= result) {
+            break;
+        }
+        result = next;
+    }
+    return static_cast<float>(result);
+}
+
+struct sin_cos_pair {
+    double sin;
+    double cos;
 };
 
+// Sine and cosine evaluated in double precision with Cody-Waite reduction
+// to [-pi/4, pi/4]. The same code runs at compile time and at runtime so both
+// agree bit for bit, std::sin/std::cos are neither constexpr nor guaranteed
+// to round the same way on every platform. Meant for angles, not for
+// arguments in the millions.
+constexpr sin_cos_pair sin_cos(double x) {
+    constexpr double two_over_pi = 6.36619772367581382433e-01;
+    // pi/2 split in a 33 bit head and a tail, so k * pio2_hi is exact
+    constexpr double pio2_hi = 1.57079632673412561417e+00;
+    constexpr double pio2_lo = 6.07710050650619224932e-11;
+
+    const auto k = static_cast<int64_t>(x * two_over_pi + (x < 0 ? -0.5 : 0.5));
+    const double r = (x - k * pio2_hi) - k * pio2_lo;
+    const double r2 = r * r;
+
+    const double s =
+        r +
+        r * r2 *
+            (-1.0 / 6 +
+             r2 * (1.0 / 120 +
+                   r2 * (-1.0 / 5040 +
+                         r2 * (1.0 / 362880 +
+                               r2 * (-1.0 / 39916800 +
+                                     r2 * (1.0 / 6227020800 +
+                                           r2 * (-1.0 / 1307674368000)))))));
+    const double c =
+        1.0 +
+        r2 * (-1.0 / 2 +
+              r2 * (1.0 / 24 +
+                    r2 * (-1.0 / 720 +
+                          r2 * (1.0 / 40320 +
+                                r2 * (-1.0 / 3628800 +
+                                      r2 * (1.0 / 479001600 +
+                                            r2 * (-1.0 / 87178291200 +
+                                                  r2 / 20922789888000)))))));
+
+    switch (k & 3) {
+    case 0:
+        return {s, c};
+    case 1:
+        return {c, -s};
+    case 2:
+        return {-s, -c};
+    default:
+        return {-c, s};
+    }
+}
+
+constexpr float abs(float x) { return x < 0.0f ? -x : x; }
+
+// Abramowitz and Stegun 4.4.46, absolute error below 2e-8 on [0, 1], which
+// is less than the float rounding of the result.
+constexpr float acos(float x) {
+    const double a = abs(x);
+    const double p =
+        1.5707963050 +
+        a * (-0.2145988016 +
+             a * (0.0889789874 +
+                  a * (-0.0501743046 +
+                       a * (0.0308918810 +
+                            a * (-0.0170881256 +
+                                 a * (0.0066700901 + a * -0.0012624911))))));
+    const double result = sqrt(static_cast<float>(1.0 - a)) * p;
+    return static_cast<float>(x < 0.0f ? std::numbers::pi - result : result);
+}
+
+constexpr float sin(float x) { return static_cast<float>(sin_cos(x).sin); }
+constexpr float cos(float x) { return static_cast<float>(sin_cos(x).cos); }
+constexpr float tan(float x) {
+    const auto result = sin_cos(x);
+    return static_cast<float>(result.sin / result.cos);
+}
+} // namespace detail
+
+constexpr vec4 operator*(const mat4& m, const vec4& v) {
+    if (std::is_constant_evaluated()) {
+        return detail::mul<detail::scalar4>(m, v);
+    }
+    return detail::mul<detail::native4>(m, v);
+}
+
+constexpr mat4 operator*(const mat4& a, const mat4& b) {
+    if (std::is_constant_evaluated()) {
+        return detail::mul<detail::scalar4>(a, b);
+    }
+#if MATHLIB_AVX
+    return detail::mul_avx(a, b);
+#else
+    return detail::mul<detail::native4>(a, b);
+#endif
+}
+
+constexpr mat4 transpose(const mat4& m) {
+    if (std::is_constant_evaluated()) {
+        return detail::transpose<detail::scalar4>(m);
+    }
+    return detail::transpose<detail::native4>(m);
+}
+
+// Inverse of a matrix whose last row is (0, 0, 0, 1), i.e. any combination of
+// rotation, scale and translation. Cheaper than the general inverse.
+constexpr mat4 inverse_affine(const mat4& m) {
+    if (std::is_constant_evaluated()) {
+        return detail::inverse_affine<detail::scalar4>(m);
+    }
+    return detail::inverse_affine<detail::native4>(m);
+}
+
+// General 4x4 inverse by cofactor expansion. The matrix must be invertible.
+constexpr mat4 inverse(const mat4& m) {
+    if (std::is_constant_evaluated()) {
+        return detail::inverse<detail::scalar4>(m);
+    }
+    return detail::inverse<detail::native4>(m);
+}
+
 // Functions
 
-float radians(float degrees);
-vec3 normalize(const vec3& vector);
-vec3 cross(const vec3& a, const vec3& b);
-float dot(const vec3& a, const vec3& b);
-mat4 look_at(const vec3& position, const vec3& target, const vec3& up);
+constexpr float radians(float degrees) {
+    return degrees * std::numbers::pi / 180;
+}
+
+constexpr float dot(const vec3& a, const vec3& b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+constexpr vec3 normalize(const vec3& vector) {
+    const auto isqrt = 1 / detail::sqrt(dot(vector, vector));
+    return vec3(vector.x * isqrt, vector.y * isqrt, vector.z * isqrt);
+}
+
+constexpr vec3 cross(const vec3& a, const vec3& b) {
+    return vec3{a.y * b.z - a.z * b.y,
+                a.z * b.x - a.x * b.z,
+                a.x * b.y - a.y * b.x};
+}
+
+constexpr mat4 look_at(const vec3& position,
+                       const vec3& target,
+                       const vec3& up) {
+    const auto f = normalize(target - position);
+    const auto s = normalize(cross(f, up));
+    const auto u = cross(s, f);
+
+    mat4 result(1.0f);
+    result[0][0] = s.x;
+    result[1][0] = s.y;
+    result[2][0] = s.z;
+    result[0][1] = u.x;
+    result[1][1] = u.y;
+    result[2][1] = u.z;
+    result[0][2] = -f.x;
+    result[1][2] = -f.y;
+    result[2][2] = -f.z;
+    result[3][0] = -dot(s, position);
+    result[3][1] = -dot(u, position);
+    result[3][2] = dot(f, position);
+    return result;
+};
+
+constexpr mat4 perspesctive(float fov,
+                            float aspect,
+                            float near_clipping,
+                            float far_clipping) {
+    assert(aspect != 0.0f);
+    assert(near_clipping != far_clipping);
+    const float half_fov_tan = detail::tan(fov / 2);
+
+    mat4 result{};
+    result[0][0] = 1 / (aspect * half_fov_tan);
+    result[1][1] = 1 / half_fov_tan;
+    result[2][2] =
+        -(far_clipping + near_clipping) / (far_clipping - near_clipping);
+    result[2][3] = -1;
+    result[3][2] =
+        -(2 * near_clipping * far_clipping) / (far_clipping - near_clipping);
+
+    return result;
+}
+
+constexpr mat4 rotate(const mat4& matrix, float angle, const vec3& vector) {
+    const auto cos = detail::cos(angle);
+    const auto sin = detail::sin(angle);
+
+    const auto axis = normalize(vector);
+    const auto temp = (1.0f - cos) * axis;
+
+    mat4 rotate{};
+    rotate[0][0] = cos + temp[0] * axis[0];
+    rotate[0][1] = 0 + temp[0] * axis[1] + sin * axis[2];
+    rotate[0][2] = 0 + temp[0] * axis[2] - sin * axis[1];
+
+    rotate[1][0] = 0 + temp[1] * axis[0] - sin * axis[2];
+    rotate[1][1] = cos + temp[1] * axis[1];
+    rotate[1][2] = 0 + temp[1] * axis[2] + sin * axis[0];
+
+    rotate[2][0] = 0 + temp[2] * axis[0] + sin * axis[1];
+    rotate[2][1] = 0 + temp[2] * axis[1] - sin * axis[0];
+    rotate[2][2] = cos + temp[2] * axis[2];
+
+    rotate[3][3] = 1;
+
+    return matrix * rotate;
+}
+
+// Smallest box containing `box` transformed by the affine matrix `m`.
+constexpr aabb transform_aabb(const mat4& m, const aabb& box) {
+    const vec3 center((box.min.x + box.max.x) * 0.5f,
+                      (box.min.y + box.max.y) * 0.5f,
+                      (box.min.z + box.max.z) * 0.5f);
+    const vec3 extent((box.max.x - box.min.x) * 0.5f,
+                      (box.max.y - box.min.y) * 0.5f,
+                      (box.max.z - box.min.z) * 0.5f);
+    const auto new_center = m * vec4(center.x, center.y, center.z, 1.0f);
+    vec3 new_extent{};
+    for (int i = 0; i < 3; ++i) {
+        new_extent[i] = detail::abs(m[0][i]) * extent.x +
+                        detail::abs(m[1][i]) * extent.y +
+                        detail::abs(m[2][i]) * extent.z;
+    }
+    return {
+        {new_center.x - new_extent.x,
+         new_center.y - new_extent.y,
+         new_center.z - new_extent.z},
+        {new_center.x + new_extent.x,
+         new_center.y + new_extent.y,
+         new_center.z + new_extent.z}
+    };
+}
+
+// Quaternions
+
+constexpr quat operator*(const quat& a, const quat& b) {
+    return {a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+            a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+            a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+            a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z};
+}
+
+constexpr float dot(const quat& a, const quat& b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+}
+
+constexpr quat normalize(const quat& q) {
+    const auto isqrt = 1 / detail::sqrt(dot(q, q));
+    return {q.x * isqrt, q.y * isqrt, q.z * isqrt, q.w * isqrt};
+}
+
+// Inverse of a unit quaternion.
+constexpr quat conjugate(const quat& q) { return {-q.x, -q.y, -q.z, q.w}; }
+
+constexpr quat angle_axis(float angle, const vec3& axis) {
+    const auto half = detail::sin_cos(angle * 0.5f);
+    const auto s = static_cast<float>(half.sin);
+    const auto a = normalize(axis);
+    return {a.x * s, a.y * s, a.z * s, static_cast<float>(half.cos)};
+}
+
+// q * v * conjugate(q), expanded to two cross products.
+constexpr vec3 rotate(const quat& q, const vec3& v) {
+    const vec3 u(q.x, q.y, q.z);
+    const auto t = 2.0f * cross(u, v);
+    return v + q.w * t + cross(u, t);
+}
+
+// Interpolates along the shorter arc. Nearly parallel inputs fall back to a
+// normalized lerp, where slerp would divide by a vanishing sine.
+constexpr quat slerp(const quat& a, const quat& b, float t) {
+    auto cos_theta = dot(a, b);
+    auto end = b;
+    if (cos_theta < 0.0f) {
+        cos_theta = -cos_theta;
+        end = {-b.x, -b.y, -b.z, -b.w};
+    }
+
+    float wa = 1.0f - t;
+    float wb = t;
+    if (cos_theta < 0.9995f) {
+        // sin((1 - t) * theta) expanded, so one sin_cos covers both weights.
+        const auto theta = detail::acos(cos_theta);
+        const auto sin_theta = detail::sqrt(1.0f - cos_theta * cos_theta);
+        const auto partial = detail::sin_cos(t * theta);
+        wb = static_cast<float>(partial.sin) / sin_theta;
+        wa = static_cast<float>(partial.cos) - cos_theta * wb;
+    }
+    const quat result{a.x * wa + end.x * wb,
+                      a.y * wa + end.y * wb,
+                      a.z * wa + end.z * wb,
+                      a.w * wa + end.w * wb};
+    return cos_theta < 0.9995f ? result : normalize(result);
+}
+
+constexpr mat4 to_mat4(const quat& q) {
+    const auto xx = q.x * q.x;
+    const auto yy = q.y * q.y;
+    const auto zz = q.z * q.z;
+    const auto xy = q.x * q.y;
+    const auto xz = q.x * q.z;
+    const auto yz = q.y * q.z;
+    const auto wx = q.w * q.x;
+    const auto wy = q.w * q.y;
+    const auto wz = q.w * q.z;
+    return {
+        {1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f},
+        {2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f},
+        {2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f},
+        {0.0f, 0.0f, 0.0f, 1.0f}
+    };
+}
+
+// Transforms
+
+constexpr vec3 transform_point(const transform& t, const vec3& p) {
+    return t.translation + rotate(t.rotation, t.scale * p);
+}
+
+// parent * child applies child first, like the matrix product.
+constexpr transform operator*(const transform& parent, const transform& child) {
+    return {transform_point(parent, child.translation),
+            parent.rotation * child.rotation,
+            parent.scale * child.scale};
+}
+
+constexpr transform inverse(const transform& t) {
+    const vec3 inv_scale(1.0f / t.scale.x, 1.0f / t.scale.y, 1.0f / t.scale.z);
+    const auto inv_rotation = conjugate(t.rotation);
+    return {inv_scale * rotate(inv_rotation, -1.0f * t.translation),
+            inv_rotation,
+            inv_scale};
+}
 
-mat4 perspesctive(float fov,
-                  float aspect,
-                  float near_clipping,
-                  float far_clipping);
+// Translation and rotation are interpolated independently, rotation along
+// the shorter arc.
+constexpr transform interpolate(const transform& a,
+                                const transform& b,
+                                float t) {
+    return {a.translation + t * (b.translation - a.translation),
+            slerp(a.rotation, b.rotation, t),
+            a.scale + t * (b.scale - a.scale)};
+}
 
-mat4 rotate(const mat4& matrix, float angle, const vec3& vector);
+// Builds the T * R * S matrix, meant for upload to the GPU.
+constexpr mat4 to_mat4(const transform& t) {
+    auto result = to_mat4(t.rotation);
+    result[0] = result[0] * t.scale.x;
+    result[1] = result[1] * t.scale.y;
+    result[2] = result[2] * t.scale.z;
+    result[3] = vec4(t.translation.x, t.translation.y, t.translation.z, 1.0f);
+    return result;
+}
 
 } // namespace math
 namespace std {
+// Hashes the bytes with -0.0f folded into 0.0f, which operator== treats as
+// equal.
 template <> struct hash<math::vec2> {
     size_t operator()(math::vec2 const& vertex) const {
-        return ((hash<float>()(vertex.x) ^ (hash<float>()(vertex.y) << 1)) >>
-                1);
+        const math::vec2 canonical(vertex.x + 0.0f, vertex.y + 0.0f);
+        return ::hash::hash_bytes(&canonical, sizeof(canonical));
     }
 };
 template <> struct hash<math::vec3> {
     size_t operator()(math::vec3 const& vertex) const {
-        return ((hash<float>()(vertex.x) ^ (hash<float>()(vertex.y) << 1)) >>
-                1) ^
-               (hash<float>()(vertex.z) << 1);
+        const math::vec3 canonical(vertex.x + 0.0f,
+                                   vertex.y + 0.0f,
+                                   vertex.z + 0.0f);
+        return ::hash::hash_bytes(&canonical, sizeof(canonical));
     }
 };
 } // namespace std
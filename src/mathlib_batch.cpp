@@ -0,0 +1,180 @@
+#include "mathlib_batch.hpp"
+
+#include "mathlib_wide.hpp"
+
+#include <cstring>
+#include <limits>
+
+namespace math {
+namespace {
+
+using detail::scalar_ops;
+using detail::wide_ops;
+
+// Every kernel processes [begin, end of stream) in steps of Ops::width and
+// returns the index where it stopped.
+
+template <typename Ops, bool is_point>
+size_t transform_impl(const mat4& m,
+                      const_vec3_soa_span in,
+                      vec3_soa_span out,
+                      size_t begin) {
+    using O = Ops;
+    const typename O::type c[4][3] = {
+        {O::splat(m[0].x), O::splat(m[0].y), O::splat(m[0].z)},
+        {O::splat(m[1].x), O::splat(m[1].y), O::splat(m[1].z)},
+        {O::splat(m[2].x), O::splat(m[2].y), O::splat(m[2].z)},
+        {O::splat(m[3].x), O::splat(m[3].y), O::splat(m[3].z)},
+    };
+
+    size_t i = begin;
+    for (; i + O::width <= in.count; i += O::width) {
+        const auto x = O::load(in.x + i);
+        const auto y = O::load(in.y + i);
+        const auto z = O::load(in.z + i);
+        float* const dst[3] = {out.x + i, out.y + i, out.z + i};
+        for (int row = 0; row < 3; ++row) {
+            auto r = O::mul(c[0][row], x);
+            r = O::add(r, O::mul(c[1][row], y));
+            r = O::add(r, O::mul(c[2][row], z));
+            if constexpr (is_point) {
+                r = O::add(r, c[3][row]);
+            }
+            O::store(dst[row], r);
+        }
+    }
+    return i;
+}
+
+template <typename Ops>
+size_t normalize_impl(const_vec3_soa_span in, vec3_soa_span out, size_t begin) {
+    using O = Ops;
+    const auto one = O::splat(1.0f);
+    size_t i = begin;
+    for (; i + O::width <= in.count; i += O::width) {
+        const auto x = O::load(in.x + i);
+        const auto y = O::load(in.y + i);
+        const auto z = O::load(in.z + i);
+        auto length_sq = O::mul(x, x);
+        length_sq = O::add(length_sq, O::mul(y, y));
+        length_sq = O::add(length_sq, O::mul(z, z));
+        const auto inv_length = O::div(one, O::sqrt(length_sq));
+        O::store(out.x + i, O::mul(x, inv_length));
+        O::store(out.y + i, O::mul(y, inv_length));
+        O::store(out.z + i, O::mul(z, inv_length));
+    }
+    return i;
+}
+
+template <typename Ops>
+size_t aabb_impl(const_vec3_soa_span in, size_t begin, aabb& bounds) {
+    using O = Ops;
+    auto min_x = O::splat(bounds.min.x);
+    auto min_y = O::splat(bounds.min.y);
+    auto min_z = O::splat(bounds.min.z);
+    auto max_x = O::splat(bounds.max.x);
+    auto max_y = O::splat(bounds.max.y);
+    auto max_z = O::splat(bounds.max.z);
+    size_t i = begin;
+    for (; i + O::width <= in.count; i += O::width) {
+        const auto x = O::load(in.x + i);
+        const auto y = O::load(in.y + i);
+        const auto z = O::load(in.z + i);
+        min_x = O::min(min_x, x);
+        min_y = O::min(min_y, y);
+        min_z = O::min(min_z, z);
+        max_x = O::max(max_x, x);
+        max_y = O::max(max_y, y);
+        max_z = O::max(max_z, z);
+    }
+    bounds.min = {O::reduce_min(min_x),
+                  O::reduce_min(min_y),
+                  O::reduce_min(min_z)};
+    bounds.max = {O::reduce_max(max_x),
+                  O::reduce_max(max_y),
+                  O::reduce_max(max_z)};
+    return i;
+}
+
+template <typename Ops>
+size_t max_distance_sq_impl(const_vec3_soa_span in,
+                            const vec3& center,
+                            size_t begin,
+                            float& max_distance_sq) {
+    using O = Ops;
+    const auto cx = O::splat(center.x);
+    const auto cy = O::splat(center.y);
+    const auto cz = O::splat(center.z);
+    auto result = O::splat(max_distance_sq);
+    size_t i = begin;
+    for (; i + O::width <= in.count; i += O::width) {
+        const auto dx = O::sub(O::load(in.x + i), cx);
+        const auto dy = O::sub(O::load(in.y + i), cy);
+        const auto dz = O::sub(O::load(in.z + i), cz);
+        auto distance_sq = O::mul(dx, dx);
+        distance_sq = O::add(distance_sq, O::mul(dy, dy));
+        distance_sq = O::add(distance_sq, O::mul(dz, dz));
+        result = O::max(result, distance_sq);
+    }
+    max_distance_sq = O::reduce_max(result);
+    return i;
+}
+
+} // namespace
+
+void deinterleave(const std::byte* base, size_t stride, vec3_soa_span out) {
+    for (size_t i = 0; i < out.count; ++i) {
+        float v[3];
+        std::memcpy(v, base + i * stride, sizeof(v));
+        out.x[i] = v[0];
+        out.y[i] = v[1];
+        out.z[i] = v[2];
+    }
+}
+
+void transform_points(const mat4& m,
+                      const_vec3_soa_span in,
+                      vec3_soa_span out) {
+    const auto i = transform_impl<wide_ops, true>(m, in, out, 0);
+    transform_impl<scalar_ops, true>(m, in, out, i);
+}
+
+void transform_vectors(const mat4& m,
+                       const_vec3_soa_span in,
+                       vec3_soa_span out) {
+    const auto i = transform_impl<wide_ops, false>(m, in, out, 0);
+    transform_impl<scalar_ops, false>(m, in, out, i);
+}
+
+void normalize(const_vec3_soa_span in, vec3_soa_span out) {
+    const auto i = normalize_impl<wide_ops>(in, out, 0);
+    normalize_impl<scalar_ops>(in, out, i);
+}
+
+aabb compute_aabb(const_vec3_soa_span points) {
+    constexpr auto inf = std::numeric_limits<float>::infinity();
+    aabb bounds{
+        { inf,  inf,  inf},
+        {-inf, -inf, -inf}
+    };
+    const auto i = aabb_impl<wide_ops>(points, 0, bounds);
+    aabb_impl<scalar_ops>(points, i, bounds);
+    return bounds;
+}
+
+sphere compute_bounding_sphere(const_vec3_soa_span points) {
+    if (points.count == 0) {
+        return {};
+    }
+    const auto bounds = compute_aabb(points);
+    const vec3 center((bounds.min.x + bounds.max.x) * 0.5f,
+                      (bounds.min.y + bounds.max.y) * 0.5f,
+                      (bounds.min.z + bounds.max.z) * 0.5f);
+    float max_distance_sq = 0.0f;
+    const auto i =
+        max_distance_sq_impl<wide_ops>(points, center, 0, max_distance_sq);
+    max_distance_sq_impl<scalar_ops>(points, center, i, max_distance_sq);
+    return {center, std::sqrt(max_distance_sq)};
+}
+
+} // namespace math
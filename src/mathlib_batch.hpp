@@ -0,0 +1,76 @@
+#ifndef MATHLIB_BATCH_HPP
+#define MATHLIB_BATCH_HPP
+
+#include "mathlib.hpp"
+
+#include <cstddef>
+#include <vector>
+
+// Batch kernels over structure-of-arrays vec3 streams. They process 8 (AVX2)
+// or 4 (SSE, NEON) elements per iteration and are meant to run over whole
+// vertex streams at a time instead of one call per vertex.
+namespace math {
+
+// Non-owning view of `count` vec3s stored as three separate float arrays.
+struct vec3_soa_span {
+    float* x;
+    float* y;
+    float* z;
+    size_t count;
+};
+
+struct const_vec3_soa_span {
+    const float* x;
+    const float* y;
+    const float* z;
+    size_t count;
+
+    const_vec3_soa_span(const float* x,
+                        const float* y,
+                        const float* z,
+                        size_t count)
+        : x(x), y(y), z(z), count(count) {}
+    const_vec3_soa_span(vec3_soa_span span)
+        : x(span.x), y(span.y), z(span.z), count(span.count) {}
+};
+
+struct vec3_soa {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+
+    void resize(size_t count) {
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+    }
+    size_t size() const { return x.size(); }
+
+    vec3_soa_span span() { return {x.data(), y.data(), z.data(), size()}; }
+    const_vec3_soa_span span() const {
+        return {x.data(), y.data(), z.data(), size()};
+    }
+};
+
+// Copies the vec3 found at `base + i * stride` for each element into `out`,
+// e.g. the positions of an interleaved vertex array.
+void deinterleave(const std::byte* base, size_t stride, vec3_soa_span out);
+
+// out = m * (in, 1). Produces the same bits as mat4 * vec4 per element.
+void transform_points(const mat4& m,
+                      const_vec3_soa_span in,
+                      vec3_soa_span out);
+// out = m * (in, 0), for directions.
+void transform_vectors(const mat4& m,
+                       const_vec3_soa_span in,
+                       vec3_soa_span out);
+// Same result as math::normalize per element, `in` and `out` may alias.
+void normalize(const_vec3_soa_span in, vec3_soa_span out);
+
+aabb compute_aabb(const_vec3_soa_span points);
+// Sphere centered on the bounding box, enclosing every point.
+sphere compute_bounding_sphere(const_vec3_soa_span points);
+
+} // namespace math
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef MATHLIB_WIDE_HPP
+#define MATHLIB_WIDE_HPP
+
+#include "mathlib.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#if !defined(MATHLIB_FORCE_SCALAR) && defined(__aarch64__) &&                 \
+    defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Vector backends for the kernels that stream over arrays (batch transforms,
+// culling). wide_ops is the widest one the build targets: AVX2, SSE, NEON or
+// scalar.
+namespace math::detail {
+
+// Each backend exposes the same static interface so every kernel is written
+// once. The scalar backend handles the tail that does not fill a full vector.
+struct scalar_ops {
+    using type = float;
+    static constexpr size_t width = 1;
+
+    static float load(const float* p) { return *p; }
+    static void store(float* p, float a) { *p = a; }
+    static float splat(float f) { return f; }
+    static float add(float a, float b) { return a + b; }
+    static float sub(float a, float b) { return a - b; }
+    static float mul(float a, float b) { return a * b; }
+    static float div(float a, float b) { return a / b; }
+    static float min(float a, float b) { return std::min(a, b); }
+    static float max(float a, float b) { return std::max(a, b); }
+    static float sqrt(float a) { return std::sqrt(a); }
+    static float reduce_min(float a) { return a; }
+    static float reduce_max(float a) { return a; }
+    static unsigned negative_mask(float a) { return a < 0.0f ? 1 : 0; }
+};
+
+#if !defined(MATHLIB_FORCE_SCALAR) && defined(__AVX2__)
+struct avx_ops {
+    using type = __m256;
+    static constexpr size_t width = 8;
+
+    static __m256 load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, __m256 a) { _mm256_storeu_ps(p, a); }
+    static __m256 splat(float f) { return _mm256_set1_ps(f); }
+    static __m256 add(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+    static __m256 sub(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+    static __m256 mul(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+    static __m256 div(__m256 a, __m256 b) { return _mm256_div_ps(a, b); }
+    static __m256 min(__m256 a, __m256 b) { return _mm256_min_ps(a, b); }
+    static __m256 max(__m256 a, __m256 b) { return _mm256_max_ps(a, b); }
+    static __m256 sqrt(__m256 a) { return _mm256_sqrt_ps(a); }
+    static float reduce_min(__m256 a) {
+        auto m = _mm_min_ps(_mm256_castps256_ps128(a),
+                            _mm256_extractf128_ps(a, 1));
+        m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+        m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+        return _mm_cvtss_f32(m);
+    }
+    static float reduce_max(__m256 a) {
+        auto m = _mm_max_ps(_mm256_castps256_ps128(a),
+                            _mm256_extractf128_ps(a, 1));
+        m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+        m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+        return _mm_cvtss_f32(m);
+    }
+    static unsigned negative_mask(__m256 a) {
+        return _mm256_movemask_ps(
+            _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_LT_OQ));
+    }
+};
+using wide_ops = avx_ops;
+#elif MATHLIB_SSE
+struct sse_ops {
+    using type = __m128;
+    static constexpr size_t width = 4;
+
+    static __m128 load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, __m128 a) { _mm_storeu_ps(p, a); }
+    static __m128 splat(float f) { return _mm_set1_ps(f); }
+    static __m128 add(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+    static __m128 sub(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+    static __m128 mul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+    static __m128 div(__m128 a, __m128 b) { return _mm_div_ps(a, b); }
+    static __m128 min(__m128 a, __m128 b) { return _mm_min_ps(a, b); }
+    static __m128 max(__m128 a, __m128 b) { return _mm_max_ps(a, b); }
+    static __m128 sqrt(__m128 a) { return _mm_sqrt_ps(a); }
+    static float reduce_min(__m128 a) {
+        auto m = _mm_min_ps(a, _mm_movehl_ps(a, a));
+        m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+        return _mm_cvtss_f32(m);
+    }
+    static float reduce_max(__m128 a) {
+        auto m = _mm_max_ps(a, _mm_movehl_ps(a, a));
+        m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+        return _mm_cvtss_f32(m);
+    }
+    static unsigned negative_mask(__m128 a) {
+        return _mm_movemask_ps(_mm_cmplt_ps(a, _mm_setzero_ps()));
+    }
+};
+using wide_ops = sse_ops;
+#elif !defined(MATHLIB_FORCE_SCALAR) && defined(__aarch64__) &&               \
+    defined(__ARM_NEON)
+struct neon_ops {
+    using type = float32x4_t;
+    static constexpr size_t width = 4;
+
+    static float32x4_t load(const float* p) { return vld1q_f32(p); }
+    static void store(float* p, float32x4_t a) { vst1q_f32(p, a); }
+    static float32x4_t splat(float f) { return vdupq_n_f32(f); }
+    static float32x4_t add(float32x4_t a, float32x4_t b) {
+        return vaddq_f32(a, b);
+    }
+    static float32x4_t sub(float32x4_t a, float32x4_t b) {
+        return vsubq_f32(a, b);
+    }
+    static float32x4_t mul(float32x4_t a, float32x4_t b) {
+        return vmulq_f32(a, b);
+    }
+    static float32x4_t div(float32x4_t a, float32x4_t b) {
+        return vdivq_f32(a, b);
+    }
+    static float32x4_t min(float32x4_t a, float32x4_t b) {
+        return vminq_f32(a, b);
+    }
+    static float32x4_t max(float32x4_t a, float32x4_t b) {
+        return vmaxq_f32(a, b);
+    }
+    static float32x4_t sqrt(float32x4_t a) { return vsqrtq_f32(a); }
+    static float reduce_min(float32x4_t a) { return vminvq_f32(a); }
+    static float reduce_max(float32x4_t a) { return vmaxvq_f32(a); }
+    static unsigned negative_mask(float32x4_t a) {
+        const uint32x4_t bits = {1, 2, 4, 8};
+        return vaddvq_u32(vandq_u32(vcltzq_f32(a), bits));
+    }
+};
+using wide_ops = neon_ops;
+#else
+using wide_ops = scalar_ops;
+#endif
+
+} // namespace math::detail
+
+#endif
@@ -0,0 +1,286 @@
+#include "mesh_cache.hpp"
+
+#include "asset_package.hpp"
+#include "hash.hpp"
+#include "mathlib_batch.hpp"
+#include "mesh_optimizer.hpp"
+#include "obj_parser.hpp"
+#include "simplifier.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+namespace {
+
+constexpr char mesh_cache_magic[4] = {'M', 'E', 'S', 'H'};
+
+// Followed by the vertex, index, range, meshlet and level of detail arrays at
+// the given offsets, in native byte order.
+struct mesh_cache_header {
+    char magic[4];
+    uint32_t version;
+    uint64_t source_hash;
+    uint32_t vertex_size;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t index_size;
+    uint32_t range_count;
+    uint32_t meshlet_count;
+    uint32_t lod_count;
+    tex_coord_encoding encoding;
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint64_t range_offset;
+    uint64_t meshlet_offset;
+    uint64_t lod_offset;
+    vertex_dequantization dequantization;
+    math::aabb bounds;
+    math::sphere sphere;
+};
+
+constexpr uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Points `mesh` into the mapped cache when it is valid and matches
+// `source_hash` and `encoding`.
+bool use_cache(cooked_mesh& mesh,
+               mapped_file file,
+               uint64_t source_hash,
+               tex_coord_encoding encoding) {
+    if (file.size() < sizeof(mesh_cache_header)) {
+        return false;
+    }
+    mesh_cache_header header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, mesh_cache_magic, 4) != 0 ||
+        header.version != mesh_cache_version ||
+        header.vertex_size != sizeof(packed_vertex) ||
+        header.source_hash != source_hash || header.encoding != encoding) {
+        return false;
+    }
+    const auto vertex_end =
+        header.vertex_offset +
+        uint64_t{header.vertex_count} * sizeof(packed_vertex);
+    const auto index_end =
+        header.index_offset + uint64_t{header.index_count} * header.index_size;
+    const auto range_end =
+        header.range_offset + uint64_t{header.range_count} * sizeof(mesh_range);
+    const auto meshlet_end = header.meshlet_offset +
+                             uint64_t{header.meshlet_count} * sizeof(meshlet);
+    const auto lod_end =
+        header.lod_offset + uint64_t{header.lod_count} * sizeof(mesh_lod);
+    if ((header.index_size != 2 && header.index_size != 4) ||
+        header.vertex_offset % alignof(packed_vertex) != 0 ||
+        header.index_offset % header.index_size != 0 ||
+        header.range_offset % alignof(mesh_range) != 0 ||
+        header.meshlet_offset % alignof(meshlet) != 0 ||
+        header.lod_offset % alignof(mesh_lod) != 0 || header.lod_count == 0 ||
+        vertex_end > file.size() || index_end > file.size() ||
+        range_end > file.size() || meshlet_end > file.size() ||
+        lod_end > file.size()) {
+        return false;
+    }
+
+    mesh.vertices = {
+        reinterpret_cast<const packed_vertex*>(file.data() +
+                                               header.vertex_offset),
+        header.vertex_count};
+    mesh.indices = {file.data() + header.index_offset,
+                    uint64_t{header.index_count} * header.index_size};
+    mesh.index_size = header.index_size;
+    mesh.ranges = {
+        reinterpret_cast<const mesh_range*>(file.data() + header.range_offset),
+        header.range_count};
+    mesh.meshlets = {
+        reinterpret_cast<const meshlet*>(file.data() + header.meshlet_offset),
+        header.meshlet_count};
+    mesh.lods = {
+        reinterpret_cast<const mesh_lod*>(file.data() + header.lod_offset),
+        header.lod_count};
+    mesh.encoding = header.encoding;
+    mesh.dequantization = header.dequantization;
+    mesh.bounds = header.bounds;
+    mesh.sphere = header.sphere;
+    mesh.file = std::move(file);
+    return true;
+}
+
+bool write_cache(const std::string& cache_path,
+                 const cooked_mesh& mesh,
+                 uint64_t source_hash) {
+    mesh_cache_header header{};
+    std::memcpy(header.magic, mesh_cache_magic, 4);
+    header.version = mesh_cache_version;
+    header.source_hash = source_hash;
+    header.vertex_size = sizeof(packed_vertex);
+    header.vertex_count = static_cast<uint32_t>(mesh.vertices.size());
+    header.index_count =
+        static_cast<uint32_t>(mesh.indices.size() / mesh.index_size);
+    header.index_size = mesh.index_size;
+    header.range_count = static_cast<uint32_t>(mesh.ranges.size());
+    header.meshlet_count = static_cast<uint32_t>(mesh.meshlets.size());
+    header.lod_count = static_cast<uint32_t>(mesh.lods.size());
+    header.encoding = mesh.encoding;
+    header.vertex_offset = align_up(sizeof(header), 16);
+    header.index_offset =
+        align_up(header.vertex_offset + mesh.vertices.size_bytes(), 16);
+    header.range_offset =
+        align_up(header.index_offset + mesh.indices.size_bytes(), 16);
+    header.meshlet_offset =
+        align_up(header.range_offset + mesh.ranges.size_bytes(), 16);
+    header.lod_offset =
+        align_up(header.meshlet_offset + mesh.meshlets.size_bytes(), 16);
+    header.dequantization = mesh.dequantization;
+    header.bounds = mesh.bounds;
+    header.sphere = mesh.sphere;
+
+    return write_file_atomically(cache_path, [&](std::ostream& file) {
+        const char padding[16]{};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(padding, header.vertex_offset - sizeof(header));
+        file.write(reinterpret_cast<const char*>(mesh.vertices.data()),
+                   mesh.vertices.size_bytes());
+        file.write(padding,
+                   header.index_offset - header.vertex_offset -
+                       mesh.vertices.size_bytes());
+        file.write(reinterpret_cast<const char*>(mesh.indices.data()),
+                   mesh.indices.size_bytes());
+        file.write(padding,
+                   header.range_offset - header.index_offset -
+                       mesh.indices.size_bytes());
+        file.write(reinterpret_cast<const char*>(mesh.ranges.data()),
+                   mesh.ranges.size_bytes());
+        file.write(padding,
+                   header.meshlet_offset - header.range_offset -
+                       mesh.ranges.size_bytes());
+        file.write(reinterpret_cast<const char*>(mesh.meshlets.data()),
+                   mesh.meshlets.size_bytes());
+        file.write(padding,
+                   header.lod_offset - header.meshlet_offset -
+                       mesh.meshlets.size_bytes());
+        file.write(reinterpret_cast<const char*>(mesh.lods.data()),
+                   mesh.lods.size_bytes());
+    });
+}
+
+cooked_mesh cook(std::span<const std::byte> text,
+                 tex_coord_encoding encoding) {
+    cooked_mesh mesh;
+    auto source = parse_obj(text);
+    if (source.indices.empty()) {
+        return mesh;
+    }
+    const auto clusters =
+        optimize_vertex_cache(source.indices, source.vertices.size());
+    optimize_overdraw(source.indices, source.vertices, clusters);
+    source.vertices = optimize_vertex_fetch(source.vertices, source.indices);
+
+    math::vec3_soa positions;
+    positions.resize(source.vertices.size());
+    const auto* first_position =
+        reinterpret_cast<const std::byte*>(&source.vertices[0].pos);
+    math::deinterleave(first_position, sizeof(Vertex), positions.span());
+    mesh.bounds = math::compute_aabb(positions.span());
+    mesh.sphere = math::compute_bounding_sphere(positions.span());
+
+    // Splitting for 16 bit indices duplicates the vertices shared between
+    // ranges. It only pays off while they cost less than the index bytes
+    // saved, which is always the case for meshes that need no split.
+    auto split = source;
+    auto ranges = split_mesh(split);
+    const auto split_size = split.indices.size() * sizeof(uint16_t) +
+                            split.vertices.size() * sizeof(packed_vertex);
+    const auto whole_size = source.indices.size() * sizeof(uint32_t) +
+                            source.vertices.size() * sizeof(packed_vertex);
+    if (split_size < whole_size) {
+        source = std::move(split);
+        mesh.index_size = sizeof(uint16_t);
+    } else {
+        const auto index_count = static_cast<uint32_t>(source.indices.size());
+        const auto vertex_count = static_cast<uint32_t>(source.vertices.size());
+        ranges = {
+            {0, index_count, 0, vertex_count, mesh.bounds}
+        };
+        mesh.index_size = sizeof(uint32_t);
+    }
+
+    // Levels only add indices, so they keep the index size chosen for the
+    // full mesh.
+    auto lods = build_lod_chain(source, ranges);
+    // Meshlets come out in range order, so every level's are contiguous.
+    // Building them reorders the triangles of each range.
+    mesh.meshlet_storage = build_meshlets(source, ranges);
+    if (mesh.index_size == sizeof(uint16_t)) {
+        std::vector<uint16_t> indices(source.indices.size());
+        std::transform(source.indices.begin(),
+                       source.indices.end(),
+                       indices.begin(),
+                       [](uint32_t index) {
+                           return static_cast<uint16_t>(index);
+                       });
+        mesh.index_storage.resize(indices.size() * sizeof(uint16_t));
+        std::memcpy(mesh.index_storage.data(),
+                    indices.data(),
+                    mesh.index_storage.size());
+    } else {
+        mesh.index_storage.resize(source.indices.size() * sizeof(uint32_t));
+        std::memcpy(mesh.index_storage.data(),
+                    source.indices.data(),
+                    mesh.index_storage.size());
+    }
+
+    for (auto& lod : lods) {
+        const auto in_lod = [&](const meshlet& m) {
+            return m.range >= lod.first_range &&
+                   m.range < lod.first_range + lod.range_count;
+        };
+        const auto first = std::find_if(mesh.meshlet_storage.begin(),
+                                        mesh.meshlet_storage.end(),
+                                        in_lod);
+        const auto last =
+            std::find_if_not(first, mesh.meshlet_storage.end(), in_lod);
+        lod.first_meshlet =
+            static_cast<uint32_t>(first - mesh.meshlet_storage.begin());
+        lod.meshlet_count = static_cast<uint32_t>(last - first);
+    }
+    auto quantized = quantize_vertices(source.vertices, mesh.bounds, encoding);
+    mesh.encoding = encoding;
+    mesh.dequantization = quantized.dequantization;
+    mesh.vertex_storage = std::move(quantized.vertices);
+    mesh.range_storage = std::move(ranges);
+    mesh.lod_storage = std::move(lods);
+    mesh.vertices = mesh.vertex_storage;
+    mesh.indices = mesh.index_storage;
+    mesh.ranges = mesh.range_storage;
+    mesh.meshlets = mesh.meshlet_storage;
+    mesh.lods = mesh.lod_storage;
+    return mesh;
+}
+
+} // namespace
+
+cooked_mesh load_cooked_mesh(const std::string& source_path,
+                             const std::string& cache_path,
+                             tex_coord_encoding encoding) {
+    const auto source = open_asset(source_path, file_access::sequential);
+    if (!source.is_open()) {
+        std::cerr << "failed to open file! " << source_path << std::endl;
+        return {};
+    }
+    const auto source_hash = hash::hash_bytes(source.data(), source.size());
+
+    cooked_mesh mesh;
+    if (use_cache(mesh, open_asset(cache_path), source_hash, encoding)) {
+        return mesh;
+    }
+
+    mesh = cook(source.span(), encoding);
+    if (!mesh.indices.empty() && !write_cache(cache_path, mesh, source_hash)) {
+        std::cerr << "failed to write mesh cache! " << cache_path << std::endl;
+    }
+    return mesh;
+}
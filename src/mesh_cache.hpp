@@ -0,0 +1,57 @@
+#ifndef MESH_CACHE_HPP
+#define MESH_CACHE_HPP
+
+#include "asset_loader.hpp"
+#include "mapped_file.hpp"
+#include "mathlib.hpp"
+#include "mesh_optimizer.hpp"
+#include "meshlet.hpp"
+#include "simplifier.hpp"
+#include "vertex_format.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+// Version of the cooked mesh file. Bump it whenever Vertex or the cooking
+// steps change, so caches written by older builds get re-cooked.
+constexpr uint32_t mesh_cache_version = 8;
+
+// Deduplicated and quantized mesh, reordered for the vertex cache, overdraw
+// and vertex fetch, with coarser levels of detail, ready for upload. The
+// arrays point into the mapped cache file, or into the storage vectors when
+// the cache could not be written.
+struct cooked_mesh {
+    std::span<const packed_vertex> vertices;
+    // `index_size` bytes each, 2 when every range fits 16 bit indices.
+    std::span<const std::byte> indices;
+    uint32_t index_size = 4;
+    std::span<const mesh_range> ranges;
+    std::span<const meshlet> meshlets;
+    // The full mesh first, then ever coarser ones.
+    std::span<const mesh_lod> lods;
+    tex_coord_encoding encoding = tex_coord_encoding::unorm16;
+    vertex_dequantization dequantization{};
+    math::aabb bounds{};
+    math::sphere sphere{};
+
+    mapped_file file;
+    std::vector<packed_vertex> vertex_storage;
+    std::vector<std::byte> index_storage;
+    std::vector<mesh_range> range_storage;
+    std::vector<meshlet> meshlet_storage;
+    std::vector<mesh_lod> lod_storage;
+};
+
+// Returns the mesh cooked from the OBJ file at `source_path`. `cache_path` is
+// used as is when it holds the current version cooked from the same source
+// bytes with the same `encoding`, otherwise the source is cooked again and
+// the cache rewritten. Returns an empty mesh when the source cannot be
+// loaded.
+cooked_mesh load_cooked_mesh(const std::string& source_path,
+                             const std::string& cache_path,
+                             tex_coord_encoding encoding);
+
+#endif
@@ -0,0 +1,370 @@
+#include "mesh_optimizer.hpp"
+
+#include "mathlib.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+// FIFO cache modelled with timestamps: a vertex is cached while fewer than
+// `size` misses happened since it was last loaded. Bumping the clock by more
+// than `size` empties it.
+struct fifo_cache {
+    std::vector<uint32_t> load_time;
+    uint32_t clock;
+    unsigned size;
+
+    fifo_cache(size_t vertex_count, unsigned size)
+        : load_time(vertex_count, 0), clock(size + 1), size(size) {}
+
+    bool contains(uint32_t vertex) const {
+        return clock - load_time[vertex] <= size;
+    }
+    // Returns whether `vertex` missed.
+    bool access(uint32_t vertex) {
+        if (contains(vertex)) {
+            return false;
+        }
+        load_time[vertex] = clock++;
+        return true;
+    }
+    unsigned access_triangle(const uint32_t* triangle) {
+        return access(triangle[0]) + access(triangle[1]) + access(triangle[2]);
+    }
+    void flush() { clock += size + 1; }
+};
+
+// Triangles around every vertex, as offsets into one flat array.
+struct vertex_adjacency {
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> triangles;
+
+    vertex_adjacency(std::span<const uint32_t> indices, size_t vertex_count)
+        : offsets(vertex_count + 1, 0), triangles(indices.size()) {
+        for (const auto index : indices) {
+            ++offsets[index + 1];
+        }
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        auto fill = offsets;
+        for (size_t i = 0; i < indices.size(); ++i) {
+            triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+    std::span<const uint32_t> around(uint32_t vertex) const {
+        return {triangles.data() + offsets[vertex],
+                triangles.data() + offsets[vertex + 1]};
+    }
+};
+
+// Copies the triangles of `indices` in `order` back into `indices`.
+void reorder_triangles(std::span<uint32_t> indices,
+                       std::span<const uint32_t> order) {
+    const std::vector<uint32_t> source(indices.begin(), indices.end());
+    for (size_t i = 0; i < order.size(); ++i) {
+        std::copy_n(&source[3 * order[i]], 3, &indices[3 * i]);
+    }
+}
+
+} // namespace
+
+std::vector<uint32_t> optimize_vertex_cache(std::span<uint32_t> indices,
+                                            size_t vertex_count,
+                                            unsigned cache_size) {
+    const auto triangle_count = indices.size() / 3;
+    if (triangle_count == 0) {
+        return {};
+    }
+    const vertex_adjacency adjacency(indices, vertex_count);
+    std::vector<uint32_t> live(vertex_count);
+    for (size_t v = 0; v < vertex_count; ++v) {
+        live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+    }
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<uint32_t> order;
+    order.reserve(triangle_count);
+    std::vector<uint32_t> clusters;
+    fifo_cache cache(vertex_count, cache_size);
+
+    // Vertices of emitted triangles, the fallback when fanning runs into a
+    // dead end. Popped last in, first out.
+    std::vector<uint32_t> dead_end;
+    std::vector<uint32_t> candidates;
+    uint32_t cursor = 0;
+    auto skip_dead_end = [&]() -> int64_t {
+        while (!dead_end.empty()) {
+            const auto vertex = dead_end.back();
+            dead_end.pop_back();
+            if (live[vertex] > 0) {
+                return vertex;
+            }
+        }
+        for (; cursor < vertex_count; ++cursor) {
+            if (live[cursor] > 0) {
+                return cursor;
+            }
+        }
+        return -1;
+    };
+
+    int64_t fan = skip_dead_end();
+    clusters.push_back(0);
+    while (fan >= 0) {
+        candidates.clear();
+        const auto fan_vertex = static_cast<uint32_t>(fan);
+        for (const auto triangle : adjacency.around(fan_vertex)) {
+            if (emitted[triangle]) {
+                continue;
+            }
+            emitted[triangle] = true;
+            order.push_back(triangle);
+            for (size_t k = 0; k < 3; ++k) {
+                const auto vertex = indices[3 * triangle + k];
+                dead_end.push_back(vertex);
+                candidates.push_back(vertex);
+                --live[vertex];
+                cache.access(vertex);
+            }
+        }
+
+        // The candidate that stays cached longest while its remaining
+        // triangles are emitted, or a dead end fallback.
+        int64_t next = -1;
+        int64_t best_priority = -1;
+        for (const auto vertex : candidates) {
+            if (live[vertex] == 0) {
+                continue;
+            }
+            int64_t priority = 0;
+            const int64_t age = cache.clock - cache.load_time[vertex];
+            if (age + 2 * live[vertex] <= cache_size) {
+                priority = age;
+            }
+            if (priority > best_priority) {
+                best_priority = priority;
+                next = vertex;
+            }
+        }
+        if (next < 0) {
+            next = skip_dead_end();
+            if (next >= 0 && order.size() < triangle_count) {
+                clusters.push_back(static_cast<uint32_t>(order.size()));
+            }
+        }
+        fan = next;
+    }
+
+    reorder_triangles(indices, order);
+    return clusters;
+}
+
+void optimize_overdraw(std::span<uint32_t> indices,
+                       std::span<const Vertex> vertices,
+                       std::span<const uint32_t> clusters,
+                       float threshold,
+                       unsigned cache_size) {
+    const auto triangle_count = static_cast<uint32_t>(indices.size() / 3);
+    if (triangle_count == 0 || clusters.empty()) {
+        return;
+    }
+
+    fifo_cache cache(vertices.size(), cache_size);
+    unsigned input_misses = 0;
+    for (uint32_t t = 0; t < triangle_count; ++t) {
+        input_misses += cache.access_triangle(&indices[3 * t]);
+    }
+
+    // Soft boundaries: a run whose miss rate is already close to its hard
+    // cluster's loses little by starting with a cold cache.
+    std::vector<uint32_t> starts;
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        const auto begin = clusters[c];
+        const auto end = c + 1 < clusters.size() ? clusters[c + 1]
+                                                 : triangle_count;
+        cache.flush();
+        unsigned cluster_misses = 0;
+        for (auto t = begin; t < end; ++t) {
+            cluster_misses += cache.access_triangle(&indices[3 * t]);
+        }
+        const auto cluster_acmr =
+            static_cast<float>(cluster_misses) / (end - begin);
+
+        cache.flush();
+        starts.push_back(begin);
+        auto run_begin = begin;
+        unsigned run_misses = 0;
+        for (auto t = begin; t + 1 < end; ++t) {
+            run_misses += cache.access_triangle(&indices[3 * t]);
+            if (run_misses <= threshold * cluster_acmr * (t + 1 - run_begin)) {
+                starts.push_back(t + 1);
+                run_begin = t + 1;
+                run_misses = 0;
+                cache.flush();
+            }
+        }
+        // The rest of the cluster is a run too, kept with the previous one
+        // unless it passes the same test.
+        run_misses += cache.access_triangle(&indices[3 * (end - 1)]);
+        if (run_begin > begin &&
+            run_misses > threshold * cluster_acmr * (end - run_begin)) {
+            starts.pop_back();
+        }
+    }
+    starts.push_back(triangle_count);
+
+    // Area weighted centroid and normal of every cluster.
+    struct cluster_shape {
+        math::vec3 centroid{};
+        math::vec3 normal{};
+        float area = 0;
+    };
+    std::vector<cluster_shape> shapes(starts.size() - 1);
+    math::vec3 mesh_centroid{};
+    float mesh_area = 0;
+    for (size_t c = 0; c + 1 < starts.size(); ++c) {
+        auto& shape = shapes[c];
+        for (auto t = starts[c]; t < starts[c + 1]; ++t) {
+            const auto& a = vertices[indices[3 * t + 0]].pos;
+            const auto& b = vertices[indices[3 * t + 1]].pos;
+            const auto& d = vertices[indices[3 * t + 2]].pos;
+            const auto normal = math::cross(b - a, d - a);
+            const auto area = math::detail::sqrt(math::dot(normal, normal));
+            shape.centroid = shape.centroid + (a + b + d) * (area / 3);
+            shape.normal = shape.normal + normal;
+            shape.area += area;
+        }
+        mesh_centroid = mesh_centroid + shape.centroid;
+        mesh_area += shape.area;
+    }
+    if (mesh_area > 0) {
+        mesh_centroid = mesh_centroid * (1 / mesh_area);
+    }
+
+    std::vector<float> keys(shapes.size(), 0.0f);
+    for (size_t c = 0; c < shapes.size(); ++c) {
+        const auto& shape = shapes[c];
+        const auto normal_length =
+            math::detail::sqrt(math::dot(shape.normal, shape.normal));
+        if (shape.area > 0 && normal_length > 0) {
+            const auto offset = shape.centroid * (1 / shape.area) -
+                                mesh_centroid;
+            keys[c] = math::dot(offset, shape.normal) / normal_length;
+        }
+    }
+    std::vector<uint32_t> cluster_order(shapes.size());
+    std::iota(cluster_order.begin(), cluster_order.end(), 0);
+    std::stable_sort(cluster_order.begin(),
+                     cluster_order.end(),
+                     [&](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+    std::vector<uint32_t> order;
+    order.reserve(triangle_count);
+    cache.flush();
+    unsigned sorted_misses = 0;
+    for (const auto c : cluster_order) {
+        for (auto t = starts[c]; t < starts[c + 1]; ++t) {
+            order.push_back(t);
+            sorted_misses += cache.access_triangle(&indices[3 * t]);
+        }
+    }
+    if (sorted_misses > threshold * input_misses) {
+        return;
+    }
+    reorder_triangles(indices, order);
+}
+
+std::vector<Vertex> optimize_vertex_fetch(std::span<const Vertex> vertices,
+                                          std::span<uint32_t> indices) {
+    constexpr auto unused = ~uint32_t{0};
+    std::vector<uint32_t> remap(vertices.size(), unused);
+    std::vector<Vertex> result;
+    result.reserve(vertices.size());
+    for (auto& index : indices) {
+        if (remap[index] == unused) {
+            remap[index] = static_cast<uint32_t>(result.size());
+            result.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    return result;
+}
+
+std::vector<mesh_range> split_mesh(mesh_data& mesh, size_t max_vertices) {
+    constexpr auto unused = ~uint32_t{0};
+    // Index of each source vertex inside the current range.
+    std::vector<uint32_t> local(mesh.vertices.size(), unused);
+    std::vector<uint32_t> range_sources;
+    std::vector<Vertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+    std::vector<mesh_range> ranges;
+
+    mesh_range range{};
+    auto finish_range = [&](size_t end) {
+        range.index_count = static_cast<uint32_t>(end - range.first_index);
+        range.vertex_count = static_cast<uint32_t>(range_sources.size());
+        if (range.vertex_count > 0) {
+            auto& bounds = range.bounds;
+            bounds = {vertices[range.vertex_offset].pos,
+                      vertices[range.vertex_offset].pos};
+            for (auto v = range.vertex_offset; v < vertices.size(); ++v) {
+                const auto& pos = vertices[v].pos;
+                bounds.min = {std::min(bounds.min.x, pos.x),
+                              std::min(bounds.min.y, pos.y),
+                              std::min(bounds.min.z, pos.z)};
+                bounds.max = {std::max(bounds.max.x, pos.x),
+                              std::max(bounds.max.y, pos.y),
+                              std::max(bounds.max.z, pos.z)};
+            }
+        }
+        ranges.push_back(range);
+        for (const auto source : range_sources) {
+            local[source] = unused;
+        }
+        range_sources.clear();
+    };
+
+    for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+        const auto a = mesh.indices[i + 0];
+        const auto b = mesh.indices[i + 1];
+        const auto c = mesh.indices[i + 2];
+        const size_t added = (local[a] == unused) +
+                             (local[b] == unused && b != a) +
+                             (local[c] == unused && c != a && c != b);
+        if (range_sources.size() + added > max_vertices) {
+            finish_range(i);
+            range = {};
+            range.first_index = static_cast<uint32_t>(i);
+            range.vertex_offset = static_cast<uint32_t>(vertices.size());
+        }
+        for (size_t k = 0; k < 3; ++k) {
+            auto& index = mesh.indices[i + k];
+            if (local[index] == unused) {
+                local[index] = static_cast<uint32_t>(range_sources.size());
+                range_sources.push_back(index);
+                vertices.push_back(mesh.vertices[index]);
+            }
+            index = local[index];
+        }
+    }
+    finish_range(mesh.indices.size());
+    mesh.vertices = std::move(vertices);
+    return ranges;
+}
+
+vertex_cache_stats analyze_vertex_cache(std::span<const uint32_t> indices,
+                                        size_t vertex_count,
+                                        unsigned cache_size) {
+    fifo_cache cache(vertex_count, cache_size);
+    size_t transformed = 0;
+    for (const auto index : indices) {
+        transformed += cache.access(index);
+    }
+    vertex_cache_stats stats{transformed, 0.0f, 0.0f};
+    if (!indices.empty()) {
+        stats.acmr = static_cast<float>(transformed) / (indices.size() / 3);
+    }
+    if (vertex_count > 0) {
+        stats.atvr = static_cast<float>(transformed) / vertex_count;
+    }
+    return stats;
+}
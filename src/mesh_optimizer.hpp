@@ -0,0 +1,86 @@
+#ifndef MESH_OPTIMIZER_HPP
+#define MESH_OPTIMIZER_HPP
+
+#include "asset_loader.hpp"
+#include "mathlib.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Index and vertex buffer reordering for the GPU's post-transform cache,
+// overdraw and vertex fetch. Run them in the order declared here: the overdraw
+// pass sorts the clusters the cache pass produced, and the fetch pass follows
+// the final index order.
+
+// Size of the FIFO post-transform cache the passes and statistics model.
+constexpr unsigned vertex_cache_size = 16;
+
+// Reorders the triangles of `indices` in place with Tipsify (Sander et al.,
+// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"), so
+// consecutive triangles reuse recently transformed vertices. Returns the first
+// triangle of every cluster, the runs that start after the cache went cold.
+std::vector<uint32_t> optimize_vertex_cache(std::span<uint32_t> indices,
+                                            size_t vertex_count,
+                                            unsigned cache_size =
+                                                vertex_cache_size);
+
+// Splits `clusters` further wherever the cache miss rate so far stays within
+// `threshold` of the cluster's own, then sorts the clusters so those facing
+// away from the mesh centre are drawn first. They are the likeliest to occlude
+// the rest, which lowers overdraw while keeping most of the cache locality.
+// When sorting would still raise the miss rate by more than `threshold`, the
+// triangles are left in the order the cache pass gave them.
+void optimize_overdraw(std::span<uint32_t> indices,
+                       std::span<const Vertex> vertices,
+                       std::span<const uint32_t> clusters,
+                       float threshold = 1.05f,
+                       unsigned cache_size = vertex_cache_size);
+
+// Returns the vertices in order of first use and rewrites `indices` to match,
+// so the vertex fetch walks memory mostly forward. Unused vertices are
+// dropped.
+std::vector<Vertex> optimize_vertex_fetch(std::span<const Vertex> vertices,
+                                          std::span<uint32_t> indices);
+
+// Triangles drawn by one vkCmdDrawIndexed. Their indices are relative to
+// `vertex_offset` and below `vertex_count`.
+struct mesh_range {
+    uint32_t first_index;
+    uint32_t index_count;
+    uint32_t vertex_offset;
+    uint32_t vertex_count;
+    math::aabb bounds;
+};
+
+// Largest vertex count a range drawn with 16 bit indices can reference.
+// Primitive restart is off, so 0xffff is an ordinary index.
+constexpr size_t max_16bit_range_vertices = 65536;
+
+// Cuts the triangles, in their current order, into ranges that each reference
+// at most `max_vertices` vertices. `mesh` is rewritten so every range owns a
+// contiguous run of vertices and its indices are relative to it. Vertices used
+// by several ranges are duplicated, few of them after optimize_vertex_fetch.
+std::vector<mesh_range> split_mesh(mesh_data& mesh,
+                                   size_t max_vertices =
+                                       max_16bit_range_vertices);
+
+struct vertex_cache_stats {
+    size_t vertices_transformed;
+    // Average cache miss ratio, transformed vertices per triangle. 0.5 is the
+    // ideal for large regular grids, 3 means no reuse at all.
+    float acmr;
+    // Average transform to vertex ratio, transformed vertices per vertex. 1 is
+    // the ideal.
+    float atvr;
+};
+
+// Simulates a FIFO post-transform cache of `cache_size` entries over
+// `indices`.
+vertex_cache_stats analyze_vertex_cache(std::span<const uint32_t> indices,
+                                        size_t vertex_count,
+                                        unsigned cache_size =
+                                            vertex_cache_size);
+
+#endif
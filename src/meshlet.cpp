@@ -0,0 +1,296 @@
+#include "meshlet.hpp"
+
+#include "mathlib_batch.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+namespace {
+
+// Normals spread this far apart (dot product with the axis) leave a cone too
+// wide to be worth testing.
+constexpr float min_cone_dot = 0.1f;
+
+// Growing a meshlet prefers triangles that add few vertices, then those
+// facing along its normals: a triangle turned fully away costs as much as
+// this many new vertices.
+constexpr float cone_weight = 2.0f;
+
+// Once a meshlet holds this many triangles, it is closed rather than grown
+// by a triangle more than 60 degrees off its average normal, so its cone
+// still culls. Meshlets stay large enough for the draws merged from them to
+// be few.
+constexpr size_t min_closing_triangles = 32;
+constexpr float max_normal_spread_dot = 0.5f;
+
+math::vec3 triangle_normal(const math::vec3& a,
+                           const math::vec3& b,
+                           const math::vec3& c) {
+    const auto normal = math::cross(b - a, c - a);
+    const auto length = math::detail::sqrt(math::dot(normal, normal));
+    return length > 0 ? normal * (1 / length) : math::vec3{};
+}
+
+void compute_bounds(meshlet& m,
+                    const mesh_data& mesh,
+                    const mesh_range& range,
+                    std::span<const uint32_t> vertices) {
+    math::vec3_soa positions;
+    positions.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        const auto& pos = mesh.vertices[range.vertex_offset + vertices[i]].pos;
+        positions.x[i] = pos.x;
+        positions.y[i] = pos.y;
+        positions.z[i] = pos.z;
+    }
+    m.sphere = math::compute_bounding_sphere(positions.span());
+
+    // Axis is the average of the unit triangle normals. Degenerate triangles
+    // face nowhere and are left out.
+    const auto* indices = mesh.indices.data() + m.first_index;
+    const auto triangle_count = m.index_count / 3;
+    std::vector<math::vec3> normals;
+    normals.reserve(triangle_count);
+    math::vec3 axis{};
+    for (uint32_t t = 0; t < triangle_count; ++t) {
+        const auto& a = mesh.vertices[range.vertex_offset + indices[3 * t]].pos;
+        const auto& b =
+            mesh.vertices[range.vertex_offset + indices[3 * t + 1]].pos;
+        const auto& c =
+            mesh.vertices[range.vertex_offset + indices[3 * t + 2]].pos;
+        normals.push_back(triangle_normal(a, b, c));
+        axis = axis + normals.back();
+    }
+
+    m.cone_apex = m.sphere.center;
+    m.cone_axis = {};
+    m.cone_cutoff = 2.0f;
+    const auto axis_length = math::detail::sqrt(math::dot(axis, axis));
+    if (axis_length == 0) {
+        return;
+    }
+    axis = axis * (1 / axis_length);
+    float min_dot = 1.0f;
+    for (const auto& normal : normals) {
+        if (!(normal == math::vec3{})) {
+            min_dot = std::min(min_dot, math::dot(axis, normal));
+        }
+    }
+    if (min_dot <= min_cone_dot) {
+        return;
+    }
+
+    // Moves the apex back along the axis until it lies behind every
+    // triangle's plane, so any camera inside the cone sees only back faces.
+    float max_t = 0.0f;
+    for (uint32_t t = 0; t < triangle_count; ++t) {
+        if (normals[t] == math::vec3{}) {
+            continue;
+        }
+        const auto& a = mesh.vertices[range.vertex_offset + indices[3 * t]].pos;
+        const auto distance = math::dot(m.sphere.center - a, normals[t]);
+        max_t = std::max(max_t, distance / math::dot(axis, normals[t]));
+    }
+    m.cone_apex = m.sphere.center - axis * max_t;
+    m.cone_axis = axis;
+    m.cone_cutoff = math::detail::sqrt(1 - min_dot * min_dot);
+}
+
+} // namespace
+
+std::vector<meshlet> build_meshlets(mesh_data& mesh,
+                                    std::span<const mesh_range> ranges) {
+    std::vector<meshlet> meshlets;
+    meshlets.reserve(mesh.indices.size() / (3 * max_meshlet_triangles / 2));
+    std::vector<uint32_t> vertices;
+    vertices.reserve(max_meshlet_vertices);
+    // Meshlet number + 1 of the last meshlet that used each vertex, or
+    // queued each triangle as a candidate, so neither needs clearing between
+    // meshlets.
+    std::vector<uint32_t> used_by;
+    std::vector<uint32_t> queued_by;
+    // Index among its meshlet's vertices, while the meshlet is remapped.
+    std::vector<uint32_t> remapped_by;
+    std::vector<uint32_t> local_of;
+    std::vector<uint32_t> adjacency_offsets;
+    std::vector<uint32_t> adjacency;
+    std::vector<math::vec3> normals;
+    std::vector<bool> emitted;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> source;
+    std::vector<uint32_t> local_indices;
+
+    for (uint32_t r = 0; r < ranges.size(); ++r) {
+        const auto& range = ranges[r];
+        const auto triangle_count = range.index_count / 3;
+        auto* indices = mesh.indices.data() + range.first_index;
+        const auto* positions = &mesh.vertices[range.vertex_offset];
+        const auto first_meshlet = meshlets.size();
+
+        // Triangles around every vertex, as offsets into one flat array.
+        adjacency_offsets.assign(range.vertex_count + 1, 0);
+        for (uint32_t i = 0; i < range.index_count; ++i) {
+            ++adjacency_offsets[indices[i] + 1];
+        }
+        std::partial_sum(adjacency_offsets.begin(),
+                         adjacency_offsets.end(),
+                         adjacency_offsets.begin());
+        adjacency.resize(range.index_count);
+        auto fill = adjacency_offsets;
+        normals.resize(triangle_count);
+        for (uint32_t t = 0; t < triangle_count; ++t) {
+            for (size_t k = 0; k < 3; ++k) {
+                adjacency[fill[indices[3 * t + k]]++] = t;
+            }
+            normals[t] = triangle_normal(positions[indices[3 * t]].pos,
+                                         positions[indices[3 * t + 1]].pos,
+                                         positions[indices[3 * t + 2]].pos);
+        }
+        used_by.assign(range.vertex_count, 0);
+        remapped_by.assign(range.vertex_count, 0);
+        local_of.resize(range.vertex_count);
+        queued_by.assign(triangle_count, 0);
+        emitted.assign(triangle_count, false);
+        order.clear();
+
+        // Seeds are taken in the current triangle order, so meshlets follow
+        // the overdraw order and a seed is usually near the last meshlet.
+        uint32_t cursor = 0;
+        while (order.size() < triangle_count) {
+            const auto stamp = static_cast<uint32_t>(meshlets.size() + 1);
+            const auto meshlet_start = order.size();
+            vertices.clear();
+            candidates.clear();
+            math::vec3 normal_sum{};
+            const auto added_vertices = [&](uint32_t t) {
+                const auto a = indices[3 * t + 0];
+                const auto b = indices[3 * t + 1];
+                const auto c = indices[3 * t + 2];
+                return size_t{used_by[a] != stamp} +
+                       (used_by[b] != stamp && b != a) +
+                       (used_by[c] != stamp && c != a && c != b);
+            };
+            const auto add = [&](uint32_t t) {
+                emitted[t] = true;
+                order.push_back(t);
+                normal_sum = normal_sum + normals[t];
+                for (size_t k = 0; k < 3; ++k) {
+                    const auto vertex = indices[3 * t + k];
+                    if (used_by[vertex] == stamp) {
+                        continue;
+                    }
+                    used_by[vertex] = stamp;
+                    vertices.push_back(vertex);
+                    for (auto i = adjacency_offsets[vertex];
+                         i < adjacency_offsets[vertex + 1];
+                         ++i) {
+                        const auto neighbor = adjacency[i];
+                        if (!emitted[neighbor] &&
+                            queued_by[neighbor] != stamp) {
+                            queued_by[neighbor] = stamp;
+                            candidates.push_back(neighbor);
+                        }
+                    }
+                }
+            };
+
+            while (emitted[cursor]) {
+                ++cursor;
+            }
+            add(cursor);
+            while (order.size() - meshlet_start < max_meshlet_triangles) {
+                const auto sum_length =
+                    math::detail::sqrt(math::dot(normal_sum, normal_sum));
+                const auto axis = sum_length > 0 ? normal_sum * (1 / sum_length)
+                                                 : math::vec3{};
+                // The connected triangle adding the fewest vertices, ties
+                // going to the one closest to the meshlet's normals.
+                int64_t best = -1;
+                auto best_score = std::numeric_limits<float>::max();
+                size_t kept = 0;
+                for (const auto candidate : candidates) {
+                    if (emitted[candidate]) {
+                        continue;
+                    }
+                    candidates[kept++] = candidate;
+                    const auto added = added_vertices(candidate);
+                    if (vertices.size() + added > max_meshlet_vertices) {
+                        continue;
+                    }
+                    const auto score =
+                        added +
+                        cone_weight *
+                            (1 - math::dot(axis, normals[candidate]));
+                    if (score < best_score) {
+                        best_score = score;
+                        best = candidate;
+                    }
+                }
+                candidates.resize(kept);
+
+                const auto size = order.size() - meshlet_start;
+                if (best < 0) {
+                    // Nothing connected fits: a meshlet that is still small
+                    // continues with the next triangle in order.
+                    if (size >= min_closing_triangles) {
+                        break;
+                    }
+                    while (cursor < triangle_count && emitted[cursor]) {
+                        ++cursor;
+                    }
+                    if (cursor == triangle_count ||
+                        vertices.size() + added_vertices(cursor) >
+                            max_meshlet_vertices) {
+                        break;
+                    }
+                    best = cursor;
+                } else if (size >= min_closing_triangles &&
+                           math::dot(axis, normals[best]) <
+                               max_normal_spread_dot) {
+                    break;
+                }
+                add(static_cast<uint32_t>(best));
+            }
+
+            meshlet current{};
+            current.first_index =
+                range.first_index + static_cast<uint32_t>(3 * meshlet_start);
+            current.index_count =
+                static_cast<uint32_t>(3 * (order.size() - meshlet_start));
+            current.range = r;
+            meshlets.push_back(current);
+        }
+
+        // The triangles are stored in meshlet order, each meshlet reordered
+        // for the vertex cache on its own vertices.
+        source.assign(indices, indices + range.index_count);
+        for (size_t i = 0; i < order.size(); ++i) {
+            std::copy_n(&source[3 * order[i]], 3, &indices[3 * i]);
+        }
+        for (auto m = first_meshlet; m < meshlets.size(); ++m) {
+            auto& current = meshlets[m];
+            const auto stamp = static_cast<uint32_t>(m + 1);
+            auto* meshlet_indices =
+                mesh.indices.data() + current.first_index;
+            vertices.clear();
+            local_indices.resize(current.index_count);
+            for (uint32_t i = 0; i < current.index_count; ++i) {
+                const auto vertex = meshlet_indices[i];
+                if (remapped_by[vertex] != stamp) {
+                    remapped_by[vertex] = stamp;
+                    local_of[vertex] = static_cast<uint32_t>(vertices.size());
+                    vertices.push_back(vertex);
+                }
+                local_indices[i] = local_of[vertex];
+            }
+            optimize_vertex_cache(local_indices, vertices.size());
+            for (uint32_t i = 0; i < current.index_count; ++i) {
+                meshlet_indices[i] = vertices[local_indices[i]];
+            }
+            compute_bounds(current, mesh, range, vertices);
+        }
+    }
+    return meshlets;
+}
@@ -0,0 +1,53 @@
+#ifndef MESHLET_HPP
+#define MESHLET_HPP
+
+#include "asset_loader.hpp"
+#include "mathlib.hpp"
+#include "mesh_optimizer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Meshlets are small runs of consecutive triangles in the index buffer, culled
+// on the CPU as a unit before the surviving runs are merged into draws.
+
+constexpr size_t max_meshlet_vertices = 64;
+constexpr size_t max_meshlet_triangles = 124;
+
+struct meshlet {
+    math::sphere sphere;
+    // Every triangle faces away from cameras inside the cone around `-axis`
+    // with its tip at `apex`, see is_backfacing.
+    math::vec3 cone_apex;
+    math::vec3 cone_axis;
+    // Sine of the normal cone's half angle. Above 1 when the normals spread
+    // too far for the cone to ever cull.
+    float cone_cutoff;
+    uint32_t first_index;
+    uint32_t index_count;
+    // The mesh_range the indices belong to.
+    uint32_t range;
+};
+
+// Groups the triangles of every range into meshlets of at most
+// max_meshlet_vertices vertices and max_meshlet_triangles triangles. Each is
+// grown from a seed, taken in the current triangle order, over the triangles
+// sharing its vertices that add the fewest new ones and turn least from its
+// normals; full enough meshlets stop at a sharp turn. `mesh` holds indices
+// relative to the ranges, as split_mesh leaves them. Its triangles are
+// reordered within their range into meshlet order, and every meshlet for
+// the vertex cache.
+std::vector<meshlet> build_meshlets(mesh_data& mesh,
+                                    std::span<const mesh_range> ranges);
+
+// Whether every triangle of `m` faces away from `camera`, both in the mesh's
+// space.
+inline bool is_backfacing(const meshlet& m, const math::vec3& camera) {
+    const auto direction = m.cone_apex - camera;
+    const auto length = math::detail::sqrt(math::dot(direction, direction));
+    return math::dot(direction, m.cone_axis) > m.cone_cutoff * length;
+}
+
+#endif
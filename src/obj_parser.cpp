@@ -0,0 +1,450 @@
+#include "obj_parser.hpp"
+
+#include "flat_hash_map.hpp"
+#include "hash.hpp"
+#include "job_system.hpp"
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+// Chunks smaller than this are not worth a job.
+constexpr size_t min_chunk_size = 1 << 20;
+
+struct corner {
+    int32_t position;
+    int32_t texcoord; // -1 when the face has no texture coordinates
+};
+
+struct chunk {
+    const char* begin;
+    const char* end;
+
+    size_t position_count = 0;
+    size_t texcoord_count = 0;
+    size_t position_base = 0;
+    size_t texcoord_base = 0;
+
+    // Three per triangle, with absolute indices.
+    std::vector<corner> corners;
+    // Distinct corners in order of first use inside the chunk, and indices
+    // into them.
+    std::vector<corner> unique_corners;
+    std::vector<uint32_t> indices;
+    // Index of each of `unique_corners` in the final mesh.
+    std::vector<uint32_t> remap;
+    bool valid = true;
+};
+
+using corner_map = flat_hash_map<corner,
+                                 uint32_t,
+                                 hash::byte_hash<corner>,
+                                 hash::byte_equal<corner>>;
+using vertex_map = flat_hash_map<Vertex,
+                                 uint32_t,
+                                 hash::byte_hash<Vertex>,
+                                 hash::byte_equal<Vertex>>;
+
+// The scanning below follows tiny_obj_loader.h rule for rule, so both read
+// the same numbers from the same text. Lines end at '\n' or '\r'.
+
+bool is_space(char c) { return c == ' ' || c == '\t'; }
+bool is_digit(char c) { return static_cast<unsigned>(c - '0') < 10; }
+bool is_line_end(char c) { return c == '\n' || c == '\r'; }
+
+const char* skip_spaces(const char* p, const char* end) {
+    while (p != end && is_space(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+// Next ' ', '\t', '\r' or, for indices, '/'.
+const char* token_end(const char* p, const char* end, bool slash) {
+    while (p != end && !is_space(*p) && *p != '\r' && !(slash && *p == '/')) {
+        ++p;
+    }
+    return p;
+}
+
+// atoi
+int parse_int(const char* p, const char* end) {
+    p = skip_spaces(p, end);
+    if (p != end && *p == '+') {
+        ++p;
+    }
+    int value = 0;
+    std::from_chars(p, end, value);
+    return value;
+}
+
+// tinyobj's tryParseDouble. It is not correctly rounded, std::from_chars
+// would disagree with it in the last bit for some inputs.
+bool parse_double(const char* s, const char* s_end, double& result) {
+    if (s >= s_end) {
+        return false;
+    }
+    double mantissa = 0.0;
+    int exponent = 0;
+    char sign = '+';
+    char exp_sign = '+';
+    const char* curr = s;
+    int read = 0;
+    bool end_not_reached = false;
+
+    if (*curr == '+' || *curr == '-') {
+        sign = *curr;
+        curr++;
+    } else if (!is_digit(*curr)) {
+        return false;
+    }
+
+    end_not_reached = curr != s_end;
+    while (end_not_reached && is_digit(*curr)) {
+        mantissa *= 10;
+        mantissa += static_cast<int>(*curr - '0');
+        curr++;
+        read++;
+        end_not_reached = curr != s_end;
+    }
+    if (read == 0) {
+        return false;
+    }
+
+    if (end_not_reached && *curr == '.') {
+        curr++;
+        read = 1;
+        end_not_reached = curr != s_end;
+        while (end_not_reached && is_digit(*curr)) {
+            static const double pow_lut[] = {
+                1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001};
+            mantissa += static_cast<int>(*curr - '0') *
+                        (read < 8 ? pow_lut[read] : std::pow(10.0, -read));
+            read++;
+            curr++;
+            end_not_reached = curr != s_end;
+        }
+    } else if (!end_not_reached || (*curr != 'e' && *curr != 'E')) {
+        end_not_reached = false;
+    }
+
+    if (end_not_reached && (*curr == 'e' || *curr == 'E')) {
+        curr++;
+        end_not_reached = curr != s_end;
+        if (end_not_reached && (*curr == '+' || *curr == '-')) {
+            exp_sign = *curr;
+            curr++;
+        } else if (!end_not_reached || !is_digit(*curr)) {
+            return false;
+        }
+        read = 0;
+        end_not_reached = curr != s_end;
+        while (end_not_reached && is_digit(*curr)) {
+            exponent *= 10;
+            exponent += static_cast<int>(*curr - '0');
+            curr++;
+            read++;
+            end_not_reached = curr != s_end;
+        }
+        exponent *= exp_sign == '+' ? 1 : -1;
+        if (read == 0) {
+            return false;
+        }
+    }
+
+    result = (sign == '+' ? 1 : -1) *
+             (exponent ? std::ldexp(mantissa * std::pow(5.0, exponent),
+                                    exponent)
+                       : mantissa);
+    return true;
+}
+
+// parseReal, missing or malformed values read as 0.
+float parse_float(const char*& token, const char* end) {
+    token = skip_spaces(token, end);
+    const auto value_end = token_end(token, end, false);
+    double value = 0.0;
+    parse_double(token, value_end, value);
+    token = value_end;
+    return static_cast<float>(value);
+}
+
+// fixIndex, `count` is the number of elements declared so far.
+int32_t resolve_index(int index, size_t count) {
+    if (index > 0) {
+        return index - 1;
+    }
+    if (index == 0) {
+        return 0;
+    }
+    return static_cast<int32_t>(count) + index;
+}
+
+enum class line_type { other, position, texcoord, face };
+
+// Returns the type and moves `p` past the keyword.
+line_type classify(const char*& p, const char* end) {
+    p = skip_spaces(p, end);
+    if (end - p < 2) {
+        return line_type::other;
+    }
+    if (p[0] == 'v' && is_space(p[1])) {
+        p += 2;
+        return line_type::position;
+    }
+    if (p[0] == 'f' && is_space(p[1])) {
+        p += 2;
+        return line_type::face;
+    }
+    if (end - p >= 3 && p[0] == 'v' && p[1] == 't' && is_space(p[2])) {
+        p += 3;
+        return line_type::texcoord;
+    }
+    return line_type::other;
+}
+
+const char* line_end(const char* p, const char* end) {
+    while (p != end && !is_line_end(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+void count_lines(chunk& c) {
+    for (auto p = c.begin; p < c.end;) {
+        const auto end = line_end(p, c.end);
+        switch (classify(p, end)) {
+        case line_type::position:
+            ++c.position_count;
+            break;
+        case line_type::texcoord:
+            ++c.texcoord_count;
+            break;
+        default:
+            break;
+        }
+        p = end == c.end ? end : end + 1;
+    }
+}
+
+// Reads positions and texture coordinates into their slices of the global
+// arrays and triangulates faces as a fan, like tinyobj.
+void parse_lines(chunk& c, float* positions, float* texcoords) {
+    auto position_count = c.position_base;
+    auto texcoord_count = c.texcoord_base;
+    std::vector<corner> face;
+    for (auto p = c.begin; p < c.end;) {
+        const auto end = line_end(p, c.end);
+        switch (classify(p, end)) {
+        case line_type::position: {
+            auto* out = positions + 3 * position_count++;
+            out[0] = parse_float(p, end);
+            out[1] = parse_float(p, end);
+            out[2] = parse_float(p, end);
+            break;
+        }
+        case line_type::texcoord: {
+            auto* out = texcoords + 2 * texcoord_count++;
+            out[0] = parse_float(p, end);
+            out[1] = parse_float(p, end);
+            break;
+        }
+        case line_type::face: {
+            face.clear();
+            p = skip_spaces(p, end);
+            while (p != end && *p != '\r') {
+                corner vertex{resolve_index(parse_int(p, end), position_count),
+                              -1};
+                p = token_end(p, end, true);
+                if (p != end && *p == '/') {
+                    ++p;
+                    // i//k has no texture coordinate.
+                    if (p == end || *p != '/') {
+                        vertex.texcoord =
+                            resolve_index(parse_int(p, end), texcoord_count);
+                        p = token_end(p, end, true);
+                    }
+                    if (p != end && *p == '/') {
+                        ++p;
+                        p = token_end(p, end, true);
+                    }
+                }
+                face.push_back(vertex);
+                while (p != end && (is_space(*p) || *p == '\r')) {
+                    ++p;
+                }
+            }
+            for (size_t k = 2; k < face.size(); ++k) {
+                c.corners.push_back(face[0]);
+                c.corners.push_back(face[k - 1]);
+                c.corners.push_back(face[k]);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        p = end == c.end ? end : end + 1;
+    }
+}
+
+// Merges corners with the same position and texture coordinate index. Two
+// indices can still name equal values, the final merge catches those. Keying
+// on the 8 byte index pair keeps this table much smaller than one keyed on
+// whole vertices.
+void deduplicate(chunk& c, size_t position_total, size_t texcoord_total) {
+    corner_map unique_corners;
+    unique_corners.reserve(c.corners.size() / 4);
+    c.unique_corners.reserve(c.corners.size() / 4);
+    c.indices.reserve(c.corners.size());
+    for (const auto& key : c.corners) {
+        const auto next_index = static_cast<uint32_t>(c.unique_corners.size());
+        const auto [slot, inserted] =
+            unique_corners.try_emplace(key, next_index);
+        if (inserted) {
+            if (key.position < 0 ||
+                static_cast<size_t>(key.position) >= position_total ||
+                (key.texcoord >= 0 &&
+                 static_cast<size_t>(key.texcoord) >= texcoord_total)) {
+                c.valid = false;
+                return;
+            }
+            c.unique_corners.push_back(key);
+        }
+        c.indices.push_back(*slot);
+    }
+    std::vector<corner>().swap(c.corners);
+}
+
+Vertex make_vertex(const corner& key,
+                   const std::vector<float>& positions,
+                   const std::vector<float>& texcoords) {
+    const auto v = static_cast<size_t>(key.position);
+    const auto vt = static_cast<size_t>(key.texcoord);
+    Vertex vertex{};
+    vertex.pos = {positions[3 * v + 0],
+                  positions[3 * v + 1],
+                  positions[3 * v + 2]};
+    vertex.tex_coord = {0.0f, 1.0f};
+    if (key.texcoord >= 0) {
+        vertex.tex_coord = {texcoords[2 * vt + 0],
+                            1.0f - texcoords[2 * vt + 1]};
+    }
+    vertex.color = {1.0f, 1.0f, 1.0f};
+    return vertex;
+}
+
+} // namespace
+
+mesh_data parse_obj(std::span<const std::byte> text, unsigned thread_count) {
+    if (thread_count == 0) {
+        thread_count = jobs::pool().thread_count() + 1;
+    }
+    const auto* const begin = reinterpret_cast<const char*>(text.data());
+    const auto* const end = begin + text.size();
+
+    // Split at line ends, so no line straddles two chunks.
+    const auto chunk_count = std::clamp<size_t>(text.size() / min_chunk_size,
+                                                1,
+                                                thread_count);
+    std::vector<chunk> chunks(chunk_count);
+    auto chunk_begin = begin;
+    for (size_t i = 0; i < chunk_count; ++i) {
+        auto chunk_end = begin + text.size() * (i + 1) / chunk_count;
+        chunk_end = std::max(chunk_end, chunk_begin);
+        while (chunk_end != end && !is_line_end(*chunk_end)) {
+            ++chunk_end;
+        }
+        if (chunk_end != end) {
+            ++chunk_end;
+        }
+        chunks[i].begin = chunk_begin;
+        chunks[i].end = chunk_end;
+        chunk_begin = chunk_end;
+    }
+
+    jobs::parallel_for(chunk_count,
+                       [&](size_t i) { count_lines(chunks[i]); });
+
+    size_t position_total = 0;
+    size_t texcoord_total = 0;
+    for (auto& c : chunks) {
+        c.position_base = position_total;
+        c.texcoord_base = texcoord_total;
+        position_total += c.position_count;
+        texcoord_total += c.texcoord_count;
+    }
+    std::vector<float> positions(3 * position_total);
+    std::vector<float> texcoords(2 * texcoord_total);
+
+    jobs::parallel_for(chunk_count, [&](size_t i) {
+        parse_lines(chunks[i], positions.data(), texcoords.data());
+    });
+    // Faces may use positions from any earlier chunk, so deduplication waits
+    // until every chunk is parsed.
+    jobs::parallel_for(chunk_count, [&](size_t i) {
+        deduplicate(chunks[i], position_total, texcoord_total);
+    });
+    for (const auto& c : chunks) {
+        if (!c.valid) {
+            std::cerr << "face index out of range in OBJ" << std::endl;
+            return {};
+        }
+    }
+
+    // Merging the chunks' distinct corners in chunk order keeps every vertex
+    // at the position of its first use in the file, as load_obj orders them.
+    mesh_data mesh;
+    size_t local_total = 0;
+    size_t index_total = 0;
+    for (const auto& c : chunks) {
+        local_total += c.unique_corners.size();
+        index_total += c.indices.size();
+    }
+    mesh.vertices.reserve(local_total);
+    vertex_map unique_vertices;
+    unique_vertices.reserve(local_total);
+    for (auto& c : chunks) {
+        c.remap.resize(c.unique_corners.size());
+        for (size_t i = 0; i < c.unique_corners.size(); ++i) {
+            const auto vertex =
+                make_vertex(c.unique_corners[i], positions, texcoords);
+            const auto next_index = static_cast<uint32_t>(mesh.vertices.size());
+            const auto [slot, inserted] =
+                unique_vertices.try_emplace(vertex, next_index);
+            if (inserted) {
+                mesh.vertices.push_back(vertex);
+            }
+            c.remap[i] = *slot;
+        }
+    }
+
+    mesh.indices.resize(index_total);
+    std::vector<size_t> index_base(chunk_count);
+    for (size_t i = 1; i < chunk_count; ++i) {
+        index_base[i] = index_base[i - 1] + chunks[i - 1].indices.size();
+    }
+    jobs::parallel_for(chunk_count, [&](size_t i) {
+        const auto& c = chunks[i];
+        auto* out = mesh.indices.data() + index_base[i];
+        for (const auto index : c.indices) {
+            *out++ = c.remap[index];
+        }
+    });
+    return mesh;
+}
+
+mesh_data parse_obj(const std::string& filename, unsigned thread_count) {
+    const mapped_file file(filename, file_access::sequential);
+    if (!file.is_open()) {
+        std::cerr << "failed to open file! " << filename << std::endl;
+        return {};
+    }
+    return parse_obj(file.span(), thread_count);
+}
@@ -0,0 +1,22 @@
+#ifndef OBJ_PARSER_HPP
+#define OBJ_PARSER_HPP
+
+#include "asset_loader.hpp"
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+// Parallel OBJ parser. The text is split at line boundaries into one chunk
+// per thread, and each chunk is parsed and deduplicated on its own as a job
+// on the shared pool. Position and texture coordinate counts are prefix
+// summed so face indices resolve to the global arrays. The result matches
+// load_obj vertex for vertex, only positions, texture coordinates and faces
+// are read.
+//
+// `thread_count` 0 makes a chunk for every pool thread and the caller.
+// Returns an empty mesh on failure.
+mesh_data parse_obj(const std::string& filename, unsigned thread_count = 0);
+mesh_data parse_obj(std::span<const std::byte> text, unsigned thread_count = 0);
+
+#endif
@@ -1,8 +1,18 @@
 #include "render_vk.hpp"
 
 #include "asset_loader.hpp"
+#include "asset_package.hpp"
+#include "culling.hpp"
+#include "gpu_allocator.hpp"
 #include "graphics.hpp"
+#include "job_system.hpp"
+#include "mapped_file.hpp"
 #include "mathlib.hpp"
+#include "mesh_cache.hpp"
+#include "meshlet.hpp"
+#include "staging_ring.hpp"
+#include "texture_file.hpp"
+#include "vertex_format.hpp"
 
 #include <SDL.h>
 #include <SDL_video.h>
@@ -15,11 +25,13 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <deque>
 #include <iostream>
 #include <limits>
-#include <unordered_map>
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <vulkan/vk_platform.h>
 #include <vulkan/vulkan_core.h>
@@ -52,65 +64,141 @@
         }                                                                      \
     }
 
-struct Vertex {
-    math::vec3 pos;
-    math::vec3 color;
-    math::vec2 tex_coord;
+namespace {
 
-    static VkVertexInputBindingDescription get_binding_description() {
-        VkVertexInputBindingDescription binding_description{};
-        binding_description.binding = 0;
-        binding_description.stride = sizeof(Vertex);
-        binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+struct UniformBufferObject {
+    alignas(16) math::mat4 model;
+    alignas(16) math::mat4 view;
+    alignas(16) math::mat4 proj;
+    alignas(16) math::mat4 mvp;
+    alignas(16) vertex_dequantization dequantization;
+};
 
-        return binding_description;
-    }
+// One vkCmdDrawIndexed, a run of consecutive meshlets that survived culling.
+// `first_index` counts indices of `index_type`.
+struct DrawCommand {
+    uint32_t index_count;
+    uint32_t first_index;
+    int32_t vertex_offset;
+    VkIndexType index_type;
+};
 
-    static std::array<VkVertexInputAttributeDescription, 3>
-    get_attribute_descriptions() {
-        std::array<VkVertexInputAttributeDescription, 3>
-            attribute_descriptions{};
-        attribute_descriptions[0].location = 0;
-        attribute_descriptions[0].binding = 0;
-        attribute_descriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attribute_descriptions[0].offset = offsetof(Vertex, pos);
+VkVertexInputBindingDescription get_binding_description() {
+    VkVertexInputBindingDescription binding_description{};
+    binding_description.binding = 0;
+    binding_description.stride = sizeof(packed_vertex);
+    binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
-        attribute_descriptions[1].location = 1;
-        attribute_descriptions[1].binding = 0;
-        attribute_descriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attribute_descriptions[1].offset = offsetof(Vertex, color);
+    return binding_description;
+}
 
-        attribute_descriptions[2].location = 2;
-        attribute_descriptions[2].binding = 0;
-        attribute_descriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-        attribute_descriptions[2].offset = offsetof(Vertex, tex_coord);
+std::array<VkVertexInputAttributeDescription, 2>
+get_attribute_descriptions(tex_coord_encoding encoding) {
+    std::array<VkVertexInputAttributeDescription, 2> attribute_descriptions{};
+    attribute_descriptions[0].location = 0;
+    attribute_descriptions[0].binding = 0;
+    attribute_descriptions[0].format = VK_FORMAT_R16G16B16A16_SNORM;
+    attribute_descriptions[0].offset = offsetof(packed_vertex, pos);
+
+    attribute_descriptions[1].location = 1;
+    attribute_descriptions[1].binding = 0;
+    attribute_descriptions[1].format =
+        encoding == tex_coord_encoding::unorm16 ? VK_FORMAT_R16G16_UNORM
+                                                : VK_FORMAT_R16G16_SFLOAT;
+    attribute_descriptions[1].offset = offsetof(packed_vertex, tex_coord);
+
+    return attribute_descriptions;
+}
 
-        return attribute_descriptions;
-    }
+// Where the mip levels of textures loaded without them are generated.
+enum class mip_generation {
+    // By blits on the GPU, unless the device cannot filter the format
+    // linearly or is a software rasterizer.
+    automatic,
+    cpu,
+    gpu,
+};
 
-    bool operator==(const Vertex& other) const {
-        return pos == other.pos && color == other.color &&
-               tex_coord == other.tex_coord;
-    }
+// Device local resources can be moved by compaction, which copies from them.
+constexpr VkBufferUsageFlags vertex_buffer_usage =
+    VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+constexpr VkBufferUsageFlags index_buffer_usage =
+    VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+    VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+constexpr VkImageUsageFlags texture_usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                                            VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                                            VK_IMAGE_USAGE_SAMPLED_BIT;
+
+// Uploads are recorded into batches submitted whole, their data staged in a
+// ring of host memory that stays mapped. Each batch has a fence telling when
+// its part of the ring can be reused, so nothing waits for the queue unless
+// the ring runs out. Used by one thread at a time, like the command pool.
+//
+// With a transfer queue of its own, a batch's copies run there, and its
+// graphics commands take ownership of what they wrote once a semaphore says
+// they are done, along with the work only the graphics queue can do.
+struct upload_batch {
+    VkCommandBuffer transfer_commands = VK_NULL_HANDLE;
+    // The same as transfer_commands when transfers use the graphics queue.
+    VkCommandBuffer graphics_commands = VK_NULL_HANDLE;
+    VkSemaphore copies_done = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    bool transfer_recording = false;
+    bool graphics_recording = false;
+    uint64_t serial = 0;
+    // Staging buffers of uploads larger than the ring.
+    std::vector<std::pair<VkBuffer, gpu_allocation>> overflow;
 };
-namespace std {
-template <> struct hash<Vertex> {
-    size_t operator()(Vertex const& vertex) const {
-        return ((hash<math::vec3>()(vertex.pos) ^
-                 (hash<math::vec3>()(vertex.color) << 1)) >>
-                1) ^
-               (hash<math::vec2>()(vertex.tex_coord) << 1);
-    }
+
+struct upload_queue {
+    VkBuffer staging_buffer = VK_NULL_HANDLE;
+    gpu_allocation staging_memory;
+    staging_ring ring;
+    // Without a command buffer until something is recorded.
+    upload_batch recording;
+    std::deque<upload_batch> in_flight;
+    // Done batches, whose command buffers and fences are reused.
+    std::vector<upload_batch> spare;
+    uint64_t next_serial = 1;
+    uint64_t completed_serial = 0;
+    // Whether staging memory is cached on the host. Otherwise it is likely
+    // write-combined, and reading back from it is slow.
+    bool host_cached = false;
 };
-} // namespace std
-namespace {
 
-struct UniformBufferObject {
-    alignas(16) math::mat4 model;
-    alignas(16) math::mat4 view;
-    alignas(16) math::mat4 proj;
+struct staging_allocation {
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    std::byte* data;
+};
+
+// Data written for the frame being recorded, read by shaders from the frame
+// arena. `offset` is the dynamic offset binding it.
+struct frame_allocation {
+    uint32_t offset;
+    std::byte* data;
+};
+
+// A compaction pass of device memory, see defragment_memory.
+struct defragment_pass {
+    std::vector<gpu_defragment_move> moves;
+    // Made like the moved resources and bound to their destinations, then
+    // swapped with the originals once filled, which they hold until those
+    // are destroyed. Buffers are null for moves of the texture.
+    std::vector<VkBuffer> buffers;
+    VkImage texture_image = VK_NULL_HANDLE;
+    VkImageView texture_image_view = VK_NULL_HANDLE;
+    // Upload batch the copies were submitted with.
+    uint64_t upload_serial = 0;
+    bool swapped = false;
+    // Frame from which no frame in flight uses the originals.
+    uint64_t retire_frame = 0;
 };
 
+void create_allocator();
+void destroy_upload_queue();
+void finish_defragmentation();
 void cleanup_swapchain();
 void recreate_swapchain();
 void create_color_resources();
@@ -120,8 +208,35 @@ class VulkanGlobals {
     VkExtent2D windowExtent{1280, 720};
     const char* app_name = "Vulkan Game";
     const char* engine_name = "Andrei Game Engine";
+    // Written by the asset_packer target with PACKAGE_ASSETS on. Assets in it
+    // are read from it instead of the loose files.
+    const std::string PACKAGE_PATH = "assets.pak";
     const std::string MODEL_PATH = "models/viking_room.obj";
+    const std::string MODEL_CACHE_PATH = "models/viking_room.mesh";
     const std::string TEXTURE_PATH = "textures/viking_room.png";
+    // Written by the texture_cooker target with every mip level, used
+    // instead of TEXTURE_PATH when present.
+    const std::string TEXTURE_COOKED_PATH = "textures/viking_room.ktx2";
+    // The same block compressed, used instead when the device samples it.
+    const std::string TEXTURE_COMPRESSED_PATH = "textures/viking_room.bc.ktx2";
+    // Half floats keep texture coordinates that tile far outside [0, 1]
+    // precise, unorm16 is finer for atlas style coordinates.
+    const tex_coord_encoding TEX_COORD_ENCODING = tex_coord_encoding::unorm16;
+    // The coarsest level of detail whose error projects to at most this many
+    // pixels is drawn.
+    const float MAX_SCREEN_ERROR = 1.0f;
+    // Only used for textures that were not cooked. The GPU is still only
+    // used when it can filter the format linearly.
+    const mip_generation MIP_GENERATION = mip_generation::automatic;
+    // Compaction copies about this much device memory per pass, so a pass
+    // takes a fraction of a frame's GPU time.
+    const uint64_t DEFRAGMENT_BYTES_PER_PASS = 16ull << 20;
+    // Staging memory reused by uploads. Larger uploads get their own.
+    const uint64_t UPLOAD_RING_SIZE = 32ull << 20;
+    // Of staging data, enough for any texel block.
+    const uint64_t UPLOAD_ALIGNMENT = 16;
+    // Uniform and storage data every frame in flight can write.
+    const uint64_t FRAME_ARENA_SIZE = 1ull << 20;
     const std::vector<const char*> required_device_extensions = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME};
     const std::vector<const char*> validation_layers = {
@@ -133,9 +248,14 @@ class VulkanGlobals {
 
     const uint32_t double_buffered = 2;
     uint32_t current_frame = 0;
+    uint64_t frame_count = 0;
     VkPhysicalDevice physical_device = VK_NULL_HANDLE;
     uint32_t graphics_family;
     VkQueue graphics_queue = VK_NULL_HANDLE;
+    // Family without graphics that uploads are copied on, so they run
+    // beside the frames. The graphics family and queue when there is none.
+    uint32_t transfer_family;
+    VkQueue transfer_queue = VK_NULL_HANDLE;
     VkFormat swapchain_format = VK_FORMAT_B8G8R8A8_SRGB;
     VkColorSpaceKHR swapchain_color_space = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
     VkPresentModeKHR present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
@@ -143,6 +263,7 @@ class VulkanGlobals {
     uint32_t swapchain_min_image_count{};
     std::vector<VkImage> images{};
     VkSampleCountFlagBits msaa_samples = VK_SAMPLE_COUNT_1_BIT;
+    bool texture_compression_bc = false;
 
     // Variables that need cleanup
   public:
@@ -153,43 +274,76 @@ class VulkanGlobals {
 #endif
     VkSurfaceKHR surface;
     VkDevice device;
+    // Every buffer and image is bound to memory from here.
+    std::unique_ptr<gpu_allocator> allocator;
     VkSwapchainKHR swapchain;
     std::vector<VkImageView> image_views{};
     VkRenderPass render_pass;
     VkDescriptorSetLayout descriptor_set_layout;
     VkDescriptorPool descriptor_pool;
     std::vector<VkDescriptorSet> descriptor_sets;
+    // Sets still pointing at a texture moved by compaction, rewritten when
+    // their frame comes around.
+    std::vector<bool> stale_descriptor_sets;
     VkPipelineLayout pipeline_layout;
     VkPipeline graphics_pipeline;
     std::vector<VkFramebuffer> framebuffers;
     VkCommandPool command_pool;
+    // The command pool when transfers use the graphics family.
+    VkCommandPool transfer_command_pool;
+    upload_queue uploads;
+    // Read and decoded ahead of the Vulkan objects made from them.
+    mapped_file vert_shader_code;
+    mapped_file frag_shader_code;
+    cooked_texture cooked_image;
+    cooked_texture compressed_image;
+    image_info texture_info{};
+    VkFormat texture_format;
+    VkExtent2D texture_extent;
     uint32_t mip_levels;
     VkImage texture_image;
     VkImageView texture_image_view;
-    VkDeviceMemory texture_image_memory;
+    gpu_allocation texture_image_memory;
     VkSampler texture_sampler;
     VkImage depth_image;
-    VkDeviceMemory depth_image_memory;
+    gpu_allocation depth_image_memory;
     VkImageView depth_image_view;
     VkImage color_image;
-    VkDeviceMemory color_image_memory;
+    gpu_allocation color_image_memory;
     VkImageView color_image_view;
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
+    cooked_mesh model;
+    // Meshlet bounds of every level of detail.
+    std::vector<culling::sphere_soa> meshlet_spheres;
+    std::vector<uint32_t> visible_meshlets;
+    std::vector<DrawCommand> draws;
     VkBuffer vertex_buffer;
-    VkDeviceMemory vertex_buffer_memory;
+    gpu_allocation vertex_buffer_memory;
     VkBuffer index_buffer;
-    VkDeviceMemory index_buffer_memory;
-    std::vector<VkBuffer> uniform_buffers;
-    std::vector<VkDeviceMemory> uniform_buffers_memory;
-    std::vector<void*> uniform_buffers_mapped;
+    gpu_allocation index_buffer_memory;
+    // Shader data written every frame, which stays mapped. Each frame in
+    // flight bump allocates from its own region, emptied once the frame
+    // drawn with it before is done, and draws bind their data by dynamic
+    // offsets into one descriptor set.
+    VkBuffer frame_arena;
+    gpu_allocation frame_arena_memory;
+    // Of the offsets, which the device may want larger than the data's own.
+    VkDeviceSize frame_arena_alignment;
+    // Of the current frame's region.
+    VkDeviceSize frame_arena_used = 0;
+    // Of the frame's UniformBufferObject.
+    uint32_t uniform_offset = 0;
     std::vector<VkCommandBuffer> command_buffers;
     std::vector<VkSemaphore> image_available_semaphores;
     std::vector<VkSemaphore> render_finished_semaphores;
     std::vector<VkFence> in_flight_fences;
+    defragment_pass defragment;
+    // Allocator state the last pass found nothing to compact in.
+    gpu_allocator_stats defragment_checked{};
 
     ~VulkanGlobals() {
         vkDeviceWaitIdle(device);
+        finish_defragmentation();
+        destroy_upload_queue();
         cleanup_swapchain();
         for (auto i = 0; i < double_buffered; ++i) {
             vkDestroyFence(device, in_flight_fences[i], nullptr);
@@ -197,23 +351,25 @@ class VulkanGlobals {
             vkDestroySemaphore(device, image_available_semaphores[i], nullptr);
         }
         vkDestroyBuffer(device, index_buffer, nullptr);
-        vkFreeMemory(device, index_buffer_memory, nullptr);
+        allocator->free(index_buffer_memory);
         vkDestroyBuffer(device, vertex_buffer, nullptr);
-        vkFreeMemory(device, vertex_buffer_memory, nullptr);
+        allocator->free(vertex_buffer_memory);
         vkDestroySampler(device, texture_sampler, nullptr);
         vkDestroyImageView(device, texture_image_view, nullptr);
         vkDestroyImage(device, texture_image, nullptr);
-        vkFreeMemory(device, texture_image_memory, nullptr);
+        allocator->free(texture_image_memory);
+        if (transfer_command_pool != command_pool) {
+            vkDestroyCommandPool(device, transfer_command_pool, nullptr);
+        }
         vkDestroyCommandPool(device, command_pool, nullptr);
         vkDestroyPipeline(device, graphics_pipeline, nullptr);
         vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
-        for (auto i = 0; i < double_buffered; ++i) {
-            vkDestroyBuffer(device, uniform_buffers[i], nullptr);
-            vkFreeMemory(device, uniform_buffers_memory[i], nullptr);
-        }
+        vkDestroyBuffer(device, frame_arena, nullptr);
+        allocator->free(frame_arena_memory);
         vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
         vkDestroyDescriptorSetLayout(device, descriptor_set_layout, nullptr);
         vkDestroyRenderPass(device, render_pass, nullptr);
+        allocator.reset();
         vkDestroyDevice(device, nullptr);
         vkDestroySurfaceKHR(instance, surface, nullptr);
 #ifdef _DEBUG
@@ -427,6 +583,35 @@ int32_t physical_device_score(VkPhysicalDevice device) {
     return score;
 }
 
+// A family that only transfers is meant for copies beside the graphics
+// work, otherwise a compute family without graphics can copy too.
+uint32_t find_transfer_family(VkPhysicalDevice device) {
+    uint32_t queue_family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device,
+                                             &queue_family_count,
+                                             nullptr);
+    std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(device,
+                                             &queue_family_count,
+                                             queue_families.data());
+
+    auto family = vkg.graphics_family;
+    for (uint32_t i = 0; i < queue_family_count; ++i) {
+        const auto flags = queue_families[i].queueFlags;
+        if (flags & VK_QUEUE_GRAPHICS_BIT ||
+            !(flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            continue;
+        }
+        if (!(flags & VK_QUEUE_COMPUTE_BIT)) {
+            return i;
+        }
+        if (family == vkg.graphics_family) {
+            family = i;
+        }
+    }
+    return family;
+}
+
 VkSampleCountFlagBits get_max_usable_sample_count() {
     VkPhysicalDeviceProperties physical_device_properties;
     vkGetPhysicalDeviceProperties(vkg.physical_device,
@@ -512,25 +697,37 @@ void init_device() {
     }
     ASSERT(vkg.physical_device, "No graphics device selected!");
     vkg.msaa_samples = get_max_usable_sample_count();
+    vkg.transfer_family = find_transfer_family(vkg.physical_device);
 
-    VkDeviceQueueCreateInfo queue_create_info{};
-    queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    // queue_create_info.pNext;
-    // queue_create_info.flags;
-    queue_create_info.queueFamilyIndex = vkg.graphics_family;
-    queue_create_info.queueCount = 1;
+    std::array<VkDeviceQueueCreateInfo, 2> queue_create_infos{};
     float queue_priorities = 1.0f;
-    queue_create_info.pQueuePriorities = &queue_priorities;
+    for (auto& queue_create_info : queue_create_infos) {
+        queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        // queue_create_info.pNext;
+        // queue_create_info.flags;
+        queue_create_info.queueCount = 1;
+        queue_create_info.pQueuePriorities = &queue_priorities;
+    }
+    queue_create_infos[0].queueFamilyIndex = vkg.graphics_family;
+    queue_create_infos[1].queueFamilyIndex = vkg.transfer_family;
+    const uint32_t queue_family_count =
+        vkg.transfer_family != vkg.graphics_family ? 2 : 1;
+
+    VkPhysicalDeviceFeatures supported_features;
+    vkGetPhysicalDeviceFeatures(vkg.physical_device, &supported_features);
+    vkg.texture_compression_bc = supported_features.textureCompressionBC;
 
     VkPhysicalDeviceFeatures device_features{};
     device_features.samplerAnisotropy = VK_TRUE;
+    device_features.textureCompressionBC =
+        supported_features.textureCompressionBC;
 
     VkDeviceCreateInfo create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     // create_info.pNext;
     // create_info.flags;
-    create_info.queueCreateInfoCount = 1;
-    create_info.pQueueCreateInfos = &queue_create_info;
+    create_info.queueCreateInfoCount = queue_family_count;
+    create_info.pQueueCreateInfos = queue_create_infos.data();
     // create_info.enabledLayerCount;
     // create_info.ppEnabledLayerNames;
     create_info.enabledExtensionCount = vkg.required_device_extensions.size();
@@ -543,6 +740,8 @@ void init_device() {
                             &vkg.device));
 
     vkGetDeviceQueue(vkg.device, vkg.graphics_family, 0, &vkg.graphics_queue);
+    vkGetDeviceQueue(vkg.device, vkg.transfer_family, 0, &vkg.transfer_queue);
+    create_allocator();
 }
 
 VkImageView create_image_view(VkImage image,
@@ -689,7 +888,7 @@ void create_swapchain() {
     }
 }
 
-VkShaderModule create_shader_module(const std::vector<std::byte>& spv_code) {
+VkShaderModule create_shader_module(std::span<const std::byte> spv_code) {
     VkShaderModuleCreateInfo create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
     // create_info.pNext;
@@ -705,12 +904,16 @@ VkShaderModule create_shader_module(const std::vector<std::byte>& spv_code) {
     return shader_module;
 }
 
-void create_graphics_pipeline() {
-    auto vert_shader_code = read_file("shaders/shader.vert.spv");
-    auto frag_shader_code = read_file("shaders/shader.frag.spv");
+void read_shaders() {
+    vkg.vert_shader_code = read_file("shaders/shader.vert.spv");
+    vkg.frag_shader_code = read_file("shaders/shader.frag.spv");
+}
 
-    VkShaderModule vert_shader_module = create_shader_module(vert_shader_code);
-    VkShaderModule frag_shader_module = create_shader_module(frag_shader_code);
+void create_graphics_pipeline() {
+    VkShaderModule vert_shader_module =
+        create_shader_module(vkg.vert_shader_code.span());
+    VkShaderModule frag_shader_module =
+        create_shader_module(vkg.frag_shader_code.span());
 
     VkPipelineShaderStageCreateInfo vert_shader_stage_info{};
     vert_shader_stage_info.sType =
@@ -745,8 +948,9 @@ void create_graphics_pipeline() {
         static_cast<uint32_t>(dynamic_states.size());
     dynamic_state.pDynamicStates = dynamic_states.data();
 
-    auto binding_description = Vertex::get_binding_description();
-    auto attribute_descriptions = Vertex::get_attribute_descriptions();
+    auto binding_description = get_binding_description();
+    auto attribute_descriptions =
+        get_attribute_descriptions(vkg.TEX_COORD_ENCODING);
 
     VkPipelineVertexInputStateCreateInfo vertex_input_info{};
     vertex_input_info.sType =
@@ -904,6 +1108,8 @@ void create_graphics_pipeline() {
 
     vkDestroyShaderModule(vkg.device, vert_shader_module, nullptr);
     vkDestroyShaderModule(vkg.device, frag_shader_module, nullptr);
+    vkg.vert_shader_code.close();
+    vkg.frag_shader_code.close();
 }
 
 VkFormat find_supported_format(const std::vector<VkFormat>& candidates,
@@ -1072,6 +1278,15 @@ void create_command_pool() {
                                  &pool_info,
                                  nullptr,
                                  &vkg.command_pool));
+
+    vkg.transfer_command_pool = vkg.command_pool;
+    if (vkg.transfer_family != vkg.graphics_family) {
+        pool_info.queueFamilyIndex = vkg.transfer_family;
+        VK_CHECK(vkCreateCommandPool(vkg.device,
+                                     &pool_info,
+                                     nullptr,
+                                     &vkg.transfer_command_pool));
+    }
 }
 
 void create_command_buffer() {
@@ -1106,11 +1321,109 @@ uint32_t find_memory_type(uint32_t type_filter,
     ASSERT(false, "Failed to find memory type");
 }
 
-void create_buffer(VkDeviceSize size,
-                   VkBufferUsageFlags usage,
-                   VkMemoryPropertyFlags properties,
-                   VkBuffer& buffer,
-                   VkDeviceMemory& buffer_memory) {
+// Non-dispatchable Vulkan handles are pointers on 64 bit platforms and
+// integers elsewhere, the allocator's are always integers.
+template <typename T> uint64_t to_handle(T object) {
+    if constexpr (std::is_pointer_v<T>) {
+        return reinterpret_cast<uint64_t>(object);
+    } else {
+        return static_cast<uint64_t>(object);
+    }
+}
+
+template <typename T> T from_handle(uint64_t handle) {
+    if constexpr (std::is_pointer_v<T>) {
+        return reinterpret_cast<T>(handle);
+    } else {
+        return static_cast<T>(handle);
+    }
+}
+
+// Device memory blocks for the allocator. Host visible ones stay mapped
+// until they are freed. Dedicated memory of optimal resources is for images,
+// of linear ones for buffers, as linearly tiled images are not used.
+void create_allocator() {
+    VkPhysicalDeviceMemoryProperties mem_properties;
+    vkGetPhysicalDeviceMemoryProperties(vkg.physical_device, &mem_properties);
+
+    gpu_memory_device device;
+    device.allocate = [mem_properties](uint32_t memory_type,
+                                       uint64_t size,
+                                       gpu_resource_kind kind,
+                                       uint64_t dedicated_resource) {
+        VkMemoryDedicatedAllocateInfo dedicated_info{};
+        dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+        if (kind == gpu_resource_kind::optimal) {
+            dedicated_info.image = from_handle<VkImage>(dedicated_resource);
+        } else {
+            dedicated_info.buffer = from_handle<VkBuffer>(dedicated_resource);
+        }
+        VkMemoryAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.pNext = dedicated_resource != 0 ? &dedicated_info : nullptr;
+        alloc_info.allocationSize = size;
+        alloc_info.memoryTypeIndex = memory_type;
+
+        VkDeviceMemory memory;
+        gpu_memory_block block;
+        if (vkAllocateMemory(vkg.device, &alloc_info, nullptr, &memory) !=
+            VK_SUCCESS) {
+            return block;
+        }
+        block.memory = to_handle(memory);
+        if (mem_properties.memoryTypes[memory_type].propertyFlags &
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            void* data;
+            VK_CHECK(
+                vkMapMemory(vkg.device, memory, 0, VK_WHOLE_SIZE, 0, &data));
+            block.mapped = static_cast<std::byte*>(data);
+        }
+        return block;
+    };
+    // Freeing memory unmaps it.
+    device.free = [](const gpu_memory_block& block) {
+        vkFreeMemory(vkg.device,
+                     from_handle<VkDeviceMemory>(block.memory),
+                     nullptr);
+    };
+
+    // Blocks of memory types on heaps under 1GB, like the 256MB of device
+    // local memory that is host visible on many GPUs, take at most an eighth
+    // of their heap. Types on larger heaps keep the default size.
+    std::vector<uint64_t> block_sizes(mem_properties.memoryTypeCount);
+    for (uint32_t type = 0; type < mem_properties.memoryTypeCount; ++type) {
+        const auto heap_index = mem_properties.memoryTypes[type].heapIndex;
+        const auto heap_size = mem_properties.memoryHeaps[heap_index].size;
+        block_sizes[type] = gpu_allocator::default_block_size;
+        if (heap_size < (1ull << 30)) {
+            block_sizes[type] =
+                std::min<uint64_t>(block_sizes[type], heap_size / 8);
+        }
+    }
+    vkg.allocator = std::make_unique<gpu_allocator>(device, block_sizes);
+}
+
+gpu_allocation allocate_memory(const VkMemoryRequirements& requirements,
+                               const VkMemoryDedicatedRequirements& dedicated,
+                               VkMemoryPropertyFlags properties,
+                               gpu_resource_kind kind,
+                               uint64_t resource) {
+    gpu_memory_request request;
+    request.size = requirements.size;
+    request.alignment = requirements.alignment;
+    request.memory_type =
+        find_memory_type(requirements.memoryTypeBits, properties);
+    request.kind = kind;
+    request.dedicated = dedicated.prefersDedicatedAllocation ||
+                        dedicated.requiresDedicatedAllocation;
+    request.resource = resource;
+    auto allocation = vkg.allocator->allocate(request);
+    ASSERT(allocation, "Failed to allocate device memory");
+    return allocation;
+}
+
+// Creates a buffer without memory bound to it.
+VkBuffer create_unbound_buffer(VkDeviceSize size, VkBufferUsageFlags usage) {
     VkBufferCreateInfo buffer_info{};
     buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     // buffer_info.pNext;
@@ -1121,136 +1434,447 @@ void create_buffer(VkDeviceSize size,
     // buffer_info.queueFamilyIndexCount;
     // buffer_info.pQueueFamilyIndices;
 
+    VkBuffer buffer;
     VK_CHECK(vkCreateBuffer(vkg.device, &buffer_info, nullptr, &buffer));
+    return buffer;
+}
 
-    VkMemoryRequirements mem_requirements;
-    vkGetBufferMemoryRequirements(vkg.device, buffer, &mem_requirements);
+void create_buffer(VkDeviceSize size,
+                   VkBufferUsageFlags usage,
+                   VkMemoryPropertyFlags properties,
+                   VkBuffer& buffer,
+                   gpu_allocation& buffer_memory) {
+    buffer = create_unbound_buffer(size, usage);
+
+    VkBufferMemoryRequirementsInfo2 requirements_info{};
+    requirements_info.sType =
+        VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+    requirements_info.buffer = buffer;
+    VkMemoryDedicatedRequirements dedicated_requirements{};
+    dedicated_requirements.sType =
+        VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+    VkMemoryRequirements2 mem_requirements{};
+    mem_requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    mem_requirements.pNext = &dedicated_requirements;
+    vkGetBufferMemoryRequirements2(vkg.device,
+                                   &requirements_info,
+                                   &mem_requirements);
+
+    buffer_memory = allocate_memory(mem_requirements.memoryRequirements,
+                                    dedicated_requirements,
+                                    properties,
+                                    gpu_resource_kind::linear,
+                                    to_handle(buffer));
+    VK_CHECK(vkBindBufferMemory(vkg.device,
+                                buffer,
+                                from_handle<VkDeviceMemory>(
+                                    buffer_memory.memory),
+                                buffer_memory.offset));
+}
 
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    // alloc_info.pNext;
-    alloc_info.allocationSize = mem_requirements.size;
-    alloc_info.memoryTypeIndex =
-        find_memory_type(mem_requirements.memoryTypeBits, properties);
+void create_upload_queue() {
+    auto& uploads = vkg.uploads;
+    create_buffer(vkg.UPLOAD_RING_SIZE,
+                  VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                  uploads.staging_buffer,
+                  uploads.staging_memory);
+    uploads.ring = staging_ring(vkg.UPLOAD_RING_SIZE);
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(vkg.device,
+                                  uploads.staging_buffer,
+                                  &requirements);
+    const auto memory_type =
+        find_memory_type(requirements.memoryTypeBits,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    VkPhysicalDeviceMemoryProperties mem_properties;
+    vkGetPhysicalDeviceMemoryProperties(vkg.physical_device, &mem_properties);
+    uploads.host_cached =
+        mem_properties.memoryTypes[memory_type].propertyFlags &
+        VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+}
 
-    VK_CHECK(
-        vkAllocateMemory(vkg.device, &alloc_info, nullptr, &buffer_memory));
+// Recycles the submitted batches the GPU is done with, oldest first,
+// waiting for the oldest one first when `wait` is set.
+void retire_uploads(bool wait) {
+    auto& uploads = vkg.uploads;
+    while (!uploads.in_flight.empty()) {
+        auto& batch = uploads.in_flight.front();
+        if (wait) {
+            VK_CHECK(vkWaitForFences(vkg.device,
+                                     1,
+                                     &batch.fence,
+                                     VK_TRUE,
+                                     std::numeric_limits<uint64_t>::max()));
+            wait = false;
+        }
+        const auto status = vkGetFenceStatus(vkg.device, batch.fence);
+        if (status == VK_NOT_READY) {
+            return;
+        }
+        VK_CHECK(status);
+        for (auto& [buffer, memory] : batch.overflow) {
+            vkDestroyBuffer(vkg.device, buffer, nullptr);
+            vkg.allocator->free(memory);
+        }
+        batch.overflow.clear();
+        uploads.ring.release(batch.serial);
+        uploads.completed_serial = batch.serial;
+        uploads.spare.push_back(std::move(batch));
+        uploads.in_flight.pop_front();
+    }
+}
 
-    VK_CHECK(vkBindBufferMemory(vkg.device, buffer, buffer_memory, 0));
+bool separate_transfer_queue() {
+    return vkg.transfer_family != vkg.graphics_family;
 }
 
-VkCommandBuffer begin_single_time_commands() {
-    VkCommandBufferAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    // alloc_info.pNext;
-    alloc_info.commandPool = vkg.command_pool;
-    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    alloc_info.commandBufferCount = 1;
+// The batch being recorded, with its fence and semaphore.
+upload_batch& recording_batch() {
+    auto& uploads = vkg.uploads;
+    auto& batch = uploads.recording;
+    if (batch.fence) {
+        return batch;
+    }
+    if (!uploads.spare.empty()) {
+        batch = std::move(uploads.spare.back());
+        uploads.spare.pop_back();
+        VK_CHECK(vkResetFences(vkg.device, 1, &batch.fence));
+        return batch;
+    }
+    VkFenceCreateInfo fence_info{};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VK_CHECK(vkCreateFence(vkg.device, &fence_info, nullptr, &batch.fence));
+    if (separate_transfer_queue()) {
+        VkSemaphoreCreateInfo semaphore_info{};
+        semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        VK_CHECK(vkCreateSemaphore(vkg.device,
+                                   &semaphore_info,
+                                   nullptr,
+                                   &batch.copies_done));
+    }
+    return batch;
+}
 
-    VkCommandBuffer command_buffer;
-    VK_CHECK(
-        vkAllocateCommandBuffers(vkg.device, &alloc_info, &command_buffer));
+VkCommandBuffer begin_upload_commands(VkCommandBuffer& command_buffer,
+                                      bool& recording,
+                                      VkCommandPool pool) {
+    if (recording) {
+        return command_buffer;
+    }
+    if (!command_buffer) {
+        VkCommandBufferAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        // alloc_info.pNext;
+        alloc_info.commandPool = pool;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount = 1;
+        VK_CHECK(
+            vkAllocateCommandBuffers(vkg.device, &alloc_info, &command_buffer));
+    }
 
+    // Beginning resets the command buffer, as the pools allow.
     VkCommandBufferBeginInfo begin_info{};
     begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     // begin_info.pNext;
     begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
     // begin_info.pInheritanceInfo;
-    vkBeginCommandBuffer(command_buffer, &begin_info);
+    VK_CHECK(vkBeginCommandBuffer(command_buffer, &begin_info));
+    recording = true;
     return command_buffer;
 }
 
-void end_single_time_commands(VkCommandBuffer command_buffer) {
-    vkEndCommandBuffer(command_buffer);
+// Graphics commands of the batch being recorded, run after its copies.
+VkCommandBuffer graphics_upload_commands() {
+    auto& batch = recording_batch();
+    return begin_upload_commands(batch.graphics_commands,
+                                 batch.graphics_recording,
+                                 vkg.command_pool);
+}
+
+// Transfer commands of the batch being recorded: copies and the barriers
+// around them, which may only use the transfer stage.
+VkCommandBuffer upload_commands() {
+    if (!separate_transfer_queue()) {
+        return graphics_upload_commands();
+    }
+    auto& batch = recording_batch();
+    return begin_upload_commands(batch.transfer_commands,
+                                 batch.transfer_recording,
+                                 vkg.transfer_command_pool);
+}
+
+// Submits the batch being recorded, if anything was. Returns the serial of
+// the last batch submitted, which holds everything recorded so far.
+uint64_t submit_uploads() {
+    auto& uploads = vkg.uploads;
+    auto& batch = uploads.recording;
+    if (!batch.transfer_recording && !batch.graphics_recording) {
+        return uploads.next_serial - 1;
+    }
+
+    const auto copied = batch.transfer_recording;
+    if (copied) {
+        VK_CHECK(vkEndCommandBuffer(batch.transfer_commands));
+        VkSubmitInfo submit_info{};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &batch.transfer_commands;
+        submit_info.signalSemaphoreCount = 1;
+        submit_info.pSignalSemaphores = &batch.copies_done;
+        VK_CHECK(
+            vkQueueSubmit(vkg.transfer_queue, 1, &submit_info, VK_NULL_HANDLE));
+        batch.transfer_recording = false;
+    }
 
+    // Whatever the batch wrote is visible to the work submitted after it.
+    const auto command_buffer = graphics_upload_commands();
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask =
+        VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+        VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT |
+        VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+                             VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0,
+                         1,
+                         &barrier,
+                         0,
+                         nullptr,
+                         0,
+                         nullptr);
+    VK_CHECK(vkEndCommandBuffer(command_buffer));
+    batch.graphics_recording = false;
+
+    const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
     VkSubmitInfo submit_info{};
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.waitSemaphoreCount = copied ? 1 : 0;
+    submit_info.pWaitSemaphores = &batch.copies_done;
+    submit_info.pWaitDstStageMask = &wait_stage;
     submit_info.commandBufferCount = 1;
     submit_info.pCommandBuffers = &command_buffer;
+    VK_CHECK(vkQueueSubmit(vkg.graphics_queue, 1, &submit_info, batch.fence));
+
+    batch.serial = uploads.next_serial++;
+    uploads.ring.end_batch(batch.serial);
+    uploads.in_flight.push_back(std::move(batch));
+    batch = {};
+    return uploads.next_serial - 1;
+}
+
+template <typename Barrier>
+void record_barrier(VkCommandBuffer command_buffer,
+                    VkPipelineStageFlags src_stages,
+                    VkPipelineStageFlags dst_stages,
+                    const Barrier& barrier) {
+    if constexpr (std::is_same_v<Barrier, VkImageMemoryBarrier>) {
+        vkCmdPipelineBarrier(command_buffer,
+                             src_stages,
+                             dst_stages,
+                             0,
+                             0,
+                             nullptr,
+                             0,
+                             nullptr,
+                             1,
+                             &barrier);
+    } else {
+        vkCmdPipelineBarrier(command_buffer,
+                             src_stages,
+                             dst_stages,
+                             0,
+                             0,
+                             nullptr,
+                             1,
+                             &barrier,
+                             0,
+                             nullptr);
+    }
+}
 
-    vkQueueSubmit(vkg.graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
-    vkQueueWaitIdle(vkg.graphics_queue);
+// Hands what the transfer commands wrote to the graphics commands, for
+// reads by `stages` with `access`. Between queue families that is a release
+// on one and an acquire on the other, which may also change the layout of
+// images; otherwise a single barrier.
+template <typename Barrier>
+void hand_over(Barrier barrier,
+               VkPipelineStageFlags stages,
+               VkAccessFlags access) {
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = access;
+    if (!separate_transfer_queue()) {
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        record_barrier(upload_commands(),
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       stages,
+                       barrier);
+        return;
+    }
+    barrier.srcQueueFamilyIndex = vkg.transfer_family;
+    barrier.dstQueueFamilyIndex = vkg.graphics_family;
+    // The release only makes the writes available, the acquire visible.
+    auto release = barrier;
+    release.dstAccessMask = 0;
+    record_barrier(upload_commands(),
+                   VK_PIPELINE_STAGE_TRANSFER_BIT,
+                   VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                   release);
+    auto acquire = barrier;
+    acquire.srcAccessMask = 0;
+    record_barrier(graphics_upload_commands(),
+                   VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                   stages,
+                   acquire);
+}
+
+void hand_over_buffer(VkBuffer buffer,
+                      VkPipelineStageFlags stages,
+                      VkAccessFlags access) {
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.buffer = buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    hand_over(barrier, stages, access);
+}
 
-    vkFreeCommandBuffers(vkg.device, vkg.command_pool, 1, &command_buffer);
+void hand_over_image(VkImage image,
+                     uint32_t mip_levels,
+                     VkImageLayout old_layout,
+                     VkImageLayout new_layout,
+                     VkPipelineStageFlags stages,
+                     VkAccessFlags access) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = new_layout;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = mip_levels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    hand_over(barrier, stages, access);
 }
 
-void copy_buffer(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize size) {
-    VkCommandBuffer command_buffer = begin_single_time_commands();
+// Whether the batch `serial` is done, without waiting for it.
+bool uploads_done(uint64_t serial) {
+    retire_uploads(false);
+    return vkg.uploads.completed_serial >= serial;
+}
 
+// Staging memory for `size` bytes, written before recording the copy from
+// it, which has to come before asking for more. When the ring is held by
+// batches in flight, the oldest is waited for; uploads larger than the ring
+// get a buffer of their own, freed with their batch.
+staging_allocation upload_staging(VkDeviceSize size) {
+    auto& uploads = vkg.uploads;
+    staging_allocation staging{};
+    if (size > uploads.ring.capacity()) {
+        gpu_allocation memory;
+        create_buffer(size,
+                      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                      staging.buffer,
+                      memory);
+        staging.data = memory.mapped;
+        uploads.recording.overflow.emplace_back(staging.buffer, memory);
+        return staging;
+    }
+
+    retire_uploads(false);
+    auto offset = uploads.ring.allocate(size, vkg.UPLOAD_ALIGNMENT);
+    while (offset == staging_ring::no_space) {
+        // The batch being recorded holds the rest of the ring.
+        if (uploads.in_flight.empty()) {
+            submit_uploads();
+        }
+        retire_uploads(true);
+        offset = uploads.ring.allocate(size, vkg.UPLOAD_ALIGNMENT);
+    }
+    staging.buffer = uploads.staging_buffer;
+    staging.offset = offset;
+    staging.data = uploads.staging_memory.mapped + offset;
+    return staging;
+}
+
+// Called once the device is idle.
+void destroy_upload_queue() {
+    auto& uploads = vkg.uploads;
+    submit_uploads();
+    retire_uploads(true);
+    for (const auto& batch : uploads.spare) {
+        vkDestroySemaphore(vkg.device, batch.copies_done, nullptr);
+        vkDestroyFence(vkg.device, batch.fence, nullptr);
+    }
+    vkDestroyBuffer(vkg.device, uploads.staging_buffer, nullptr);
+    vkg.allocator->free(uploads.staging_memory);
+}
+
+void copy_buffer(const staging_allocation& staging,
+                 VkBuffer dst_buffer,
+                 VkDeviceSize size) {
     VkBufferCopy copy_region{};
-    copy_region.srcOffset = 0;
+    copy_region.srcOffset = staging.offset;
     copy_region.dstOffset = 0;
     copy_region.size = size;
-    vkCmdCopyBuffer(command_buffer, src_buffer, dst_buffer, 1, &copy_region);
-
-    end_single_time_commands(command_buffer);
+    vkCmdCopyBuffer(upload_commands(),
+                    staging.buffer,
+                    dst_buffer,
+                    1,
+                    &copy_region);
 }
 
 void create_vertex_buffer() {
-    VkDeviceSize buffer_size = sizeof(vkg.vertices[0]) * vkg.vertices.size();
+    VkDeviceSize buffer_size = vkg.model.vertices.size_bytes();
 
-    VkBuffer staging_buffer;
-    VkDeviceMemory staging_buffer_memory;
+    const auto staging = upload_staging(buffer_size);
+    std::memcpy(staging.data,
+                vkg.model.vertices.data(),
+                static_cast<size_t>(buffer_size));
 
     create_buffer(buffer_size,
-                  VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                  staging_buffer,
-                  staging_buffer_memory);
-
-    void* data;
-    VK_CHECK(vkMapMemory(vkg.device,
-                         staging_buffer_memory,
-                         0,
-                         buffer_size,
-                         0,
-                         &data));
-    std::memcpy(data, vkg.vertices.data(), static_cast<size_t>(buffer_size));
-    vkUnmapMemory(vkg.device, staging_buffer_memory);
-
-    create_buffer(buffer_size,
-                  VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-                      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                  vertex_buffer_usage,
                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
                   vkg.vertex_buffer,
                   vkg.vertex_buffer_memory);
 
-    copy_buffer(staging_buffer, vkg.vertex_buffer, buffer_size);
-
-    vkDestroyBuffer(vkg.device, staging_buffer, nullptr);
-    vkFreeMemory(vkg.device, staging_buffer_memory, nullptr);
+    copy_buffer(staging, vkg.vertex_buffer, buffer_size);
+    hand_over_buffer(vkg.vertex_buffer,
+                     VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                     VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
 }
 
 void create_index_buffer() {
-    VkDeviceSize buffer_size = sizeof(vkg.indices[0]) * vkg.indices.size();
+    VkDeviceSize buffer_size = vkg.model.indices.size_bytes();
 
-    VkBuffer staging_buffer;
-    VkDeviceMemory staging_buffer_memory;
+    const auto staging = upload_staging(buffer_size);
+    std::memcpy(staging.data,
+                vkg.model.indices.data(),
+                static_cast<size_t>(buffer_size));
 
     create_buffer(buffer_size,
-                  VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                  staging_buffer,
-                  staging_buffer_memory);
-
-    void* data;
-    vkMapMemory(vkg.device, staging_buffer_memory, 0, buffer_size, 0, &data);
-    std::memcpy(data, vkg.indices.data(), static_cast<size_t>(buffer_size));
-    vkUnmapMemory(vkg.device, staging_buffer_memory);
-
-    create_buffer(buffer_size,
-                  VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-                      VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                  index_buffer_usage,
                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
                   vkg.index_buffer,
                   vkg.index_buffer_memory);
 
-    copy_buffer(staging_buffer, vkg.index_buffer, buffer_size);
-
-    vkDestroyBuffer(vkg.device, staging_buffer, nullptr);
-    vkFreeMemory(vkg.device, staging_buffer_memory, nullptr);
+    copy_buffer(staging, vkg.index_buffer, buffer_size);
+    hand_over_buffer(vkg.index_buffer,
+                     VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                     VK_ACCESS_INDEX_READ_BIT);
 }
 
 void record_command_buffer(VkCommandBuffer command_buffer,
@@ -1306,26 +1930,32 @@ void record_command_buffer(VkCommandBuffer command_buffer,
     VkDeviceSize offsets[] = {0};
     vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
 
-    vkCmdBindIndexBuffer(command_buffer,
-                         vkg.index_buffer,
-                         0,
-                         VK_INDEX_TYPE_UINT32);
-
     vkCmdBindDescriptorSets(command_buffer,
                             VK_PIPELINE_BIND_POINT_GRAPHICS,
                             vkg.pipeline_layout,
                             0,
                             1,
                             &vkg.descriptor_sets[vkg.current_frame],
-                            0,
-                            nullptr);
-
-    vkCmdDrawIndexed(command_buffer,
-                     static_cast<uint32_t>(vkg.indices.size()),
-                     1,
-                     0,
-                     0,
-                     0);
+                            1,
+                            &vkg.uniform_offset);
+
+    // Rebound only when the index type changes between draws.
+    auto bound_index_type = VK_INDEX_TYPE_MAX_ENUM;
+    for (const auto& draw : vkg.draws) {
+        if (draw.index_type != bound_index_type) {
+            vkCmdBindIndexBuffer(command_buffer,
+                                 vkg.index_buffer,
+                                 0,
+                                 draw.index_type);
+            bound_index_type = draw.index_type;
+        }
+        vkCmdDrawIndexed(command_buffer,
+                         draw.index_count,
+                         1,
+                         draw.first_index,
+                         draw.vertex_offset,
+                         0);
+    }
 
     // End Render Pass
 
@@ -1369,11 +1999,11 @@ void create_sync_objects() {
 void cleanup_swapchain() {
     vkDestroyImageView(vkg.device, vkg.color_image_view, nullptr);
     vkDestroyImage(vkg.device, vkg.color_image, nullptr);
-    vkFreeMemory(vkg.device, vkg.color_image_memory, nullptr);
+    vkg.allocator->free(vkg.color_image_memory);
 
     vkDestroyImageView(vkg.device, vkg.depth_image_view, nullptr);
     vkDestroyImage(vkg.device, vkg.depth_image, nullptr);
-    vkFreeMemory(vkg.device, vkg.depth_image_memory, nullptr);
+    vkg.allocator->free(vkg.depth_image_memory);
     for (auto framebuffer : vkg.framebuffers) {
         vkDestroyFramebuffer(vkg.device, framebuffer, nullptr);
     }
@@ -1398,7 +2028,8 @@ void recreate_swapchain() {
 void create_descriptor_set_layout() {
     VkDescriptorSetLayoutBinding ubo_layout_binding{};
     ubo_layout_binding.binding = 0;
-    ubo_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    ubo_layout_binding.descriptorType =
+        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     ubo_layout_binding.descriptorCount = 1;
     ubo_layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     ubo_layout_binding.pImmutableSamplers = nullptr;
@@ -1427,28 +2058,34 @@ void create_descriptor_set_layout() {
                                          &vkg.descriptor_set_layout));
 }
 
-void create_uniform_buffers() {
-    VkDeviceSize buffer_size = sizeof(UniformBufferObject);
-
-    vkg.uniform_buffers.resize(vkg.double_buffered);
-    vkg.uniform_buffers_memory.resize(vkg.double_buffered);
-    vkg.uniform_buffers_mapped.resize(vkg.double_buffered);
-
-    for (size_t i = 0; i < vkg.double_buffered; ++i) {
-        create_buffer(buffer_size,
-                      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                      vkg.uniform_buffers[i],
-                      vkg.uniform_buffers_memory[i]);
+void create_frame_arena() {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vkg.physical_device, &properties);
+    // Both are powers of two, which divide the region size.
+    vkg.frame_arena_alignment =
+        std::max(properties.limits.minUniformBufferOffsetAlignment,
+                 properties.limits.minStorageBufferOffsetAlignment);
+
+    create_buffer(vkg.FRAME_ARENA_SIZE * vkg.double_buffered,
+                  VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                  vkg.frame_arena,
+                  vkg.frame_arena_memory);
+}
 
-        vkMapMemory(vkg.device,
-                    vkg.uniform_buffers_memory[i],
-                    0,
-                    buffer_size,
-                    0,
-                    &vkg.uniform_buffers_mapped[i]);
-    }
+// `size` bytes of the current frame's region, valid until the frame is
+// drawn again.
+frame_allocation allocate_frame_data(VkDeviceSize size) {
+    const auto start =
+        (vkg.frame_arena_used + vkg.frame_arena_alignment - 1) /
+        vkg.frame_arena_alignment * vkg.frame_arena_alignment;
+    ASSERT(start + size <= vkg.FRAME_ARENA_SIZE, "frame arena is full!");
+    vkg.frame_arena_used = start + size;
+    const auto offset = vkg.current_frame * vkg.FRAME_ARENA_SIZE + start;
+    return {static_cast<uint32_t>(offset),
+            vkg.frame_arena_memory.mapped + offset};
 }
 
 void update_uniform_buffer(uint32_t current_image) {
@@ -1459,29 +2096,98 @@ void update_uniform_buffer(uint32_t current_image) {
                      current_time - start_time)
                      .count();
 
+    // The camera is fixed, so the view matrix is folded at compile time.
+    constexpr math::vec3 camera(2.0f, 2.0f, 2.0f);
+    constexpr auto view = math::look_at(camera,
+                                        math::vec3(0.0f, 0.0f, 0.0f),
+                                        math::vec3(0.0f, 0.0f, 1.0f));
+
+    math::transform model{};
+    model.rotation = math::angle_axis(time * math::radians(90.0f),
+                                      math::vec3(0.0f, 0.0f, 1.0f));
+
     UniformBufferObject ubo{};
-    ubo.model = math::rotate(math::mat4::identity(),
-                             time * math::radians(90.0f),
-                             math::vec3(0.0f, 0.0f, 1.0f));
+    ubo.model = math::to_mat4(model);
 
-    ubo.view = math::look_at(math::vec3(2.0f, 2.0f, 2.0f),
-                             math::vec3(0.0f, 0.0f, 0.0f),
-                             math::vec3(0.0f, 0.0f, 1.0f));
+    ubo.view = view;
+    constexpr float near_plane = 0.1f;
     ubo.proj =
         math::perspesctive(math::radians(45.0f),
                            vkg.swapchain_extend.width /
                                static_cast<float>(vkg.swapchain_extend.height),
-                           0.1f,
+                           near_plane,
                            10.f);
 
     ubo.proj[1][1] *= -1;
+    ubo.mvp = ubo.proj * ubo.view * ubo.model;
+    ubo.dequantization = vkg.model.dequantization;
+
+    // Meshlet bounds are in model space, so the frustum and camera are taken
+    // there too.
+    const auto frustum = culling::extract_frustum(ubo.mvp);
+    const auto eye = math::inverse_affine(ubo.model) *
+                     math::vec4(camera.x, camera.y, camera.z, 1.0f);
+    const math::vec3 model_camera(eye.x, eye.y, eye.z);
+
+    // Level errors are in model units and the model is not scaled, so they
+    // project like any length at the distance of the closest point of the
+    // bounding sphere.
+    const auto to_center = vkg.model.sphere.center - model_camera;
+    const auto distance = std::max(
+        math::detail::sqrt(math::dot(to_center, to_center)) -
+            vkg.model.sphere.radius,
+        near_plane);
+    const auto pixels_per_unit =
+        0.5f * vkg.swapchain_extend.height * std::abs(ubo.proj[1][1]);
+    size_t level = 0;
+    while (level + 1 < vkg.model.lods.size() &&
+           vkg.model.lods[level + 1].error * pixels_per_unit / distance <=
+               vkg.MAX_SCREEN_ERROR) {
+        ++level;
+    }
+    const auto& lod = vkg.model.lods[level];
+
+    vkg.visible_meshlets.resize(lod.meshlet_count);
+    const auto in_frustum = culling::cull(frustum,
+                                          vkg.meshlet_spheres[level],
+                                          vkg.visible_meshlets.data());
+
+    // Visible meshlets that follow each other in the index buffer become one
+    // draw.
+    const auto index_type = vkg.model.index_size == sizeof(uint16_t)
+                                ? VK_INDEX_TYPE_UINT16
+                                : VK_INDEX_TYPE_UINT32;
+    vkg.draws.clear();
+    uint32_t draw_range = 0;
+    for (size_t i = 0; i < in_frustum; ++i) {
+        const auto& cluster =
+            vkg.model.meshlets[lod.first_meshlet + vkg.visible_meshlets[i]];
+        if (is_backfacing(cluster, model_camera)) {
+            continue;
+        }
+        if (!vkg.draws.empty() && cluster.range == draw_range) {
+            auto& draw = vkg.draws.back();
+            if (draw.first_index + draw.index_count == cluster.first_index) {
+                draw.index_count += cluster.index_count;
+                continue;
+            }
+        }
+        const auto& range = vkg.model.ranges[cluster.range];
+        vkg.draws.push_back({cluster.index_count,
+                             cluster.first_index,
+                             static_cast<int32_t>(range.vertex_offset),
+                             index_type});
+        draw_range = cluster.range;
+    }
 
-    std::memcpy(vkg.uniform_buffers_mapped[current_image], &ubo, sizeof(ubo));
+    const auto uniforms = allocate_frame_data(sizeof(ubo));
+    std::memcpy(uniforms.data, &ubo, sizeof(ubo));
+    vkg.uniform_offset = uniforms.offset;
 }
 
 void create_descriptor_pool() {
     std::array<VkDescriptorPoolSize, 2> pool_sizes{};
-    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     pool_sizes[0].descriptorCount = static_cast<uint32_t>(vkg.double_buffered);
     pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     pool_sizes[1].descriptorCount = static_cast<uint32_t>(vkg.double_buffered);
@@ -1511,13 +2217,14 @@ void create_descriptor_sets() {
     alloc_info.pSetLayouts = layouts.data();
 
     vkg.descriptor_sets.resize(vkg.double_buffered);
+    vkg.stale_descriptor_sets.assign(vkg.double_buffered, false);
     VK_CHECK(vkAllocateDescriptorSets(vkg.device,
                                       &alloc_info,
                                       vkg.descriptor_sets.data()));
 
     for (size_t i = 0; i < vkg.double_buffered; ++i) {
         VkDescriptorBufferInfo buffer_info{};
-        buffer_info.buffer = vkg.uniform_buffers[i];
+        buffer_info.buffer = vkg.frame_arena;
         buffer_info.offset = 0;
         buffer_info.range = sizeof(UniformBufferObject);
 
@@ -1533,7 +2240,8 @@ void create_descriptor_sets() {
         descriptor_writes[0].dstBinding = 0;
         descriptor_writes[0].dstArrayElement = 0;
         descriptor_writes[0].descriptorCount = 1;
-        descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptor_writes[0].descriptorType =
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         descriptor_writes[0].pImageInfo = nullptr;
         descriptor_writes[0].pBufferInfo = &buffer_info;
         descriptor_writes[0].pTexelBufferView = nullptr;
@@ -1564,17 +2272,8 @@ void generate_mipmaps(VkImage image,
                       int32_t tex_height,
                       uint32_t mip_levels) {
 
-    // There are two alternatives in this case. You could implement a function
-    // that searches common texture image formats for one that does support
-    // linear blitting, or you could implement the mipmap generation in software
-    // with a library like stb_image_resize. Each mip level can then be loaded
-    // into the image in the same way that you loaded the original image.
-
-    // It should be noted that it is uncommon in practice to generate the mipmap
-    // levels at runtime anyway. Usually they are pregenerated and stored in the
-    // texture file alongside the base level to improve loading speed.
-    // Implementing resizing in software and loading multiple levels from a file
-    // is left as an exercise to the reader.
+    // Callers check generate_mips_on_gpu first and build the levels on the
+    // CPU for formats that cannot be blitted with linear filtering.
     VkFormatProperties format_properties;
     vkGetPhysicalDeviceFormatProperties(vkg.physical_device,
                                         image_format,
@@ -1583,7 +2282,8 @@ void generate_mipmaps(VkImage image,
                VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT,
            "texture image format does not support linear blitting!");
 
-    VkCommandBuffer command_buffer = begin_single_time_commands();
+    // Blits need the graphics queue.
+    VkCommandBuffer command_buffer = graphics_upload_commands();
 
     VkImageMemoryBarrier barrier{};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -1682,21 +2382,16 @@ void generate_mipmaps(VkImage image,
                          nullptr,
                          1,
                          &barrier);
-
-    end_single_time_commands(command_buffer);
 }
 
-void create_image(uint32_t width,
-                  uint32_t height,
-                  uint32_t mip_levels,
-                  VkSampleCountFlagBits num_samples,
-                  VkFormat format,
-                  VkImageTiling tiling,
-                  VkImageUsageFlags usage,
-                  VkMemoryPropertyFlags properties,
-                  VkImage& image,
-                  VkDeviceMemory& image_memory) {
-
+// Creates a 2D image without memory bound to it.
+VkImage create_unbound_image(uint32_t width,
+                             uint32_t height,
+                             uint32_t mip_levels,
+                             VkSampleCountFlagBits num_samples,
+                             VkFormat format,
+                             VkImageTiling tiling,
+                             VkImageUsageFlags usage) {
     VkImageCreateInfo image_info{};
     image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     // image_info.pNext;
@@ -1716,19 +2411,54 @@ void create_image(uint32_t width,
     // image_info.pQueueFamilyIndices;
     image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
+    VkImage image;
     VK_CHECK(vkCreateImage(vkg.device, &image_info, nullptr, &image));
+    return image;
+}
 
-    VkMemoryRequirements mem_requirements{};
-    vkGetImageMemoryRequirements(vkg.device, image, &mem_requirements);
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    // alloc_info.pNext;
-    alloc_info.allocationSize = mem_requirements.size;
-    alloc_info.memoryTypeIndex =
-        find_memory_type(mem_requirements.memoryTypeBits, properties);
-
-    VK_CHECK(vkAllocateMemory(vkg.device, &alloc_info, nullptr, &image_memory));
-    vkBindImageMemory(vkg.device, image, image_memory, 0);
+void create_image(uint32_t width,
+                  uint32_t height,
+                  uint32_t mip_levels,
+                  VkSampleCountFlagBits num_samples,
+                  VkFormat format,
+                  VkImageTiling tiling,
+                  VkImageUsageFlags usage,
+                  VkMemoryPropertyFlags properties,
+                  VkImage& image,
+                  gpu_allocation& image_memory) {
+    image = create_unbound_image(width,
+                                 height,
+                                 mip_levels,
+                                 num_samples,
+                                 format,
+                                 tiling,
+                                 usage);
+
+    VkImageMemoryRequirementsInfo2 requirements_info{};
+    requirements_info.sType =
+        VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+    requirements_info.image = image;
+    VkMemoryDedicatedRequirements dedicated_requirements{};
+    dedicated_requirements.sType =
+        VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+    VkMemoryRequirements2 mem_requirements{};
+    mem_requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    mem_requirements.pNext = &dedicated_requirements;
+    vkGetImageMemoryRequirements2(vkg.device,
+                                  &requirements_info,
+                                  &mem_requirements);
+
+    image_memory = allocate_memory(mem_requirements.memoryRequirements,
+                                   dedicated_requirements,
+                                   properties,
+                                   tiling == VK_IMAGE_TILING_OPTIMAL
+                                       ? gpu_resource_kind::optimal
+                                       : gpu_resource_kind::linear,
+                                   to_handle(image));
+    VK_CHECK(vkBindImageMemory(vkg.device,
+                               image,
+                               from_handle<VkDeviceMemory>(image_memory.memory),
+                               image_memory.offset));
 }
 
 void transition_image_layout(VkImage image,
@@ -1736,7 +2466,7 @@ void transition_image_layout(VkImage image,
                              VkImageLayout old_layout,
                              VkImageLayout new_layout,
                              uint32_t mip_levels) {
-    VkCommandBuffer command_buffer = begin_single_time_commands();
+    VkCommandBuffer command_buffer = upload_commands();
 
     VkImageMemoryBarrier barrier{};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -1785,18 +2515,25 @@ void transition_image_layout(VkImage image,
                          nullptr,
                          1,
                          &barrier);
-
-    end_single_time_commands(command_buffer);
 }
 
 void copy_buffer_to_image(VkBuffer buffer,
+                          VkImage image,
+                          std::span<const VkBufferImageCopy> regions) {
+    vkCmdCopyBufferToImage(upload_commands(),
+                           buffer,
+                           image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           static_cast<uint32_t>(regions.size()),
+                           regions.data());
+}
+
+void copy_buffer_to_image(const staging_allocation& staging,
                           VkImage image,
                           uint32_t width,
                           uint32_t height) {
-    VkCommandBuffer command_buffer = begin_single_time_commands();
-
     VkBufferImageCopy region{};
-    region.bufferOffset = 0;
+    region.bufferOffset = staging.offset;
     region.bufferRowLength = 0;
     region.bufferImageHeight = 0;
     region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -1806,41 +2543,173 @@ void copy_buffer_to_image(VkBuffer buffer,
     region.imageOffset = {0, 0, 0};
     region.imageExtent = {width, height, 1};
 
-    vkCmdCopyBufferToImage(command_buffer,
-                           buffer,
-                           image,
-                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                           1,
-                           &region);
+    copy_buffer_to_image(staging.buffer, image, {&region, 1});
+}
 
-    end_single_time_commands(command_buffer);
+static_assert(static_cast<VkFormat>(texture_format::r8g8b8a8_srgb) ==
+              VK_FORMAT_R8G8B8A8_SRGB);
+static_assert(static_cast<VkFormat>(texture_format::bc1_rgb_srgb_block) ==
+              VK_FORMAT_BC1_RGB_SRGB_BLOCK);
+static_assert(static_cast<VkFormat>(texture_format::bc7_srgb_block) ==
+              VK_FORMAT_BC7_SRGB_BLOCK);
+
+// Maps the cooked textures. Without an uncompressed one to fall back to, only
+// the source image's size is read here: it is decoded straight into the
+// memory it is uploaded from once that exists.
+void load_texture() {
+    vkg.compressed_image = load_texture_file(vkg.TEXTURE_COMPRESSED_PATH);
+    vkg.cooked_image = load_texture_file(vkg.TEXTURE_COOKED_PATH);
+    if (vkg.cooked_image.levels.empty()) {
+        vkg.texture_info = load_image_info(vkg.TEXTURE_PATH);
+    }
+}
+
+bool can_sample(const cooked_texture& texture) {
+    if (texture.levels.empty()) {
+        return false;
+    }
+    const auto format = static_cast<VkFormat>(texture.format);
+    if (format != VK_FORMAT_R8G8B8A8_SRGB && !vkg.texture_compression_bc) {
+        return false;
+    }
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(vkg.physical_device,
+                                        format,
+                                        &format_properties);
+    const VkFormatFeatureFlags required =
+        VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT |
+        VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (format_properties.optimalTilingFeatures & required) == required;
+}
+
+// Uploads every level of the cooked texture with a single copy, one region
+// per level, so neither decoding nor blits are left for startup.
+void create_cooked_texture_image(const cooked_texture& texture) {
+    const auto& largest = texture.levels.front();
+    const auto format = static_cast<VkFormat>(texture.format);
+    vkg.texture_format = format;
+    vkg.texture_extent = {largest.width, largest.height};
+    vkg.mip_levels = static_cast<uint32_t>(texture.levels.size());
+
+    VkDeviceSize image_size = texture.data.size();
+
+    const auto staging = upload_staging(image_size);
+    std::memcpy(staging.data,
+                texture.data.data(),
+                static_cast<size_t>(image_size));
+
+    create_image(largest.width,
+                 largest.height,
+                 vkg.mip_levels,
+                 VK_SAMPLE_COUNT_1_BIT,
+                 format,
+                 VK_IMAGE_TILING_OPTIMAL,
+                 texture_usage,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                 vkg.texture_image,
+                 vkg.texture_image_memory);
+
+    std::vector<VkBufferImageCopy> regions(texture.levels.size());
+    for (uint32_t i = 0; i < vkg.mip_levels; ++i) {
+        const auto& level = texture.levels[i];
+        auto& region = regions[i];
+        region.bufferOffset = staging.offset + level.offset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = i;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = {level.width, level.height, 1};
+    }
+
+    transition_image_layout(vkg.texture_image,
+                            format,
+                            VK_IMAGE_LAYOUT_UNDEFINED,
+                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                            vkg.mip_levels);
+    copy_buffer_to_image(staging.buffer, vkg.texture_image, regions);
+    hand_over_image(vkg.texture_image,
+                    vkg.mip_levels,
+                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                    VK_ACCESS_SHADER_READ_BIT);
+}
+
+// Whether blits can generate the mips of `format`, and are not emulated by a
+// CPU rasterizer where generating them on the CPU directly is faster.
+bool generate_mips_on_gpu(VkFormat format) {
+    if (vkg.MIP_GENERATION == mip_generation::cpu) {
+        return false;
+    }
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(vkg.physical_device,
+                                        format,
+                                        &format_properties);
+    if (!(format_properties.optimalTilingFeatures &
+          VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+        return false;
+    }
+    if (vkg.MIP_GENERATION == mip_generation::gpu) {
+        return true;
+    }
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vkg.physical_device, &properties);
+    return properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_CPU;
 }
 
 void create_texture_image() {
-    auto texture = load_image(vkg.TEXTURE_PATH);
+    // Block compressed levels take a quarter to an eighth of the memory and
+    // upload bandwidth, so they are preferred whenever they can be sampled.
+    if (can_sample(vkg.compressed_image) || can_sample(vkg.cooked_image)) {
+        create_cooked_texture_image(can_sample(vkg.compressed_image)
+                                        ? vkg.compressed_image
+                                        : vkg.cooked_image);
+        vkg.compressed_image = {};
+        vkg.cooked_image = {};
+        return;
+    }
+    const auto& texture = vkg.texture_info;
+    ASSERT(texture.width > 0, "failed to load texture image!");
+
+    // Levels generated on the CPU are uploaded like cooked ones. They are
+    // read back while downsampling, which is slow from mapped device memory,
+    // so the image is decoded into the level storage instead.
+    if (!generate_mips_on_gpu(VK_FORMAT_R8G8B8A8_SRGB)) {
+        auto levels = allocate_texture(static_cast<uint32_t>(texture.width),
+                                       static_cast<uint32_t>(texture.height));
+        const auto& largest = levels.levels.front();
+        ASSERT(load_image_into(vkg.TEXTURE_PATH,
+                               std::span(levels.storage)
+                                   .subspan(largest.offset, largest.size)),
+               "failed to load texture image!");
+        generate_mip_levels(levels);
+        create_cooked_texture_image(levels);
+        return;
+    }
 
     vkg.mip_levels = static_cast<uint32_t>(std::floor(
                          std::log2(std::max(texture.width, texture.height)))) +
                      1;
+    vkg.texture_format = VK_FORMAT_R8G8B8A8_SRGB;
+    vkg.texture_extent = {static_cast<uint32_t>(texture.width),
+                          static_cast<uint32_t>(texture.height)};
 
     VkDeviceSize image_size = texture.width * texture.height * 4;
 
-    ASSERT(texture.pixels, "failed to load texture image!");
-
-    VkBuffer staging_buffer;
-    VkDeviceMemory staging_buffer_memory;
-
-    create_buffer(image_size,
-                  VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                  staging_buffer,
-                  staging_buffer_memory);
-
-    void* data;
-    vkMapMemory(vkg.device, staging_buffer_memory, 0, image_size, 0, &data);
-    std::memcpy(data, texture.pixels, static_cast<size_t>(image_size));
-    vkUnmapMemory(vkg.device, staging_buffer_memory);
+    // PNG unfiltering reads back the rows it wrote, so the image is decoded
+    // straight into staging memory only when that is cached on the host.
+    // Otherwise it is decoded on the heap and copied over once.
+    const auto staging = upload_staging(image_size);
+    const std::span pixels(staging.data, static_cast<size_t>(image_size));
+    if (vkg.uploads.host_cached) {
+        ASSERT(load_image_into(vkg.TEXTURE_PATH, pixels),
+               "failed to load texture image!");
+    } else {
+        std::vector<std::byte> decoded(pixels.size());
+        ASSERT(load_image_into(vkg.TEXTURE_PATH, decoded),
+               "failed to load texture image!");
+        std::memcpy(pixels.data(), decoded.data(), decoded.size());
+    }
 
     create_image(texture.width,
                  texture.height,
@@ -1848,9 +2717,7 @@ void create_texture_image() {
                  VK_SAMPLE_COUNT_1_BIT,
                  VK_FORMAT_R8G8B8A8_SRGB,
                  VK_IMAGE_TILING_OPTIMAL,
-                 VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
-                     VK_IMAGE_USAGE_TRANSFER_DST_BIT |
-                     VK_IMAGE_USAGE_SAMPLED_BIT,
+                 texture_usage,
                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
                  vkg.texture_image,
                  vkg.texture_image_memory);
@@ -1860,7 +2727,7 @@ void create_texture_image() {
                             VK_IMAGE_LAYOUT_UNDEFINED,
                             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                             vkg.mip_levels);
-    copy_buffer_to_image(staging_buffer,
+    copy_buffer_to_image(staging,
                          vkg.texture_image,
                          static_cast<uint32_t>(texture.width),
                          static_cast<uint32_t>(texture.height));
@@ -1871,19 +2738,22 @@ void create_texture_image() {
     //                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
     //                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
     //                         vkg.mip_levels);
+    hand_over_image(vkg.texture_image,
+                    vkg.mip_levels,
+                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
     generate_mipmaps(vkg.texture_image,
                      VK_FORMAT_R8G8B8A8_SRGB,
                      texture.width,
                      texture.height,
                      vkg.mip_levels);
-
-    vkDestroyBuffer(vkg.device, staging_buffer, nullptr);
-    vkFreeMemory(vkg.device, staging_buffer_memory, nullptr);
 }
 
 void create_texture_image_view() {
     vkg.texture_image_view = create_image_view(vkg.texture_image,
-                                               VK_FORMAT_R8G8B8A8_SRGB,
+                                               vkg.texture_format,
                                                VK_IMAGE_ASPECT_COLOR_BIT,
                                                vkg.mip_levels);
 }
@@ -1942,39 +2812,17 @@ void create_depth_resources() {
 }
 
 void load_model() {
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string err;
-
-    auto result = tinyobj::LoadObj(&attrib,
-                                   &shapes,
-                                   &materials,
-                                   &err,
-                                   vkg.MODEL_PATH.c_str());
-
-    ASSERT(result, "Loading model" + err);
-
-    std::unordered_map<Vertex, uint32_t> unique_vertices{};
-    for (const auto& shape : shapes) {
-        for (const auto& index : shape.mesh.indices) {
-            Vertex vertex{};
-
-            vertex.pos = {attrib.vertices[3 * index.vertex_index + 0],
-                          attrib.vertices[3 * index.vertex_index + 1],
-                          attrib.vertices[3 * index.vertex_index + 2]};
-            vertex.tex_coord = {
-                attrib.texcoords[2 * index.texcoord_index + 0],
-                1.0f - attrib.texcoords[2 * index.texcoord_index + 1]};
-            vertex.color = {1.0f, 1.0f, 1.0f};
-            vkg.vertices.push_back(vertex);
-
-            if (unique_vertices.count(vertex) == 0) {
-                unique_vertices[vertex] =
-                    static_cast<uint32_t>(vkg.vertices.size());
-                vkg.vertices.push_back(vertex);
-            }
-            vkg.indices.push_back(unique_vertices[vertex]);
+    vkg.model = load_cooked_mesh(vkg.MODEL_PATH,
+                                 vkg.MODEL_CACHE_PATH,
+                                 vkg.TEX_COORD_ENCODING);
+    ASSERT(!vkg.model.indices.empty(), "Loading model " + vkg.MODEL_PATH);
+    vkg.meshlet_spheres.resize(vkg.model.lods.size());
+    for (size_t level = 0; level < vkg.model.lods.size(); ++level) {
+        const auto& lod = vkg.model.lods[level];
+        auto& spheres = vkg.meshlet_spheres[level];
+        spheres.resize(lod.meshlet_count);
+        for (uint32_t i = 0; i < lod.meshlet_count; ++i) {
+            spheres.set(i, vkg.model.meshlets[lod.first_meshlet + i].sphere);
         }
     }
 }
@@ -1998,47 +2846,381 @@ void create_color_resources() {
                                              1);
 }
 
+// Writes the texture into frame `frame`'s descriptor set, once the last
+// frame drawn with it is done.
+void update_texture_descriptor(uint32_t frame) {
+    VkDescriptorImageInfo image_info{};
+    image_info.sampler = vkg.texture_sampler;
+    image_info.imageView = vkg.texture_image_view;
+    image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkWriteDescriptorSet descriptor_write{};
+    descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptor_write.dstSet = vkg.descriptor_sets[frame];
+    descriptor_write.dstBinding = 1;
+    descriptor_write.dstArrayElement = 0;
+    descriptor_write.descriptorCount = 1;
+    descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptor_write.pImageInfo = &image_info;
+
+    vkUpdateDescriptorSets(vkg.device, 1, &descriptor_write, 0, nullptr);
+}
+
+struct movable_buffer {
+    VkBuffer* buffer;
+    gpu_allocation* memory;
+    VkDeviceSize size;
+    VkBufferUsageFlags usage;
+};
+
+// The buffers compaction may move, besides the texture.
+std::array<movable_buffer, 2> movable_buffers() {
+    return {{{&vkg.vertex_buffer,
+              &vkg.vertex_buffer_memory,
+              vkg.model.vertices.size_bytes(),
+              vertex_buffer_usage},
+             {&vkg.index_buffer,
+              &vkg.index_buffer_memory,
+              vkg.model.indices.size_bytes(),
+              index_buffer_usage}}};
+}
+
+movable_buffer buffer_of(const gpu_defragment_move& move) {
+    const auto buffers = movable_buffers();
+    return *std::find_if(buffers.begin(),
+                         buffers.end(),
+                         [&](const movable_buffer& buffer) {
+                             return buffer.memory == move.allocation;
+                         });
+}
+
+// Plans a pass and submits the copies of the moved resources into
+// replacements bound to their destinations. The originals are only read,
+// so frames keep drawing with them meanwhile.
+void start_defragment_pass() {
+    // Nothing changed since the last plan found nothing to do.
+    const auto stats = vkg.allocator->stats();
+    const auto& checked = vkg.defragment_checked;
+    if (stats.allocation_count == checked.allocation_count &&
+        stats.block_count == checked.block_count &&
+        stats.used_bytes == checked.used_bytes) {
+        return;
+    }
+
+    auto& pass = vkg.defragment;
+    std::vector<gpu_allocation*> movable = {&vkg.texture_image_memory};
+    for (const auto& buffer : movable_buffers()) {
+        movable.push_back(buffer.memory);
+    }
+    pass.moves = vkg.allocator->plan_defragmentation(
+        movable,
+        vkg.DEFRAGMENT_BYTES_PER_PASS);
+    if (pass.moves.empty()) {
+        vkg.defragment_checked = stats;
+        return;
+    }
+
+    pass.buffers.assign(pass.moves.size(), VK_NULL_HANDLE);
+    for (size_t i = 0; i < pass.moves.size(); ++i) {
+        const auto& destination = pass.moves[i].destination;
+        if (pass.moves[i].allocation == &vkg.texture_image_memory) {
+            pass.texture_image =
+                create_unbound_image(vkg.texture_extent.width,
+                                     vkg.texture_extent.height,
+                                     vkg.mip_levels,
+                                     VK_SAMPLE_COUNT_1_BIT,
+                                     vkg.texture_format,
+                                     VK_IMAGE_TILING_OPTIMAL,
+                                     texture_usage);
+            VK_CHECK(vkBindImageMemory(
+                vkg.device,
+                pass.texture_image,
+                from_handle<VkDeviceMemory>(destination.memory),
+                destination.offset));
+            pass.texture_image_view =
+                create_image_view(pass.texture_image,
+                                  vkg.texture_format,
+                                  VK_IMAGE_ASPECT_COLOR_BIT,
+                                  vkg.mip_levels);
+        } else {
+            const auto buffer = buffer_of(pass.moves[i]);
+            pass.buffers[i] = create_unbound_buffer(buffer.size, buffer.usage);
+            VK_CHECK(vkBindBufferMemory(
+                vkg.device,
+                pass.buffers[i],
+                from_handle<VkDeviceMemory>(destination.memory),
+                destination.offset));
+        }
+    }
+
+    // The resources in use belong to the graphics queue, so they are copied
+    // there.
+    const auto command_buffer = graphics_upload_commands();
+
+    // The texture is copied in transfer layouts and put back, the barriers
+    // ordering this against the frames drawn before and after on the queue.
+    std::array<VkImageMemoryBarrier, 2> barriers{};
+    for (auto& barrier : barriers) {
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = vkg.mip_levels;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+    }
+    if (pass.texture_image) {
+        barriers[0].srcAccessMask = 0;
+        barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barriers[0].image = vkg.texture_image;
+        barriers[1].srcAccessMask = 0;
+        barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barriers[1].image = pass.texture_image;
+        vkCmdPipelineBarrier(command_buffer,
+                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0,
+                             0,
+                             nullptr,
+                             0,
+                             nullptr,
+                             static_cast<uint32_t>(barriers.size()),
+                             barriers.data());
+
+        std::vector<VkImageCopy> regions(vkg.mip_levels);
+        for (uint32_t level = 0; level < vkg.mip_levels; ++level) {
+            auto& region = regions[level];
+            region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.srcSubresource.mipLevel = level;
+            region.srcSubresource.baseArrayLayer = 0;
+            region.srcSubresource.layerCount = 1;
+            region.dstSubresource = region.srcSubresource;
+            region.extent = {std::max(vkg.texture_extent.width >> level, 1u),
+                             std::max(vkg.texture_extent.height >> level, 1u),
+                             1};
+        }
+        vkCmdCopyImage(command_buffer,
+                       vkg.texture_image,
+                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                       pass.texture_image,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                       static_cast<uint32_t>(regions.size()),
+                       regions.data());
+    }
+    for (size_t i = 0; i < pass.moves.size(); ++i) {
+        if (pass.buffers[i]) {
+            const auto buffer = buffer_of(pass.moves[i]);
+            VkBufferCopy copy_region{};
+            copy_region.srcOffset = 0;
+            copy_region.dstOffset = 0;
+            copy_region.size = buffer.size;
+            vkCmdCopyBuffer(command_buffer,
+                            *buffer.buffer,
+                            pass.buffers[i],
+                            1,
+                            &copy_region);
+        }
+    }
+
+    // The buffers are made visible by the end of the batch.
+    if (pass.texture_image) {
+        barriers[0].srcAccessMask = 0;
+        barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        vkCmdPipelineBarrier(command_buffer,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                             0,
+                             0,
+                             nullptr,
+                             0,
+                             nullptr,
+                             static_cast<uint32_t>(barriers.size()),
+                             barriers.data());
+    }
+    pass.upload_serial = submit_uploads();
+}
+
+// Frames recorded from here on draw with the copies.
+void swap_defragmented_resources() {
+    auto& pass = vkg.defragment;
+    for (size_t i = 0; i < pass.moves.size(); ++i) {
+        if (pass.buffers[i]) {
+            std::swap(*buffer_of(pass.moves[i]).buffer, pass.buffers[i]);
+        }
+    }
+    if (pass.texture_image) {
+        std::swap(vkg.texture_image, pass.texture_image);
+        std::swap(vkg.texture_image_view, pass.texture_image_view);
+        vkg.stale_descriptor_sets.assign(vkg.double_buffered, true);
+    }
+    pass.swapped = true;
+}
+
+// Ends the pass in flight, which needs its copies done and no frame in
+// flight drawing with the originals: they are destroyed and the emptied
+// blocks go back to the device.
+void finish_defragmentation() {
+    auto& pass = vkg.defragment;
+    if (pass.moves.empty()) {
+        return;
+    }
+    if (!pass.swapped) {
+        swap_defragmented_resources();
+    }
+    for (const auto buffer : pass.buffers) {
+        vkDestroyBuffer(vkg.device, buffer, nullptr);
+    }
+    vkDestroyImageView(vkg.device, pass.texture_image_view, nullptr);
+    vkDestroyImage(vkg.device, pass.texture_image, nullptr);
+
+    const auto stats = vkg.allocator->commit_defragmentation(pass.moves);
+    std::cout << "[INFO] compacted device memory: moved " << stats.move_count
+              << " resources, " << stats.bytes_moved / 1024 << " KB, freed "
+              << stats.blocks_freed << " blocks, "
+              << stats.bytes_freed / 1024 << " KB" << std::endl;
+    pass = {};
+}
+
+// Compacts device memory a pass at a time while frames are drawn, called
+// once the current frame's previous use is done. A pass copies the
+// resources out of the sparsest blocks in one upload batch, frames switch to
+// the copies once it completes, and the originals are freed when the
+// frames drawn with them are done too. Each step only looks at fences, so
+// no frame waits on a pass.
+void defragment_memory() {
+    auto& pass = vkg.defragment;
+    if (pass.moves.empty()) {
+        start_defragment_pass();
+        return;
+    }
+    if (!pass.swapped) {
+        if (!uploads_done(pass.upload_serial)) {
+            return;
+        }
+        swap_defragmented_resources();
+        pass.retire_frame = vkg.frame_count + vkg.double_buffered;
+        return;
+    }
+    if (vkg.frame_count >= pass.retire_frame) {
+        finish_defragmentation();
+    }
+}
+
 } // namespace
 
 namespace graphics {
 void init() {
-    // We initialize SDL and create a window with it.
-    SDL_Init(SDL_INIT_VIDEO);
-
-    vkg.window = SDL_CreateWindow("Vulkan Game Engine",
-                                  SDL_WINDOWPOS_UNDEFINED,
-                                  SDL_WINDOWPOS_UNDEFINED,
-                                  vkg.windowExtent.width,
-                                  vkg.windowExtent.height,
-                                  SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
-
-    init_instance();
-    create_surface();
+    // Stages run as soon as the stages they need are done, so reading and
+    // decoding assets overlaps with setting up Vulkan. Stages that record
+    // into the command pool and submit to the queue form one chain, as both
+    // need external synchronization. SDL calls stay on the main thread.
+    mount_asset_package(vkg.PACKAGE_PATH);
+
+    jobs::task_graph graph;
+    const auto main_thread = jobs::thread_affinity::main;
+    const auto window = graph.add(
+        "create window",
+        [] {
+            // We initialize SDL and create a window with it.
+            SDL_Init(SDL_INIT_VIDEO);
+
+            vkg.window =
+                SDL_CreateWindow("Vulkan Game Engine",
+                                 SDL_WINDOWPOS_UNDEFINED,
+                                 SDL_WINDOWPOS_UNDEFINED,
+                                 vkg.windowExtent.width,
+                                 vkg.windowExtent.height,
+                                 SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
+        },
+        {},
+        main_thread);
+    const auto instance =
+        graph.add("init_instance", init_instance, {window}, main_thread);
+    auto surface =
+        graph.add("create_surface", create_surface, {instance}, main_thread);
 #ifdef _DEBUG
     if (vkg.validation_layer) {
-        init_debug_messenger();
+        surface = graph.add("init_debug_messenger",
+                            init_debug_messenger,
+                            {surface});
     }
 #endif
-    init_device();
-    create_swapchain();
-    create_render_pass();
-    create_descriptor_set_layout();
-    create_graphics_pipeline();
-    create_command_pool();
-    create_color_resources();
-    create_depth_resources();
-    create_framebuffers();
-    create_texture_image();
-    create_texture_image_view();
-    create_texture_sampler();
-    load_model();
-    create_vertex_buffer();
-    create_index_buffer();
-    create_uniform_buffers();
-    create_descriptor_pool();
-    create_descriptor_sets();
-    create_command_buffer();
-    create_sync_objects();
+    const auto device = graph.add("init_device", init_device, {surface});
+    const auto swapchain =
+        graph.add("create_swapchain", create_swapchain, {device}, main_thread);
+    const auto render_pass =
+        graph.add("create_render_pass", create_render_pass, {swapchain});
+    const auto descriptor_set_layout =
+        graph.add("create_descriptor_set_layout",
+                  create_descriptor_set_layout,
+                  {device});
+    const auto shaders = graph.add("read_shaders", read_shaders);
+    graph.add("create_graphics_pipeline",
+              create_graphics_pipeline,
+              {render_pass, descriptor_set_layout, shaders});
+    const auto command_pool =
+        graph.add("create_command_pool", create_command_pool, {device});
+    const auto uploads = graph.add("create_upload_queue",
+                                   create_upload_queue,
+                                   {command_pool});
+    const auto color_resources = graph.add("create_color_resources",
+                                           create_color_resources,
+                                           {swapchain});
+    const auto depth_resources = graph.add("create_depth_resources",
+                                           create_depth_resources,
+                                           {swapchain});
+    graph.add("create_framebuffers",
+              create_framebuffers,
+              {render_pass, color_resources, depth_resources});
+    const auto texture = graph.add("load_texture", load_texture);
+    const auto texture_image = graph.add("create_texture_image",
+                                         create_texture_image,
+                                         {uploads, texture});
+    const auto texture_image_view = graph.add("create_texture_image_view",
+                                              create_texture_image_view,
+                                              {texture_image});
+    const auto texture_sampler = graph.add("create_texture_sampler",
+                                           create_texture_sampler,
+                                           {texture_image});
+    const auto model = graph.add("load_model", load_model);
+    const auto vertex_buffer = graph.add("create_vertex_buffer",
+                                         create_vertex_buffer,
+                                         {model, texture_image});
+    const auto index_buffer = graph.add("create_index_buffer",
+                                        create_index_buffer,
+                                        {model, vertex_buffer});
+    const auto frame_arena =
+        graph.add("create_frame_arena", create_frame_arena, {device});
+    const auto descriptor_pool =
+        graph.add("create_descriptor_pool", create_descriptor_pool, {device});
+    graph.add("create_descriptor_sets",
+              create_descriptor_sets,
+              {descriptor_set_layout,
+               descriptor_pool,
+               frame_arena,
+               texture_image_view,
+               texture_sampler});
+    graph.add("create_command_buffer",
+              create_command_buffer,
+              {command_pool, index_buffer});
+    graph.add("create_sync_objects", create_sync_objects, {device});
+
+    graph.run(jobs::pool());
+    // The uploads are submitted together, unless they filled the ring, and
+    // the first frames follow them on the queue.
+    submit_uploads();
+    graph.print_timings(std::cout);
 }
 
 void draw() {
@@ -2048,6 +3230,14 @@ void draw() {
                              VK_TRUE,
                              std::numeric_limits<uint64_t>::max()));
 
+    // The frame drawn with this region before is done with it.
+    vkg.frame_arena_used = 0;
+    defragment_memory();
+    if (vkg.stale_descriptor_sets[vkg.current_frame]) {
+        update_texture_descriptor(vkg.current_frame);
+        vkg.stale_descriptor_sets[vkg.current_frame] = false;
+    }
+
     uint32_t image_index;
     auto acquire_result =
         vkAcquireNextImageKHR(vkg.device,
@@ -2118,6 +3308,7 @@ void draw() {
     }
 
     vkg.current_frame = (vkg.current_frame + 1) % vkg.double_buffered;
+    ++vkg.frame_count;
 }
 
 void resize_window() {
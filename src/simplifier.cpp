@@ -0,0 +1,686 @@
+#include "simplifier.hpp"
+
+#include "flat_hash_map.hpp"
+#include "job_system.hpp"
+#include "mathlib.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <utility>
+
+namespace {
+
+constexpr auto no_vertex = ~uint32_t{0};
+constexpr auto many_vertices = ~uint32_t{1};
+
+// Levels may move the surface by up to this fraction of the range's
+// bounding box diagonal. Beyond it a coarser level looks wrong even far away.
+constexpr float max_lod_relative_error = 0.02f;
+
+// A level that keeps more than this share of the previous level's indices is
+// not worth its memory, and ends the chain.
+constexpr float min_lod_reduction = 0.85f;
+
+// Border edges weigh this much more than surface planes, so silhouettes of
+// open meshes stay put.
+constexpr double border_weight = 10.0;
+
+// Sum of squared distances to a set of weighted planes, as the symmetric
+// matrix A, vector b and constant c of p^T A p + 2 b^T p + c.
+struct quadric {
+    double a00 = 0, a11 = 0, a22 = 0, a10 = 0, a20 = 0, a21 = 0;
+    double b0 = 0, b1 = 0, b2 = 0;
+    double c = 0;
+    double weight = 0;
+
+    // The plane dot(normal, p) + distance = 0, `normal` of unit length.
+    static quadric plane(const math::vec3& normal, float distance, double w) {
+        const double x = normal.x;
+        const double y = normal.y;
+        const double z = normal.z;
+        const double d = distance;
+        quadric q;
+        q.a00 = w * x * x;
+        q.a11 = w * y * y;
+        q.a22 = w * z * z;
+        q.a10 = w * y * x;
+        q.a20 = w * z * x;
+        q.a21 = w * z * y;
+        q.b0 = w * x * d;
+        q.b1 = w * y * d;
+        q.b2 = w * z * d;
+        q.c = w * d * d;
+        q.weight = w;
+        return q;
+    }
+
+    quadric& operator+=(const quadric& o) {
+        a00 += o.a00;
+        a11 += o.a11;
+        a22 += o.a22;
+        a10 += o.a10;
+        a20 += o.a20;
+        a21 += o.a21;
+        b0 += o.b0;
+        b1 += o.b1;
+        b2 += o.b2;
+        c += o.c;
+        weight += o.weight;
+        return *this;
+    }
+
+    // Weighted mean squared distance of `p` to the planes.
+    double error(const math::vec3& p) const {
+        if (weight == 0) {
+            return 0;
+        }
+        const double x = p.x;
+        const double y = p.y;
+        const double z = p.z;
+        const double r = a00 * x * x + a11 * y * y + a22 * z * z +
+                         2 * (a10 * x * y + a20 * x * z + a21 * y * z) +
+                         2 * (b0 * x + b1 * y + b2 * z) + c;
+        return std::max(r, 0.0) / weight;
+    }
+};
+
+math::vec3 normalized_or_zero(const math::vec3& v) {
+    const auto length = math::detail::sqrt(math::dot(v, v));
+    return length > 0 ? v * (1 / length) : math::vec3{};
+}
+
+enum class vertex_kind : uint8_t {
+    // Every edge is shared by two triangles, free to collapse anywhere.
+    manifold,
+    // On an open border, collapses only along it.
+    border,
+    // One of two vertices at the same position on a texture seam, collapses
+    // along the seam together with its twin.
+    seam,
+    // Corners and anything more complex, never collapses.
+    locked,
+};
+
+// Connectivity of the remaining triangles, kept up to date around every
+// collapse rather than rebuilt.
+struct topology {
+    // Triangles around every vertex as first given, as offsets into one flat
+    // array. Collapses rewrite triangles in place and mark the ones that
+    // degenerate as removed.
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> triangles;
+    std::vector<bool> removed;
+    // Vertices collapsed into every vertex, whose triangles it now owns,
+    // chained from the vertex itself. Collapsed vertices own none.
+    std::vector<uint32_t> next_merged;
+    std::vector<uint32_t> last_merged;
+    std::vector<bool> collapsed;
+    // Vertices at every position, as offsets into one flat array.
+    std::vector<uint32_t> position_offsets;
+    std::vector<uint32_t> position_vertices;
+    // Vertex across the one open edge leaving and entering every vertex,
+    // no_vertex or many_vertices otherwise.
+    std::vector<uint32_t> open_out;
+    std::vector<uint32_t> open_in;
+    // The other referenced vertex at the same position, for seams.
+    std::vector<uint32_t> twin;
+    std::vector<vertex_kind> kinds;
+    // The next and previous corner of every triangle around one vertex.
+    std::vector<std::pair<uint32_t, uint32_t>> fan;
+
+    // Whether `f` returns true for any remaining triangle around `vertex`.
+    template <typename F>
+    bool any_triangle(uint32_t vertex, const F& f) const {
+        if (collapsed[vertex]) {
+            return false;
+        }
+        for (auto v = vertex; v != no_vertex; v = next_merged[v]) {
+            for (auto i = offsets[v]; i < offsets[v + 1]; ++i) {
+                if (!removed[triangles[i]] && f(triangles[i])) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    std::span<const uint32_t> at_position(uint32_t position) const {
+        return {position_vertices.data() + position_offsets[position],
+                position_vertices.data() + position_offsets[position + 1]};
+    }
+
+    // Whether a triangle runs along a -> b. An edge is open when no triangle
+    // runs along it the other way.
+    bool has_edge(std::span<const uint32_t> indices,
+                  uint32_t a,
+                  uint32_t b) const {
+        return any_triangle(a, [&](uint32_t t) {
+            const auto* tri = &indices[3 * t];
+            for (size_t k = 0; k < 3; ++k) {
+                if (tri[k] == a && tri[(k + 1) % 3] == b) {
+                    return true;
+                }
+            }
+            return false;
+        });
+    }
+
+    void build(std::span<const uint32_t> indices,
+               std::span<const uint32_t> position_remap) {
+        const auto vertex_count = position_remap.size();
+        removed.assign(indices.size() / 3, false);
+        collapsed.assign(vertex_count, false);
+        compact(indices);
+
+        position_offsets.assign(vertex_count + 1, 0);
+        for (const auto p : position_remap) {
+            ++position_offsets[p + 1];
+        }
+        std::partial_sum(position_offsets.begin(),
+                         position_offsets.end(),
+                         position_offsets.begin());
+        position_vertices.resize(vertex_count);
+        auto fill = position_offsets;
+        for (uint32_t v = 0; v < vertex_count; ++v) {
+            position_vertices[fill[position_remap[v]]++] = v;
+        }
+
+        open_out.resize(vertex_count);
+        open_in.resize(vertex_count);
+        twin.resize(vertex_count);
+        kinds.resize(vertex_count);
+        for (uint32_t p = 0; p < vertex_count; ++p) {
+            if (position_remap[p] == p) {
+                update(p, indices, position_remap);
+            }
+        }
+    }
+
+    // Lists only the remaining triangles around every vertex, so chains of
+    // merged vertices stop piling up removed ones.
+    void compact(std::span<const uint32_t> indices) {
+        const auto vertex_count = collapsed.size();
+        offsets.assign(vertex_count + 1, 0);
+        for (size_t t = 0; t < removed.size(); ++t) {
+            if (!removed[t]) {
+                for (size_t k = 0; k < 3; ++k) {
+                    ++offsets[indices[3 * t + k] + 1];
+                }
+            }
+        }
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        triangles.resize(offsets.back());
+        auto fill = offsets;
+        for (size_t t = 0; t < removed.size(); ++t) {
+            if (!removed[t]) {
+                for (size_t k = 0; k < 3; ++k) {
+                    triangles[fill[indices[3 * t + k]]++] =
+                        static_cast<uint32_t>(t);
+                }
+            }
+        }
+        next_merged.assign(vertex_count, no_vertex);
+        last_merged.resize(vertex_count);
+        std::iota(last_merged.begin(), last_merged.end(), 0);
+    }
+
+    // Recomputes the open edges, twins and kinds of the vertices at
+    // `position`, after collapses changed triangles around it.
+    void update(uint32_t position,
+                std::span<const uint32_t> indices,
+                std::span<const uint32_t> position_remap) {
+        auto record = [](uint32_t& slot, uint32_t vertex) {
+            if (slot == no_vertex) {
+                slot = vertex;
+            } else if (slot != vertex) {
+                slot = many_vertices;
+            }
+        };
+        auto first = no_vertex;
+        uint32_t shared = 0;
+        for (const auto v : at_position(position)) {
+            open_out[v] = no_vertex;
+            open_in[v] = no_vertex;
+            twin[v] = no_vertex;
+            // Every triangle along an edge of `v` has `v` as a corner, so
+            // the edges of its own triangles tell which of them are open.
+            fan.clear();
+            any_triangle(v, [&](uint32_t t) {
+                const auto* tri = &indices[3 * t];
+                const auto k = tri[0] == v ? 0 : tri[1] == v ? 1 : 2;
+                fan.push_back({tri[(k + 1) % 3], tri[(k + 2) % 3]});
+                return false;
+            });
+            if (fan.empty()) {
+                continue;
+            }
+            for (const auto& edges : fan) {
+                bool back = false;
+                bool ahead = false;
+                for (const auto& other : fan) {
+                    back |= other.second == edges.first;
+                    ahead |= other.first == edges.second;
+                }
+                if (!back) {
+                    record(open_out[v], edges.first);
+                }
+                if (!ahead) {
+                    record(open_in[v], edges.second);
+                }
+            }
+            if (first == no_vertex) {
+                first = v;
+            } else {
+                twin[v] = first;
+                twin[first] = v;
+            }
+            ++shared;
+        }
+
+        auto single = [](uint32_t v) { return v < many_vertices; };
+        for (const auto v : at_position(position)) {
+            kinds[v] = vertex_kind::locked;
+            const bool closed =
+                open_out[v] == no_vertex && open_in[v] == no_vertex;
+            if (shared == 1) {
+                if (closed) {
+                    kinds[v] = vertex_kind::manifold;
+                } else if (single(open_out[v]) && single(open_in[v])) {
+                    kinds[v] = vertex_kind::border;
+                }
+            } else if (shared == 2) {
+                const auto w = twin[v];
+                if (single(open_out[v]) && single(open_in[v]) &&
+                    single(open_out[w]) && single(open_in[w]) &&
+                    position_remap[open_out[v]] ==
+                        position_remap[open_in[w]] &&
+                    position_remap[open_in[v]] ==
+                        position_remap[open_out[w]]) {
+                    kinds[v] = vertex_kind::seam;
+                }
+            }
+        }
+    }
+
+    // Moves the triangles around `from` onto `to`, and returns how many of
+    // them degenerated and were removed.
+    size_t collapse_onto(std::span<uint32_t> indices,
+                         uint32_t from,
+                         uint32_t to) {
+        size_t count = 0;
+        any_triangle(from, [&](uint32_t t) {
+            auto* tri = &indices[3 * t];
+            if (tri[0] == to || tri[1] == to || tri[2] == to) {
+                removed[t] = true;
+                ++count;
+            } else {
+                for (size_t k = 0; k < 3; ++k) {
+                    if (tri[k] == from) {
+                        tri[k] = to;
+                    }
+                }
+            }
+            return false;
+        });
+        next_merged[last_merged[to]] = from;
+        last_merged[to] = last_merged[from];
+        collapsed[from] = true;
+        return count;
+    }
+};
+
+struct collapse {
+    uint32_t from;
+    uint32_t to;
+    double error;
+};
+
+// One range being simplified. Every call to simplify_to carries on from
+// where the one before stopped, with the quadrics accumulated so far.
+struct range_simplifier {
+    std::span<const Vertex> vertices;
+    // The triangles as first given, rewritten by the collapses.
+    std::vector<uint32_t> indices;
+    size_t index_count;
+    // Vertices split only by their texture coordinates share one quadric.
+    std::vector<uint32_t> position_remap;
+    std::vector<quadric> quadrics;
+    topology topo;
+    double max_error_sq;
+    double worst_error = 0;
+    // The cheapest allowed collapse leaving every vertex, recomputed only for
+    // the vertices in `dirty`.
+    std::vector<collapse> best;
+    std::vector<uint32_t> dirty;
+    std::vector<collapse> candidates;
+    std::vector<bool> touched;
+    std::vector<uint32_t> touched_positions;
+
+    range_simplifier(std::span<const uint32_t> source,
+                     std::span<const Vertex> range_vertices,
+                     float max_error)
+        : vertices(range_vertices),
+          indices(source.begin(), source.end()),
+          index_count(source.size()),
+          max_error_sq(double{max_error} * max_error) {
+        const auto vertex_count = vertices.size();
+        position_remap.resize(vertex_count);
+        {
+            flat_hash_map<math::vec3,
+                          uint32_t,
+                          std::hash<math::vec3>,
+                          std::equal_to<math::vec3>>
+                positions;
+            positions.reserve(vertex_count);
+            for (uint32_t v = 0; v < vertex_count; ++v) {
+                const auto [first, inserted] =
+                    positions.try_emplace(vertices[v].pos, v);
+                position_remap[v] = *first;
+            }
+        }
+        topo.build(indices, position_remap);
+
+        // Area weighted triangle planes, plus planes through open edges
+        // standing perpendicular to their triangle.
+        quadrics.resize(vertex_count);
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            const uint32_t corners[3] = {
+                indices[i], indices[i + 1], indices[i + 2]};
+            const auto& a = position(corners[0]);
+            const auto cross = math::cross(position(corners[1]) - a,
+                                           position(corners[2]) - a);
+            const auto area = math::detail::sqrt(math::dot(cross, cross));
+            if (area == 0) {
+                continue;
+            }
+            const auto normal = cross * (1 / area);
+            const auto q = quadric::plane(normal, -math::dot(normal, a), area);
+            for (const auto v : corners) {
+                quadrics[position_remap[v]] += q;
+            }
+            for (size_t k = 0; k < 3; ++k) {
+                const auto v0 = corners[k];
+                const auto v1 = corners[(k + 1) % 3];
+                if (topo.has_edge(indices, v1, v0)) {
+                    continue;
+                }
+                const auto edge = position(v1) - position(v0);
+                const auto edge_normal =
+                    normalized_or_zero(math::cross(edge, normal));
+                const auto border = quadric::plane(
+                    edge_normal,
+                    -math::dot(edge_normal, position(v0)),
+                    border_weight * math::dot(edge, edge));
+                quadrics[position_remap[v0]] += border;
+                quadrics[position_remap[v1]] += border;
+            }
+        }
+
+        best.assign(vertex_count, {no_vertex, no_vertex, 0});
+        dirty.resize(vertex_count);
+        std::iota(dirty.begin(), dirty.end(), 0);
+        touched.assign(vertex_count, false);
+    }
+
+    const math::vec3& position(uint32_t v) const { return vertices[v].pos; }
+
+    // Whether moving `from` onto `to` turns any remaining triangle around
+    // `from` by more than about 75 degrees.
+    bool flips(uint32_t from, uint32_t to) const {
+        return topo.any_triangle(from, [&](uint32_t t) {
+            const auto* tri = &indices[3 * t];
+            if (tri[0] == to || tri[1] == to || tri[2] == to) {
+                return false;
+            }
+            const auto k = tri[0] == from ? 0 : tri[1] == from ? 1 : 2;
+            const auto& b = position(tri[(k + 1) % 3]);
+            const auto& c = position(tri[(k + 2) % 3]);
+            const auto before = math::cross(b - position(from),
+                                            c - position(from));
+            const auto after = math::cross(b - position(to), c - position(to));
+            const auto scale = math::detail::sqrt(math::dot(before, before) *
+                                                  math::dot(after, after));
+            return math::dot(before, after) <= 0.25f * scale;
+        });
+    }
+
+    collapse cheapest_collapse(uint32_t from) const {
+        collapse result{no_vertex, no_vertex, 0};
+        const auto kind = topo.kinds[from];
+        if (kind == vertex_kind::locked) {
+            return result;
+        }
+        const auto& q = quadrics[position_remap[from]];
+        topo.any_triangle(from, [&](uint32_t t) {
+            for (size_t k = 0; k < 3; ++k) {
+                const auto to = indices[3 * t + k];
+                const bool along_open =
+                    topo.open_out[from] == to || topo.open_in[from] == to;
+                if ((kind != vertex_kind::manifold && !along_open) ||
+                    position_remap[from] == position_remap[to]) {
+                    continue;
+                }
+                const auto error = q.error(position(to));
+                if (error <= max_error_sq &&
+                    (result.to == no_vertex || error < result.error)) {
+                    result = {from, to, error};
+                }
+            }
+            return false;
+        });
+        return result;
+    }
+
+    void touch_around(uint32_t v) {
+        topo.any_triangle(v, [&](uint32_t t) {
+            for (size_t k = 0; k < 3; ++k) {
+                const auto p = position_remap[indices[3 * t + k]];
+                if (!touched[p]) {
+                    touched[p] = true;
+                    touched_positions.push_back(p);
+                }
+            }
+            return false;
+        });
+    }
+
+    void simplify_to(size_t target_index_count) {
+        while (index_count > target_index_count) {
+            for (const auto v : dirty) {
+                best[v] = cheapest_collapse(v);
+            }
+            dirty.clear();
+            candidates.clear();
+            for (const auto& c : best) {
+                if (c.to != no_vertex) {
+                    candidates.push_back(c);
+                }
+            }
+            if (candidates.empty()) {
+                break;
+            }
+
+            // Collapses blocked in this pass may come back cheaper in the
+            // next one than most of what is left, so each pass only goes past
+            // the cheapest quarter of the candidates until something
+            // collapses. Only that part needs sorting up front.
+            const auto by_error = [](const collapse& x, const collapse& y) {
+                return x.error < y.error;
+            };
+            const auto cheapest = candidates.begin() + candidates.size() / 4;
+            std::nth_element(candidates.begin(),
+                             cheapest,
+                             candidates.end(),
+                             by_error);
+            std::sort(candidates.begin(), cheapest + 1, by_error);
+
+            // Collapses in one pass must not share triangles, or the flip
+            // tests would look at moved geometry.
+            const auto triangles_to_remove =
+                (index_count - target_index_count + 2) / 3;
+            size_t removed = 0;
+            for (auto it = candidates.begin(); it != candidates.end(); ++it) {
+                if (removed >= triangles_to_remove) {
+                    break;
+                }
+                if (it == cheapest + 1) {
+                    if (removed > 0) {
+                        break;
+                    }
+                    std::sort(it, candidates.end(), by_error);
+                }
+                const auto& c = *it;
+                if (touched[position_remap[c.from]] ||
+                    touched[position_remap[c.to]]) {
+                    continue;
+                }
+                if (topo.kinds[c.from] == vertex_kind::seam) {
+                    // The twin follows along its side of the seam.
+                    const auto twin = topo.twin[c.from];
+                    const auto twin_to = c.to == topo.open_out[c.from]
+                                             ? topo.open_in[twin]
+                                             : topo.open_out[twin];
+                    if (flips(c.from, c.to) || flips(twin, twin_to)) {
+                        continue;
+                    }
+                    touch_around(c.from);
+                    touch_around(twin);
+                    removed += topo.collapse_onto(indices, c.from, c.to);
+                    removed += topo.collapse_onto(indices, twin, twin_to);
+                } else {
+                    if (flips(c.from, c.to)) {
+                        continue;
+                    }
+                    touch_around(c.from);
+                    removed += topo.collapse_onto(indices, c.from, c.to);
+                }
+                quadrics[position_remap[c.to]] +=
+                    quadrics[position_remap[c.from]];
+                worst_error = std::max(worst_error, c.error);
+            }
+            if (removed == 0) {
+                break;
+            }
+            index_count -= 3 * removed;
+            // Walking past removed triangles costs more than relisting the
+            // rest once a quarter of them are gone.
+            if (4 * index_count < 3 * topo.triangles.size()) {
+                topo.compact(indices);
+            }
+
+            // Only vertices at touched positions may have a different best
+            // collapse now, or one onto a vertex that is gone.
+            for (const auto p : touched_positions) {
+                topo.update(p, indices, position_remap);
+                const auto at = topo.at_position(p);
+                dirty.insert(dirty.end(), at.begin(), at.end());
+                touched[p] = false;
+            }
+            touched_positions.clear();
+        }
+    }
+
+    std::vector<uint32_t> result() const {
+        std::vector<uint32_t> remaining;
+        remaining.reserve(index_count);
+        for (size_t t = 0; t < topo.removed.size(); ++t) {
+            if (!topo.removed[t]) {
+                remaining.insert(remaining.end(),
+                                 indices.begin() + 3 * t,
+                                 indices.begin() + 3 * t + 3);
+            }
+        }
+        return remaining;
+    }
+
+    float error() const { return static_cast<float>(std::sqrt(worst_error)); }
+};
+
+} // namespace
+
+std::vector<uint32_t> simplify(std::span<const uint32_t> indices,
+                               std::span<const Vertex> vertices,
+                               size_t target_index_count,
+                               float max_error,
+                               float* result_error) {
+    range_simplifier simplifier(indices, vertices, max_error);
+    simplifier.simplify_to(target_index_count);
+    if (result_error) {
+        *result_error = simplifier.error();
+    }
+    return simplifier.result();
+}
+
+std::vector<mesh_lod> build_lod_chain(mesh_data& mesh,
+                                      std::vector<mesh_range>& ranges) {
+    const auto base_range_count = static_cast<uint32_t>(ranges.size());
+    std::vector<mesh_lod> lods;
+    lods.push_back({0, base_range_count, 0, 0, 0.0f});
+
+    // Every range carries on from its own previous level, on the job pool.
+    std::vector<std::unique_ptr<range_simplifier>> simplifiers(
+        base_range_count);
+    std::vector<std::vector<uint32_t>> simplified(base_range_count);
+    std::vector<float> errors(base_range_count);
+
+    size_t previous_index_count = mesh.indices.size();
+    float previous_error = 0.0f;
+    for (size_t level = 1; level < max_lod_count; ++level) {
+        jobs::parallel_for(base_range_count, [&](size_t r) {
+            const auto& range = ranges[r];
+            if (!simplifiers[r]) {
+                const std::span<const uint32_t> indices(
+                    mesh.indices.data() + range.first_index,
+                    range.index_count);
+                const std::span<const Vertex> vertices(
+                    mesh.vertices.data() + range.vertex_offset,
+                    range.vertex_count);
+                const auto diagonal = range.bounds.max - range.bounds.min;
+                const auto max_error =
+                    max_lod_relative_error *
+                    math::detail::sqrt(math::dot(diagonal, diagonal));
+                simplifiers[r] = std::make_unique<range_simplifier>(
+                    indices,
+                    vertices,
+                    max_error);
+            }
+            const auto target = range.index_count >> level;
+            simplifiers[r]->simplify_to(target / 3 * 3);
+            simplified[r] = simplifiers[r]->result();
+            optimize_vertex_cache(simplified[r], range.vertex_count);
+            errors[r] = simplifiers[r]->error();
+        });
+
+        const auto first_range = static_cast<uint32_t>(ranges.size());
+        const auto first_index = mesh.indices.size();
+        float level_error = previous_error;
+        for (uint32_t r = 0; r < base_range_count; ++r) {
+            level_error = std::max(level_error, errors[r]);
+            auto lod_range = ranges[r];
+            lod_range.first_index = static_cast<uint32_t>(mesh.indices.size());
+            lod_range.index_count = static_cast<uint32_t>(simplified[r].size());
+            mesh.indices.insert(mesh.indices.end(),
+                                simplified[r].begin(),
+                                simplified[r].end());
+            ranges.push_back(lod_range);
+        }
+
+        const auto index_count = mesh.indices.size() - first_index;
+        if (index_count > min_lod_reduction * previous_index_count) {
+            mesh.indices.resize(first_index);
+            ranges.resize(first_range);
+            break;
+        }
+        lods.push_back({first_range,
+                        base_range_count,
+                        0,
+                        0,
+                        level_error});
+        previous_index_count = index_count;
+        previous_error = level_error;
+    }
+    return lods;
+}
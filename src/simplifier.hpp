@@ -0,0 +1,51 @@
+#ifndef SIMPLIFIER_HPP
+#define SIMPLIFIER_HPP
+
+#include "asset_loader.hpp"
+#include "mesh_optimizer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Returns `indices` simplified towards `target_index_count` by collapsing
+// edges in order of quadric error (Garland and Heckbert, "Surface
+// Simplification Using Quadric Error Metrics"). Vertices only collapse onto
+// other existing vertices, so the result indexes the same vertex array. Open
+// borders and texture seams keep their shape: vertices on them only collapse
+// along them.
+//
+// Stops before any collapse that would move the surface by more than
+// `max_error`, in model units. `result_error`, when given, receives the
+// largest error of the collapses made.
+std::vector<uint32_t> simplify(std::span<const uint32_t> indices,
+                               std::span<const Vertex> vertices,
+                               size_t target_index_count,
+                               float max_error,
+                               float* result_error = nullptr);
+
+constexpr size_t max_lod_count = 4;
+
+// One level of detail, a set of mesh ranges drawn instead of the full
+// mesh's, and the meshlets built from them.
+struct mesh_lod {
+    uint32_t first_range;
+    uint32_t range_count;
+    uint32_t first_meshlet;
+    uint32_t meshlet_count;
+    // How far, in model units, the surface may lie from the full mesh's.
+    float error;
+};
+
+// Appends up to max_lod_count - 1 coarser levels to `mesh`, each simplified
+// from the one before to about half its triangles, carrying on with the
+// quadrics collapsed so far. Ranges are simplified in parallel on the job
+// pool. Their indices go to the end of `mesh.indices` and their ranges to the
+// end of `ranges`, sharing the vertices of the range they were simplified
+// from. `ranges` covers the full mesh on entry, and becomes the first level.
+// Levels have increasing error and the meshlet fields left at zero.
+std::vector<mesh_lod> build_lod_chain(mesh_data& mesh,
+                                      std::vector<mesh_range>& ranges);
+
+#endif
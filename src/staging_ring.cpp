@@ -0,0 +1,44 @@
+#include "staging_ring.hpp"
+
+namespace {
+
+constexpr uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+uint64_t staging_ring::allocate(uint64_t size, uint64_t alignment) {
+    if (size > ring_size) {
+        return no_space;
+    }
+    // Nothing is held, so any size up to the capacity fits.
+    if (batches.empty() && head == tail) {
+        head = 0;
+        tail = 0;
+    }
+    auto start = align_up(head, alignment);
+    // A range that would cross the end starts over at the beginning.
+    if (start % ring_size + size > ring_size) {
+        start = align_up(start, ring_size);
+    }
+    if (start + size - tail > ring_size) {
+        return no_space;
+    }
+    head = start + size;
+    return start % ring_size;
+}
+
+void staging_ring::end_batch(uint64_t serial) {
+    // Batches that took no space have none to give back.
+    if (head != (batches.empty() ? tail : batches.back().second)) {
+        batches.emplace_back(serial, head);
+    }
+}
+
+void staging_ring::release(uint64_t serial) {
+    while (!batches.empty() && batches.front().first <= serial) {
+        tail = batches.front().second;
+        batches.pop_front();
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef STAGING_RING_HPP
+#define STAGING_RING_HPP
+
+#include <cstdint>
+#include <deque>
+#include <utility>
+
+// Hands out the space of a fixed size staging buffer in order, for data the
+// GPU reads once from work submitted in batches. Space handed out for a
+// batch is reused once the batch is done, so both take a few additions, and
+// the buffer can stay mapped for good. Offsets are positions that only
+// grow, taken modulo the size.
+class staging_ring {
+  public:
+    static constexpr uint64_t no_space = UINT64_MAX;
+
+    explicit staging_ring(uint64_t size = 0) : ring_size(size) {}
+
+    uint64_t capacity() const { return ring_size; }
+    // Offset of `size` bytes at `alignment`, which must divide the
+    // capacity, or no_space while the batches not done hold too much of it.
+    // Ranges never wrap around the end.
+    uint64_t allocate(uint64_t size, uint64_t alignment);
+    // What was handed out since the last batch ended belongs to `serial`.
+    // Serials increase from batch to batch, which are done in order.
+    void end_batch(uint64_t serial);
+    // Batches up to `serial` are done with their space.
+    void release(uint64_t serial);
+
+  private:
+    uint64_t ring_size;
+    uint64_t head = 0;
+    uint64_t tail = 0;
+    // Serial and end position of the batches not done.
+    std::deque<std::pair<uint64_t, uint64_t>> batches;
+};
+
+#endif
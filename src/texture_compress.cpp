@@ -0,0 +1,488 @@
+#include "texture_compress.hpp"
+
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using color = std::array<float, 4>;
+using texel_block = std::array<color, 16>;
+using decoded_block = std::array<std::array<uint8_t, 4>, 16>;
+
+// Gathers the block at (`block_x`, `block_y`), repeating the last row and
+// column of the image for blocks that overhang it.
+texel_block load_block(const uint8_t* rgba,
+                       uint32_t width,
+                       uint32_t height,
+                       uint32_t block_x,
+                       uint32_t block_y) {
+    texel_block texels;
+    for (uint32_t y = 0; y < 4; ++y) {
+        const auto row = std::min(4 * block_y + y, height - 1);
+        for (uint32_t x = 0; x < 4; ++x) {
+            const auto column = std::min(4 * block_x + x, width - 1);
+            const auto* texel = rgba + 4 * (size_t{row} * width + column);
+            for (int c = 0; c < 4; ++c) {
+                texels[4 * y + x][c] = texel[c];
+            }
+        }
+    }
+    return texels;
+}
+
+float dot(const color& a, const color& b, int channels) {
+    float sum = 0;
+    for (int c = 0; c < channels; ++c) {
+        sum += a[c] * b[c];
+    }
+    return sum;
+}
+
+// Fits the line through the block's colors that the endpoints are chosen
+// on: the mean and, by power iteration on the covariance, the direction of
+// largest variance. Returns the endpoints where the colors' projections on
+// the line start and end.
+std::pair<color, color> fit_endpoints(const texel_block& texels,
+                                      int channels) {
+    color mean{};
+    for (const auto& texel : texels) {
+        for (int c = 0; c < channels; ++c) {
+            mean[c] += texel[c] / 16.0f;
+        }
+    }
+    float covariance[4][4] = {};
+    for (const auto& texel : texels) {
+        for (int i = 0; i < channels; ++i) {
+            for (int j = 0; j < channels; ++j) {
+                covariance[i][j] +=
+                    (texel[i] - mean[i]) * (texel[j] - mean[j]);
+            }
+        }
+    }
+    // Starting from the column of the most varying channel keeps the start
+    // from being orthogonal to the direction searched for.
+    int largest = 0;
+    for (int c = 1; c < channels; ++c) {
+        if (covariance[c][c] > covariance[largest][largest]) {
+            largest = c;
+        }
+    }
+    color axis{};
+    for (int c = 0; c < channels; ++c) {
+        axis[c] = covariance[c][largest];
+    }
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        color next{};
+        for (int i = 0; i < channels; ++i) {
+            for (int j = 0; j < channels; ++j) {
+                next[i] += covariance[i][j] * axis[j];
+            }
+        }
+        const auto length = std::sqrt(dot(next, next, channels));
+        if (length < 1e-6f) {
+            break;
+        }
+        for (int c = 0; c < channels; ++c) {
+            axis[c] = next[c] / length;
+        }
+    }
+
+    auto low = std::numeric_limits<float>::max();
+    auto high = std::numeric_limits<float>::lowest();
+    for (const auto& texel : texels) {
+        color offset{};
+        for (int c = 0; c < channels; ++c) {
+            offset[c] = texel[c] - mean[c];
+        }
+        const auto t = dot(offset, axis, channels);
+        low = std::min(low, t);
+        high = std::max(high, t);
+    }
+    color first{};
+    color last{};
+    for (int c = 0; c < channels; ++c) {
+        first[c] = mean[c] + low * axis[c];
+        last[c] = mean[c] + high * axis[c];
+    }
+    return {first, last};
+}
+
+// Least squares endpoints for texels mixed as (1 - t) * first + t * last
+// with the given weights. Returns false when the weights cannot tell the
+// endpoints apart.
+bool refine_endpoints(const texel_block& texels,
+                      const std::array<float, 16>& weights,
+                      int channels,
+                      color& first,
+                      color& last) {
+    float aa = 0;
+    float ab = 0;
+    float bb = 0;
+    color ax{};
+    color bx{};
+    for (size_t i = 0; i < texels.size(); ++i) {
+        const auto t = weights[i];
+        aa += (1 - t) * (1 - t);
+        ab += (1 - t) * t;
+        bb += t * t;
+        for (int c = 0; c < channels; ++c) {
+            ax[c] += (1 - t) * texels[i][c];
+            bx[c] += t * texels[i][c];
+        }
+    }
+    const auto determinant = aa * bb - ab * ab;
+    if (std::abs(determinant) < 1e-6f) {
+        return false;
+    }
+    for (int c = 0; c < channels; ++c) {
+        first[c] = std::clamp((bb * ax[c] - ab * bx[c]) / determinant,
+                              0.0f,
+                              255.0f);
+        last[c] = std::clamp((aa * bx[c] - ab * ax[c]) / determinant,
+                             0.0f,
+                             255.0f);
+    }
+    return true;
+}
+
+struct bit_writer {
+    uint8_t* bytes;
+    uint32_t position = 0;
+
+    void write(uint32_t value, uint32_t count) {
+        for (uint32_t i = 0; i < count; ++i, ++position) {
+            if ((value >> i) & 1) {
+                bytes[position / 8] |=
+                    static_cast<uint8_t>(1 << position % 8);
+            }
+        }
+    }
+};
+
+uint16_t pack_565(const color& c) {
+    const auto r = static_cast<uint16_t>(std::lround(c[0] * 31.0f / 255.0f));
+    const auto g = static_cast<uint16_t>(std::lround(c[1] * 63.0f / 255.0f));
+    const auto b = static_cast<uint16_t>(std::lround(c[2] * 31.0f / 255.0f));
+    return static_cast<uint16_t>(r << 11 | g << 5 | b);
+}
+
+std::array<uint8_t, 4> unpack_565(uint16_t packed) {
+    const auto r = packed >> 11;
+    const auto g = (packed >> 5) & 63;
+    const auto b = packed & 31;
+    return {static_cast<uint8_t>(r << 3 | r >> 2),
+            static_cast<uint8_t>(g << 2 | g >> 4),
+            static_cast<uint8_t>(b << 3 | b >> 2),
+            255};
+}
+
+struct bc1_block {
+    uint16_t color0;
+    uint16_t color1;
+    std::array<uint8_t, 16> indices;
+    decoded_block decoded;
+    float error;
+};
+
+// Picks the nearest of the four colors encoded by `color0` and `color1` for
+// every texel.
+bc1_block choose_bc1_indices(const texel_block& texels,
+                             uint16_t color0,
+                             uint16_t color1) {
+    // color0 > color1 selects the four color mode, equal endpoints leave a
+    // single color to use.
+    if (color0 < color1) {
+        std::swap(color0, color1);
+    }
+    std::array<std::array<uint8_t, 4>, 4> palette;
+    palette[0] = unpack_565(color0);
+    palette[1] = unpack_565(color1);
+    for (int c = 0; c < 3; ++c) {
+        palette[2][c] = static_cast<uint8_t>(
+            (2 * palette[0][c] + palette[1][c] + 1) / 3);
+        palette[3][c] = static_cast<uint8_t>(
+            (palette[0][c] + 2 * palette[1][c] + 1) / 3);
+    }
+    palette[2][3] = 255;
+    palette[3][3] = 255;
+    const int palette_size = color0 == color1 ? 1 : 4;
+
+    bc1_block block{color0, color1, {}, {}, 0};
+    for (size_t i = 0; i < texels.size(); ++i) {
+        auto best = std::numeric_limits<float>::max();
+        for (int p = 0; p < palette_size; ++p) {
+            float error = 0;
+            for (int c = 0; c < 3; ++c) {
+                const auto d = texels[i][c] - palette[p][c];
+                error += d * d;
+            }
+            if (error < best) {
+                best = error;
+                block.indices[i] = static_cast<uint8_t>(p);
+            }
+        }
+        block.decoded[i] = palette[block.indices[i]];
+        block.error += best;
+    }
+    return block;
+}
+
+void encode_bc1_block(const texel_block& texels,
+                      std::byte* out,
+                      decoded_block& decoded) {
+    auto [first, last] = fit_endpoints(texels, 3);
+    auto best = choose_bc1_indices(texels, pack_565(first), pack_565(last));
+    for (int iteration = 0; iteration < 2 && best.color0 != best.color1;
+         ++iteration) {
+        constexpr float index_weights[4] = {0, 1, 1 / 3.0f, 2 / 3.0f};
+        std::array<float, 16> weights;
+        for (size_t i = 0; i < weights.size(); ++i) {
+            weights[i] = index_weights[best.indices[i]];
+        }
+        if (!refine_endpoints(texels, weights, 3, first, last)) {
+            break;
+        }
+        auto block = choose_bc1_indices(texels,
+                                        pack_565(first),
+                                        pack_565(last));
+        if (block.error >= best.error) {
+            break;
+        }
+        best = block;
+    }
+
+    uint32_t indices = 0;
+    for (size_t i = 0; i < best.indices.size(); ++i) {
+        indices |= uint32_t{best.indices[i]} << (2 * i);
+    }
+    std::memcpy(out, &best.color0, 2);
+    std::memcpy(out + 2, &best.color1, 2);
+    std::memcpy(out + 4, &indices, 4);
+    decoded = best.decoded;
+}
+
+constexpr std::array<int, 16> bc7_weights =
+    {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+struct bc7_block {
+    // 8 bit RGBA endpoints, the lowest bit of each shared by its channels.
+    std::array<std::array<uint8_t, 4>, 2> endpoints;
+    std::array<uint8_t, 16> indices;
+    decoded_block decoded;
+    float error;
+};
+
+std::array<uint8_t, 4> quantize_mode6_endpoint(const color& endpoint,
+                                               uint32_t p_bit) {
+    std::array<uint8_t, 4> quantized;
+    for (int c = 0; c < 4; ++c) {
+        const auto value = std::clamp(
+            static_cast<int>(std::lround((endpoint[c] - p_bit) / 2)),
+            0,
+            127);
+        quantized[c] = static_cast<uint8_t>(value << 1 | p_bit);
+    }
+    return quantized;
+}
+
+// Picks the nearest of the 16 interpolated values for every texel, testing
+// the value its projection on the endpoints' line rounds to and those next
+// to it.
+bc7_block choose_bc7_indices(const texel_block& texels,
+                             const std::array<uint8_t, 4>& endpoint0,
+                             const std::array<uint8_t, 4>& endpoint1) {
+    std::array<std::array<uint8_t, 4>, 16> palette;
+    for (size_t i = 0; i < palette.size(); ++i) {
+        for (int c = 0; c < 4; ++c) {
+            palette[i][c] =
+                static_cast<uint8_t>(((64 - bc7_weights[i]) * endpoint0[c] +
+                                      bc7_weights[i] * endpoint1[c] + 32) >>
+                                     6);
+        }
+    }
+    color direction;
+    for (int c = 0; c < 4; ++c) {
+        direction[c] = static_cast<float>(endpoint1[c] - endpoint0[c]);
+    }
+    const auto length_squared = dot(direction, direction, 4);
+    const auto scale = length_squared > 0 ? 15.0f / length_squared : 0.0f;
+
+    bc7_block block{{endpoint0, endpoint1}, {}, {}, 0};
+    for (size_t i = 0; i < texels.size(); ++i) {
+        color offset;
+        for (int c = 0; c < 4; ++c) {
+            offset[c] = texels[i][c] - endpoint0[c];
+        }
+        const auto guess = std::clamp(
+            static_cast<int>(std::lround(dot(offset, direction, 4) * scale)),
+            0,
+            15);
+        auto best = std::numeric_limits<float>::max();
+        const auto last = std::min(guess + 1, 15);
+        for (int p = std::max(guess - 1, 0); p <= last; ++p) {
+            float error = 0;
+            for (int c = 0; c < 4; ++c) {
+                const auto d = texels[i][c] - palette[p][c];
+                error += d * d;
+            }
+            if (error < best) {
+                best = error;
+                block.indices[i] = static_cast<uint8_t>(p);
+            }
+        }
+        block.decoded[i] = palette[block.indices[i]];
+        block.error += best;
+    }
+    return block;
+}
+
+// Tries every pair of p bits for the endpoints and keeps the closest block.
+bc7_block quantize_bc7_block(const texel_block& texels,
+                             const color& first,
+                             const color& last) {
+    bc7_block best{};
+    best.error = std::numeric_limits<float>::max();
+    for (uint32_t p0 = 0; p0 < 2; ++p0) {
+        for (uint32_t p1 = 0; p1 < 2; ++p1) {
+            auto block =
+                choose_bc7_indices(texels,
+                                   quantize_mode6_endpoint(first, p0),
+                                   quantize_mode6_endpoint(last, p1));
+            if (block.error < best.error) {
+                best = block;
+            }
+        }
+    }
+    return best;
+}
+
+void encode_bc7_block(const texel_block& texels,
+                      std::byte* out,
+                      decoded_block& decoded) {
+    auto [first, last] = fit_endpoints(texels, 4);
+    auto best = quantize_bc7_block(texels, first, last);
+    for (int iteration = 0; iteration < 2; ++iteration) {
+        std::array<float, 16> weights;
+        for (size_t i = 0; i < weights.size(); ++i) {
+            weights[i] = bc7_weights[best.indices[i]] / 64.0f;
+        }
+        if (!refine_endpoints(texels, weights, 4, first, last)) {
+            break;
+        }
+        auto block = quantize_bc7_block(texels, first, last);
+        if (block.error >= best.error) {
+            break;
+        }
+        best = block;
+    }
+
+    // The first texel's index is stored without its top bit, so it has to
+    // be below 8. The weights are symmetric, so swapping the endpoints and
+    // mirroring the indices decodes to the same values.
+    if (best.indices[0] >= 8) {
+        std::swap(best.endpoints[0], best.endpoints[1]);
+        for (auto& index : best.indices) {
+            index = static_cast<uint8_t>(15 - index);
+        }
+    }
+
+    std::memset(out, 0, bc7_block_size);
+    bit_writer bits{reinterpret_cast<uint8_t*>(out)};
+    bits.write(1 << 6, 7);
+    for (int c = 0; c < 4; ++c) {
+        bits.write(best.endpoints[0][c] >> 1, 7);
+        bits.write(best.endpoints[1][c] >> 1, 7);
+    }
+    bits.write(best.endpoints[0][0] & 1, 1);
+    bits.write(best.endpoints[1][0] & 1, 1);
+    bits.write(best.indices[0], 3);
+    for (size_t i = 1; i < best.indices.size(); ++i) {
+        bits.write(best.indices[i], 4);
+    }
+    decoded = best.decoded;
+}
+
+template <typename F>
+uint64_t encode_blocks(std::span<const std::byte> rgba,
+                       uint32_t width,
+                       uint32_t height,
+                       std::span<std::byte> blocks,
+                       size_t block_size,
+                       const F& encode_block) {
+    const auto* texels = reinterpret_cast<const uint8_t*>(rgba.data());
+    const auto blocks_x = (width + 3) / 4;
+    const auto blocks_y = (height + 3) / 4;
+    // A few rows of blocks per job, so threads that finish early can steal
+    // the remaining ones.
+    const auto job_count = std::min<size_t>(
+        blocks_y,
+        4 * (size_t{jobs::pool().thread_count()} + 1));
+    std::vector<uint64_t> errors(job_count);
+    jobs::parallel_for(job_count, [&](size_t job) {
+        const auto first_row = blocks_y * job / job_count;
+        const auto last_row = blocks_y * (job + 1) / job_count;
+        uint64_t error = 0;
+        for (auto block_y = static_cast<uint32_t>(first_row);
+             block_y < last_row;
+             ++block_y) {
+            for (uint32_t block_x = 0; block_x < blocks_x; ++block_x) {
+                const auto block =
+                    load_block(texels, width, height, block_x, block_y);
+                decoded_block decoded;
+                encode_block(block,
+                             blocks.data() +
+                                 (size_t{block_y} * blocks_x + block_x) *
+                                     block_size,
+                             decoded);
+                // Only the texels inside the image count.
+                for (uint32_t y = 0; y < 4 && 4 * block_y + y < height; ++y) {
+                    for (uint32_t x = 0; x < 4 && 4 * block_x + x < width;
+                         ++x) {
+                        for (int c = 0; c < 3; ++c) {
+                            const auto d =
+                                static_cast<int>(block[4 * y + x][c]) -
+                                decoded[4 * y + x][c];
+                            error += static_cast<uint64_t>(d * d);
+                        }
+                    }
+                }
+            }
+        }
+        errors[job] = error;
+    });
+    return std::accumulate(errors.begin(), errors.end(), uint64_t{0});
+}
+
+} // namespace
+
+uint64_t encode_bc1(std::span<const std::byte> rgba,
+                    uint32_t width,
+                    uint32_t height,
+                    std::span<std::byte> blocks) {
+    return encode_blocks(rgba,
+                         width,
+                         height,
+                         blocks,
+                         bc1_block_size,
+                         encode_bc1_block);
+}
+
+uint64_t encode_bc7(std::span<const std::byte> rgba,
+                    uint32_t width,
+                    uint32_t height,
+                    std::span<std::byte> blocks) {
+    return encode_blocks(rgba,
+                         width,
+                         height,
+                         blocks,
+                         bc7_block_size,
+                         encode_bc7_block);
+}
@@ -0,0 +1,39 @@
+#ifndef TEXTURE_COMPRESS_HPP
+#define TEXTURE_COMPRESS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Block compression of sRGB encoded RGBA8 images, one 4x4 texel block at a
+// time, the blocks of an image spread over the shared thread pool. Colors
+// are fitted to the sRGB encoded values, which is the space the hardware
+// interpolates BC*_SRGB endpoints in.
+
+constexpr size_t bc1_block_size = 8;
+constexpr size_t bc7_block_size = 16;
+
+// Bytes of the blocks covering a `width` x `height` image.
+constexpr size_t block_compressed_size(uint32_t width,
+                                       uint32_t height,
+                                       size_t block_size) {
+    return size_t{(width + 3) / 4} * ((height + 3) / 4) * block_size;
+}
+
+// Encodes `rgba` into BC1 blocks in `blocks`, four colors per block and no
+// alpha. Returns the squared error of the decoded colors, summed over the
+// red, green and blue values of every texel.
+uint64_t encode_bc1(std::span<const std::byte> rgba,
+                    uint32_t width,
+                    uint32_t height,
+                    std::span<std::byte> blocks);
+
+// Encodes `rgba` into BC7 blocks in `blocks`, all in mode 6: one pair of
+// RGBA endpoints and 16 interpolated values per block, which suits smooth
+// and photographic textures. Returns the squared error like encode_bc1.
+uint64_t encode_bc7(std::span<const std::byte> rgba,
+                    uint32_t width,
+                    uint32_t height,
+                    std::span<std::byte> blocks);
+
+#endif
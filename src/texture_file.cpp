@@ -0,0 +1,246 @@
+#include "texture_file.hpp"
+
+#include "asset_package.hpp"
+#include "texture_compress.hpp"
+#include "texture_mips.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+namespace {
+
+constexpr uint8_t ktx2_identifier[12] =
+    {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+constexpr uint64_t level_alignment = 16;
+
+struct ktx2_header {
+    uint8_t identifier[12];
+    uint32_t vk_format;
+    uint32_t type_size;
+    uint32_t pixel_width;
+    uint32_t pixel_height;
+    uint32_t pixel_depth;
+    uint32_t layer_count;
+    uint32_t face_count;
+    uint32_t level_count;
+    uint32_t supercompression_scheme;
+    uint32_t dfd_byte_offset;
+    uint32_t dfd_byte_length;
+    uint32_t kvd_byte_offset;
+    uint32_t kvd_byte_length;
+    uint64_t sgd_byte_offset;
+    uint64_t sgd_byte_length;
+};
+static_assert(sizeof(ktx2_header) == 80);
+
+// Follows the header, one per level, largest first.
+struct ktx2_level {
+    uint64_t byte_offset;
+    uint64_t byte_length;
+    uint64_t uncompressed_byte_length;
+};
+
+constexpr uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool is_known_format(uint32_t format) {
+    switch (static_cast<texture_format>(format)) {
+    case texture_format::r8g8b8a8_srgb:
+    case texture_format::bc1_rgb_srgb_block:
+    case texture_format::bc7_srgb_block:
+        return true;
+    }
+    return false;
+}
+
+uint64_t level_size(texture_format format, uint32_t width, uint32_t height) {
+    switch (format) {
+    case texture_format::bc1_rgb_srgb_block:
+        return block_compressed_size(width, height, bc1_block_size);
+    case texture_format::bc7_srgb_block:
+        return block_compressed_size(width, height, bc7_block_size);
+    default:
+        return uint64_t{width} * height * 4;
+    }
+}
+
+// Offsets of the levels in the data, smallest first as KTX2 stores them, so
+// a partial read still finds the levels drawn from afar.
+void lay_out_levels(std::vector<texture_level>& levels) {
+    uint64_t offset = 0;
+    for (auto level = levels.rbegin(); level != levels.rend(); ++level) {
+        level->offset = offset;
+        offset = align_up(offset + level->size, level_alignment);
+    }
+}
+
+} // namespace
+
+cooked_texture allocate_texture(uint32_t width, uint32_t height) {
+    cooked_texture texture;
+    texture.format = texture_format::r8g8b8a8_srgb;
+    const auto level_count = mip_level_count(width, height);
+    for (uint32_t i = 0; i < level_count; ++i) {
+        const auto level_width = std::max(width >> i, 1u);
+        const auto level_height = std::max(height >> i, 1u);
+        texture.levels.push_back(
+            {0,
+             level_size(texture.format, level_width, level_height),
+             level_width,
+             level_height});
+    }
+    lay_out_levels(texture.levels);
+    const auto& largest = texture.levels.front();
+    texture.storage.resize(largest.offset + largest.size);
+    texture.data = texture.storage;
+    return texture;
+}
+
+void generate_mip_levels(cooked_texture& texture) {
+    for (size_t i = 1; i < texture.levels.size(); ++i) {
+        const auto& src = texture.levels[i - 1];
+        const auto& dst = texture.levels[i];
+        downsample_srgb_rgba8(
+            {texture.storage.data() + src.offset, src.size},
+            src.width,
+            src.height,
+            {texture.storage.data() + dst.offset, dst.size});
+    }
+}
+
+cooked_texture cook_texture(std::span<const std::byte> pixels,
+                            uint32_t width,
+                            uint32_t height) {
+    auto texture = allocate_texture(width, height);
+    const auto& largest = texture.levels.front();
+    std::memcpy(texture.storage.data() + largest.offset,
+                pixels.data(),
+                largest.size);
+    generate_mip_levels(texture);
+    return texture;
+}
+
+cooked_texture compress_texture(const cooked_texture& texture,
+                                texture_format format,
+                                double* psnr) {
+    cooked_texture compressed;
+    compressed.format = format;
+    compressed.levels = texture.levels;
+    for (auto& level : compressed.levels) {
+        level.size = level_size(format, level.width, level.height);
+    }
+    lay_out_levels(compressed.levels);
+    const auto& largest = compressed.levels.front();
+    compressed.storage.resize(largest.offset + largest.size);
+
+    uint64_t error = 0;
+    uint64_t texel_count = 0;
+    for (size_t i = 0; i < texture.levels.size(); ++i) {
+        const auto& src = texture.levels[i];
+        const auto& dst = compressed.levels[i];
+        const auto pixels = texture.data.subspan(src.offset, src.size);
+        const auto blocks = std::span(compressed.storage).subspan(dst.offset,
+                                                                  dst.size);
+        error += format == texture_format::bc1_rgb_srgb_block
+                     ? encode_bc1(pixels, src.width, src.height, blocks)
+                     : encode_bc7(pixels, src.width, src.height, blocks);
+        texel_count += uint64_t{src.width} * src.height;
+    }
+    if (psnr) {
+        const auto mse = static_cast<double>(error) / (3.0 * texel_count);
+        *psnr = mse > 0 ? 10.0 * std::log10(255.0 * 255.0 / mse)
+                        : std::numeric_limits<double>::infinity();
+    }
+    compressed.data = compressed.storage;
+    return compressed;
+}
+
+bool write_texture_file(const std::string& path,
+                        const cooked_texture& texture) {
+    const auto& largest = texture.levels.front();
+    ktx2_header header{};
+    std::memcpy(header.identifier, ktx2_identifier, sizeof(ktx2_identifier));
+    header.vk_format = static_cast<uint32_t>(texture.format);
+    header.type_size = 1;
+    header.pixel_width = largest.width;
+    header.pixel_height = largest.height;
+    header.face_count = 1;
+    header.level_count = static_cast<uint32_t>(texture.levels.size());
+
+    const auto data_offset = align_up(
+        sizeof(header) + texture.levels.size() * sizeof(ktx2_level),
+        level_alignment);
+    std::vector<ktx2_level> index;
+    for (const auto& level : texture.levels) {
+        index.push_back({data_offset + level.offset, level.size, level.size});
+    }
+
+    return write_file_atomically(path, [&](std::ostream& file) {
+        const char padding[level_alignment]{};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(index.data()),
+                   index.size() * sizeof(ktx2_level));
+        file.write(padding,
+                   data_offset - sizeof(header) -
+                       index.size() * sizeof(ktx2_level));
+        file.write(reinterpret_cast<const char*>(texture.data.data()),
+                   texture.data.size());
+    });
+}
+
+cooked_texture load_texture_file(const std::string& path) {
+    cooked_texture texture;
+    auto file = open_asset(path, file_access::sequential);
+    if (file.size() < sizeof(ktx2_header)) {
+        return texture;
+    }
+    ktx2_header header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.identifier,
+                    ktx2_identifier,
+                    sizeof(ktx2_identifier)) != 0 ||
+        !is_known_format(header.vk_format) ||
+        header.pixel_depth != 0 || header.layer_count != 0 ||
+        header.face_count != 1 || header.supercompression_scheme != 0 ||
+        header.level_count == 0 ||
+        header.level_count >
+            mip_level_count(header.pixel_width, header.pixel_height) ||
+        sizeof(header) + uint64_t{header.level_count} * sizeof(ktx2_level) >
+            file.size()) {
+        return texture;
+    }
+    texture.format = static_cast<texture_format>(header.vk_format);
+
+    // The levels run from the smallest level's offset to the file's end.
+    uint64_t data_offset = file.size();
+    uint64_t data_end = 0;
+    std::vector<ktx2_level> index(header.level_count);
+    std::memcpy(index.data(),
+                file.data() + sizeof(header),
+                index.size() * sizeof(ktx2_level));
+    for (uint32_t i = 0; i < header.level_count; ++i) {
+        const auto width = std::max(header.pixel_width >> i, 1u);
+        const auto height = std::max(header.pixel_height >> i, 1u);
+        const auto& level = index[i];
+        if (level.byte_length != level_size(texture.format, width, height) ||
+            level.byte_offset % level_alignment != 0 ||
+            level.byte_offset + level.byte_length > file.size()) {
+            return {};
+        }
+        data_offset = std::min(data_offset, level.byte_offset);
+        data_end = std::max(data_end, level.byte_offset + level.byte_length);
+        texture.levels.push_back(
+            {level.byte_offset, level.byte_length, width, height});
+    }
+    for (auto& level : texture.levels) {
+        level.offset -= data_offset;
+    }
+    texture.data = {file.data() + data_offset, data_end - data_offset};
+    texture.file = std::move(file);
+    return texture;
+}
@@ -0,0 +1,70 @@
+#ifndef TEXTURE_FILE_HPP
+#define TEXTURE_FILE_HPP
+
+#include "mapped_file.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+// Textures cooked offline with every mip level, stored in the KTX2 layout:
+// identifier, header, level index, then the levels from the smallest up.
+// The data format descriptor and key/value data are left out, as the format
+// number says everything the renderer needs, so other KTX2 tools may refuse
+// the files.
+
+// Pixel formats, numbered as the VkFormat of the same name.
+enum class texture_format : uint32_t {
+    r8g8b8a8_srgb = 43,
+    bc1_rgb_srgb_block = 132,
+    bc7_srgb_block = 146,
+};
+
+struct texture_level {
+    // Offset of the level in `cooked_texture::data`, a multiple of 16 so it
+    // can be used as the copy's buffer offset for any format.
+    uint64_t offset;
+    uint64_t size;
+    uint32_t width;
+    uint32_t height;
+};
+
+struct cooked_texture {
+    texture_format format = texture_format::r8g8b8a8_srgb;
+    // Largest first.
+    std::vector<texture_level> levels;
+    // Every level, laid out to be copied to a staging buffer as is. Points
+    // into the mapped file, or into `storage` for a texture just cooked.
+    std::span<const std::byte> data;
+
+    mapped_file file;
+    std::vector<std::byte> storage;
+};
+
+// Builds the full mip chain of a `width` x `height` sRGB RGBA8 image.
+cooked_texture cook_texture(std::span<const std::byte> pixels,
+                            uint32_t width,
+                            uint32_t height);
+
+// Lays out every level of a `width` x `height` sRGB RGBA8 texture in its
+// storage, for the caller to decode the first level into before calling
+// generate_mip_levels.
+cooked_texture allocate_texture(uint32_t width, uint32_t height);
+void generate_mip_levels(cooked_texture& texture);
+
+// Block compresses every level of the RGBA8 `texture` into `format`, on the
+// shared thread pool. `psnr` receives the peak signal to noise ratio of the
+// decoded colors over all levels, in dB.
+cooked_texture compress_texture(const cooked_texture& texture,
+                                texture_format format,
+                                double* psnr = nullptr);
+
+bool write_texture_file(const std::string& path, const cooked_texture& texture);
+
+// Maps a file written by write_texture_file. Returns a texture without levels
+// when the file is missing or not valid.
+cooked_texture load_texture_file(const std::string& path);
+
+#endif
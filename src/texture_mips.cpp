@@ -0,0 +1,166 @@
+#include "texture_mips.hpp"
+
+#include "job_system.hpp"
+#include "mathlib_wide.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+using math::detail::scalar_ops;
+using math::detail::wide_ops;
+
+double srgb_to_linear(double c) {
+    return c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+}
+
+// Converts between sRGB encoded bytes and linear floats with tables instead
+// of pow, which dominated the cost of a mip chain.
+struct srgb_tables {
+    // Powers of two below 1 that `encode_start` covers, and the buckets per
+    // power of two. With 128 buckets no bucket spans more than two codes,
+    // and linear values below 2^-16 all encode to 0.
+    static constexpr int exponent_count = 16;
+    static constexpr int mantissa_bits = 7;
+
+    std::array<float, 256> decode;
+    // The linear values halfway between consecutive codes, and one past
+    // the last code that no value reaches.
+    std::array<float, 256> encode_threshold;
+    // The code of the smallest value in each bucket of floats.
+    std::array<uint8_t, (exponent_count << mantissa_bits)> encode_start;
+
+    srgb_tables() {
+        for (int i = 0; i < 256; ++i) {
+            decode[i] = static_cast<float>(srgb_to_linear(i / 255.0));
+        }
+        for (int i = 0; i < 255; ++i) {
+            encode_threshold[i] =
+                static_cast<float>(srgb_to_linear((i + 0.5) / 255.0));
+        }
+        encode_threshold[255] = 2.0f;
+        for (size_t i = 0; i < encode_start.size(); ++i) {
+            const auto bits = static_cast<uint32_t>(
+                (i + ((127 - exponent_count) << mantissa_bits))
+                << (23 - mantissa_bits));
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            encode_start[i] = static_cast<uint8_t>(
+                std::upper_bound(encode_threshold.begin(),
+                                 encode_threshold.end() - 1,
+                                 value) -
+                encode_threshold.begin());
+        }
+    }
+
+    // Same as rounding the sRGB encoding of `value` to 8 bits.
+    uint8_t encode(float value) const {
+        if (!(value >= 1.0f / (1 << exponent_count))) {
+            return 0;
+        }
+        if (value >= 1.0f) {
+            return 255;
+        }
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        const auto bucket = (bits >> (23 - mantissa_bits)) -
+                            ((127 - exponent_count) << mantissa_bits);
+        const auto code = encode_start[bucket];
+        return static_cast<uint8_t>(code + (value >= encode_threshold[code]));
+    }
+};
+
+const srgb_tables& tables() {
+    static const srgb_tables instance;
+    return instance;
+}
+
+uint8_t to_unorm8(float c) {
+    return static_cast<uint8_t>(std::clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+// Decodes a row of texels to linear RGB, with alpha scaled to [0, 1].
+void decode_row(const uint8_t* in, size_t texel_count, float* out) {
+    const auto& decode = tables().decode;
+    for (size_t i = 0; i < 4 * texel_count; i += 4) {
+        out[i] = decode[in[i]];
+        out[i + 1] = decode[in[i + 1]];
+        out[i + 2] = decode[in[i + 2]];
+        out[i + 3] = in[i + 3] * (1.0f / 255.0f);
+    }
+}
+
+template <typename ops>
+size_t add_rows(const float* a,
+                const float* b,
+                float* sum,
+                size_t count,
+                size_t i) {
+    for (; i + ops::width <= count; i += ops::width) {
+        ops::store(sum + i, ops::add(ops::load(a + i), ops::load(b + i)));
+    }
+    return i;
+}
+
+} // namespace
+
+uint32_t mip_level_count(uint32_t width, uint32_t height) {
+    uint32_t count = 1;
+    for (auto size = std::max(width, height); size > 1; size /= 2) {
+        ++count;
+    }
+    return count;
+}
+
+void downsample_srgb_rgba8(std::span<const std::byte> src,
+                           uint32_t width,
+                           uint32_t height,
+                           std::span<std::byte> dst) {
+    const auto& srgb = tables();
+    const auto dst_width = std::max(width / 2, 1u);
+    const auto dst_height = std::max(height / 2, 1u);
+    const auto* in = reinterpret_cast<const uint8_t*>(src.data());
+    auto* out = reinterpret_cast<uint8_t*>(dst.data());
+    const size_t row_floats = 4 * size_t{width};
+
+    // Bands of rows, a few per thread so the ones finishing early can
+    // steal the rest. Small levels are not worth splitting.
+    const auto band_count = std::clamp<size_t>(
+        size_t{dst_width} * dst_height / 16384,
+        1,
+        std::min<size_t>(dst_height,
+                         4 * (size_t{jobs::pool().thread_count()} + 1)));
+    jobs::parallel_for(band_count, [&](size_t band) {
+        const auto first_row = dst_height * band / band_count;
+        const auto last_row = dst_height * (band + 1) / band_count;
+        std::vector<float> rows(3 * row_floats);
+        auto* top = rows.data();
+        auto* bottom = top + row_floats;
+        auto* sum = bottom + row_floats;
+        for (auto y = static_cast<uint32_t>(first_row); y < last_row; ++y) {
+            const auto top_row = std::min(2 * y, height - 1);
+            const auto bottom_row = std::min(2 * y + 1, height - 1);
+            decode_row(in + 4 * size_t{top_row} * width, width, top);
+            decode_row(in + 4 * size_t{bottom_row} * width, width, bottom);
+            const auto i =
+                add_rows<wide_ops>(top, bottom, sum, row_floats, 0);
+            add_rows<scalar_ops>(top, bottom, sum, row_floats, i);
+
+            auto* texel = out + 4 * size_t{y} * dst_width;
+            for (uint32_t x = 0; x < dst_width; ++x, texel += 4) {
+                const auto* left =
+                    sum + 4 * size_t{std::min(2 * x, width - 1)};
+                const auto* right =
+                    sum + 4 * size_t{std::min(2 * x + 1, width - 1)};
+                for (int c = 0; c < 3; ++c) {
+                    texel[c] = srgb.encode((left[c] + right[c]) * 0.25f);
+                }
+                texel[3] = to_unorm8((left[3] + right[3]) * 0.25f);
+            }
+        }
+    });
+}
@@ -0,0 +1,22 @@
+#ifndef TEXTURE_MIPS_HPP
+#define TEXTURE_MIPS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Number of levels in a full mip chain down to 1x1, each level half the size
+// of the one before, rounded down.
+uint32_t mip_level_count(uint32_t width, uint32_t height);
+
+// Writes the level after the `width` x `height` sRGB encoded RGBA8 image
+// `src` into `dst`, max(width / 2, 1) x max(height / 2, 1) texels. Every
+// texel averages a 2x2 box of the source, clamped at its edges. Colors are
+// averaged in linear space so the mips do not darken, alpha as stored. Large
+// levels are split into bands of rows run on the shared thread pool.
+void downsample_srgb_rgba8(std::span<const std::byte> src,
+                           uint32_t width,
+                           uint32_t height,
+                           std::span<std::byte> dst);
+
+#endif
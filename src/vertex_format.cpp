@@ -0,0 +1,145 @@
+#include "vertex_format.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace {
+
+int16_t to_snorm16(float value) {
+    return static_cast<int16_t>(
+        std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+uint16_t to_unorm16(float value) {
+    return static_cast<uint16_t>(
+        std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+// Zero for empty ranges, so the stored value is 0 and the shader gets the
+// offset back.
+float inverse_or_zero(float range) { return range > 0 ? 1 / range : 0; }
+
+} // namespace
+
+quantized_vertices quantize_vertices(std::span<const Vertex> vertices,
+                                     const math::aabb& bounds,
+                                     tex_coord_encoding encoding) {
+    quantized_vertices result{};
+    auto& dequantization = result.dequantization;
+
+    const auto center = (bounds.min + bounds.max) * 0.5f;
+    const auto extent = (bounds.max - bounds.min) * 0.5f;
+    dequantization.position_scale = {extent.x, extent.y, extent.z, 0.0f};
+    dequantization.position_offset = {center.x, center.y, center.z, 0.0f};
+    const math::vec3 position_factor{inverse_or_zero(extent.x),
+                                     inverse_or_zero(extent.y),
+                                     inverse_or_zero(extent.z)};
+
+    math::vec2 tex_coord_min{0.0f, 0.0f};
+    math::vec2 tex_coord_factor{1.0f, 1.0f};
+    dequantization.tex_coord_transform = {1.0f, 1.0f, 0.0f, 0.0f};
+    if (encoding == tex_coord_encoding::unorm16 && !vertices.empty()) {
+        tex_coord_min = vertices[0].tex_coord;
+        auto tex_coord_max = tex_coord_min;
+        for (const auto& vertex : vertices) {
+            tex_coord_min.x = std::min(tex_coord_min.x, vertex.tex_coord.x);
+            tex_coord_min.y = std::min(tex_coord_min.y, vertex.tex_coord.y);
+            tex_coord_max.x = std::max(tex_coord_max.x, vertex.tex_coord.x);
+            tex_coord_max.y = std::max(tex_coord_max.y, vertex.tex_coord.y);
+        }
+        const math::vec2 range{tex_coord_max.x - tex_coord_min.x,
+                               tex_coord_max.y - tex_coord_min.y};
+        tex_coord_factor = {inverse_or_zero(range.x),
+                            inverse_or_zero(range.y)};
+        dequantization.tex_coord_transform = {range.x,
+                                              range.y,
+                                              tex_coord_min.x,
+                                              tex_coord_min.y};
+    }
+
+    result.vertices.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        const auto& vertex = vertices[i];
+        auto& packed = result.vertices[i];
+        const auto position = (vertex.pos - center) * position_factor;
+        packed.pos[0] = to_snorm16(position.x);
+        packed.pos[1] = to_snorm16(position.y);
+        packed.pos[2] = to_snorm16(position.z);
+        packed.pos[3] = 0;
+        if (encoding == tex_coord_encoding::unorm16) {
+            packed.tex_coord[0] = to_unorm16(
+                (vertex.tex_coord.x - tex_coord_min.x) * tex_coord_factor.x);
+            packed.tex_coord[1] = to_unorm16(
+                (vertex.tex_coord.y - tex_coord_min.y) * tex_coord_factor.y);
+        } else {
+            packed.tex_coord[0] = float_to_half(vertex.tex_coord.x);
+            packed.tex_coord[1] = float_to_half(vertex.tex_coord.y);
+        }
+    }
+    return result;
+}
+
+Vertex dequantize_vertex(const packed_vertex& vertex,
+                         const vertex_dequantization& dequantization,
+                         tex_coord_encoding encoding) {
+    // Vulkan's snorm conversion, -32768 maps to -1 as well.
+    auto snorm = [](int16_t value) {
+        return std::max(value / 32767.0f, -1.0f);
+    };
+    const auto& scale = dequantization.position_scale;
+    const auto& offset = dequantization.position_offset;
+    const auto& tex_coord = dequantization.tex_coord_transform;
+
+    Vertex result{};
+    result.pos = {offset.x + snorm(vertex.pos[0]) * scale.x,
+                  offset.y + snorm(vertex.pos[1]) * scale.y,
+                  offset.z + snorm(vertex.pos[2]) * scale.z};
+    result.color = {1.0f, 1.0f, 1.0f};
+    if (encoding == tex_coord_encoding::unorm16) {
+        result.tex_coord = {
+            tex_coord.z + vertex.tex_coord[0] / 65535.0f * tex_coord.x,
+            tex_coord.w + vertex.tex_coord[1] / 65535.0f * tex_coord.y};
+    } else {
+        result.tex_coord = {half_to_float(vertex.tex_coord[0]),
+                            half_to_float(vertex.tex_coord[1])};
+    }
+    return result;
+}
+
+uint16_t float_to_half(float value) {
+    const auto bits = std::bit_cast<uint32_t>(value);
+    const auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    auto magnitude = bits & 0x7fffffff;
+
+    // Infinity, NaN and everything that rounds past the largest half.
+    if (magnitude >= 0x47800000) {
+        return sign | (magnitude > 0x7f800000 ? 0x7e00 : 0x7c00);
+    }
+    // Below the smallest normal half, adding 0.5 lets the FPU round the
+    // mantissa to the 2^-24 steps of a subnormal half.
+    if (magnitude < 0x38800000) {
+        const auto shifted = std::bit_cast<float>(magnitude) + 0.5f;
+        return sign | static_cast<uint16_t>(std::bit_cast<uint32_t>(shifted) -
+                                            0x3f000000);
+    }
+    // Rebias the exponent and round the 13 dropped mantissa bits to even.
+    const auto odd = (magnitude >> 13) & 1;
+    magnitude += 0xc8000fff + odd;
+    return sign | static_cast<uint16_t>(magnitude >> 13);
+}
+
+float half_to_float(uint16_t value) {
+    const uint32_t sign = (value & 0x8000u) << 16;
+    const uint32_t exponent = (value >> 10) & 0x1f;
+    const uint32_t mantissa = value & 0x3ff;
+    if (exponent == 0) {
+        const auto magnitude = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -magnitude : magnitude;
+    }
+    if (exponent == 0x1f) {
+        return std::bit_cast<float>(sign | 0x7f800000 | (mantissa << 13));
+    }
+    return std::bit_cast<float>(sign | ((exponent + 112) << 23) |
+                                (mantissa << 13));
+}
@@ -0,0 +1,53 @@
+#ifndef VERTEX_FORMAT_HPP
+#define VERTEX_FORMAT_HPP
+
+#include "asset_loader.hpp"
+#include "mathlib.hpp"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Compact vertex layout uploaded to the GPU, 12 bytes instead of the 32 of
+// Vertex. Positions are 16 bit snorm relative to the mesh bounds, the fourth
+// component only pads them to a format every device can fetch
+// (R16G16B16A16_SNORM). The constant white color is not stored.
+struct packed_vertex {
+    int16_t pos[4];
+    uint16_t tex_coord[2];
+};
+
+enum class tex_coord_encoding : uint32_t {
+    // R16G16_UNORM relative to the texture coordinate bounds.
+    unorm16,
+    // R16G16_SFLOAT, for coordinates that tile far outside [0, 1].
+    half,
+};
+
+// What shader.vert needs to undo the quantization, value = offset + stored *
+// scale. Laid out as three std140 vec4s.
+struct vertex_dequantization {
+    math::vec4 position_scale;      // w unused
+    math::vec4 position_offset;     // w unused
+    math::vec4 tex_coord_transform; // xy scale, zw offset
+};
+
+struct quantized_vertices {
+    std::vector<packed_vertex> vertices;
+    vertex_dequantization dequantization;
+};
+
+// `bounds` must contain every position.
+quantized_vertices quantize_vertices(std::span<const Vertex> vertices,
+                                     const math::aabb& bounds,
+                                     tex_coord_encoding encoding);
+// The inverse, as the vertex shader computes it. Color is white.
+Vertex dequantize_vertex(const packed_vertex& vertex,
+                         const vertex_dequantization& dequantization,
+                         tex_coord_encoding encoding);
+
+// IEEE half precision, rounding to nearest even.
+uint16_t float_to_half(float value);
+float half_to_float(uint16_t value);
+
+#endif
@@ -0,0 +1,62 @@
+// Packs asset directories into one package, for the renderer to map once
+// instead of opening every file by path. Files are named by their path
+// relative to <root>, such as models/viking_room.obj.
+//
+// Usage: asset_packer [--compress] <output.pak> <root> <directory>...
+
+#include "asset_package.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv) {
+    bool compress = false;
+    int arg = 1;
+    if (argc > 1 && std::string(argv[1]) == "--compress") {
+        compress = true;
+        arg = 2;
+    }
+    if (argc - arg < 3) {
+        std::cerr << "usage: asset_packer [--compress] <output.pak> <root> "
+                     "<directory>..."
+                  << std::endl;
+        return 1;
+    }
+    const std::string output = argv[arg];
+    const std::filesystem::path root = argv[arg + 1];
+
+    std::vector<package_input> inputs;
+    for (int i = arg + 2; i < argc; ++i) {
+        std::error_code error;
+        std::filesystem::recursive_directory_iterator it(root / argv[i], error);
+        if (error) {
+            std::cerr << "failed to open directory! "
+                      << (root / argv[i]).string() << std::endl;
+            return 1;
+        }
+        for (const auto& entry : it) {
+            // Leftovers of interrupted cache writes are not assets.
+            if (!entry.is_regular_file() ||
+                entry.path().extension() == ".tmp") {
+                continue;
+            }
+            inputs.push_back(
+                {entry.path().lexically_relative(root).generic_string(),
+                 entry.path().string()});
+        }
+    }
+    // Directory order differs between file systems, the package should not.
+    std::sort(inputs.begin(), inputs.end(), [](const auto& a, const auto& b) {
+        return a.name < b.name;
+    });
+
+    if (!write_asset_package(output, inputs, compress)) {
+        std::cerr << "failed to write asset package! " << output << std::endl;
+        return 1;
+    }
+    std::cout << output << ": " << inputs.size() << " files" << std::endl;
+    return 0;
+}
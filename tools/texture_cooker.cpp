@@ -0,0 +1,87 @@
+// Decodes an image and writes it with its full mip chain, for the renderer
+// to upload without decoding or generating mips at startup. Block compressed
+// formats report their size and quality against the uncompressed levels.
+//
+// Usage: texture_cooker [--format rgba8|bc1|bc7] <input.png|jpg> <output.ktx2>
+
+#include "asset_loader.hpp"
+#include "texture_file.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace {
+
+bool is_opaque(const img_data& image) {
+    const auto texel_count = size_t(image.width) * image.height;
+    for (size_t i = 0; i < texel_count; ++i) {
+        if (image.pixels[4 * i + 3] != std::byte{255}) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string format_name = "rgba8";
+    int arg = 1;
+    if (argc == 5 && std::string(argv[1]) == "--format") {
+        format_name = argv[2];
+        arg = 3;
+    }
+    if (argc - arg != 2 ||
+        (format_name != "rgba8" && format_name != "bc1" &&
+         format_name != "bc7")) {
+        std::cerr << "usage: texture_cooker [--format rgba8|bc1|bc7] <input> "
+                     "<output.ktx2>"
+                  << std::endl;
+        return 1;
+    }
+    const char* input = argv[arg];
+    const char* output = argv[arg + 1];
+
+    const auto image = load_image(input);
+    if (!image.pixels) {
+        std::cerr << "failed to load texture image! " << input << std::endl;
+        return 1;
+    }
+    // BC1 as used here stores no alpha, so it is only for opaque textures.
+    if (format_name == "bc1" && !is_opaque(image)) {
+        std::cerr << "texture has alpha, using bc7! " << input << std::endl;
+        format_name = "bc7";
+    }
+
+    const auto width = static_cast<uint32_t>(image.width);
+    const auto height = static_cast<uint32_t>(image.height);
+    auto texture =
+        cook_texture({image.pixels, size_t{width} * height * 4}, width, height);
+    const auto uncompressed_size = texture.data.size();
+    const auto lossy = format_name != "rgba8";
+    double psnr = 0;
+    if (lossy) {
+        texture = compress_texture(texture,
+                                   format_name == "bc1"
+                                       ? texture_format::bc1_rgb_srgb_block
+                                       : texture_format::bc7_srgb_block,
+                                   &psnr);
+    }
+    std::cout << input << ": " << format_name << ", " << width << "x"
+              << height << ", " << texture.levels.size() << " levels, ";
+    if (lossy) {
+        std::cout << uncompressed_size << " -> " << texture.data.size()
+                  << " bytes, PSNR " << std::fixed << std::setprecision(2)
+                  << psnr << " dB" << std::endl;
+    } else {
+        std::cout << texture.data.size() << " bytes" << std::endl;
+    }
+    if (!write_texture_file(output, texture)) {
+        std::cerr << "failed to write texture file! " << output << std::endl;
+        return 1;
+    }
+    return 0;
+}